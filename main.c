@@ -25,5 +25,35 @@ int main()
     RUN_TEST(test_backup_read_complex_struct);
     RUN_TEST(test_bit_flip_register);
     RUN_TEST(test_bit_flip_read_uint32);
+    RUN_TEST(test_delete_attribute);
+    RUN_TEST(test_compact_memory);
+    RUN_TEST(test_resize_attribute);
+    RUN_TEST(test_space_stats);
+    RUN_TEST(test_no_space);
+    RUN_TEST(test_ab_table_switch);
+    RUN_TEST(test_ab_magic_in_value);
+    RUN_TEST(test_schema_typed_access);
+    RUN_TEST(test_fast_format_defaults);
+    RUN_TEST(test_ctx_instances);
+    RUN_TEST(test_crc_single_bit_correction);
+    RUN_TEST(test_patch_attribute);
+    RUN_TEST(test_integrity_modes);
+    RUN_TEST(test_durability_levels);
+    RUN_TEST(test_crc8_table_check);
+    RUN_TEST(test_attribute_history);
+    RUN_TEST(test_reserved_ring);
+    RUN_TEST(test_sealed_values);
+    RUN_TEST(test_workload_trace);
+    RUN_TEST(test_generational_compaction);
+    RUN_TEST(test_group_placement);
+    RUN_TEST(test_stack_high_water);
+    RUN_TEST(test_change_subscription);
+    RUN_TEST(test_delta_chain);
+#if defined(MEM_HAVE_MMAP)
+    RUN_TEST(test_mmap_dirty_pages);
+#endif
+#if defined(MEM_HAVE_URING)
+    RUN_TEST(test_uring_backend);
+#endif
     return UNITY_END();
 }
@@ -15,10 +15,34 @@
 
 #include <stdio.h>
 #include <string.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__linux__)
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 
 #include "memory.h"
 #include "nvm.h"
 
+/// Writes a file to the media: data and size, skipping other metadata
+#if defined(_WIN32)
+#define MEM_FILE_SYNC(f)    _commit(_fileno(f))
+#elif defined(__APPLE__)
+#define MEM_FILE_SYNC(f)    fsync(fileno(f))
+#else
+#define MEM_FILE_SYNC(f)    fdatasync(fileno(f))
+#endif
+
 
 /**********************************
  * Exported module variables
@@ -31,7 +55,9 @@
  * Local module variables
  **********************************
 */
-FILE *pMemory; ///< The file modeling the Flash/EEPROM
+/// The memory used by @ref memRead, @ref memWrite and the like
+static const nvm_mem_t memDefault = { .pOps = &memFileOps, \
+                                      .path = MEM_DEFAULT_PATH };
 
 /**********************************
  * Exported module variables
@@ -41,51 +67,1141 @@ FILE *pMemory; ///< The file modeling the Flash/EEPROM
 
 
 /**
- * @brief Function to initialize the memory
+ * @brief Function to get the open file of a memory modeled by a file
  *
- * This function initializes the memory, making it ready
- * to be used. This procedure erase all the data on it.
- * Actually, this version creates a new empty file, then fill
- * the allocation table area with 0xFF, meaning the memory
- * holds no data. It also sets the next available address to
- * the beggining of the values area of the memory and sets this area
- * to 0xFF.
+ * The file is opened on the first access and kept open until
+ * @ref memFileClose. It is unbuffered, so the bytes written are handed
+ * to the OS at once and other handles on the same file (as the tests
+ * use) see them, just as when the file was opened on every access.
  *
+ * @param[in,out] pMem The memory
+ * @return The file, NULL if it can't be opened
+ */
+static FILE *memFileOpen (nvm_mem_t *pMem)
+{
+    if (!pMem->pFile)
+    {
+        pMem->pFile = fopen(pMem->path, "rb+");
+        if (pMem->pFile)
+            setvbuf((FILE *)pMem->pFile, NULL, _IONBF, 0);
+    }
+    return (FILE *)pMem->pFile;
+} //memFileOpen (
+
+/**
+ * @brief Function to close a memory modeled by a file
+ *
+ * The file is opened again on the next access.
+ *
+ * @param[in,out] pMem The memory
+ */
+static void memFileClose (nvm_mem_t *pMem)
+{
+    if (pMem->pFile)
+        fclose((FILE *)pMem->pFile);
+    pMem->pFile = NULL;
+} //memFileClose (
+
+/**
+ * @brief Function to fill part of a file with the bytes of a buffer
+ *
+ * The buffer is written over and over, so a whole area is filled with
+ * @ref MEM_CHUNK_LEN bytes of RAM.
+ *
+ * @param[in,out] pMemory The file, written from its current position
+ * @param[in] pBuff The buffer, @ref MEM_CHUNK_LEN bytes
+ * @param[in] length Number of bytes to be written
  * @return Error status: 0 for success, 0xFF for error
  */
-UInt8 memInit (void)
+static UInt8 memFileFill(FILE *pMemory, const UInt8 *pBuff, UInt32 length)
 {
-    alloc_reg_t allFF[MAX_REG_ALLOC];
-    UInt16 valueStartAddress = ALLOC_TABLE_LEN + SIZE_MEM_ADDRESS;
-    UInt8 memValuesFF[MEM_VALUES_LEN];
+    UInt32 chunk;
 
-    pMemory = fopen(".\\mem.bin", "wb"); //Create new, empty file
+    while (length)
+    {
+        chunk = (length > MEM_CHUNK_LEN) ? MEM_CHUNK_LEN : length;
+        if (fwrite(pBuff, 1, chunk, pMemory) != chunk)
+            return 0xFF;
+        length -= chunk;
+    }
+    return 0;
+} //memFileFill (
+
+/**
+ * @brief Function to format a memory modeled by a file
+ *
+ * This function makes the memory ready to be used. The allocation table
+ * is filled up with 0xFF, meaning the memory holds no data, and the next
+ * available address is set to the beggining of the values area.
+ * A full format creates a new empty file and sets the values area to
+ * 0xFF too, erasing all the data on it. Otherwise the values area is left
+ * as it is: nothing there can be reached without a register pointing to
+ * it. If the file doesn't exist yet it's created, and a short file is
+ * extended to the full memory size by writing its last byte.
+ * The file kept open is closed first, since it may be recreated.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] full Non-zero to erase the values area too
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memFileFormat (nvm_mem_t *pMem, UInt8 full)
+{
+    FILE *pMemory; ///< The file modeling the Flash/EEPROM
+    UInt8 allFF[MEM_CHUNK_LEN];
+    UInt16 valueStartAddress = MEM_VALUES_START;
+    UInt8 lastByte = 0xFF;
+    UInt8 ret;
+
+    memFileClose(pMem);
+    if (full)
+    {
+        pMemory = fopen(pMem->path, "wb"); //Create new, empty file
+    }
+    else
+    {
+        pMemory = fopen(pMem->path, "rb+");
+        if (!pMemory)
+            pMemory = fopen(pMem->path, "wb+"); //Create new, empty file
+    }
     if (!pMemory)
       return 0xFF;
 
-    memset((UInt8 *)allFF, 0xFF, sizeof(allFF));
+    memset(allFF, 0xFF, sizeof(allFF));
 
     //Fill up the allocation table with 0xFF
-    fwrite(allFF, 1, sizeof(allFF), pMemory);
+    ret = memFileFill(pMemory, allFF, ALLOC_TABLE_LEN);
 
     //Initialize the next available address.
     fwrite((UInt16 *)&valueStartAddress, 1, sizeof(UInt16), pMemory);
 
-    //Fill up the values area with 0xFF
-    memset((UInt8 *)memValuesFF, 0xFF, sizeof(memValuesFF));
-    fwrite(memValuesFF, 1, sizeof(memValuesFF), pMemory);
+    if (full)
+    {
+        //Fill up the values area with 0xFF
+        ret |= memFileFill(pMemory, allFF, MEM_VALUES_LEN);
+    }
+    else
+    {
+        //Make sure the file models the whole memory
+        fseek(pMemory, 0, SEEK_END);
+        if (ftell(pMemory) < (long)MEM_SIZE)
+        {
+            fseek(pMemory, MEM_SIZE - 1, SEEK_SET);
+            fwrite(&lastByte, 1, 1, pMemory);
+        }
+    }
 
     fclose(pMemory);
 
+    return ret;
+} //memFileFormat (
+
+/**
+ * @brief Function to read bytes from a memory modeled by a file
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for reading
+ * @param[in] length Number of bytes to be read
+ * @param[out] *buffRead Pointer to the buffer that will receive the data
+ * @return Error code: Number of bytes read
+ *                     0xFF for unrecoverable error
+ */
+static UInt8 memFileRead (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                          UInt8 *buffRead)
+{
+    FILE *pMemory = memFileOpen(pMem);
+
+    if (!pMemory || fseek(pMemory, start, SEEK_SET))
+      return 0xFF;
+    return fread(buffRead, 1, length, pMemory);
+} //memFileRead (
+
+/**
+ * @brief Function to write bytes to a memory modeled by a file
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for writing
+ * @param[in] length The length of data to be written
+ * @param[out] *buffWrite Pointer to the buffer containing data to be written
+ * @return Error code: Number of bytes written
+ *                     0xFF for writing error
+ */
+static UInt8 memFileWrite (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                           UInt8 *buffWrite)
+{
+    FILE *pMemory = memFileOpen(pMem);
+
+    if (!pMemory || fseek(pMemory, start, SEEK_SET))
+      return 0xFF;
+    return fwrite(buffWrite, 1, length, pMemory);
+} //memFileWrite (
+
+/**
+ * @brief Function to sync a memory modeled by a file to the media
+ *
+ * Syncs the whole file, so the writes done through other handles (such
+ * as the formatting) are covered too.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memFileSync (nvm_mem_t *pMem)
+{
+    FILE *pMemory = memFileOpen(pMem);
+
+    if (!pMemory || fflush(pMemory) || MEM_FILE_SYNC(pMemory))
+      return 0xFF;
+    return 0;
+} //memFileSync (
+
+/**
+ * @brief Function to prefetch a range of a memory modeled by a file
+ *
+ * The OS is asked to read the range ahead (POSIX only), so the reads
+ * that follow find it on the page cache.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ */
+static void memFilePrefetch (nvm_mem_t *pMem, UInt16 start, UInt16 length)
+{
+#if !defined(_WIN32)
+    FILE *pMemory = memFileOpen(pMem);
+
+    if (pMemory)
+        posix_fadvise(fileno(pMemory), start, length, POSIX_FADV_WILLNEED);
+#else
+    (void)pMem;
+    (void)start;
+    (void)length;
+#endif
+} //memFilePrefetch (
+
+/**
+ * @brief Function to submit the writes to a memory modeled by a file
+ *
+ * The file is unbuffered: every write is with the OS already.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: always 0
+ */
+static UInt8 memFileSubmit (nvm_mem_t *pMem)
+{
+    (void)pMem;
+    return 0;
+} //memFileSubmit (
+
+const nvm_mem_ops_t memFileOps = { memFileRead, memFileWrite, memFileFormat, \
+                                   memFileSync, memFileClose, \
+                                   memFilePrefetch, memFileSubmit };
+
+/**
+ * @brief Function to format a memory modeled by a RAM buffer
+ *
+ * Same as @ref memFileFormat, on the buffer.
+ *
+ * @param[in] pMem The memory
+ * @param[in] full Non-zero to erase the values area too
+ * @return Error status: 0 for success
+ */
+static UInt8 memRamFormat (nvm_mem_t *pMem, UInt8 full)
+{
+    UInt16 valueStartAddress = MEM_VALUES_START;
+
+    memset(pMem->pRam, 0xFF, full ? MEM_SIZE : ALLOC_TABLE_LEN);
+    memcpy(pMem->pRam + NEXT_FREE_ADDR, &valueStartAddress, SIZE_MEM_ADDRESS);
+    return 0;
+} //memRamFormat (
+
+/**
+ * @brief Function to read bytes from a memory modeled by a RAM buffer
+ *
+ * Like the file backend, a reading past the end of the memory is cut.
+ *
+ * @param[in] pMem The memory
+ * @param[in] start The start address for reading
+ * @param[in] length Number of bytes to be read
+ * @param[out] *buffRead Pointer to the buffer that will receive the data
+ * @return Number of bytes read
+ */
+static UInt8 memRamRead (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                         UInt8 *buffRead)
+{
+    if (start + length > MEM_SIZE)
+        length = MEM_SIZE - start;
+    memcpy(buffRead, pMem->pRam + start, length);
+    return length;
+} //memRamRead (
+
+/**
+ * @brief Function to write bytes to a memory modeled by a RAM buffer
+ *
+ * @param[in] pMem The memory
+ * @param[in] start The start address for writing
+ * @param[in] length The length of data to be written
+ * @param[out] *buffWrite Pointer to the buffer containing data to be written
+ * @return Number of bytes written
+ */
+static UInt8 memRamWrite (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                          UInt8 *buffWrite)
+{
+    if (start + length > MEM_SIZE)
+        length = MEM_SIZE - start;
+    memcpy(pMem->pRam + start, buffWrite, length);
+    return length;
+} //memRamWrite (
+
+/**
+ * @brief Function to sync a memory modeled by a RAM buffer
+ *
+ * A RAM buffer never survives a power loss, there is nothing to do.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: always 0
+ */
+static UInt8 memRamSync (nvm_mem_t *pMem)
+{
+    (void)pMem;
+    return 0;
+} //memRamSync (
+
+/**
+ * @brief Function to close a memory modeled by a RAM buffer
+ *
+ * The buffer belongs to the caller, there is nothing to release.
+ *
+ * @param[in,out] pMem The memory
+ */
+static void memRamClose (nvm_mem_t *pMem)
+{
+    (void)pMem;
+} //memRamClose (
+
+/**
+ * @brief Function to prefetch a range of a memory modeled by a RAM buffer
+ *
+ * The buffer is already in RAM, there is nothing to do.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ */
+static void memRamPrefetch (nvm_mem_t *pMem, UInt16 start, UInt16 length)
+{
+    (void)pMem;
+    (void)start;
+    (void)length;
+} //memRamPrefetch (
+
+/**
+ * @brief Function to submit the writes to a memory modeled by a RAM buffer
+ *
+ * The writes are done on the buffer at once, there is nothing to do.
+ * The mmap backend works the same way on its mapping.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: always 0
+ */
+static UInt8 memRamSubmit (nvm_mem_t *pMem)
+{
+    (void)pMem;
+    return 0;
+} //memRamSubmit (
+
+const nvm_mem_ops_t memRamOps = { memRamRead, memRamWrite, memRamFormat, \
+                                  memRamSync, memRamClose, memRamPrefetch, \
+                                  memRamSubmit };
+
+#if defined(MEM_HAVE_MMAP)
+/**
+ * @brief Function to get the granularity of the dirty tracking
+ *
+ * This is the page size, doubled as needed for the whole memory to fit
+ * on the 32 bits of the dirty map.
+ *
+ * @return Bytes tracked by each bit of the dirty map
+ */
+static UInt32 memMmapPageLen (void)
+{
+    UInt32 pageLen = (UInt32)sysconf(_SC_PAGESIZE);
+
+    while (pageLen < MEM_SIZE / 32)
+        pageLen <<= 1;
+    return pageLen;
+} //memMmapPageLen (
+
+/**
+ * @brief Function to get the mapping of a memory modeled by a mapped file
+ *
+ * The file is mapped on the first access and stays mapped until
+ * @ref memMmapClose. A short file is extended to the full memory size.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] create Non-zero to create the file if it doesn't exist
+ * @return The mapping, NULL if the file can't be mapped
+ */
+static UInt8 *memMmapMap (nvm_mem_t *pMem, UInt8 create)
+{
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    if (pMem->pRam)
+        return pMem->pRam;
+    fd = open(pMem->path, O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) || \
+        ((st.st_size < (off_t)MEM_SIZE) && ftruncate(fd, MEM_SIZE)))
+    {
+        close(fd);
+        return NULL;
+    }
+    pMap = mmap(NULL, MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); //The mapping holds the file on its own
+    if (pMap == MAP_FAILED)
+        return NULL;
+    pMem->pRam = (UInt8 *)pMap;
+    return pMem->pRam;
+} //memMmapMap (
+
+/**
+ * @brief Function to mark the pages of a range as not synced
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ */
+static void memMmapDirty (nvm_mem_t *pMem, UInt32 start, UInt32 length)
+{
+    UInt32 pageLen = memMmapPageLen();
+    UInt32 page;
+
+    if (!length)
+        return;
+    for (page = start / pageLen; page <= (start + length - 1) / pageLen; \
+         ++page)
+        pMem->dirty |= 1UL << page;
+} //memMmapDirty (
+
+/**
+ * @brief Function to format a memory modeled by a mapped file
+ *
+ * Same as @ref memFileFormat, on the mapping.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] full Non-zero to erase the values area too
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memMmapFormat (nvm_mem_t *pMem, UInt8 full)
+{
+    if (!memMmapMap(pMem, 1))
+        return 0xFF;
+    memRamFormat(pMem, full);
+    memMmapDirty(pMem, 0, full ? MEM_SIZE : NEXT_FREE_ADDR + SIZE_MEM_ADDRESS);
+    return 0;
+} //memMmapFormat (
+
+/**
+ * @brief Function to read bytes from a memory modeled by a mapped file
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for reading
+ * @param[in] length Number of bytes to be read
+ * @param[out] *buffRead Pointer to the buffer that will receive the data
+ * @return Error code: Number of bytes read
+ *                     0xFF if the file can't be mapped
+ */
+static UInt8 memMmapRead (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                          UInt8 *buffRead)
+{
+    if (!memMmapMap(pMem, 0))
+        return 0xFF;
+    return memRamRead(pMem, start, length, buffRead);
+} //memMmapRead (
+
+/**
+ * @brief Function to write bytes to a memory modeled by a mapped file
+ *
+ * The pages written are marked, to be synced by @ref memMmapSync.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for writing
+ * @param[in] length The length of data to be written
+ * @param[out] *buffWrite Pointer to the buffer containing data to be written
+ * @return Error code: Number of bytes written
+ *                     0xFF if the file can't be mapped
+ */
+static UInt8 memMmapWrite (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                           UInt8 *buffWrite)
+{
+    if (!memMmapMap(pMem, 0))
+        return 0xFF;
+    length = memRamWrite(pMem, start, length, buffWrite);
+    memMmapDirty(pMem, start, length);
+    return length;
+} //memMmapWrite (
+
+/**
+ * @brief Function to sync a memory modeled by a mapped file to the media
+ *
+ * Only the pages written since the last sync are synced, in address
+ * order, each run of adjacent ones by a single msync. A batch of small
+ * writes usually touches a handful of pages: the table copy and the tail
+ * of the values area.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memMmapSync (nvm_mem_t *pMem)
+{
+    UInt32 pageLen = memMmapPageLen();
+    UInt32 first, last, len;
+
+    if (!pMem->pRam)
+        return 0; //Nothing written since it was unmapped
+    for (first = 0; (first < 32) && (pMem->dirty >> first); first = last)
+    {
+        if (!(pMem->dirty & (1UL << first)))
+        {
+            last = first + 1;
+            continue;
+        }
+        for (last = first + 1; (last < 32) && \
+                               (pMem->dirty & (1UL << last)); ++last)
+            ;
+        len = (last - first) * pageLen;
+        if (first * pageLen + len > MEM_SIZE)
+            len = MEM_SIZE - first * pageLen;
+        if (msync(pMem->pRam + first * pageLen, len, MS_SYNC))
+            return 0xFF;
+        pMem->dirty &= ~(((1ULL << (last - first)) - 1) << first);
+    }
     return 0;
+} //memMmapSync (
+
+/**
+ * @brief Function to unmap a memory modeled by a mapped file
+ *
+ * The pages not synced are left for the OS to write back. The file is
+ * mapped again on the next access.
+ *
+ * @param[in,out] pMem The memory
+ */
+static void memMmapClose (nvm_mem_t *pMem)
+{
+    if (pMem->pRam)
+        munmap(pMem->pRam, MEM_SIZE);
+    pMem->pRam = NULL;
+    pMem->dirty = 0;
+} //memMmapClose (
+
+/**
+ * @brief Function to prefetch a range of a memory modeled by a mapped file
+ *
+ * The pages of the range are faulted in ahead of the reads.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ */
+static void memMmapPrefetch (nvm_mem_t *pMem, UInt16 start, UInt16 length)
+{
+    UInt32 pageLen = memMmapPageLen();
+    UInt32 first = start & ~(pageLen - 1);
+
+    if (!memMmapMap(pMem, 0) || !length)
+        return;
+    madvise(pMem->pRam + first, start + length - first, MADV_WILLNEED);
+} //memMmapPrefetch (
+
+const nvm_mem_ops_t memMmapOps = { memMmapRead, memMmapWrite, memMmapFormat, \
+                                   memMmapSync, memMmapClose, \
+                                   memMmapPrefetch, memRamSubmit };
+#endif
+
+#if defined(MEM_HAVE_URING)
+/// What a completion is for, in the low byte of its user data
+#define URING_OP_WRITE      0
+#define URING_OP_SYNC       1
+#define URING_OP_READ       2
+
+/**
+ * @brief State of a memory accessed through io_uring
+ *
+ * The rings are shared with the kernel, which moves the head of the
+ * submission ring and the tail of the completion ring. A write is copied
+ * to the staging area until it completes, so the caller's buffer can be
+ * reused at once, and its range is kept so a read of it waits for it.
+ */
+typedef struct
+{
+    int fd;                     ///< The file
+    int ring;                   ///< The io_uring, -1 for synchronous I/O
+    UInt32 *sqTail;             ///< Tail of the submission ring
+    UInt32 *sqMask;             ///< Its index mask
+    UInt32 *sqArray;            ///< Its entries, indexes into sqes
+    UInt32 *cqHead;             ///< Head of the completion ring
+    UInt32 *cqTail;             ///< Its tail
+    UInt32 *cqMask;             ///< Its index mask
+    struct io_uring_sqe *sqes;  ///< Submission entries
+    struct io_uring_cqe *cqes;  ///< Completion entries
+    struct io_uring_sqe *pLast; ///< Last write queued, NULL if submitted
+    void *pSqMap;               ///< Mapping of the submission ring
+    void *pCqMap;               ///< Of the completion ring, may be the same
+    size_t sqMapLen;            ///< Length of the submission ring mapping
+    size_t cqMapLen;            ///< Of the completion ring mapping
+    size_t sqesLen;             ///< Of the submission entries
+    UInt32 queued;              ///< Entries queued, not submitted yet
+    UInt32 inFlight;            ///< Entries submitted, not completed yet
+    UInt8 err;                  ///< A write failed since last reported
+    UInt8 winReady;             ///< The window was read
+    UInt16 winStart;            ///< Start of the window read ahead
+    UInt16 winLen;              ///< Its length, 0 if none
+    UInt16 stageLen;            ///< Bytes of the staging area used
+    UInt16 pendCount;           ///< Writes not completed yet
+    UInt16 pendStart[MEM_URING_DEPTH]; ///< Their start addresses
+    UInt8 pendLen[MEM_URING_DEPTH];    ///< Their lengths
+    UInt8 stage[MEM_URING_STAGE];      ///< Their bytes
+    UInt8 win[MEM_URING_WINDOW];       ///< Bytes read ahead
+} mem_uring_t;
+
+/**
+ * @brief Function to set up the io_uring of a memory
+ *
+ * The ring has room for the deepest queue, a sync and a read ahead.
+ *
+ * @param[in,out] pU The state of the memory
+ * @return Error status: 0 for success, 0xFF if io_uring is not available
+ */
+static UInt8 memUringSetup (mem_uring_t *pU)
+{
+    struct io_uring_params params;
+    UInt8 *pSq, *pCq;
+
+    memset(&params, 0, sizeof(params));
+    pU->ring = syscall(__NR_io_uring_setup, MEM_URING_DEPTH + 2, &params);
+    if (pU->ring < 0)
+        return 0xFF;
+    pU->sqMapLen = params.sq_off.array + params.sq_entries * sizeof(UInt32);
+    pU->cqMapLen = params.cq_off.cqes + \
+                   params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) && \
+        (pU->cqMapLen > pU->sqMapLen))
+        pU->sqMapLen = pU->cqMapLen;
+    pU->sqesLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    pU->pSqMap = mmap(NULL, pU->sqMapLen, PROT_READ | PROT_WRITE, \
+                      MAP_SHARED | MAP_POPULATE, pU->ring, IORING_OFF_SQ_RING);
+    pU->pCqMap = (params.features & IORING_FEAT_SINGLE_MMAP) ? pU->pSqMap : \
+                 mmap(NULL, pU->cqMapLen, PROT_READ | PROT_WRITE, \
+                      MAP_SHARED | MAP_POPULATE, pU->ring, IORING_OFF_CQ_RING);
+    pU->sqes = mmap(NULL, pU->sqesLen, PROT_READ | PROT_WRITE, \
+                    MAP_SHARED | MAP_POPULATE, pU->ring, IORING_OFF_SQES);
+    if ((pU->pSqMap == MAP_FAILED) || (pU->pCqMap == MAP_FAILED) || \
+        (pU->sqes == MAP_FAILED))
+    {
+        if (pU->sqes != MAP_FAILED)
+            munmap(pU->sqes, pU->sqesLen);
+        if ((pU->pCqMap != MAP_FAILED) && (pU->pCqMap != pU->pSqMap))
+            munmap(pU->pCqMap, pU->cqMapLen);
+        if (pU->pSqMap != MAP_FAILED)
+            munmap(pU->pSqMap, pU->sqMapLen);
+        close(pU->ring);
+        pU->ring = -1;
+        return 0xFF;
+    }
+
+    pSq = (UInt8 *)pU->pSqMap;
+    pCq = (UInt8 *)pU->pCqMap;
+    pU->sqTail = (UInt32 *)(pSq + params.sq_off.tail);
+    pU->sqMask = (UInt32 *)(pSq + params.sq_off.ring_mask);
+    pU->sqArray = (UInt32 *)(pSq + params.sq_off.array);
+    pU->cqHead = (UInt32 *)(pCq + params.cq_off.head);
+    pU->cqTail = (UInt32 *)(pCq + params.cq_off.tail);
+    pU->cqMask = (UInt32 *)(pCq + params.cq_off.ring_mask);
+    pU->cqes = (struct io_uring_cqe *)(pCq + params.cq_off.cqes);
+    return 0;
+} //memUringSetup (
+
+/**
+ * @brief Function to get the state of a memory accessed through io_uring
+ *
+ * The file is opened on the first access and kept open until
+ * @ref memUringClose. Where io_uring can't be set up (an old kernel, or
+ * a sandbox forbidding it), or with a depth of 0, the memory is read and
+ * written synchronously instead, as by the file backend.
+ *
+ * @param[in,out] pMem The memory
+ * @return The state, NULL if the file can't be opened
+ */
+static mem_uring_t *memUringOpen (nvm_mem_t *pMem)
+{
+    mem_uring_t *pU = (mem_uring_t *)pMem->pUring;
+
+    if (pU)
+        return pU;
+    pU = (mem_uring_t *)calloc(1, sizeof(*pU));
+    if (!pU)
+        return NULL;
+    pU->fd = open(pMem->path, O_RDWR);
+    if (pU->fd < 0)
+    {
+        free(pU);
+        return NULL;
+    }
+    pU->ring = -1;
+    if (pMem->depth)
+        memUringSetup(pU);
+    pMem->pUring = pU;
+    return pU;
+} //memUringOpen (
+
+/**
+ * @brief Function to take the completions of a memory off its ring
+ *
+ * A failed write, or one cancelled because a write linked before it
+ * failed, is kept to be reported. Once nothing is in flight, the staging
+ * area is free again.
+ *
+ * @param[in,out] pU The state of the memory
+ */
+static void memUringReap (mem_uring_t *pU)
+{
+    UInt32 head = *pU->cqHead;
+    UInt32 tail = __atomic_load_n(pU->cqTail, __ATOMIC_ACQUIRE);
+    const struct io_uring_cqe *pCqe;
+
+    for (; head != tail; ++head, --pU->inFlight)
+    {
+        pCqe = &pU->cqes[head & *pU->cqMask];
+        if ((pCqe->user_data & 0xFF) == URING_OP_READ)
+        {
+            pU->winReady = (pCqe->res == (Int32)pU->winLen);
+            if (!pU->winReady)
+                pU->winLen = 0;
+        }
+        else if ((pCqe->res < 0) || \
+                 (pCqe->res != (Int32)(pCqe->user_data >> 8)))
+            pU->err = 1;
+    }
+    __atomic_store_n(pU->cqHead, head, __ATOMIC_RELEASE);
+    if (!pU->inFlight && !pU->queued)
+    {
+        pU->pendCount = 0;
+        pU->stageLen = 0;
+    }
+} //memUringReap (
+
+/**
+ * @brief Function to submit the entries queued and take completions
+ *
+ * The entries are submitted together; the next write queued waits for
+ * them (see @ref memUringQueue).
+ *
+ * @param[in,out] pU The state of the memory
+ * @param[in] wait Non-zero to wait for a completion, if any is due
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memUringEnter (mem_uring_t *pU, UInt8 wait)
+{
+    long ret;
+
+    wait = wait && (pU->queued || pU->inFlight);
+    do
+    {
+        ret = syscall(__NR_io_uring_enter, pU->ring, pU->queued, wait, \
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while ((ret < 0) && (errno == EINTR));
+    if (ret < 0)
+        return 0xFF;
+    pU->queued -= ret;
+    pU->inFlight += ret;
+    if (ret)
+        pU->pLast = NULL;
+    memUringReap(pU);
+    return 0;
+} //memUringEnter (
+
+/**
+ * @brief Function to wait for every entry queued or in flight
+ *
+ * @param[in,out] pU The state of the memory
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memUringWait (mem_uring_t *pU)
+{
+    while (pU->queued || pU->inFlight)
+    {
+        if (memUringEnter(pU, 1))
+            return 0xFF;
+    }
+    return 0;
+} //memUringWait (
+
+/**
+ * @brief Function to queue an entry on the submission ring
+ *
+ * A write or sync is linked to the one queued before it, so it only
+ * starts once that one completed, and none of them is done after one
+ * fails. The first one after a submission waits for all those still in
+ * flight, so what reaches the file is always the writes done up to some
+ * point, in order, as after a power loss.
+ *
+ * @param[in,out] pU The state of the memory
+ * @param[in] opcode IORING_OP_* operation
+ * @param[in] userData URING_OP_* in the low byte, the length expected
+ *                     above it
+ * @return The entry, to be filled with the operands
+ */
+static struct io_uring_sqe *memUringQueue (mem_uring_t *pU,
+                                           UInt8 opcode,
+                                           UInt64 userData)
+{
+    UInt32 tail = *pU->sqTail;
+    UInt32 index = tail & *pU->sqMask;
+    struct io_uring_sqe *pSqe = &pU->sqes[index];
+
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->opcode = opcode;
+    pSqe->fd = pU->fd;
+    pSqe->user_data = userData;
+    if ((userData & 0xFF) != URING_OP_READ)
+    {
+        if (pU->pLast)
+            pU->pLast->flags |= IOSQE_IO_LINK;
+        else if (pU->inFlight)
+            pSqe->flags |= IOSQE_IO_DRAIN;
+        pU->pLast = pSqe;
+    }
+    pU->sqArray[index] = index;
+    __atomic_store_n(pU->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pU->queued;
+    return pSqe;
+} //memUringQueue (
+
+/**
+ * @brief Function to check if a range has writes not completed yet
+ *
+ * @param[in] pU The state of the memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ * @return Non-zero if a write queued or in flight overlaps the range
+ */
+static int memUringPending (const mem_uring_t *pU,
+                            UInt16 start,
+                            UInt16 length)
+{
+    int i;
+
+    for (i = 0; i < pU->pendCount; ++i)
+    {
+        if ((pU->pendStart[i] < (UInt32)start + length) && \
+            (start < (UInt32)pU->pendStart[i] + pU->pendLen[i]))
+            return 1;
+    }
+    return 0;
+} //memUringPending (
+
+/**
+ * @brief Function to close a memory accessed through io_uring
+ *
+ * The writes queued are waited for (not synced), then the ring and the
+ * file are closed. The file is opened again on the next access.
+ *
+ * @param[in,out] pMem The memory
+ */
+static void memUringClose (nvm_mem_t *pMem)
+{
+    mem_uring_t *pU = (mem_uring_t *)pMem->pUring;
+
+    if (!pU)
+        return;
+    if (pU->ring >= 0)
+    {
+        memUringWait(pU);
+        munmap(pU->sqes, pU->sqesLen);
+        if (pU->pCqMap != pU->pSqMap)
+            munmap(pU->pCqMap, pU->cqMapLen);
+        munmap(pU->pSqMap, pU->sqMapLen);
+        close(pU->ring);
+    }
+    close(pU->fd);
+    free(pU);
+    pMem->pUring = NULL;
+} //memUringClose (
+
+/**
+ * @brief Function to format a memory accessed through io_uring
+ *
+ * Same as @ref memFileFormat, once the writes queued are done.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] full Non-zero to erase the values area too
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memUringFormat (nvm_mem_t *pMem, UInt8 full)
+{
+    memUringClose(pMem);
+    return memFileFormat(pMem, full);
+} //memUringFormat (
+
+/**
+ * @brief Function to read bytes from a memory accessed through io_uring
+ *
+ * A read of a range written by a write not completed yet waits for it.
+ * A read within the window of the last prefetch waits for that window
+ * and is copied from it; any other read is done at once, synchronously.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for reading
+ * @param[in] length Number of bytes to be read
+ * @param[out] *buffRead Pointer to the buffer that will receive the data
+ * @return Error code: Number of bytes read
+ *                     0xFF for unrecoverable error
+ */
+static UInt8 memUringRead (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                           UInt8 *buffRead)
+{
+    mem_uring_t *pU = memUringOpen(pMem);
+    ssize_t ret;
+
+    if (!pU)
+        return 0xFF;
+    if ((pU->ring >= 0) && memUringPending(pU, start, length) && \
+        memUringWait(pU))
+        return 0xFF;
+    if (pU->winLen && (start >= pU->winStart) && \
+        ((UInt32)start + length <= (UInt32)pU->winStart + pU->winLen))
+    {
+        while (pU->winLen && !pU->winReady)
+        {
+            if (memUringEnter(pU, 1))
+                return 0xFF;
+        }
+        if (pU->winLen)
+        {
+            memcpy(buffRead, pU->win + start - pU->winStart, length);
+            return length;
+        }
+    }
+    ret = pread(pU->fd, buffRead, length, start);
+    return (ret < 0) ? 0xFF : (UInt8)ret;
+} //memUringRead (
+
+/**
+ * @brief Function to write bytes to a memory accessed through io_uring
+ *
+ * The bytes are staged and the write queued, linked to the one before,
+ * to be submitted by @ref memUringSubmit or @ref memUringSync. When the
+ * queue or the staging area is full, the writes queued are waited for.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address for writing
+ * @param[in] length The length of data to be written
+ * @param[out] *buffWrite Pointer to the buffer containing data to be written
+ * @return Error code: Number of bytes written (or queued)
+ *                     0xFF for writing error
+ */
+static UInt8 memUringWrite (nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                            UInt8 *buffWrite)
+{
+    mem_uring_t *pU = memUringOpen(pMem);
+    struct io_uring_sqe *pSqe;
+    ssize_t ret;
+
+    if (!pU)
+        return 0xFF;
+    if (pU->ring < 0)
+    {
+        ret = pwrite(pU->fd, buffWrite, length, start);
+        return (ret < 0) ? 0xFF : (UInt8)ret;
+    }
+    if (!length)
+        return 0;
+    memUringReap(pU);
+
+    //A write over the window read ahead makes it stale
+    if (pU->winLen && (pU->winStart < (UInt32)start + length) && \
+        (start < (UInt32)pU->winStart + pU->winLen))
+    {
+        if (memUringWait(pU))
+            return 0xFF;
+        pU->winLen = 0;
+    }
+    if (((pU->pendCount == pMem->depth) || \
+         (pU->stageLen + length > MEM_URING_STAGE)) && memUringWait(pU))
+        return 0xFF;
+
+    memcpy(pU->stage + pU->stageLen, buffWrite, length);
+    pSqe = memUringQueue(pU, IORING_OP_WRITE, \
+                         URING_OP_WRITE | ((UInt64)length << 8));
+    pSqe->addr = (UInt64)(uintptr_t)(pU->stage + pU->stageLen);
+    pSqe->len = length;
+    pSqe->off = start;
+    pU->pendStart[pU->pendCount] = start;
+    pU->pendLen[pU->pendCount++] = length;
+    pU->stageLen += length;
+    return length;
+} //memUringWrite (
+
+/**
+ * @brief Function to submit the writes to a memory accessed through
+ *        io_uring
+ *
+ * The writes a call queued are submitted together when it ends, as one
+ * linked chain, so none is left behind in the process once it returned.
+ * They are left in flight: the caller goes on queueing while the kernel
+ * does them, and several memories keep their queues busy at once. The
+ * queue only fills up with the chains not completed yet.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: 0 for success, 0xFF if a write failed since the
+ *         last time
+ */
+static UInt8 memUringSubmit (nvm_mem_t *pMem)
+{
+    mem_uring_t *pU = (mem_uring_t *)pMem->pUring;
+    UInt8 err;
+
+    if (!pU || (pU->ring < 0))
+        return 0;
+    memUringReap(pU);
+    if (pU->queued && memUringEnter(pU, 0))
+        return 0xFF;
+    err = pU->err;
+    pU->err = 0;
+    return err ? 0xFF : 0;
+} //memUringSubmit (
+
+/**
+ * @brief Function to sync a memory accessed through io_uring to the media
+ *
+ * A data sync is linked after the writes queued, and submitted with them
+ * in a single call; it returns once all of them completed.
+ *
+ * @param[in,out] pMem The memory
+ * @return Error status: 0 for success, 0xFF for error
+ */
+static UInt8 memUringSync (nvm_mem_t *pMem)
+{
+    mem_uring_t *pU = memUringOpen(pMem);
+    struct io_uring_sqe *pSqe;
+    UInt8 err;
+
+    if (!pU)
+        return 0xFF;
+    if (pU->ring < 0)
+        return fdatasync(pU->fd) ? 0xFF : 0;
+    pSqe = memUringQueue(pU, IORING_OP_FSYNC, URING_OP_SYNC);
+    pSqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    if (memUringWait(pU))
+        return 0xFF;
+    err = pU->err;
+    pU->err = 0;
+    return err ? 0xFF : 0;
+} //memUringSync (
+
+/**
+ * @brief Function to prefetch a range of a memory accessed through
+ *        io_uring
+ *
+ * Up to @ref MEM_URING_WINDOW bytes of the range are read ahead into a
+ * window, by a read submitted at once, so the reads that follow (the
+ * values of a batch, see @ref gpNvm_GetAttributes) overlap with it and
+ * are copied from the window. Without io_uring, the OS is asked to read
+ * the range ahead, as by the file backend.
+ *
+ * @param[in,out] pMem The memory
+ * @param[in] start The start address of the range
+ * @param[in] length The length of the range
+ */
+static void memUringPrefetch (nvm_mem_t *pMem, UInt16 start, UInt16 length)
+{
+    mem_uring_t *pU = memUringOpen(pMem);
+    struct io_uring_sqe *pSqe;
+
+    if (!pU || !length)
+        return;
+    if (pU->ring < 0)
+    {
+        posix_fadvise(pU->fd, start, length, POSIX_FADV_WILLNEED);
+        return;
+    }
+    memUringReap(pU);
+    if (pU->winLen && !pU->winReady)
+        return; //A read ahead is in flight already
+    if (length > MEM_URING_WINDOW)
+        length = MEM_URING_WINDOW;
+    //The read is not linked to the writes: those over it are done first
+    if ((memUringPending(pU, start, length) && memUringWait(pU)) || \
+        (pU->queued && memUringEnter(pU, 0)))
+        return;
+
+    pU->winStart = start;
+    pU->winLen = length;
+    pU->winReady = 0;
+    pSqe = memUringQueue(pU, IORING_OP_READ, URING_OP_READ);
+    pSqe->addr = (UInt64)(uintptr_t)pU->win;
+    pSqe->len = length;
+    pSqe->off = start;
+    if (memUringEnter(pU, 0))
+        pU->winLen = 0;
+} //memUringPrefetch (
+
+const nvm_mem_ops_t memUringOps = { memUringRead, memUringWrite, \
+                                    memUringFormat, memUringSync, \
+                                    memUringClose, memUringPrefetch, \
+                                    memUringSubmit };
+#endif
+
+
+/**
+ * @brief Function to initialize the memory
+ *
+ * This function initializes the memory, making it ready
+ * to be used. This procedure erase all the data on it.
+ * Actually, this version creates a new empty file, then fill
+ * the allocation table area with 0xFF, meaning the memory
+ * holds no data. It also sets the next available address to
+ * the beggining of the values area of the memory and sets this area
+ * to 0xFF.
+ *
+ * @return Error status: 0 for success, 0xFF for error
+ */
+UInt8 memInit (void)
+{
+    nvm_mem_t mem = memDefault;
+
+    return memFileFormat(&mem, 1);
 } //memInit (
 
 
+/**
+ * @brief Function to format the memory, without erasing the values
+ *
+ * This function is a fast alternative to @ref memInit. It fills up the
+ * allocation table with 0xFF and sets the next available address to the
+ * beggining of the values area, but leaves the values area as it is:
+ * nothing there can be reached without a register pointing to it.
+ * If the file doesn't exist yet, it's created, and a short file is
+ * extended to the full memory size by writing its last byte.
+ *
+ * @return Error status: 0 for success, 0xFF for error
+ */
+UInt8 memFormat (void)
+{
+    nvm_mem_t mem = memDefault;
+
+    return memFileFormat(&mem, 0);
+} //memFormat (
+
+
 /**
  * @brief Function to read bytes from the memory
  *
  * This function retrieves bytes from memory. Actually
- * it reads from a file that is modeling a physical memory.
+ * it reads from a file that is modeling a physical memory, opened just
+ * for this reading.
  *
  * @param[in] start The start address for reading
  * @param[in] length Number of bytes to be read
@@ -95,14 +1211,10 @@ UInt8 memInit (void)
  */
 UInt8 memRead (UInt16 start, UInt8 length, UInt8 *buffRead)
 {
-    Int8 ret = 0xFF;
-    pMemory = fopen(".\\mem.bin", "rb");
-    if (!pMemory)
-      return ret;
-    if (fseek(pMemory, start, SEEK_SET))
-      return ret;
-    ret = fread(buffRead, 1, length, pMemory);
-    fclose(pMemory);
+    nvm_mem_t mem = memDefault;
+    UInt8 ret = memFileRead(&mem, start, length, buffRead);
+
+    memFileClose(&mem);
     return ret;
 } //memRead (
 
@@ -110,7 +1222,8 @@ UInt8 memRead (UInt16 start, UInt8 length, UInt8 *buffRead)
  * @brief Function to write bytes to the memory
  *
  * This function writes bytes to memory. Actually
- * it writes to a file that is modeling a physical memory.
+ * it writes to a file that is modeling a physical memory, opened just
+ * for this writing. Nothing is synced to the media.
  *
  * @param[in] start The start address for writing
  * @param[in] length The length of data to be written
@@ -120,14 +1233,9 @@ UInt8 memRead (UInt16 start, UInt8 length, UInt8 *buffRead)
  */
 UInt8 memWrite (UInt16 start, UInt8 length, UInt8 *buffWrite)
 {
-    UInt8 ret = 0xFF;
+    nvm_mem_t mem = memDefault;
+    UInt8 ret = memFileWrite(&mem, start, length, buffWrite);
 
-    pMemory = fopen(".\\mem.bin", "rb+");
-    if (!pMemory)
-      return ret;
-    if (fseek(pMemory, start, SEEK_SET))
-      return ret;
-    ret = fwrite(buffWrite, 1, length, pMemory);
-    fclose(pMemory);
+    memFileClose(&mem);
     return ret;
 } //memWrite (
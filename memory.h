@@ -15,8 +15,116 @@
 
 #include "nvm.h"
 
+#define MEM_SIZE            (1UL << 16) ///< Size of the modeled memory, in bytes
+#define MEM_DEFAULT_PATH    ".\\mem.bin" ///< File modeling the default memory
+
+/**
+ * @brief Length of the scratch buffer of the streaming functions
+ *
+ * Whatever spans more than a value (formatting, the allocation table,
+ * blocks moved by compaction) is streamed through a buffer of this many
+ * bytes on the stack, never held whole. Any multiple of 32 up to 224 can
+ * be set at compile time (e.g. -DMEM_CHUNK_LEN=64) to trade RAM for the
+ * number of accesses.
+ */
+#if !defined(MEM_CHUNK_LEN)
+#define MEM_CHUNK_LEN       128
+#endif
+
+#if !defined(_WIN32)
+#define MEM_HAVE_MMAP ///< The mmap backend is available (POSIX)
+#endif
+#if defined(__linux__) && !defined(MEM_NO_URING)
+#define MEM_HAVE_URING ///< The io_uring backend is available (Linux)
+#endif
+
+/**
+ * @brief Writes queued at most by the io_uring backend
+ *
+ * Each memory keeps a ring of this many entries and a staging area of
+ * @ref MEM_URING_STAGE bytes for the writes in flight; when either runs
+ * out, the writes queued are waited for. Can be set at compile time.
+ */
+#if !defined(MEM_URING_DEPTH)
+#define MEM_URING_DEPTH     64
+#endif
+#if !defined(MEM_URING_STAGE)
+#define MEM_URING_STAGE     4096 ///< Bytes of the writes in flight
+#endif
+#define MEM_URING_WINDOW    1024 ///< Most bytes read ahead by a prefetch
+
+typedef struct nvm_mem nvm_mem_t;
+
+/**
+ * @brief Operations of a memory backend
+ *
+ * Reading and writing work as @ref memRead and @ref memWrite, on the
+ * memory given. Formatting works as @ref memInit when @e full is set,
+ * and as @ref memFormat otherwise. Syncing returns once everything
+ * written so far is on the media, so it survives a power loss; closing
+ * releases what the backend keeps between accesses. Prefetching tells the
+ * backend a range is about to be read, so it is fetched from the media
+ * in one go (readahead) instead of on each read; it is only a hint.
+ * Submitting starts the writes a backend may have queued, without
+ * waiting for them, and reports the writes found failed since the last
+ * time; it ends every call changing the memory. Reading, syncing and
+ * formatting wait for the queued writes they depend on.
+ */
+typedef struct
+{
+    UInt8 (*read)(nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                  UInt8 *buffRead);
+    UInt8 (*write)(nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                   UInt8 *buffWrite);
+    UInt8 (*format)(nvm_mem_t *pMem, UInt8 full);
+    UInt8 (*sync)(nvm_mem_t *pMem);
+    void (*close)(nvm_mem_t *pMem);
+    void (*prefetch)(nvm_mem_t *pMem, UInt16 start, UInt16 length);
+    UInt8 (*submit)(nvm_mem_t *pMem);
+} nvm_mem_ops_t;
+
+/**
+ * @brief A memory, as seen by the NVM
+ *
+ * Each instance of the NVM (see nvm_ctx.h) has a memory of its own.
+ * The file backend opens the file on the first access and keeps it open,
+ * unbuffered: every write is handed to the OS at once, but only reaches
+ * the media when synced. The RAM backend works on a buffer of
+ * @ref MEM_SIZE bytes given by the caller, and has nothing to sync.
+ * The mmap backend maps the file on the first access and works on the
+ * mapping as on a RAM buffer, keeping track of the pages written since
+ * the last sync, so only those are synced.
+ * The io_uring backend queues the writes of a call on a ring of its own,
+ * linked so they complete in order, and submits them at once at the end
+ * of the call, with the sync linked after them when there is one; where
+ * io_uring is not available (or with a depth of 0), it reads and writes
+ * the file synchronously instead.
+ * Nothing is shared between memories, so each one can be used from a
+ * different thread.
+ */
+struct nvm_mem
+{
+    const nvm_mem_ops_t *pOps; ///< @ref memFileOps or @ref memRamOps
+    const char *path;          ///< File modeling the memory (file backend)
+    UInt8 *pRam;               ///< Buffer (RAM) or mapping (mmap backend)
+    void *pFile;               ///< Open file, NULL if closed (file backend)
+    UInt32 dirty;              ///< Pages not synced yet (mmap backend)
+    void *pUring;              ///< Ring, NULL if closed (io_uring backend)
+    UInt8 depth;               ///< Writes queued at most (io_uring backend)
+};
+
+extern const nvm_mem_ops_t memFileOps; ///< Memory modeled by a file
+extern const nvm_mem_ops_t memRamOps;  ///< Memory modeled by a RAM buffer
+#if defined(MEM_HAVE_MMAP)
+extern const nvm_mem_ops_t memMmapOps; ///< Memory modeled by a mapped file
+#endif
+#if defined(MEM_HAVE_URING)
+extern const nvm_mem_ops_t memUringOps; ///< File accessed through io_uring
+#endif
+
 UInt8 memRead (UInt16 start, UInt8 length, UInt8 *buffRead);
 UInt8 memWrite (UInt16 start, UInt8 length, UInt8 *buffWrite);
 UInt8 memInit (void);
+UInt8 memFormat (void);
 
 #endif
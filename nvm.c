@@ -8,6 +8,9 @@
  * @ref memWrite, that in this exercise reads from and writes to
  * a file. In order to use an actual Flash/EEPROM memory one just
  * need to provide those lower level basic functions.
+ * All the state lives in an @ref nvm_ctx_t instance, reaching the memory
+ * through its backend; the gpNvm_* functions are thin wrappers over a
+ * default instance, on @ref MEM_DEFAULT_PATH.
  *
  * @author Marcio J Teixeira Jr.
  * @date 09/12/18
@@ -15,8 +18,12 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "nvm.h"
+#include "nvm_ctx.h"
+#include "nvm_integrity.h"
+#include "nvm_schema.h"
 #include "memory.h"
 
 /**
@@ -30,118 +37,3710 @@
 #define ID_ADDRESS(x) (x<<2) //Since the record length is 4 bytes, let's
                              //take advantage of bit shifting
 
+/**
+ * @brief Macro to check if an allocation register holds a live value
+ *
+ * A register is live when its CRC-8 is valid and it is neither empty
+ * nor a tombstone (length @ref ALLOC_LEN_FREE).
+ */
+#define REG_IS_LIVE(r) ((!calcCRC8((UInt8 *)&(r), ALLOC_REG_LEN)) && \
+                        ((r).length != ALLOC_LEN_FREE))
+
+/**
+ * @brief Macro to check if an allocation register holds no value
+ *
+ * That's the case for a register never written (all 0xFF, as left by
+ * @ref memInit) and for a tombstone. Anything else failing
+ * @ref REG_IS_LIVE is a corrupted register.
+ */
+#define REG_IS_FREE(r) ((((r).start == 0xFFFF) && ((r).length == 0xFF) && \
+                         ((r).crc == 0xFF)) || \
+                        ((!calcCRC8((UInt8 *)&(r), ALLOC_REG_LEN)) && \
+                         ((r).length == ALLOC_LEN_FREE)))
+
+/**
+ * @brief Macro to check if an allocation register points to a ring
+ *
+ * See @ref gpNvm_ReserveAttribute. The CRC-8 is valid once
+ * @ref ALLOC_CRC_RING is XORed out of it, so the single register write
+ * moving an attribute to its ring is also what marks it as such.
+ */
+#define REG_IS_RING(r) (((calcCRC8((UInt8 *)&(r), ALLOC_REG_NO_CRC) ^ \
+                          ALLOC_CRC_RING) == (r).crc) && \
+                        ((r).length != ALLOC_LEN_FREE))
+
+/**
+ * @brief Macro to check if an allocation register points to a delta
+ *
+ * See @ref gpNvm_SetDeltaChain. Same as @ref REG_IS_RING, with
+ * @ref ALLOC_CRC_DELTA.
+ */
+#define REG_IS_DELTA(r) (((calcCRC8((UInt8 *)&(r), ALLOC_REG_NO_CRC) ^ \
+                           ALLOC_CRC_DELTA) == (r).crc) && \
+                         ((r).length != ALLOC_LEN_FREE))
+
+/// End of the values area, the fixed slots of the schema are above it
+#define APPEND_END  NVM_SCHEMA_AREA_START
+
+/**
+ * @brief Macro to test a bit of an allocation register bitmap
+ */
+#define REG_BIT(map, x) ((map)[(x) >> 3] & (1 << ((x) & 7)))
+
+/// Length of a value plus its trailer, on the values area of an instance
+#define REC_LEN(c, len) ((len) + nvmIntegrityLen((c)->integrity, (len)))
+
+/// Integrity mode of the schema slots: the CRC-16, unless sealed
+#define SLOT_INTEGRITY(c) (((c)->integrity == NVM_INTEGRITY_SEALED) ? \
+                           NVM_INTEGRITY_SEALED : NVM_INTEGRITY_CRC16)
+
+/// Length of a slot of a ring: sequence number, value and their trailer
+#define RING_SLOT_LEN(c, len) \
+    (1 + (len) + nvmIntegrityLen((c)->integrity, (len) + 1))
+
+/// Room for the longest slot of a ring, in any integrity mode
+#define RING_SLOT_MAX   (1 + MAX_VALUE_LENGTH + NVM_MAX_TRAILER_LEN)
+
+/// Length of the back-pointer before the values of an attribute with history
+#define HIST_LEN(id)    (nvmSchemaHistory(id) ? SIZE_MEM_ADDRESS : 0)
+
+/// The header is written in one go, so it must have no padding
+typedef char abHeaderLenCheck[(sizeof(ab_header_t) == AB_HEADER_LEN) ? 1 : -1];
+typedef char deltaHeaderLenCheck[(sizeof(delta_header_t) == \
+                                  DELTA_HEADER_LEN) ? 1 : -1];
+
+/// Longest runs of a delta: sealed ones are opened through a scratch
+/// buffer, as long as a chunk, so the buffer of a ring slot holds them too
+#define DELTA_RUNS_MAX  MEM_CHUNK_LEN
+
+/// Room for the runs of a delta with their trailer, in any integrity mode
+#define DELTA_SCRATCH_LEN   (DELTA_RUNS_MAX + NVM_MAX_TRAILER_LEN)
+
+/// Bytes of the runs of a delta read at once: a SECDED block
+#define DELTA_PIECE_LEN 8
+
+/// Header of a run: its offset and count
+#define DELTA_RUN_HDR   2
+
+/// Keeps the buffers only some paths need (e.g. sealed values) off the
+/// frames of the others
+#if defined(_MSC_VER)
+#define NVM_NOINLINE __declspec(noinline)
+#else
+#define NVM_NOINLINE __attribute__((noinline))
+#endif
+
+/// Length of a delta record: header, runs and their trailer
+#define DELTA_REC_LEN(c, runs)  (DELTA_HEADER_LEN + REC_LEN(c, runs))
+
+/// Longest gap of unchanged bytes kept within a run (as long as a header)
+#define DELTA_GAP_MAX   DELTA_RUN_HDR
+
+/// Result of nvmDeltaPut: no delta made, a whole value is due instead
+#define DELTA_SKIPPED   1
+
+/// Registers of the allocation table streamed at once, see nvmTableLive
+#define TABLE_CHUNK_REGS    (MEM_CHUNK_LEN / ALLOC_REG_LEN)
+
+/// Chunks fit a transfer, and hold whole bytes of the register bitmaps
+typedef char memChunkLenCheck[((MEM_CHUNK_LEN % 32) == 0) && \
+                              (MEM_CHUNK_LEN <= 224) ? 1 : -1];
+
+/// Reading and writing on the memory of an instance
+#define CTX_READ(c, s, l, b)  ((c)->mem.pOps->read(&(c)->mem, (s), (l), (b)))
+#define CTX_WRITE(c, s, l, b) ((c)->mem.pOps->write(&(c)->mem, (s), (l), (b)))
+
+/**
+ * @brief A value kept by @ref gpNvmCtx_Compact
+ */
+typedef struct
+{
+    UInt16 start;   ///< Address of the value
+    UInt16 recLen;  ///< Value and trailer, or the whole ring
+    UInt16 newer;   ///< Address of the value it is former of, KEEP_NONE
+    UInt8 attrId;   ///< Its attribute
+    UInt8 flags;    ///< KEEP_* flags
+    UInt16 rank;    ///< Order when gathered: its group, the hot ones last
+} nvm_keep_t;
+
+/**
+ * @brief What a compaction moves, see @ref nvmCompactIndex
+ */
+typedef struct
+{
+    UInt16 from;        ///< Lowest address of the values being compacted
+    UInt32 end;         ///< Values from there on were gathered already
+    UInt8 moveHot;      ///< Non-zero to gather the hot values
+    UInt8 gathered[32]; ///< Bitmap of the placement groups gathered
+} nvm_compact_plan_t;
+
+/// Values kept by a compaction indexed at once, the smallest keys first
+#define KEEP_WINDOW     16
+
+/// Order of a value kept: its address, after its rank when gathered, and
+/// its attribute (registers can't share a value, corrupted ones may)
+#define KEEP_KEY(p, gather) \
+    (((gather) ? ((Int64)(p)->rank << 24) : 0) | \
+     ((Int64)(p)->start << 8) | (p)->attrId)
+
+#define KEEP_NONE       0xFFFF ///< The current value, no newer one
+#define KEEP_CURRENT    0x01   ///< Its register points to it
+#define KEEP_RING       0x02   ///< A whole ring
+#define KEEP_HOT        0x04   ///< Its attribute is hot
+#define KEEP_MOVE       0x08   ///< To be gathered above the others
+#define KEEP_DELTA      0x10   ///< A chain of deltas, from its whole value
+#define KEEP_LAST       0x20   ///< The oldest value kept of its history
+
+/**
+ * @brief Where the runs of a delta are applied, piece by piece
+ */
+typedef struct
+{
+    UInt8 *pValue;  ///< The value on RAM, NULL to patch it on memory
+    UInt16 dest;    ///< Address of the value patched on memory
+    UInt8 length;   ///< Length of the value
+    UInt8 hdr;      ///< Bytes of the header of the current run read
+    UInt8 offset;   ///< Offset of the next byte of the current run
+    UInt8 left;     ///< Bytes of the current run left
+} delta_cursor_t;
+
+/// Appends since the last compaction (halved by each one) making it hot
+#define HOT_APPENDS     2
+
+/// Longest run of values read at once: as long as a full length value
+#define GROUP_READ_MAX  (MAX_VALUE_LENGTH + NVM_MAX_TRAILER_LEN)
+#define GROUP_GAP_MAX   64  ///< Longest gap read through within a run
+
+/// Least a compaction of the hot region alone must free: a full value
+#define COMPACT_MIN_GAIN (SIZE_MEM_ADDRESS + MAX_VALUE_LENGTH + \
+                          NVM_MAX_TRAILER_LEN)
+
+/**********************************
+ * Local module variables
+ **********************************
+*/
+/// The instance behind the gpNvm_* functions
+static nvm_ctx_t nvmDefaultCtx = {
+    .mem = { .pOps = &memFileOps, .path = MEM_DEFAULT_PATH },
+    .durability = NVM_DURABILITY_BUFFERED
+};
+
+/**
+ * @brief Function to read more than 255 bytes from the memory
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] start The start address for reading
+ * @param[in] length Number of bytes to be read
+ * @param[out] pBuff Buffer receiving the data
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmReadBlock(nvm_ctx_t *pCtx,
+                          UInt16 start,
+                          UInt16 length,
+                          UInt8 *pBuff)
+{
+    UInt8 chunk;
+
+    while (length)
+    {
+        chunk = (length > MEM_CHUNK_LEN) ? MEM_CHUNK_LEN : length;
+        if (chunk != CTX_READ(pCtx, start, chunk, pBuff))
+            return 0xFF;
+        start += chunk;
+        pBuff += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to write more than 255 bytes to the memory
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] start The start address for writing
+ * @param[in] length Number of bytes to be written
+ * @param[in] pBuff Buffer containing the data
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmWriteBlock(nvm_ctx_t *pCtx,
+                           UInt16 start,
+                           UInt16 length,
+                           UInt8 *pBuff)
+{
+    UInt8 chunk;
+
+    while (length)
+    {
+        chunk = (length > MEM_CHUNK_LEN) ? MEM_CHUNK_LEN : length;
+        if (chunk != CTX_WRITE(pCtx, start, chunk, pBuff))
+            return 0xFF;
+        start += chunk;
+        pBuff += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to move a block to a lower address
+ *
+ * The block is copied in chunks from its beginning, so it may overlap
+ * its destination.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] src The current address of the block
+ * @param[in] dest The new address, below src
+ * @param[in] length Length of the block
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmMoveBlock(nvm_ctx_t *pCtx,
+                          UInt16 src,
+                          UInt16 dest,
+                          UInt16 length)
+{
+    UInt8 buff[MEM_CHUNK_LEN];
+    UInt8 chunk;
+
+    while (length)
+    {
+        chunk = (length > MEM_CHUNK_LEN) ? MEM_CHUNK_LEN : length;
+        if ((chunk != CTX_READ(pCtx, src, chunk, buff)) || \
+            (chunk != CTX_WRITE(pCtx, dest, chunk, buff)))
+            return 0xFF;
+        src += chunk;
+        dest += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to read the next available address
+ *
+ * This function reads @ref NEXT_FREE_ADDR, or the A/B header mirror.
+ * The pointer is 16 bits wide, so when the values area is filled up to
+ * the last byte of the memory it wraps to 0. That's why any address out
+ * of the values area is taken as its end.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @return The next available address, @ref APPEND_END when full
+ */
+static UInt32 nvmReadNextFree(nvm_ctx_t *pCtx)
+{
+    UInt16 nextFree = 0;
+
+    if (pCtx->tableMode == NVM_TABLE_AB)
+        nextFree = pCtx->abHeader.nextFree;
+    else
+        CTX_READ(pCtx, NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFree);
+    if ((nextFree < pCtx->valuesStart) || (nextFree > APPEND_END))
+        return APPEND_END;
+    return nextFree;
+}
+
+/**
+ * @brief Function to read an allocation register
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[out] pReg The register read (not checked)
+ */
+static void nvmReadReg(nvm_ctx_t *pCtx, gPNvm_AttrId attrId, alloc_reg_t *pReg)
+{
+    if (pCtx->tableMode == NVM_TABLE_AB)
+        *pReg = pCtx->table[attrId];
+    else
+        CTX_READ(pCtx, ID_ADDRESS(attrId), ALLOC_REG_LEN, (UInt8 *)pReg);
+}
+
+/**
+ * @brief Function to find the live registers of a chunk of the table
+ *
+ * Same as @ref REG_IS_LIVE, @ref REG_IS_RING and @ref REG_IS_DELTA on
+ * every register, but the CRC-8 of the whole chunk is checked in a single
+ * pass by @ref checkCRC8Records. Only the few registers failing it are
+ * checked for a ring or a delta. With a single table, the chunk is read
+ * into the scratch buffer given, so the table is streamed and never held
+ * whole in RAM; in A/B mode it is on the RAM mirror already.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] first First register, a multiple of @ref TABLE_CHUNK_REGS
+ * @param[in] pBuff Scratch buffer of @ref TABLE_CHUNK_REGS registers
+ * @param[out] ppTable Receives the registers of the chunk
+ * @param[out] pLive Bitmap, bit i set when register first + i is live
+ * @param[out] pRing Bitmap, bit i set when register first + i is a ring
+ * @param[out] pDelta Bitmap, bit i set when register first + i is a delta
+ * @return Number of registers in the chunk, 0 for error
+ */
+static int nvmTableLive(nvm_ctx_t *pCtx,
+                        int first,
+                        alloc_reg_t *pBuff,
+                        const alloc_reg_t **ppTable,
+                        UInt8 *pLive,
+                        UInt8 *pRing,
+                        UInt8 *pDelta)
+{
+    UInt8 erased[TABLE_CHUNK_REGS / 8];
+    const alloc_reg_t *pTable = pBuff;
+    int i, count = MAX_REG_ALLOC - first;
+
+    if (count > TABLE_CHUNK_REGS)
+        count = TABLE_CHUNK_REGS;
+    if (pCtx->tableMode == NVM_TABLE_AB)
+        pTable = &pCtx->table[first];
+    else if (count * ALLOC_REG_LEN != CTX_READ(pCtx, ID_ADDRESS(first), \
+                                               count * ALLOC_REG_LEN, \
+                                               (UInt8 *)pBuff))
+        return 0;
+
+    checkCRC8Records((const UInt8 *)pTable, count, pLive, erased);
+    memset(pRing, 0, TABLE_CHUNK_REGS / 8);
+    memset(pDelta, 0, TABLE_CHUNK_REGS / 8);
+    for (i = 0; i < count; ++i)
+    {
+        if (pTable[i].length == ALLOC_LEN_FREE)
+            pLive[i >> 3] &= ~(1 << (i & 7));
+        else if (REG_BIT(pLive, i) || REG_BIT(erased, i))
+            continue;
+        else if (REG_IS_RING(pTable[i]))
+            pRing[i >> 3] |= 1 << (i & 7);
+        else if (REG_IS_DELTA(pTable[i]))
+            pDelta[i >> 3] |= 1 << (i & 7);
+    }
+    *ppTable = pTable;
+    return count;
+}
+
+/**
+ * @brief Function to update an allocation register
+ *
+ * With a single table the register is written right away. In A/B mode
+ * it only changes the RAM mirror, and is written by @ref nvmCommit.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The new register, CRC-8 included
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmStageReg(nvm_ctx_t *pCtx,
+                         gPNvm_AttrId attrId,
+                         alloc_reg_t *pReg)
+{
+    if (pCtx->tableMode == NVM_TABLE_AB)
+    {
+        pCtx->table[attrId] = *pReg;
+        pCtx->abChanged[attrId >> 3] |= 1 << (attrId & 7);
+        return 0;
+    }
+    if (ALLOC_REG_LEN != CTX_WRITE(pCtx, ID_ADDRESS(attrId), ALLOC_REG_LEN, \
+                                  (UInt8 *)pReg))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to update the next available address
+ *
+ * Just like @ref nvmStageReg, in A/B mode it only changes the mirror.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] nextFree The new address, @ref APPEND_END when full
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmStageNextFree(nvm_ctx_t *pCtx, UInt32 nextFree)
+{
+    UInt16 addr = (UInt16)nextFree; //Wraps to 0 when full
+
+    if (pCtx->tableMode == NVM_TABLE_AB)
+    {
+        pCtx->abHeader.nextFree = addr;
+        return 0;
+    }
+    if (SIZE_MEM_ADDRESS != CTX_WRITE(pCtx, NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, \
+                                     (UInt8 *)&addr))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to make the staged table updates effective
+ *
+ * With a single table there is nothing left to do. In A/B mode the
+ * registers the inactive copy is missing are written to it, in runs of
+ * consecutive registers, followed by its header with the next generation
+ * and the CRC-16 of the whole table. This copy becomes the active one.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmCommit(nvm_ctx_t *pCtx)
+{
+    ab_header_t hdr;
+    UInt8 inactive;
+    int i, j;
+
+    if (pCtx->tableMode != NVM_TABLE_AB)
+        return 0;
+
+    inactive = pCtx->abActive ^ 1;
+    for (i = 0; i < (MAX_REG_ALLOC / 8); ++i)
+        pCtx->abStale[i] |= pCtx->abChanged[i];
+    for (i = 0; i < MAX_REG_ALLOC; i = j)
+    {
+        for (j = i; (j < MAX_REG_ALLOC) && REG_BIT(pCtx->abStale, j); ++j)
+            ;
+        if (j == i)
+        {
+            j++;
+            continue;
+        }
+        if (nvmWriteBlock(pCtx, AB_TABLE_ADDR(inactive) + ID_ADDRESS(i), \
+                          (j - i) * ALLOC_REG_LEN, (UInt8 *)&pCtx->table[i]))
+            return 0xFF;
+    }
+
+    hdr = pCtx->abHeader;
+    hdr.generation++;
+    hdr.tableCrc = calcCRC16((UInt8 *)pCtx->table, ALLOC_TABLE_LEN);
+    hdr.crc = calcCRC16((UInt8 *)&hdr, AB_HEADER_LEN - CRC_LEN);
+    if (AB_HEADER_LEN != CTX_WRITE(pCtx, AB_COPY_ADDR(inactive), \
+                                   AB_HEADER_LEN, (UInt8 *)&hdr))
+        return 0xFF;
+
+    pCtx->abHeader = hdr;
+    pCtx->abActive = inactive;
+    //The copy just left behind misses the registers of this switch
+    memcpy(pCtx->abStale, pCtx->abChanged, sizeof(pCtx->abStale));
+    memset(pCtx->abChanged, 0, sizeof(pCtx->abChanged));
+    return 0;
+}
+
+/**
+ * @brief Function to load the newest valid table copy, in A/B mode
+ *
+ * The headers are checked first, then the table of the newest one is
+ * loaded on the RAM mirror and checked against its CRC-16. If it fails,
+ * the other copy is tried. The inactive copy is marked as fully stale,
+ * so the first switch rewrites it completely.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pHdr The headers of both copies
+ * @return Error code: 0 for success, 0xFF if no copy is valid
+ */
+static UInt8 nvmMountAb(nvm_ctx_t *pCtx, ab_header_t *pHdr)
+{
+    int c, order[2], tries = 0;
+
+    for (c = 0; c < 2; ++c)
+    {
+        if ((pHdr[c].magic == AB_MAGIC) && \
+            (pHdr[c].crc == calcCRC16((UInt8 *)&pHdr[c], \
+                                      AB_HEADER_LEN - CRC_LEN)))
+            order[tries++] = c;
+    }
+    //Newest first, generations compared with wrap around
+    if ((tries == 2) && \
+        ((Int32)(pHdr[order[1]].generation - pHdr[order[0]].generation) > 0))
+    {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    for (c = 0; c < tries; ++c)
+    {
+        if (nvmReadBlock(pCtx, AB_TABLE_ADDR(order[c]), ALLOC_TABLE_LEN, \
+                         (UInt8 *)pCtx->table))
+            continue;
+        if (pHdr[order[c]].tableCrc != \
+            calcCRC16((UInt8 *)pCtx->table, ALLOC_TABLE_LEN))
+            continue;
+
+        if ((pHdr[order[c]].integrity != 0xFFFF) && \
+            !nvmIntegrityValid(pHdr[order[c]].integrity))
+            continue;
+        pCtx->abHeader = pHdr[order[c]];
+        pCtx->abActive = order[c];
+        pCtx->integrity = (pHdr[order[c]].integrity == 0xFFFF) ? \
+                          NVM_INTEGRITY_CRC16 : pHdr[order[c]].integrity;
+        memset(pCtx->abStale, 0xFF, sizeof(pCtx->abStale));
+        memset(pCtx->abChanged, 0, sizeof(pCtx->abChanged));
+        pCtx->tableMode = NVM_TABLE_AB;
+        pCtx->valuesStart = AB_VALUES_START;
+        return 0;
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to build the trailer of a value
+ *
+ * On a sealed memory the value is encrypted in place, and the trailer is
+ * its tag (see nvm_seal.h); otherwise the value is left as it is.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in,out] pValue The value, sealed in place if so
+ * @param[in] length Length of the value
+ * @param[out] pTrailer The trailer
+ * @return Error code: 0 for success, 0xFF if sealed without a key
+ */
+static gPNvm_Result nvmTrailerEncode(nvm_ctx_t *pCtx,
+                                     gPNvm_AttrId attrId,
+                                     UInt8 *pValue,
+                                     UInt8 length,
+                                     UInt8 *pTrailer)
+{
+    if (pCtx->integrity != NVM_INTEGRITY_SEALED)
+    {
+        nvmIntegrityEncode(pCtx->integrity, pValue, length, pTrailer);
+        return 0;
+    }
+    if (!pCtx->seal.loaded)
+        return 0xFF;
+    nvmSeal(&pCtx->seal, attrId, pValue, length, pTrailer);
+    return 0;
+}
+
+/**
+ * @brief Function to check a value against its trailer
+ *
+ * On a sealed memory the value is decrypted in place and its tag
+ * checked, so a value moved to another attribute fails as well.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in,out] pValue The value, corrected or opened in place
+ * @param[in] length Length of the value
+ * @param[in] pTrailer The trailer read with the value
+ * @return Same as @ref nvmIntegrityCheck
+ */
+static UInt8 nvmTrailerCheck(nvm_ctx_t *pCtx,
+                             gPNvm_AttrId attrId,
+                             UInt8 *pValue,
+                             UInt8 length,
+                             const UInt8 *pTrailer)
+{
+    if (pCtx->integrity == NVM_INTEGRITY_SEALED)
+        return nvmSealOpen(&pCtx->seal, attrId, pValue, length, pTrailer);
+    return nvmIntegrityCheck(pCtx->integrity, pValue, length, pTrailer);
+}
+
+/**
+ * @brief Function to read a value of the values area and check it
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] start Address of the value
+ * @param[in] length Length of the value
+ * @param[out] pValue the value retrieved
+ * @return Error code: 0 for success, 0xFF for unrecoverable error
+ */
+static gPNvm_Result nvmReadRecord(nvm_ctx_t *pCtx,
+                                  gPNvm_AttrId attrId,
+                                  UInt16 start,
+                                  UInt8 length,
+                                  UInt8 *pValue)
+{
+    UInt8 trailer[NVM_MAX_TRAILER_LEN];
+    UInt8 trailerLen = nvmIntegrityLen(pCtx->integrity, length);
+
+    if ((length != CTX_READ(pCtx, start, length, pValue)) || \
+        (trailerLen != CTX_READ(pCtx, start + length, trailerLen, trailer)))
+        return 0xFF;
+    // The trailer is checked against the value read, instead of
+    // calculating it over value and trailer together expecting a zero.
+    // This way only the trailer needs a buffer. In SECDED mode, the
+    // single bit errors are corrected on the value.
+    if (nvmTrailerCheck(pCtx, attrId, pValue, length, trailer) == 0xFF)
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to find the former value of an attribute with history
+ *
+ * Each value of an attribute with history is preceded by the address of
+ * the value it replaced. The former value is always below, since it was
+ * appended first and compaction keeps the order; a back-pointer out of
+ * the values area or overlapping the newer value is corrupted.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] start Address of the newer value
+ * @param[in] length Length of the values
+ * @param[out] pFormer Address of the former value
+ * @return Error code: 0 for success, 0xFF for corrupted back-pointer,
+ *                     @ref NVM_ERR_NOT_FOUND if there is no former value
+ */
+static gPNvm_Result nvmFormerValue(nvm_ctx_t *pCtx,
+                                   UInt16 start,
+                                   UInt8 length,
+                                   UInt16 *pFormer)
+{
+    UInt16 former;
+
+    if (SIZE_MEM_ADDRESS != CTX_READ(pCtx, start - SIZE_MEM_ADDRESS, \
+                                     SIZE_MEM_ADDRESS, (UInt8 *)&former))
+        return 0xFF;
+    if (former == 0xFFFF)
+        return NVM_ERR_NOT_FOUND;
+    if ((former < pCtx->valuesStart + SIZE_MEM_ADDRESS) || \
+        ((UInt32)former + REC_LEN(pCtx, length) + SIZE_MEM_ADDRESS > start))
+        return 0xFF;
+    *pFormer = former;
+    return 0;
+}
+
+/**
+ * @brief Function to find the length of a ring, from its header
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pReg The register pointing to the ring
+ * @return Length of the ring, header included, 0 if the header is
+ *         corrupted or the ring is out of the values area
+ */
+static UInt16 nvmRingLen(nvm_ctx_t *pCtx, const alloc_reg_t *pReg)
+{
+    UInt8 hdr[RING_HEADER_LEN];
+    UInt32 len;
+
+    if ((RING_HEADER_LEN != CTX_READ(pCtx, pReg->start, RING_HEADER_LEN, \
+                                     hdr)) || \
+        ((hdr[0] ^ hdr[1]) != 0xFF) || !hdr[0] || \
+        (hdr[0] > NVM_MAX_RING_SLOTS))
+        return 0;
+    len = RING_HEADER_LEN + hdr[0] * RING_SLOT_LEN(pCtx, pReg->length);
+    if ((pReg->start < pCtx->valuesStart) || (pReg->start + len > APPEND_END))
+        return 0;
+    return len;
+}
+
+/**
+ * @brief Function to find the newest slot of a ring
+ *
+ * The sequence numbers of all slots are read first. Then the slots are
+ * checked from the newest one, wrapping around, until one passes its
+ * trailer check: a slot torn by a reset is just skipped. On a sealed
+ * memory the sequence numbers are encrypted, so every slot is opened
+ * first, and those failing are not tried. The slots are read into a
+ * buffer of the caller, so a write doesn't take a second one.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register pointing to the ring
+ * @param[out] pBuff Buffer of @ref RING_SLOT_MAX bytes, receiving the
+ *                   newest slot: its current value is at pBuff + 1
+ * @param[out] pSlot Index of the newest slot
+ * @param[out] pSeq Its sequence number
+ * @return Error code: 0 for success, 0xFF if no slot is valid
+ */
+static gPNvm_Result nvmRingNewest(nvm_ctx_t *pCtx,
+                                  gPNvm_AttrId attrId,
+                                  const alloc_reg_t *pReg,
+                                  UInt8 *pBuff,
+                                  UInt8 *pSlot,
+                                  UInt8 *pSeq)
+{
+    UInt8 seq[NVM_MAX_RING_SLOTS];
+    UInt16 ringLen = nvmRingLen(pCtx, pReg);
+    UInt16 slotLen = RING_SLOT_LEN(pCtx, pReg->length);
+    UInt32 tried = 0;
+    int slots, best, i;
+
+    if (!ringLen)
+        return 0xFF;
+    slots = (ringLen - RING_HEADER_LEN) / slotLen;
+    for (i = 0; i < slots; ++i)
+    {
+        if (pCtx->integrity == NVM_INTEGRITY_SEALED)
+        {
+            if (nvmReadBlock(pCtx, pReg->start + RING_HEADER_LEN + \
+                             i * slotLen, slotLen, pBuff))
+                return 0xFF;
+            if (nvmTrailerCheck(pCtx, attrId, pBuff, pReg->length + 1, \
+                                pBuff + 1 + pReg->length) == 0xFF)
+                tried |= 1UL << i;
+            seq[i] = pBuff[0];
+        }
+        else if (1 != CTX_READ(pCtx, pReg->start + RING_HEADER_LEN + \
+                               i * slotLen, 1, &seq[i]))
+            return 0xFF;
+    }
+
+    while (tried != (1UL << slots) - 1)
+    {
+        best = -1;
+        for (i = 0; i < slots; ++i)
+        {
+            if (tried & (1UL << i))
+                continue;
+            if ((best < 0) || ((Int8)(seq[i] - seq[best]) > 0))
+                best = i;
+        }
+        tried |= 1UL << best;
+        if (nvmReadBlock(pCtx, pReg->start + RING_HEADER_LEN + \
+                         best * slotLen, slotLen, pBuff))
+            return 0xFF;
+        if (nvmTrailerCheck(pCtx, attrId, pBuff, pReg->length + 1, \
+                            pBuff + 1 + pReg->length) == 0xFF)
+            continue;
+        *pSlot = best;
+        *pSeq = pBuff[0];
+        return 0;
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to write a slot built on a buffer to a ring
+ *
+ * The slot after the newest one is the oldest, so it is overwritten in
+ * a single write, with the next sequence number. A reset in the middle
+ * leaves it failing its trailer check, and the newest slot unchanged.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register pointing to the ring
+ * @param[in,out] pBuff Buffer of @ref RING_SLOT_MAX bytes, with the new
+ *                      value at pBuff + 1
+ * @param[in] slot Index of the newest slot, -1 if none
+ * @param[in] seq Its sequence number, -1 if none
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static gPNvm_Result nvmRingPut(nvm_ctx_t *pCtx,
+                               gPNvm_AttrId attrId,
+                               const alloc_reg_t *pReg,
+                               UInt8 *pBuff,
+                               UInt8 slot,
+                               UInt8 seq)
+{
+    UInt16 ringLen = nvmRingLen(pCtx, pReg);
+    UInt16 slotLen = RING_SLOT_LEN(pCtx, pReg->length);
+
+    if (!ringLen)
+        return 0xFF;
+    slot = (UInt8)(slot + 1) % ((ringLen - RING_HEADER_LEN) / slotLen);
+
+    pBuff[0] = seq + 1;
+    if (nvmTrailerEncode(pCtx, attrId, pBuff, pReg->length + 1, \
+                         pBuff + 1 + pReg->length))
+        return 0xFF;
+    return nvmWriteBlock(pCtx, pReg->start + RING_HEADER_LEN + \
+                         slot * slotLen, slotLen, pBuff);
+}
+
+/**
+ * @brief Function to write a value on the next slot of a ring
+ *
+ * See @ref nvmRingPut. The slot is built on a buffer of the caller, so
+ * the ring is written with no other one on the stack.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register pointing to the ring
+ * @param[in] pValue The new value, of the length of the register
+ * @param[out] pBuff Buffer of @ref RING_SLOT_MAX bytes, not overlapping
+ *                   the value
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static gPNvm_Result nvmRingWrite(nvm_ctx_t *pCtx,
+                                 gPNvm_AttrId attrId,
+                                 const alloc_reg_t *pReg,
+                                 const UInt8 *pValue,
+                                 UInt8 *pBuff)
+{
+    UInt8 slot, seq;
+
+    //A ring without any valid slot starts over
+    if (nvmRingNewest(pCtx, attrId, pReg, pBuff, &slot, &seq))
+    {
+        slot = (UInt8)-1;
+        seq = (UInt8)-1;
+    }
+    memcpy(pBuff + 1, pValue, pReg->length);
+    return nvmRingPut(pCtx, attrId, pReg, pBuff, slot, seq);
+}
+
+/**
+ * @brief Function to patch bytes on a buffer
+ *
+ * @param[in,out] pDest The bytes to be patched
+ * @param[in] pValue The new bytes, or their XOR with the old ones
+ * @param[in] length Number of bytes
+ * @param[in] delta Non-zero if pValue holds the XOR of old and new bytes
+ * @return pDest, holding the new bytes
+ */
+static const UInt8 *nvmPatchBytes(UInt8 *pDest,
+                                  const UInt8 *pValue,
+                                  UInt8 length,
+                                  UInt8 delta)
+{
+    UInt8 i;
+
+    if (!delta)
+        memcpy(pDest, pValue, length);
+    for (i = 0; delta && (i < length); ++i)
+        pDest[i] ^= pValue[i];
+    return pDest;
+}
+
+/**
+ * @brief Function to patch a value in place, updating its trailer
+ *
+ * With a CRC, only the old bytes of the range and the stored CRC are
+ * read. The CRC is linear, so the CRC of the changes (old XOR new bytes),
+ * extended by the bytes after them (@ref shiftCRC16), is XORed into the
+ * stored one. A value already corrupted stays detected, with the same
+ * syndrome.
+ * With SECDED, the blocks touched by the range are read with their check
+ * bytes, corrected if needed, and their check bytes calculated again.
+ * A sealed value is opened, patched and sealed again as a whole: its
+ * tag covers all of it, and so does the keystream it selects.
+ * The runs of a delta are patched the same way, as the XOR of old and
+ * new bytes (see @ref nvmDeltaFold).
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] mode Integrity mode of the value
+ * @param[in] start Address of the value
+ * @param[in] valueLen Length of the whole value
+ * @param[in] offset First byte to be changed
+ * @param[in] length Number of bytes to be changed
+ * @param[in] pValue The new bytes, or their XOR with the old ones
+ * @param[in] delta Non-zero if pValue holds the XOR of old and new bytes
+ * @param[out] pBuff Scratch buffer: @e length bytes with a CRC, the
+ *                   blocks touched with SECDED (up to @e length + 14),
+ *                   @ref MAX_VALUE_LENGTH bytes if sealed
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static gPNvm_Result nvmPatchValue(nvm_ctx_t *pCtx,
+                                  gPNvm_AttrId attrId,
+                                  UInt8 mode,
+                                  UInt16 start,
+                                  UInt8 valueLen,
+                                  UInt8 offset,
+                                  UInt8 length,
+                                  const UInt8 *pValue,
+                                  UInt8 delta,
+                                  UInt8 *pBuff)
+{
+    UInt8 trailer[NVM_MAX_TRAILER_LEN];
+    UInt8 trailerLen = nvmIntegrityLen(mode, valueLen);
+    UInt8 first = 0, blocksLen;
+    const UInt8 *pDiff;
+    UInt16 crc16, end;
+    UInt32 crc32;
+    UInt8 i;
+
+    if (mode == NVM_INTEGRITY_SEALED)
+    {
+        if ((valueLen != CTX_READ(pCtx, start, valueLen, pBuff)) || \
+            (trailerLen != CTX_READ(pCtx, start + valueLen, trailerLen, \
+                                    trailer)) || \
+            (nvmTrailerCheck(pCtx, attrId, pBuff, valueLen, trailer) == 0xFF))
+            return 0xFF;
+        nvmPatchBytes(pBuff + offset, pValue, length, delta);
+        if (nvmTrailerEncode(pCtx, attrId, pBuff, valueLen, trailer))
+            return 0xFF;
+        offset = 0;
+        length = valueLen;
+        pValue = pBuff;
+    }
+    else if (mode == NVM_INTEGRITY_SECDED)
+    {
+        //Whole blocks, from the one holding the first byte changed
+        first = offset / 8;
+        end = (offset + length + 7) & ~7;
+        blocksLen = ((end < valueLen) ? end : valueLen) - first * 8;
+        trailerLen = nvmIntegrityLen(mode, blocksLen);
+        if ((blocksLen != CTX_READ(pCtx, start + first * 8, blocksLen, \
+                                   pBuff)) || \
+            (trailerLen != CTX_READ(pCtx, start + valueLen + first, \
+                                    trailerLen, trailer)))
+            return 0xFF;
+        if (nvmIntegrityCheck(mode, pBuff, blocksLen, trailer) == 0xFF)
+            return 0xFF;
+        pValue = nvmPatchBytes(pBuff + offset - first * 8, pValue, length, \
+                               delta);
+        nvmIntegrityEncode(mode, pBuff, blocksLen, trailer);
+    }
+    else
+    {
+        if ((length != CTX_READ(pCtx, start + offset, length, pBuff)) || \
+            (trailerLen != CTX_READ(pCtx, start + valueLen, trailerLen, \
+                                    trailer)))
+            return 0xFF;
+        //The changes are the XOR of old and new bytes, either way
+        for (i = 0; i < length; ++i)
+            pBuff[i] ^= pValue[i];
+        pDiff = delta ? pValue : pBuff;
+        if (mode == NVM_INTEGRITY_CRC32C)
+        {
+            memcpy(&crc32, trailer, sizeof(crc32));
+            crc32 ^= shiftCRC32C(updateCRC32C(0, (UInt8 *)pDiff, length), \
+                                 valueLen - offset - length);
+            memcpy(trailer, &crc32, sizeof(crc32));
+        }
+        else
+        {
+            memcpy(&crc16, trailer, sizeof(crc16));
+            crc16 ^= shiftCRC16(calcCRC16((UInt8 *)pDiff, length), \
+                                valueLen - offset - length);
+            memcpy(trailer, &crc16, sizeof(crc16));
+        }
+        if (delta)
+            pValue = pBuff;
+    }
+
+    if ((length != CTX_WRITE(pCtx, start + offset, length, \
+                             (UInt8 *)pValue)) || \
+        (trailerLen != CTX_WRITE(pCtx, start + valueLen + first, \
+                                 trailerLen, trailer)))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to read the header of a delta record and check it
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] addr Address of the record
+ * @param[out] pHdr The header read
+ * @return Error code: 0 for success, 0xFF for a corrupted header
+ */
+static gPNvm_Result nvmDeltaHeader(nvm_ctx_t *pCtx,
+                                   UInt16 addr,
+                                   delta_header_t *pHdr)
+{
+    if ((DELTA_HEADER_LEN != CTX_READ(pCtx, addr, DELTA_HEADER_LEN, \
+                                      (UInt8 *)pHdr)) || \
+        (pHdr->crc != calcCRC16((UInt8 *)pHdr, DELTA_HEADER_LEN - \
+                                               sizeof(pHdr->crc))) || \
+        (pHdr->runsLen > DELTA_RUNS_MAX))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to walk a chain of deltas down to its whole value
+ *
+ * Only the headers are read. Each record was appended after the one it
+ * applies to, so the chain goes down the values area, one depth at a
+ * time; anything else is a corrupted chain.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pReg The register pointing to the newest delta
+ * @param[out] pBase Address of the whole value
+ * @param[out] pBytes Bytes of the chain, whole value included
+ * @return Number of deltas, 0 if the chain is corrupted
+ */
+static int nvmDeltaChain(nvm_ctx_t *pCtx,
+                         const alloc_reg_t *pReg,
+                         UInt16 *pBase,
+                         UInt16 *pBytes)
+{
+    delta_header_t hdr;
+    UInt32 limit = APPEND_END, bytes = 0;
+    UInt16 addr = pReg->start;
+    int depth = 0, i;
+
+    for (i = 0; (i == 0) || (i < depth); ++i)
+    {
+        if ((addr < pCtx->valuesStart) || nvmDeltaHeader(pCtx, addr, &hdr))
+            return 0;
+        if (i == 0)
+            depth = hdr.depth;
+        if ((hdr.depth != depth - i) || !hdr.depth || \
+            (hdr.depth > NVM_DELTA_MAX_CHAIN) || \
+            ((UInt32)addr + DELTA_REC_LEN(pCtx, hdr.runsLen) > limit))
+            return 0;
+        bytes += DELTA_REC_LEN(pCtx, hdr.runsLen);
+        limit = addr;
+        addr = hdr.base;
+    }
+    if ((addr < pCtx->valuesStart) || \
+        ((UInt32)addr + REC_LEN(pCtx, pReg->length) > limit))
+        return 0;
+    *pBase = addr;
+    *pBytes = bytes + REC_LEN(pCtx, pReg->length);
+    return depth;
+}
+
+/**
+ * @brief Function to XOR a piece of the runs of a delta into its value
+ *
+ * A run may span several pieces, the cursor keeps track of it. On memory,
+ * each part of a run is patched by @ref nvmPatchValue, so the pieces are
+ * up to @ref DELTA_PIECE_LEN bytes and the value is not sealed.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in,out] pCur Where the runs are applied
+ * @param[in] pRuns The piece of the runs
+ * @param[in] n Length of the piece
+ * @return Error code: 0 for success, 0xFF for a run out of the value or
+ *         a failed patch
+ */
+static gPNvm_Result nvmDeltaXor(nvm_ctx_t *pCtx,
+                                gPNvm_AttrId attrId,
+                                delta_cursor_t *pCur,
+                                const UInt8 *pRuns,
+                                UInt8 n)
+{
+    UInt8 buff[2 * DELTA_PIECE_LEN];
+    UInt8 i = 0, j, count;
+
+    while (i < n)
+    {
+        //Offset, then count, of the next run
+        if (pCur->hdr == 0)
+            pCur->offset = pRuns[i++];
+        else if (pCur->hdr == 1)
+            pCur->left = pRuns[i++];
+        if (pCur->hdr < DELTA_RUN_HDR)
+        {
+            if ((++pCur->hdr == DELTA_RUN_HDR) && (!pCur->left || \
+                ((UInt16)pCur->offset + pCur->left > pCur->length)))
+                return 0xFF;
+            continue;
+        }
+        count = (pCur->left < n - i) ? pCur->left : n - i;
+        if (pCur->pValue)
+        {
+            for (j = 0; j < count; ++j)
+                pCur->pValue[pCur->offset + j] ^= pRuns[i + j];
+        }
+        else if (nvmPatchValue(pCtx, attrId, pCtx->integrity, pCur->dest, \
+                               pCur->length, pCur->offset, count, \
+                               pRuns + i, 1, buff))
+            return 0xFF;
+        pCur->offset += count;
+        pCur->left -= count;
+        i += count;
+        if (!pCur->left)
+            pCur->hdr = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to apply the runs of a sealed delta record
+ *
+ * Same as @ref nvmDeltaApply, but the runs are read whole and opened
+ * first: their tag covers all of them, and so does their keystream.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] addr Address of the record
+ * @param[in] pHdr Its header
+ * @param[in,out] pCur Where the runs are applied, on RAM
+ * @return Error code: 0 for success, 0xFF for unrecoverable error
+ */
+static NVM_NOINLINE gPNvm_Result nvmDeltaOpen(nvm_ctx_t *pCtx,
+                                              gPNvm_AttrId attrId,
+                                              UInt16 addr,
+                                              const delta_header_t *pHdr,
+                                              delta_cursor_t *pCur)
+{
+    UInt8 buff[DELTA_SCRATCH_LEN];
+
+    if (nvmReadBlock(pCtx, addr + DELTA_HEADER_LEN, pHdr->runsLen + \
+                     nvmIntegrityLen(pCtx->integrity, pHdr->runsLen), \
+                     buff) || \
+        (nvmTrailerCheck(pCtx, attrId, buff, pHdr->runsLen, \
+                         buff + pHdr->runsLen) == 0xFF) || \
+        nvmDeltaXor(pCtx, attrId, pCur, buff, pHdr->runsLen))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to apply the runs of a delta record to its value
+ *
+ * The runs are read @ref DELTA_PIECE_LEN bytes at a time (a SECDED block)
+ * and XORed into the value as they go, so no buffer holds them whole.
+ * With SECDED each block is checked and corrected on its own; a CRC is
+ * accumulated over the pieces and compared at the end. A record failing
+ * its check leaves the value partly patched, for the caller to discard.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] addr Address of the record
+ * @param[in] pHdr Its header
+ * @param[in,out] pCur Where the runs are applied
+ * @return Error code: 0 for success, 0xFF for unrecoverable error
+ */
+static gPNvm_Result nvmDeltaApply(nvm_ctx_t *pCtx,
+                                  gPNvm_AttrId attrId,
+                                  UInt16 addr,
+                                  const delta_header_t *pHdr,
+                                  delta_cursor_t *pCur)
+{
+    UInt8 piece[DELTA_PIECE_LEN];
+    UInt8 trailer[sizeof(UInt32)];
+    UInt8 mode = pCtx->integrity;
+    UInt8 trailerLen = nvmIntegrityLen(mode, pHdr->runsLen);
+    UInt16 runs = addr + DELTA_HEADER_LEN;
+    UInt16 crc16 = 0;
+    UInt32 crc32 = 0xFFFFFFFFUL;
+    UInt8 pos, n;
+
+    pCur->hdr = 0;
+    if (mode == NVM_INTEGRITY_SEALED)
+        return (nvmDeltaOpen(pCtx, attrId, addr, pHdr, pCur) || pCur->hdr) ? \
+               0xFF : 0;
+    for (pos = 0; pos < pHdr->runsLen; pos += n)
+    {
+        n = pHdr->runsLen - pos;
+        if (n > DELTA_PIECE_LEN)
+            n = DELTA_PIECE_LEN;
+        if (n != CTX_READ(pCtx, runs + pos, n, piece))
+            return 0xFF;
+        if (mode == NVM_INTEGRITY_SECDED)
+        {
+            //The check byte of the block, after the runs
+            if ((1 != CTX_READ(pCtx, runs + pHdr->runsLen + \
+                                     pos / DELTA_PIECE_LEN, 1, trailer)) || \
+                (nvmIntegrityCheck(mode, piece, n, trailer) == 0xFF))
+                return 0xFF;
+        }
+        else if (mode == NVM_INTEGRITY_CRC32C)
+            crc32 = updateCRC32C(crc32, piece, n);
+        else
+            crc16 = shiftCRC16(crc16, n) ^ calcCRC16(piece, n);
+        if (nvmDeltaXor(pCtx, attrId, pCur, piece, n))
+            return 0xFF;
+    }
+    //The last run must end with the runs
+    if (pCur->hdr)
+        return 0xFF;
+    if (mode == NVM_INTEGRITY_SECDED)
+        return 0;
+    crc32 = ~crc32;
+    if ((trailerLen != CTX_READ(pCtx, runs + pHdr->runsLen, trailerLen, \
+                                trailer)) || \
+        memcmp(trailer, (mode == NVM_INTEGRITY_CRC32C) ? (UInt8 *)&crc32 : \
+                        (UInt8 *)&crc16, trailerLen))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to apply the runs of every delta of a chain
+ *
+ * The runs are XORed into the whole value, so they can be applied in
+ * any order: they are, from the newest.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register pointing to the newest delta
+ * @param[in,out] pCur Where the runs are applied, holding the whole value
+ * @return Error code: 0 for success, 0xFF for unrecoverable error
+ */
+static gPNvm_Result nvmDeltaApplyAll(nvm_ctx_t *pCtx,
+                                     gPNvm_AttrId attrId,
+                                     const alloc_reg_t *pReg,
+                                     delta_cursor_t *pCur)
+{
+    delta_header_t hdr;
+    UInt16 addr;
+
+    pCur->length = pReg->length;
+    for (addr = pReg->start; !nvmDeltaHeader(pCtx, addr, &hdr); \
+         addr = hdr.base)
+    {
+        if (nvmDeltaApply(pCtx, attrId, addr, &hdr, pCur))
+            return 0xFF;
+        if (hdr.depth == 1)
+            return 0;
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to read a value kept as a chain of deltas
+ *
+ * The whole value at the bottom of the chain is read first, then the
+ * runs of each delta are XORed into it, piece by piece
+ * (see @ref nvmDeltaApply): no other buffer is needed. A register
+ * pointing to a whole value is read as is.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register, pointing to the newest delta or live
+ * @param[out] pValue The value, of the length of the register
+ * @return Error code: 0 for success, 0xFF for unrecoverable error
+ */
+static gPNvm_Result nvmDeltaRead(nvm_ctx_t *pCtx,
+                                 gPNvm_AttrId attrId,
+                                 const alloc_reg_t *pReg,
+                                 UInt8 *pValue)
+{
+    delta_cursor_t cur;
+    UInt16 base, bytes;
+
+    if (!REG_IS_DELTA(*pReg))
+        return nvmReadRecord(pCtx, attrId, pReg->start, pReg->length, \
+                             pValue);
+    if (!nvmDeltaChain(pCtx, pReg, &base, &bytes) || \
+        nvmReadRecord(pCtx, attrId, base, pReg->length, pValue))
+        return 0xFF;
+    cur.pValue = pValue;
+    return nvmDeltaApplyAll(pCtx, attrId, pReg, &cur);
+}
+
+/**
+ * @brief Function to encode the changes to a value as runs
+ *
+ * Each run is an offset, a count and the XOR of that many old and new
+ * bytes. A run goes on across up to @ref DELTA_GAP_MAX unchanged bytes,
+ * which cost no more than the header of another one.
+ * The runs are written over the current value, which starts
+ * @ref DELTA_RUN_HDR bytes into the buffer: a run takes its header more
+ * than the bytes it covers, and more unchanged bytes than a header are
+ * left between two runs, so the runs never catch up with the bytes
+ * still to be read.
+ *
+ * @param[in,out] pBuff The current value, from @ref DELTA_RUN_HDR bytes
+ *                      on, receiving the runs (up to @ref DELTA_RUNS_MAX
+ *                      bytes) from the beginning
+ * @param[in] pNew The new bytes
+ * @param[in] offset Offset of the new bytes on the value
+ * @param[in] length Number of new bytes
+ * @return Length of the runs, more than @ref DELTA_RUNS_MAX if they
+ *         don't fit
+ */
+static UInt16 nvmDeltaRuns(UInt8 *pBuff,
+                           const UInt8 *pNew,
+                           UInt8 offset,
+                           UInt8 length)
+{
+    const UInt8 *pOld = pBuff + DELTA_RUN_HDR + offset;
+    UInt8 *pRuns = pBuff;
+    UInt16 n = 0;
+    int i, j, end;
+
+    for (i = 0; i < length; i = end)
+    {
+        end = i + 1;
+        if (pOld[i] == pNew[i])
+            continue;
+        for (j = end; (j < length) && (j - end <= DELTA_GAP_MAX); ++j)
+        {
+            if (pOld[j] != pNew[j])
+                end = j + 1;
+        }
+        if (n + DELTA_RUN_HDR + end - i > DELTA_RUNS_MAX)
+            return DELTA_RUNS_MAX + 1;
+        pRuns[n++] = offset + i;
+        pRuns[n++] = end - i;
+        for (j = i; j < end; ++j)
+            pRuns[n++] = pOld[j] ^ pNew[j];
+    }
+    return n;
+}
+
+/**
+ * @brief Function to append a delta record over the current value
+ *
+ * The delta is appended only when its runs fit and it is shorter than
+ * the whole value. Its register is the commit point, as for a whole
+ * value; the records below it stay live.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pOldReg Its current register, live or delta
+ * @param[in] depth Depth of the delta, see @ref nvmDeltaDepth
+ * @param[in,out] pRuns The runs, with room for their trailer (sealed in
+ *                      place if so)
+ * @param[in] n Length of the runs
+ * @param[in] commit Non-zero to switch, zero to leave the register staged
+ * @return Error code: 0 for success, 0xFF for error,
+ *         @ref DELTA_SKIPPED if the value is to be appended whole
+ */
+static gPNvm_Result nvmDeltaPut(nvm_ctx_t *pCtx,
+                                gPNvm_AttrId attrId,
+                                const alloc_reg_t *pOldReg,
+                                UInt8 depth,
+                                UInt8 *pRuns,
+                                UInt16 n,
+                                UInt8 commit)
+{
+    delta_header_t hdr;
+    alloc_reg_t aReg;
+    UInt32 start = nvmReadNextFree(pCtx);
+    UInt16 recLen = DELTA_REC_LEN(pCtx, n);
+
+    if ((n > DELTA_RUNS_MAX) || (recLen >= REC_LEN(pCtx, pOldReg->length)) || \
+        (start + recLen > APPEND_END))
+        return DELTA_SKIPPED;
+
+    hdr.base = pOldReg->start;
+    hdr.depth = depth;
+    hdr.runsLen = n;
+    hdr.crc = calcCRC16((UInt8 *)&hdr, DELTA_HEADER_LEN - sizeof(hdr.crc));
+    if (nvmTrailerEncode(pCtx, attrId, pRuns, n, pRuns + n) || \
+        (DELTA_HEADER_LEN != CTX_WRITE(pCtx, start, DELTA_HEADER_LEN, \
+                                       (UInt8 *)&hdr)) || \
+        nvmWriteBlock(pCtx, start + DELTA_HEADER_LEN, \
+                      recLen - DELTA_HEADER_LEN, pRuns))
+        return 0xFF;
+    nvmStageNextFree(pCtx, start + recLen);
+    pCtx->stats.liveBytes += recLen;
+    pCtx->stats.freeBytes -= recLen;
+    if (pCtx->heat[attrId] < 0xFF)
+        pCtx->heat[attrId]++;
+
+    aReg.start = start;
+    aReg.length = pOldReg->length;
+    aReg.crc = calcCRC8(((UInt8 *)&aReg), ALLOC_REG_NO_CRC) ^ ALLOC_CRC_DELTA;
+    if (nvmStageReg(pCtx, attrId, &aReg) || (commit && nvmCommit(pCtx)))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to read the value an allocation register points to
+ *
+ * This is the reading done by @ref gpNvm_GetAttribute, for attributes
+ * stored on the values area.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be read
+ * @param[in] length The length expected, 0 for any length
+ * @param[out] pLength the length of the value retrieved (in bytes)
+ * @param[out] pValue the value retrieved
+ * @return Error code: 0 for success, 0xFF for unrecoverable error,
+ *                     @ref NVM_ERR_NOT_FOUND if there is no value
+ */
+static gPNvm_Result nvmReadValue(nvm_ctx_t *pCtx,
+                                 gPNvm_AttrId attrId,
+                                 UInt8 length,
+                                 UInt8 *pLength,
+                                 UInt8 *pValue)
+{
+    alloc_reg_t readReg;
+    UInt8 buff[RING_SLOT_MAX];
+    UInt8 slot, seq;
+
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+
+    //retrieve the allocation register
+    nvmReadReg(pCtx, attrId, &readReg);
+    //checks whether it was ever written or was deleted, then its CRC
+    if (REG_IS_FREE(readReg))
+        return NVM_ERR_NOT_FOUND;
+    if ((!REG_IS_LIVE(readReg) && !REG_IS_RING(readReg) && \
+         !REG_IS_DELTA(readReg)) || (length && (readReg.length != length)))
+        return 0xFF;
+    *pLength = readReg.length;
+
+    if (REG_IS_DELTA(readReg))
+        return nvmDeltaRead(pCtx, attrId, &readReg, pValue);
+
+    if (REG_IS_RING(readReg))
+    {
+        if (nvmRingNewest(pCtx, attrId, &readReg, buff, &slot, &seq))
+            return 0xFF;
+        memcpy(pValue, buff + 1, readReg.length);
+        return 0;
+    }
+    return nvmReadRecord(pCtx, attrId, readReg.start, readReg.length, \
+                         pValue);
+}
+
 /**
  * @brief Function to retrieve a value from memory, based on a attrib
  *
- * This function reads the memory, looking for the information
- * saved under attribute. It first read the allocation register to
- * find out where the actual data is stored and its length.
- * It returns the Lenght and the Value stored for this Attribute.
- * There is an integrity checking on the allocation table, made by a CRC-8
- * If the CRC doesn't match, it means the register in corrupted, so it will
- * return an error.
- * There is another integrity checking on the actual data (value), achieved
- * by a CRC-16. If this CRC doesn't match, it means the data is corrupted.
- * This approach can be improved by using a CRC-correcting algorithm in a way
- * that it could identify 1-bit flip and correct it.
+ * This function reads the memory, looking for the information
+ * saved under attribute. It first read the allocation register to
+ * find out where the actual data is stored and its length.
+ * It returns the Lenght and the Value stored for this Attribute.
+ * There is an integrity checking on the allocation table, made by a CRC-8
+ * If the CRC doesn't match, it means the register in corrupted, so it will
+ * return an error.
+ * There is another integrity checking on the actual data (value), achieved
+ * by a CRC-16. If this CRC doesn't match, it means the data is corrupted.
+ * This approach can be improved by using a CRC-correcting algorithm in a way
+ * that it could identify 1-bit flip and correct it.
+ * Attributes declared as @e SLOT on the schema are read straight from
+ * their fixed slot instead.
+ * A schema attribute that was never written (or was deleted) returns the
+ * default value of the schema, so a freshly formatted memory reads as
+ * provisioned without anything being written to the values area.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be read
+ * @param[out] pLength the length of the value retrieved (in bytes)
+ * @param[out] pValue the value retrieved
+ * @return Error code: 0xFF for unrecoverable error,
+ *                     @ref NVM_ERR_NOT_FOUND if never written or deleted
+ *                     and not on the schema,
+ *                     positive for number of bits recovered by CRC correction
+**/
+gPNvm_Result gpNvmCtx_GetAttribute(nvm_ctx_t *pCtx,
+                                   gPNvm_AttrId attrId,
+                                   UInt8 *pLength,
+                                   UInt8 *pValue)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+    gPNvm_Result ret;
+
+    if (pAttr && pAttr->slot)
+    {
+        *pLength = pAttr->length;
+        ret = nvmSlotRead(pCtx, attrId, pAttr->slotAddr, pAttr->length, \
+                          pValue);
+    }
+    else
+        ret = nvmReadValue(pCtx, attrId, 0, pLength, pValue);
+
+    if (pAttr && (ret == NVM_ERR_NOT_FOUND))
+    {
+        *pLength = pAttr->length;
+        memcpy(pValue, pAttr->pDefault, pAttr->length);
+        ret = 0;
+    }
+    if (pCtx->trace.pFile)
+        nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_GET, attrId, \
+                       ((ret == 0xFF) || (ret == NVM_ERR_NOT_FOUND)) ? 0 : \
+                       *pLength, pValue, ret);
+    return ret;
+}
+
+/**
+ * @brief Function to retrieve a former value of an attribute
+ *
+ * Attributes declared with history on the schema keep their last values:
+ * each one is appended with a back-pointer to the value it replaced, so
+ * the former values are found by following the chain from the current
+ * one, without any extra write. Up to the history depth of the schema
+ * is kept by @ref gpNvm_Compact, older ones are reclaimed. A delete ends
+ * the chain; @ref gpNvm_PatchAttribute changes the current value without
+ * making a new version.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be read
+ * @param[in] version 0 for the current value (as @ref gpNvm_GetAttribute),
+ *                    1 for the one it replaced, and so on
+ * @param[out] pLength the length of the value retrieved (in bytes)
+ * @param[out] pValue the value retrieved
+ * @return Error code: 0 for success, 0xFF for unrecoverable error,
+ *                     @ref NVM_ERR_NOT_FOUND if there is no such version
+**/
+gPNvm_Result gpNvmCtx_GetAttributeVersion(nvm_ctx_t *pCtx,
+                                          gPNvm_AttrId attrId,
+                                          UInt8 version,
+                                          UInt8 *pLength,
+                                          UInt8 *pValue)
+{
+    alloc_reg_t aReg;
+    UInt16 start;
+    gPNvm_Result ret;
+
+    if (!version)
+        return gpNvmCtx_GetAttribute(pCtx, attrId, pLength, pValue);
+    if (version > nvmSchemaHistory(attrId))
+        return NVM_ERR_NOT_FOUND;
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+
+    nvmReadReg(pCtx, attrId, &aReg);
+    if (REG_IS_FREE(aReg))
+        return NVM_ERR_NOT_FOUND;
+    if (!REG_IS_LIVE(aReg))
+        return 0xFF;
+    for (start = aReg.start; version; --version)
+    {
+        ret = nvmFormerValue(pCtx, start, aReg.length, &start);
+        if (ret)
+            return ret;
+    }
+    *pLength = aReg.length;
+
+    return nvmReadRecord(pCtx, attrId, start, aReg.length, pValue);
+}
+
+/**
+ * @brief Function to read an attribute of a known length
+ *
+ * Used by the typed getters of @e APPEND schema attributes: a value
+ * stored with any other length is reported as an error, instead of
+ * overflowing the typed buffer.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be read
+ * @param[in] length The length of its type
+ * @param[out] pValue the value retrieved
+ * @return Same as @ref gpNvm_GetAttribute
+ */
+gPNvm_Result nvmGetFixed(nvm_ctx_t *pCtx,
+                         gPNvm_AttrId attrId,
+                         UInt8 length,
+                         UInt8 *pValue)
+{
+    UInt8 readLen;
+
+    return nvmReadValue(pCtx, attrId, length, &readLen, pValue);
+}
+
+/**
+ * @brief Function to store a value in the memory, based on a Attribute
+ *
+ * This function writes a value into the memory, under an Attribute.
+ * It returns the number of bytes actually written.
+ * In order to write the data, it first reads the special address memory
+ * @ref NEXT_FREE_ADDR which holds the next available address on the memory.
+ * The value is always appended there, followed by its CRC-16, so the
+ * previous copy (if any) is left untouched while the new one is written.
+ * Then @ref NEXT_FREE_ADDR is updated summing the length, and only in the
+ * end the allocation register is rewritten, pointing to the new copy.
+ * This single 4-byte write is the commit point: a reset before it keeps
+ * the previous value (the new bytes are just leaked), a reset after it
+ * finds the new one complete. Since every write is a relocation, the
+ * length may change from one write to the next; the replaced copy is
+ * accounted as garbage, to be reclaimed by @ref gpNvm_Compact.
+ * The CRC-8 is calculated over the allocation rergister before storing it.
+ * This is meant to check the integrity on the future readings.
+ * A CRC-16 is also calculated over the value bytes, and this CRC is appended
+ * in the end of the value. This is intended to guarantee the data integrity
+ * on the future readings.
+ * An improvement could be done here, changing this
+ * method to a CRC-correcting, an algorithm that can identify a 1-bit flip
+ * and correct it.
+ * Attributes on the schema must be written with the size of their type;
+ * @e SLOT ones are overwritten on their fixed slot. Those with history
+ * get the address of the replaced copy before the value (see
+ * @ref gpNvm_GetAttributeVersion). Attributes pinned to a ring keep their
+ * length, and are written on their next slot (see
+ * @ref gpNvm_ReserveAttribute). A value changing a few bytes of the
+ * current one may be appended as a delta (see @ref gpNvm_SetDeltaChain).
+ *
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be saved
+ * @param[in] length The length of the value to be saved, in bytes.
+ *                   Up to @ref MAX_VALUE_LENGTH, 0xFF not allowed (reserved).
+ * @param[in] pValue Pointer to the value to be saved
+ * @return Error code: 0 for success,
+ *                     0xFF for error (bad length, corrupted value, failed
+ *                     write),
+ *                     @ref NVM_ERR_NO_SPACE if the value doesn't fit on
+ *                     the free space
+ *
+**/
+gPNvm_Result gpNvmCtx_SetAttribute(nvm_ctx_t *pCtx,
+                                   gPNvm_AttrId attrId,
+                                   UInt8 length,
+                                   UInt8 *pValue)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+    gPNvm_Result ret;
+
+    if ((length > MAX_VALUE_LENGTH) || (pAttr && (length != pAttr->length)))
+        ret = 0xFF;
+    else if (pAttr && pAttr->slot)
+        ret = nvmDurable(pCtx, nvmSlotWrite(pCtx, attrId, pAttr->slotAddr, \
+                                            length, pValue));
+    else
+        ret = nvmDurable(pCtx, nvmSetFixed(pCtx, attrId, length, pValue));
+
+    if (pCtx->trace.pFile)
+        nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_SET, attrId, length, \
+                       pValue, ret);
+    return nvmChanged(pCtx, attrId, ret);
+}
+
+/**
+ * @brief Function to find the depth of the next delta of an attribute
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg Its current register
+ * @return Depth of a delta over its current value, 0 if it can't have
+ *         one (no deltas, history, chain as long as allowed, no value)
+ */
+static UInt8 nvmDeltaDepth(nvm_ctx_t *pCtx,
+                           gPNvm_AttrId attrId,
+                           const alloc_reg_t *pReg)
+{
+    delta_header_t hdr;
+
+    if (!pCtx->deltaChain || HIST_LEN(attrId))
+        return 0;
+    if (REG_IS_LIVE(*pReg))
+        return 1;
+    if (!REG_IS_DELTA(*pReg) || nvmDeltaHeader(pCtx, pReg->start, &hdr) || \
+        (hdr.depth >= pCtx->deltaChain))
+        return 0;
+    return hdr.depth + 1;
+}
+
+/**
+ * @brief Function to append a whole value from a buffer
+ *
+ * This is the append described on @ref gpNvm_SetAttribute. The replaced
+ * copy, or the whole chain of deltas, turns into garbage.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be saved
+ * @param[in] pOldReg Its current register
+ * @param[in] length The length of the value, up to @ref MAX_VALUE_LENGTH
+ * @param[in,out] pBuff The value, with room for its trailer (sealed in
+ *                      place if so)
+ * @param[in] commit Non-zero to switch, zero to leave the register staged
+ * @return Same as @ref gpNvm_SetAttribute
+ */
+static gPNvm_Result nvmAppendWhole(nvm_ctx_t *pCtx,
+                                   gPNvm_AttrId attrId,
+                                   const alloc_reg_t *pOldReg,
+                                   UInt8 length,
+                                   UInt8 *pBuff,
+                                   UInt8 commit)
+{
+    UInt32 start;
+    UInt16 former, base, oldLen = 0;
+    UInt8 trailerLen = nvmIntegrityLen(pCtx->integrity, length);
+    UInt8 histLen = HIST_LEN(attrId);
+    alloc_reg_t aReg;
+
+    if (REG_IS_LIVE(*pOldReg))
+        oldLen = histLen + REC_LEN(pCtx, pOldReg->length);
+    else if (REG_IS_DELTA(*pOldReg))
+        nvmDeltaChain(pCtx, pOldReg, &base, &oldLen);
+
+    //retrieve the next available address, making sure the value fits
+    start = nvmReadNextFree(pCtx) + histLen;
+    if ((start + length + trailerLen) > APPEND_END)
+        return NVM_ERR_NO_SPACE;
+    aReg.start = start;
+    aReg.length = length;
+    aReg.crc = calcCRC8(((UInt8 *)&aReg), ALLOC_REG_NO_CRC);
+
+    //Link the copy being replaced, if the attribute keeps its history
+    former = REG_IS_LIVE(*pOldReg) ? pOldReg->start : 0xFFFF;
+    if (histLen && (histLen != CTX_WRITE(pCtx, start - histLen, histLen, \
+                                         (UInt8 *)&former)))
+        return 0xFF;
+
+    //Store the value and its trailer (CRC-16 by default)
+    if (nvmTrailerEncode(pCtx, attrId, pBuff, length, pBuff + length) || \
+        nvmWriteBlock(pCtx, aReg.start, length + trailerLen, pBuff))
+      return 0xFF;
+
+    //update the next available address
+    nvmStageNextFree(pCtx, start + length + trailerLen);
+    pCtx->stats.liveBytes += histLen + length + trailerLen;
+    pCtx->stats.freeBytes -= histLen + length + trailerLen;
+
+    //Store the allocation register, switching to the new copy
+    if (nvmStageReg(pCtx, attrId, &aReg) || (commit && nvmCommit(pCtx)))
+      return 0xFF;
+
+    //The copy just replaced turns into garbage
+    pCtx->stats.liveBytes -= oldLen;
+    pCtx->stats.deadBytes += oldLen;
+    if (pCtx->heat[attrId] < 0xFF)
+        pCtx->heat[attrId]++;
+
+    return 0;
+}
+
+/**
+ * @brief Function to append a value, leaving the switch to the caller
+ *
+ * Same as @ref nvmSetFixed, but in A/B mode the register may be left
+ * staged, for a single switch to make several values effective at once.
+ * A value of the length of the current one is compared with it first,
+ * and only the runs of its changes are appended if that is shorter (see
+ * @ref gpNvm_SetDeltaChain).
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be saved
+ * @param[in] length The length of the value, up to @ref MAX_VALUE_LENGTH
+ * @param[in] pValue Pointer to the value to be saved
+ * @param[in] commit Non-zero to switch, zero to leave the register staged
+ * @return Same as @ref gpNvm_SetAttribute
+ */
+static gPNvm_Result nvmAppend(nvm_ctx_t *pCtx,
+                              gPNvm_AttrId attrId,
+                              UInt8 length,
+                              const UInt8 *pValue,
+                              UInt8 commit)
+{
+    UInt8 buff[RING_SLOT_MAX];
+    alloc_reg_t oldReg;
+    gPNvm_Result ret;
+    UInt8 depth;
+
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+
+    //retrieve the current allocation register, to account its garbage
+    nvmReadReg(pCtx, attrId, &oldReg);
+    //An attribute pinned to a ring only has its next slot written
+    if (REG_IS_RING(oldReg))
+        return (length == oldReg.length) ? \
+               nvmRingWrite(pCtx, attrId, &oldReg, pValue, buff) : 0xFF;
+
+    //A change to a value of the same length may go as a delta, its runs
+    //built over the current value
+    depth = (length == oldReg.length) ? \
+            nvmDeltaDepth(pCtx, attrId, &oldReg) : 0;
+    if (depth && \
+        !nvmDeltaRead(pCtx, attrId, &oldReg, buff + DELTA_RUN_HDR))
+    {
+        ret = nvmDeltaPut(pCtx, attrId, &oldReg, depth, buff, \
+                          nvmDeltaRuns(buff, pValue, 0, length), commit);
+        if (ret != DELTA_SKIPPED)
+            return ret;
+    }
+
+    //A copy is stored, sealed in place if so
+    memcpy(buff, pValue, length);
+    return nvmAppendWhole(pCtx, attrId, &oldReg, length, buff, commit);
+}
+
+/**
+ * @brief Function to patch a value kept as a chain of deltas
+ *
+ * The patch is appended as a delta of its own, with the runs of the
+ * bytes it changes, or the patched value is appended whole.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg Its register, pointing to the newest delta
+ * @param[in] offset First byte to be changed
+ * @param[in] length Number of bytes to be changed
+ * @param[in] pValue The new bytes
+ * @param[out] pBuff Buffer of @ref RING_SLOT_MAX bytes
+ * @return Error code: 0 for success, 0xFF for error,
+ *         @ref NVM_ERR_NO_SPACE if the value doesn't fit
+ */
+static gPNvm_Result nvmDeltaPatch(nvm_ctx_t *pCtx,
+                                  gPNvm_AttrId attrId,
+                                  const alloc_reg_t *pReg,
+                                  UInt8 offset,
+                                  UInt8 length,
+                                  const UInt8 *pValue,
+                                  UInt8 *pBuff)
+{
+    UInt8 depth = nvmDeltaDepth(pCtx, attrId, pReg);
+    gPNvm_Result ret;
+
+    if (depth)
+    {
+        if (nvmDeltaRead(pCtx, attrId, pReg, pBuff + DELTA_RUN_HDR))
+            return 0xFF;
+        ret = nvmDeltaPut(pCtx, attrId, pReg, depth, pBuff, \
+                          nvmDeltaRuns(pBuff, pValue, offset, length), 1);
+        if (ret != DELTA_SKIPPED)
+            return ret;
+    }
+    //The runs were built over the value, so it is read again
+    if (nvmDeltaRead(pCtx, attrId, pReg, pBuff))
+        return 0xFF;
+    memcpy(pBuff + offset, pValue, length);
+    return nvmAppendWhole(pCtx, attrId, pReg, pReg->length, pBuff, 1);
+}
+
+/**
+ * @brief Function to append a value to the values area
+ *
+ * This is the writing described on @ref gpNvm_SetAttribute, done without
+ * looking the attribute up on the schema. The typed setters of
+ * @e APPEND schema attributes call it directly.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be saved
+ * @param[in] length The length of the value, up to @ref MAX_VALUE_LENGTH
+ * @param[in] pValue Pointer to the value to be saved
+ * @return Same as @ref gpNvm_SetAttribute
+ */
+gPNvm_Result nvmSetFixed(nvm_ctx_t *pCtx,
+                         gPNvm_AttrId attrId,
+                         UInt8 length,
+                         const UInt8 *pValue)
+{
+    return nvmAppend(pCtx, attrId, length, pValue, 1);
+}
+
+/**
+ * @brief Function to retrieve several values at once
+ *
+ * The values on the values area are read in address order, each run of
+ * values close to each other by a single sequential read, once the
+ * backend was asked to prefetch their whole range. A group laid out
+ * contiguously, by @ref gpNvm_SetAttributes or by compaction (see
+ * @ref gpNvm_SetGroup), is thus read at once. Each value is checked as
+ * by @ref gpNvm_GetAttribute; schema slots, rings, attributes with no
+ * value and values failing the check go through that function instead.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in,out] pBatch The attributes, receiving their values
+ * @param[in] count Number of attributes, up to @ref NVM_BATCH_MAX
+ * @return Error code: 0 if every attribute got its result (each one
+ *         with its own), 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_GetAttributes(nvm_ctx_t *pCtx,
+                                    gpNvm_Batch_t *pBatch,
+                                    UInt8 count)
+{
+    const nvm_schema_attr_t *pAttr;
+    UInt8 buff[GROUP_READ_MAX];
+    UInt16 start[NVM_BATCH_MAX];
+    UInt8 order[NVM_BATCH_MAX];
+    gpNvm_Batch_t *pGet;
+    alloc_reg_t reg;
+    UInt32 runStart, runEnd, end;
+    UInt8 readErr;
+    int i, j, k, n = 0;
+
+    if ((count > NVM_BATCH_MAX) || (!pCtx->mounted && gpNvmCtx_Mount(pCtx)))
+        return 0xFF;
+
+    //Sort the values on the values area by address, get the others
+    for (i = 0; i < count; ++i)
+    {
+        pGet = &pBatch[i];
+        pAttr = nvmSchemaFind(pGet->attrId);
+        nvmReadReg(pCtx, pGet->attrId, &reg);
+        if (!(pAttr && pAttr->slot) && REG_IS_DELTA(reg))
+        {
+            //A chain of deltas is read on its own, through the buffer
+            pGet->length = reg.length;
+            pGet->result = nvmDeltaRead(pCtx, pGet->attrId, &reg, \
+                                        pGet->pValue);
+            if (pCtx->trace.pFile)
+                nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_GET, pGet->attrId, \
+                               pGet->result ? 0 : pGet->length, \
+                               pGet->pValue, pGet->result);
+            continue;
+        }
+        if ((pAttr && pAttr->slot) || !REG_IS_LIVE(reg))
+        {
+            pGet->result = gpNvmCtx_GetAttribute(pCtx, pGet->attrId, \
+                                                 &pGet->length, pGet->pValue);
+            continue;
+        }
+        pGet->length = reg.length;
+        start[i] = reg.start;
+        for (j = n++; (j > 0) && (start[order[j - 1]] > reg.start); --j)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    if (!n)
+        return 0;
+    end = start[order[n - 1]] + REC_LEN(pCtx, pBatch[order[n - 1]].length);
+    pCtx->mem.pOps->prefetch(&pCtx->mem, start[order[0]], \
+                             end - start[order[0]]);
+
+    for (i = 0; i < n; i = j)
+    {
+        //A run of values close enough to each other to be read at once
+        runStart = start[order[i]];
+        runEnd = runStart + REC_LEN(pCtx, pBatch[order[i]].length);
+        for (j = i + 1; j < n; ++j)
+        {
+            end = start[order[j]] + REC_LEN(pCtx, pBatch[order[j]].length);
+            if ((start[order[j]] > runEnd + GROUP_GAP_MAX) || \
+                (end - runStart > GROUP_READ_MAX))
+                break;
+            if (end > runEnd)
+                runEnd = end;
+        }
+        readErr = nvmReadBlock(pCtx, runStart, runEnd - runStart, buff);
+
+        for (k = i; k < j; ++k)
+        {
+            pGet = &pBatch[order[k]];
+            end = start[order[k]] - runStart;
+            memcpy(pGet->pValue, buff + end, pGet->length);
+            if (readErr || (nvmTrailerCheck(pCtx, pGet->attrId, \
+                                            pGet->pValue, pGet->length, \
+                                            buff + end + pGet->length) == 0xFF))
+            {
+                pGet->result = gpNvmCtx_GetAttribute(pCtx, pGet->attrId, \
+                                                     &pGet->length, \
+                                                     pGet->pValue);
+                continue;
+            }
+            pGet->result = 0;
+            if (pCtx->trace.pFile)
+                nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_GET, pGet->attrId, \
+                               pGet->length, pGet->pValue, 0);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to store several values at once
+ *
+ * The values are appended one after the other, so
+ * @ref gpNvm_GetAttributes reads them back at once, and in A/B mode a
+ * single switch makes all of them effective: after a reset, either all
+ * of them or none are found. If a length is wrong, nothing is written
+ * and every result is 0xFF; if they don't fit all together, every
+ * result is @ref NVM_ERR_NO_SPACE. If an append fails, the switch is
+ * not made and every result is that of the append. With a single table
+ * each register is written with its value, so only the values after the
+ * one failing are left out. Schema slots and rings are written in place
+ * once the switch is made, each one on its own, as by
+ * @ref gpNvm_SetAttribute.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in,out] pBatch The attributes and their values, receiving the
+ *                       results
+ * @param[in] count Number of attributes, up to @ref NVM_BATCH_MAX
+ * @return Error code: 0 if every value was stored, otherwise the first
+ *         result that is not 0
+**/
+gPNvm_Result gpNvmCtx_SetAttributes(nvm_ctx_t *pCtx,
+                                    gpNvm_Batch_t *pBatch,
+                                    UInt8 count)
+{
+    const nvm_schema_attr_t *pAttr;
+    gpNvm_Batch_t *pSet;
+    alloc_reg_t reg;
+    UInt8 inPlace[(NVM_BATCH_MAX + 7) / 8] = {0};
+    UInt32 needed = 0;
+    gPNvm_Result ret = 0;
+    int i, kept = 0;
+
+    if ((count > NVM_BATCH_MAX) || (!pCtx->mounted && gpNvmCtx_Mount(pCtx)))
+        return 0xFF;
+
+    //Every length must be right, and the values appended fit together
+    for (i = 0; (i < count) && !ret; ++i)
+    {
+        pSet = &pBatch[i];
+        pAttr = nvmSchemaFind(pSet->attrId);
+        nvmReadReg(pCtx, pSet->attrId, &reg);
+        if ((pSet->length > MAX_VALUE_LENGTH) || \
+            (pAttr && (pSet->length != pAttr->length)))
+            ret = 0xFF;
+        else if ((pAttr && pAttr->slot) || REG_IS_RING(reg))
+            inPlace[i >> 3] |= 1 << (i & 7);
+        else
+            needed += HIST_LEN(pSet->attrId) + REC_LEN(pCtx, pSet->length);
+    }
+    if (!ret && (nvmReadNextFree(pCtx) + needed > APPEND_END))
+        ret = NVM_ERR_NO_SPACE;
+
+    //The values appended first, their registers staged for one switch
+    for (i = 0; (i < count) && !ret; ++i)
+    {
+        pSet = &pBatch[i];
+        if (!REG_BIT(inPlace, i))
+            ret = pSet->result = nvmAppend(pCtx, pSet->attrId, \
+                                           pSet->length, pSet->pValue, 0);
+        //With a single table, the values appended before stay
+        if (ret && (pCtx->tableMode != NVM_TABLE_AB))
+            kept = i;
+        else if (ret)
+            pCtx->mounted = 0; //Mounting again drops the registers staged
+    }
+    if (!ret && nvmCommit(pCtx))
+    {
+        ret = 0xFF;
+        pCtx->mounted = 0;
+    }
+
+    for (i = 0; (i < count) && !ret; ++i)
+    {
+        pSet = &pBatch[i];
+        pAttr = nvmSchemaFind(pSet->attrId);
+        //Then the slots and the rings, written in place
+        if (!REG_BIT(inPlace, i))
+            continue;
+        if (pAttr && pAttr->slot)
+            pSet->result = nvmSlotWrite(pCtx, pSet->attrId, pAttr->slotAddr, \
+                                        pSet->length, pSet->pValue);
+        else
+            pSet->result = nvmAppend(pCtx, pSet->attrId, pSet->length, \
+                                     pSet->pValue, 0);
+    }
+    ret = nvmDurable(pCtx, ret);
+
+    for (i = 0; i < count; ++i)
+    {
+        pSet = &pBatch[i];
+        if (ret && ((i >= kept) || REG_BIT(inPlace, i)))
+            pSet->result = ret;
+        if (pCtx->trace.pFile)
+            nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_SET, pSet->attrId, \
+                           pSet->length, pSet->pValue, pSet->result);
+    }
+    //Subscribers hear of the batch once it is all committed
+    for (i = 0; i < count; ++i)
+        nvmChanged(pCtx, pBatch[i].attrId, pBatch[i].result);
+    for (i = 0; (i < count) && !ret; ++i)
+        ret = pBatch[i].result;
+    return ret;
+}
+
+/**
+ * @brief Function to put an attribute in a placement group
+ *
+ * Attributes read together, such as a configuration, can be put in the
+ * same group (1 to 255): compaction then lays their values out
+ * contiguously (see @ref gpNvm_Compact), so @ref gpNvm_GetAttributes
+ * reads them at once. Groups are a placement hint kept in RAM only, to
+ * be given again after every setup; group 0 takes the attribute out of
+ * its group. Schema slots have a fixed place, they can't be grouped.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] group Its group, 0 for none
+ * @return Error code: 0 for success, 0xFF for a schema slot
+**/
+gPNvm_Result gpNvmCtx_SetGroup(nvm_ctx_t *pCtx,
+                               gPNvm_AttrId attrId,
+                               UInt8 group)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+
+    if (pAttr && pAttr->slot)
+        return 0xFF;
+    pCtx->group[attrId] = group;
+    return 0;
+}
+
+/**
+ * @brief Function to subscribe to the changes of a range of attributes
+ *
+ * Instead of polling the values, a consumer is called back once per
+ * committed change of an attribute of the range: a set (each value of a
+ * batch, once the whole batch is committed), a patch, a delete, or a
+ * format (every attribute). Moving values around, as compaction does,
+ * is no change. The callback runs on the thread making the change, once
+ * the call is complete; a consumer on another thread can forward it to
+ * an eventfd or a pipe. Subscriptions are kept in RAM only.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] first First attribute of the range
+ * @param[in] last Last attribute of the range
+ * @param[in] notify The callback
+ * @param[in] pArg Its first argument
+ * @return Error code: 0 for success, 0xFF for an empty range or if
+ *         there are @ref NVM_SUBSCRIBERS_MAX subscriptions already
+**/
+gPNvm_Result gpNvmCtx_Subscribe(nvm_ctx_t *pCtx,
+                                gPNvm_AttrId first,
+                                gPNvm_AttrId last,
+                                gpNvm_Notify_t notify,
+                                void *pArg)
+{
+    nvm_subscriber_t *pSub;
+    int i;
+
+    if (!notify || (first > last))
+        return 0xFF;
+    for (i = 0; i < NVM_SUBSCRIBERS_MAX; ++i)
+    {
+        pSub = &pCtx->subs[i];
+        if (pSub->notify)
+            continue;
+        pSub->notify = notify;
+        pSub->pArg = pArg;
+        pSub->first = first;
+        pSub->last = last;
+        return 0;
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to cancel the subscriptions of a callback
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] notify The callback
+ * @param[in] pArg The argument it was subscribed with
+ * @return Error code: 0 for success, @ref NVM_ERR_NOT_FOUND if there
+ *         was no such subscription
+**/
+gPNvm_Result gpNvmCtx_Unsubscribe(nvm_ctx_t *pCtx,
+                                  gpNvm_Notify_t notify,
+                                  void *pArg)
+{
+    gPNvm_Result ret = NVM_ERR_NOT_FOUND;
+    int i;
+
+    for (i = 0; i < NVM_SUBSCRIBERS_MAX; ++i)
+    {
+        if ((pCtx->subs[i].notify == notify) && (pCtx->subs[i].pArg == pArg))
+        {
+            pCtx->subs[i].notify = NULL;
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Function to get the change counter of an attribute
+ *
+ * The counter is incremented on every change reported to the
+ * subscribers (see @ref gpNvm_Subscribe), so "changed since" is a
+ * comparison with a counter read before, with no memory access. It is
+ * kept in RAM only, starts at 0 when the instance is set up, and wraps
+ * around after 65535 changes.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[out] pChange Its change counter
+ * @return Error code: 0 for success
+**/
+gPNvm_Result gpNvmCtx_GetChange(nvm_ctx_t *pCtx,
+                                gPNvm_AttrId attrId,
+                                UInt16 *pChange)
+{
+    *pChange = pCtx->change[attrId];
+    return 0;
+}
+
+/**
+ * @brief Function to let small changes be appended as deltas
+ *
+ * Every set appends the whole value, even when a few bytes of a large
+ * structure changed. Once a chain length is set, a set of a value of the
+ * same length as the current one appends only the runs of the bytes
+ * changed, as a delta record linked to the record it applies to (see
+ * @ref delta_header_t), when that is shorter than the whole value; the
+ * space taken grows with the change, not with the value. A get reads the
+ * whole value at the bottom of the chain and applies the deltas over it,
+ * so the chain length bounds the reads: the set that would make the
+ * chain longer appends the whole value again. Compaction folds every
+ * chain into a whole value. Attributes with history, schema slots and
+ * rings are always written whole. The setting is kept in RAM only,
+ * chains already on the memory are read whatever it is.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] maxChain Most deltas over a whole value, up to
+ *                     @ref NVM_DELTA_MAX_CHAIN; 0 (the default) for none
+ * @return Error code: 0 for success, 0xFF for a chain too long
+**/
+gPNvm_Result gpNvmCtx_SetDeltaChain(nvm_ctx_t *pCtx, UInt8 maxChain)
+{
+    if (maxChain > NVM_DELTA_MAX_CHAIN)
+        return 0xFF;
+    pCtx->deltaChain = maxChain;
+    return 0;
+}
+
+/**
+ * @brief Function to remove an attribute, as @ref gpNvm_DeleteAttribute
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be deleted
+ * @return Same as @ref gpNvm_DeleteAttribute
+ */
+static gPNvm_Result nvmDelete(nvm_ctx_t *pCtx, gPNvm_AttrId attrId)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+    alloc_reg_t aReg;
+    UInt16 base, recLen = 0;
+
+    if (pAttr && pAttr->slot)
+        return nvmDurable(pCtx, nvmSlotErase(pCtx, pAttr->slotAddr, \
+                                             pAttr->length));
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+
+    nvmReadReg(pCtx, attrId, &aReg);
+    if (REG_IS_RING(aReg))
+        recLen = nvmRingLen(pCtx, &aReg);
+    else if (REG_IS_LIVE(aReg))
+        recLen = HIST_LEN(attrId) + REC_LEN(pCtx, aReg.length);
+    else if (REG_IS_DELTA(aReg))
+        nvmDeltaChain(pCtx, &aReg, &base, &recLen);
+    else
+        return 0xFF;
+
+    aReg.length = ALLOC_LEN_FREE;
+    aReg.crc = calcCRC8(((UInt8 *)&aReg), ALLOC_REG_NO_CRC);
+    if (nvmStageReg(pCtx, attrId, &aReg) || nvmCommit(pCtx))
+        return 0xFF;
+    pCtx->stats.liveBytes -= recLen;
+    pCtx->stats.deadBytes += recLen;
+
+    return nvmDurable(pCtx, 0);
+}
+
+/**
+ * @brief Function to remove an attribute from the memory
+ *
+ * This function writes a tombstone on the allocation register of the
+ * attribute: the register keeps its start address, but the length is
+ * set to @ref ALLOC_LEN_FREE and the CRC-8 is recalculated. From now on
+ * @ref gpNvm_GetAttribute fails for this Id, until it is written again
+ * by @ref gpNvm_SetAttribute. The value bytes are accounted as garbage,
+ * to be reclaimed by @ref gpNvm_Compact.
+ * The fixed slot of a @e SLOT schema attribute is erased instead. A ring
+ * is dropped as a whole: the next set appends the attribute again. So is
+ * a chain of deltas.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be deleted
+ * @return Error code: 0 for success,
+ *                     0xFF if there is no valid value under this Id
+**/
+gPNvm_Result gpNvmCtx_DeleteAttribute(nvm_ctx_t *pCtx, gPNvm_AttrId attrId)
+{
+    gPNvm_Result ret = nvmDelete(pCtx, attrId);
+
+    if (pCtx->trace.pFile)
+        nvmTraceRecord(&pCtx->trace, NVM_TRACE_OP_DELETE, attrId, 0, NULL, \
+                       ret);
+    return nvmChanged(pCtx, attrId, ret);
+}
+
+/**
+ * @brief Function to change part of a value, in place
+ *
+ * This function overwrites @e length bytes of the value stored under an
+ * Attribute, starting at @e offset, leaving the rest of it as it is.
+ * Unlike @ref gpNvm_SetAttribute, the value is not appended again: only
+ * the changed bytes and the CRC are written, and the CRC is updated
+ * from the changed bytes alone (see @ref nvmPatchValue), so changing a
+ * field of a large structure costs as much as the field itself. In
+ * SECDED mode the blocks around the range are read as well.
+ * As with the @e SLOT attributes, this is not power-fail safe: a reset
+ * between writing the bytes and the CRC leaves the value with a CRC
+ * error. Attributes that must survive any reset should be set instead.
+ * On an attribute pinned to a ring, the patched value is written on the
+ * next slot, as a set would. On an attribute set as a delta, the patched
+ * value is set again, so the patch is appended as a delta of its own.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute to be changed
+ * @param[in] offset First byte to be changed
+ * @param[in] length Number of bytes to be changed, at least 1
+ * @param[in] pValue The new bytes
+ * @return Error code: 0 for success,
+ *                     0xFF for error (range out of the value, corrupted
+ *                     register),
+ *                     @ref NVM_ERR_NOT_FOUND if never written or deleted
+**/
+gPNvm_Result gpNvmCtx_PatchAttribute(nvm_ctx_t *pCtx,
+                                     gPNvm_AttrId attrId,
+                                     UInt8 offset,
+                                     UInt8 length,
+                                     UInt8 *pValue)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+    UInt8 buff[RING_SLOT_MAX];
+    UInt8 mode = SLOT_INTEGRITY(pCtx);
+    UInt8 slot, seq;
+    alloc_reg_t aReg;
+    gPNvm_Result ret;
+
+    if (pAttr && pAttr->slot)
+    {
+        //An erased slot has no trailer to be updated
+        ret = nvmSlotRead(pCtx, attrId, pAttr->slotAddr, pAttr->length, \
+                          buff);
+        if (ret == NVM_ERR_NOT_FOUND)
+            return ret;
+        aReg.start = pAttr->slotAddr;
+        aReg.length = pAttr->length;
+    }
+    else
+    {
+        if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+            return 0xFF;
+        nvmReadReg(pCtx, attrId, &aReg);
+        if (REG_IS_FREE(aReg))
+            return NVM_ERR_NOT_FOUND;
+        if (REG_IS_RING(aReg))
+        {
+            //The whole value goes to the next slot
+            if (!length || ((UInt16)offset + length > aReg.length) || \
+                nvmRingNewest(pCtx, attrId, &aReg, buff, &slot, &seq))
+                return 0xFF;
+            memcpy(buff + 1 + offset, pValue, length);
+            ret = nvmRingPut(pCtx, attrId, &aReg, buff, slot, seq);
+            return nvmChanged(pCtx, attrId, nvmDurable(pCtx, ret));
+        }
+        if (REG_IS_DELTA(aReg))
+        {
+            //The patch goes as a delta of its own, or the value whole
+            if (!length || ((UInt16)offset + length > aReg.length))
+                return 0xFF;
+            ret = nvmDeltaPatch(pCtx, attrId, &aReg, offset, length, \
+                                pValue, buff);
+            return nvmChanged(pCtx, attrId, nvmDurable(pCtx, ret));
+        }
+        if (!REG_IS_LIVE(aReg))
+            return 0xFF;
+        mode = pCtx->integrity;
+    }
+    if (!length || ((UInt16)offset + length > aReg.length))
+        return 0xFF;
+
+    ret = nvmPatchValue(pCtx, attrId, mode, aReg.start, aReg.length, \
+                        offset, length, pValue, 0, buff);
+    return nvmChanged(pCtx, attrId, nvmDurable(pCtx, ret));
+}
+
+/**
+ * @brief Function to pin an attribute to a ring of fixed slots
+ *
+ * Every set appends a new copy, rewriting @ref NEXT_FREE_ADDR and the
+ * allocation register as well. For an attribute written often with the
+ * same length, this function allocates a ring of @e slots slots, sized
+ * by the length of its current value (the first write sizes it), and
+ * points the register to it. From then on a set writes just the next
+ * slot of the ring: sequence number, value and trailer, in a single
+ * write, and a get reads the valid slot with the newest sequence number.
+ * One slot makes a fixed slot; more spread the wear over the ring.
+ * The ring is allocated with all its slots holding the current value,
+ * and the register is rewritten with @ref ALLOC_CRC_RING, marking it as
+ * a ring; that register write is the commit point, as for a set.
+ * Compaction moves the ring as a whole, and a delete drops it.
+ * Schema attributes with a fixed slot or with history can't be pinned.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] slots Number of slots, 1 to @ref NVM_MAX_RING_SLOTS
+ * @return Error code: 0 for success,
+ *                     0xFF for error (already pinned, corrupted value),
+ *                     @ref NVM_ERR_NOT_FOUND if never written or deleted,
+ *                     @ref NVM_ERR_NO_SPACE if the ring doesn't fit
+**/
+gPNvm_Result gpNvmCtx_ReserveAttribute(nvm_ctx_t *pCtx,
+                                       gPNvm_AttrId attrId,
+                                       UInt8 slots)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+    UInt8 buff[RING_SLOT_MAX];
+    UInt8 value[MAX_VALUE_LENGTH];
+    UInt8 hdr[RING_HEADER_LEN];
+    alloc_reg_t aReg;
+    UInt32 start;
+    UInt16 slotLen, ringLen, base, oldLen;
+    UInt8 i;
+
+    if (!slots || (slots > NVM_MAX_RING_SLOTS) || \
+        (pAttr && (pAttr->slot || pAttr->history)))
+        return 0xFF;
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+
+    nvmReadReg(pCtx, attrId, &aReg);
+    if (REG_IS_FREE(aReg))
+        return NVM_ERR_NOT_FOUND;
+    if (REG_IS_DELTA(aReg))
+    {
+        if (nvmDeltaRead(pCtx, attrId, &aReg, value) || \
+            !nvmDeltaChain(pCtx, &aReg, &base, &oldLen))
+            return 0xFF;
+    }
+    else if (!REG_IS_LIVE(aReg) || \
+             nvmReadRecord(pCtx, attrId, aReg.start, aReg.length, value))
+        return 0xFF;
+    else
+        oldLen = REC_LEN(pCtx, aReg.length);
+    slotLen = RING_SLOT_LEN(pCtx, aReg.length);
+    ringLen = RING_HEADER_LEN + slots * slotLen;
+    start = nvmReadNextFree(pCtx);
+    if ((start + ringLen) > APPEND_END)
+        return NVM_ERR_NO_SPACE;
+
+    //Every slot holds the current value, the last one is the newest
+    hdr[0] = slots;
+    hdr[1] = ~slots;
+    if (nvmWriteBlock(pCtx, start, RING_HEADER_LEN, hdr))
+        return 0xFF;
+    for (i = 0; i < slots; ++i)
+    {
+        buff[0] = i;
+        memcpy(buff + 1, value, aReg.length);
+        if (nvmTrailerEncode(pCtx, attrId, buff, aReg.length + 1, \
+                             buff + 1 + aReg.length) || \
+            nvmWriteBlock(pCtx, start + RING_HEADER_LEN + i * slotLen, \
+                          slotLen, buff))
+            return 0xFF;
+    }
+
+    nvmStageNextFree(pCtx, start + ringLen);
+    aReg.start = start;
+    aReg.crc = calcCRC8(((UInt8 *)&aReg), ALLOC_REG_NO_CRC) ^ ALLOC_CRC_RING;
+    if (nvmStageReg(pCtx, attrId, &aReg) || nvmCommit(pCtx))
+        return 0xFF;
+    pCtx->stats.liveBytes += ringLen - oldLen;
+    pCtx->stats.deadBytes += oldLen;
+    pCtx->stats.freeBytes -= ringLen;
+
+    return nvmDurable(pCtx, 0);
+}
+
+/**
+ * @brief Function to read a fixed slot of the schema area
+ *
+ * A slot holds the value followed by its CRC-16, on an address known at
+ * compile time. On a sealed memory the value is encrypted instead, and
+ * followed by its tag, just like the appended ones. A slot still erased
+ * (all 0xFF, trailer included) was never written.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] slotAddr Address of the slot
+ * @param[in] length Length of the value
+ * @param[out] pValue the value retrieved
+ * @return Error code: 0 for success, 0xFF for corrupted value,
+ *                     @ref NVM_ERR_NOT_FOUND if the slot is erased
+ */
+gPNvm_Result nvmSlotRead(nvm_ctx_t *pCtx,
+                         gPNvm_AttrId attrId,
+                         UInt16 slotAddr,
+                         UInt8 length,
+                         UInt8 *pValue)
+{
+    UInt8 trailer[NVM_SLOT_TRAILER_LEN];
+    UInt8 trailerLen = nvmIntegrityLen(SLOT_INTEGRITY(pCtx), length);
+    UInt16 crcRead;
+    UInt8 i, erased = 1;
+
+    if ((length != CTX_READ(pCtx, slotAddr, length, pValue)) || \
+        (trailerLen != CTX_READ(pCtx, slotAddr + length, trailerLen, \
+                                trailer)))
+        return 0xFF;
+    for (i = 0; i < length; ++i)
+        erased &= (pValue[i] == 0xFF);
+    for (i = 0; i < trailerLen; ++i)
+        erased &= (trailer[i] == 0xFF);
+
+    if (SLOT_INTEGRITY(pCtx) == NVM_INTEGRITY_SEALED)
+    {
+        if (erased)
+            return NVM_ERR_NOT_FOUND;
+        return nvmTrailerCheck(pCtx, attrId, pValue, length, trailer) ? \
+               0xFF : 0;
+    }
+    memcpy(&crcRead, trailer, CRC_LEN);
+    if (crcRead == calcCRC16(pValue, length))
+        return 0;
+    return erased ? NVM_ERR_NOT_FOUND : 0xFF;
+}
+
+/**
+ * @brief Function to seal a value and write it on its slot
+ *
+ * The value is sealed on a copy, since the caller's is constant.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] slotAddr Address of the slot
+ * @param[in] length Length of the value
+ * @param[in] pValue Pointer to the value to be saved
+ * @return Error code: 0 for success, 0xFF for error (no key)
+ */
+static NVM_NOINLINE gPNvm_Result nvmSlotSeal(nvm_ctx_t *pCtx,
+                                             gPNvm_AttrId attrId,
+                                             UInt16 slotAddr,
+                                             UInt8 length,
+                                             const UInt8 *pValue)
+{
+    UInt8 buff[MAX_VALUE_LENGTH];
+    UInt8 tag[NVM_SEAL_TAG_LEN];
+
+    memcpy(buff, pValue, length);
+    if (nvmTrailerEncode(pCtx, attrId, buff, length, tag) || \
+        (length != CTX_WRITE(pCtx, slotAddr, length, buff)) || \
+        (NVM_SEAL_TAG_LEN != CTX_WRITE(pCtx, slotAddr + length, \
+                                       NVM_SEAL_TAG_LEN, tag)))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to overwrite a fixed slot of the schema area
+ *
+ * Only the value and its CRC-16 (its tag, on a sealed memory) are
+ * written, in place. Unlike the appended values, a reset in the middle
+ * of it leaves the slot with a CRC error.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] slotAddr Address of the slot
+ * @param[in] length Length of the value
+ * @param[in] pValue Pointer to the value to be saved
+ * @return Error code: 0 for success, 0xFF for error
+ */
+gPNvm_Result nvmSlotWrite(nvm_ctx_t *pCtx,
+                          gPNvm_AttrId attrId,
+                          UInt16 slotAddr,
+                          UInt8 length,
+                          const UInt8 *pValue)
+{
+    UInt16 crc16Calc;
+
+    if (SLOT_INTEGRITY(pCtx) == NVM_INTEGRITY_SEALED)
+        return nvmSlotSeal(pCtx, attrId, slotAddr, length, pValue);
+    crc16Calc = calcCRC16((UInt8 *)pValue, length);
+    if ((length != CTX_WRITE(pCtx, slotAddr, length, (UInt8 *)pValue)) || \
+        (CRC_LEN != CTX_WRITE(pCtx, slotAddr + length, CRC_LEN, \
+                             (UInt8 *)&crc16Calc)))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to erase a fixed slot of the schema area
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] slotAddr Address of the slot
+ * @param[in] length Length of the value
+ * @return Error code: 0 for success, 0xFF for error
+ */
+gPNvm_Result nvmSlotErase(nvm_ctx_t *pCtx, UInt16 slotAddr, UInt8 length)
+{
+    UInt8 allFF[MAX_VALUE_LENGTH + NVM_SLOT_TRAILER_LEN];
+
+    memset(allFF, 0xFF, sizeof(allFF));
+    return nvmWriteBlock(pCtx, slotAddr, length + NVM_SLOT_TRAILER_LEN, \
+                         allFF);
+}
+
+/**
+ * @brief Function to fold a sealed chain of deltas into a whole value
+ *
+ * Same as @ref nvmDeltaFold, through a buffer holding the value whole:
+ * its tag covers all of it, so it can't be patched piece by piece.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pReg The register pointing to the newest delta
+ * @param[in] dest Address of the whole value
+ * @return Error code: 0 for success, 0xFF for error,
+ *                     @ref NVM_ERR_NOT_FOUND if the chain can't be read
+ */
+static NVM_NOINLINE gPNvm_Result nvmDeltaFoldSealed(nvm_ctx_t *pCtx,
+                                                    gPNvm_AttrId attrId,
+                                                    const alloc_reg_t *pReg,
+                                                    UInt16 dest)
+{
+    UInt8 value[MAX_VALUE_LENGTH + NVM_MAX_TRAILER_LEN];
+
+    if (nvmDeltaRead(pCtx, attrId, pReg, value))
+        return NVM_ERR_NOT_FOUND;
+    if (nvmTrailerEncode(pCtx, attrId, value, pReg->length, \
+                         value + pReg->length) || \
+        nvmWriteBlock(pCtx, dest, REC_LEN(pCtx, pReg->length), value))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to fold a chain of deltas into a whole value
+ *
+ * The whole value at the bottom of the chain is moved where compaction
+ * moves the chain, in chunks as any value, then the runs of each delta
+ * are patched on it, piece by piece, updating its trailer as
+ * @ref gpNvm_PatchAttribute does; the register then points to it as to
+ * any value. A sealed value goes through a buffer instead
+ * (see @ref nvmDeltaFoldSealed). A chain that can't be read any more is
+ * dropped, as by a delete.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The Id of the attribute
+ * @param[in] dest Address of the whole value
+ * @param[out] pLive Non-zero if the value was kept
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmDeltaFold(nvm_ctx_t *pCtx,
+                          gPNvm_AttrId attrId,
+                          UInt16 dest,
+                          UInt8 *pLive)
+{
+    delta_cursor_t cur;
+    alloc_reg_t reg;
+    UInt16 base, bytes;
+    gPNvm_Result ret = NVM_ERR_NOT_FOUND;
+
+    nvmReadReg(pCtx, attrId, &reg);
+    if (pCtx->integrity == NVM_INTEGRITY_SEALED)
+        ret = nvmDeltaFoldSealed(pCtx, attrId, &reg, dest);
+    else if (nvmDeltaChain(pCtx, &reg, &base, &bytes))
+    {
+        if (nvmMoveBlock(pCtx, base, dest, REC_LEN(pCtx, reg.length)))
+            return 0xFF;
+        cur.pValue = NULL;
+        cur.dest = dest;
+        if (!nvmDeltaApplyAll(pCtx, attrId, &reg, &cur))
+            ret = 0;
+    }
+    if (ret == 0xFF)
+        return 0xFF;
+    *pLive = !ret;
+    if (*pLive)
+        reg.start = dest;
+    else
+        reg.length = ALLOC_LEN_FREE;
+    reg.crc = calcCRC8((UInt8 *)&reg, ALLOC_REG_NO_CRC);
+    if (nvmStageReg(pCtx, attrId, &reg) || nvmCommit(pCtx))
+        return 0xFF;
+    return 0;
+}
+
+/**
+ * @brief Function to add a value to the window of the index, if it is in
+ *
+ * Its move flag and rank are set by the plan. A value goes into the window
+ * when its key is above the last one handled and below the keys of a
+ * full window, whose largest one it then pushes out.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pPlan What the compaction moves
+ * @param[in] gather Non-zero to index the values gathered only, by rank
+ * @param[in] lastKey Key of the last value handled, -1 for none
+ * @param[in,out] pKeep The window, sorted by key
+ * @param[in,out] pCount Number of values in the window
+ * @param[in,out] pValue The value, receiving its flags and rank
+ */
+static void nvmKeepInsert(nvm_ctx_t *pCtx,
+                          const nvm_compact_plan_t *pPlan,
+                          UInt8 gather,
+                          Int64 lastKey,
+                          nvm_keep_t *pKeep,
+                          int *pCount,
+                          nvm_keep_t *pValue)
+{
+    UInt8 group = (pValue->flags & KEEP_RING) ? 0 : \
+                  pCtx->group[pValue->attrId];
+    Int64 key;
+    int i;
+
+    pValue->rank = 0x100;
+    if (group && REG_BIT(pPlan->gathered, group))
+        pValue->rank = group;
+    if ((pValue->start >= pPlan->from) && \
+        ((pValue->rank != 0x100) || \
+         (pPlan->moveHot && (pValue->flags & KEEP_HOT))))
+        pValue->flags |= KEEP_MOVE;
+    if (gather && \
+        (!(pValue->flags & KEEP_MOVE) || (pValue->start >= pPlan->end)))
+        return;
+
+    key = KEEP_KEY(pValue, gather);
+    i = *pCount;
+    if ((key <= lastKey) || \
+        ((i == KEEP_WINDOW) && (key > KEEP_KEY(&pKeep[i - 1], gather))))
+        return;
+    if (i == KEEP_WINDOW)
+        i--;
+    else
+        (*pCount)++;
+    for (; (i > 0) && (KEEP_KEY(&pKeep[i - 1], gather) > key); --i)
+        pKeep[i] = pKeep[i - 1];
+    pKeep[i] = *pValue;
+}
+
+/**
+ * @brief Function to index the next values kept by a compaction
+ *
+ * The live values and rings are found on the table, each value followed
+ * by its former ones, up to the depth of the schema, and each chain of
+ * deltas from its whole value. The index only holds a window of them:
+ * the @ref KEEP_WINDOW ones with the smallest keys above the last one
+ * handled, so the table is streamed again for every window. Since the
+ * index is built from the memory, it follows the values already moved.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pPlan What the compaction moves
+ * @param[in] gather Non-zero to index the values gathered only, by rank
+ * @param[in] lastKey Key of the last value handled, -1 for none
+ * @param[out] pKeep The window, sorted by key
+ * @return Number of values in the window, 0 when all were handled, -1
+ *         for error
+ */
+static int nvmCompactIndex(nvm_ctx_t *pCtx,
+                           const nvm_compact_plan_t *pPlan,
+                           UInt8 gather,
+                           Int64 lastKey,
+                           nvm_keep_t *pKeep)
+{
+    alloc_reg_t regs[TABLE_CHUNK_REGS];
+    const alloc_reg_t *pReg;
+    UInt8 live[TABLE_CHUNK_REGS / 8], ring[TABLE_CHUNK_REGS / 8];
+    UInt8 delta[TABLE_CHUNK_REGS / 8];
+    nvm_keep_t value;
+    UInt16 former, base, chainBytes;
+    UInt8 depth;
+    int i, j, first, regCount, count = 0;
+
+    for (first = 0; first < MAX_REG_ALLOC; first += regCount)
+    {
+        regCount = nvmTableLive(pCtx, first, regs, &pReg, live, ring, delta);
+        if (!regCount)
+            return -1;
+        for (i = 0; i < regCount; ++i, ++pReg)
+        {
+            value.attrId = first + i;
+            value.newer = KEEP_NONE;
+            if (REG_BIT(delta, i))
+            {
+                if (!nvmDeltaChain(pCtx, pReg, &base, &chainBytes))
+                    continue;
+                value.start = base;
+                value.recLen = REC_LEN(pCtx, pReg->length);
+                value.flags = KEEP_CURRENT | KEEP_DELTA;
+                if (!pCtx->group[first + i] && \
+                    (pCtx->heat[first + i] >= HOT_APPENDS))
+                    value.flags |= KEEP_HOT;
+                nvmKeepInsert(pCtx, pPlan, gather, lastKey, pKeep, &count, \
+                              &value);
+                continue;
+            }
+            if (!REG_BIT(live, i) && !REG_BIT(ring, i))
+                continue;
+            depth = nvmSchemaHistory(first + i);
+            former = pReg->start;
+            for (j = 0; ; ++j)
+            {
+                value.start = former;
+                value.recLen = REG_BIT(ring, i) ? nvmRingLen(pCtx, pReg) : \
+                               REC_LEN(pCtx, pReg->length);
+                value.flags = j ? 0 : KEEP_CURRENT;
+                if (REG_BIT(ring, i))
+                    value.flags |= KEEP_RING;
+                else if (!pCtx->group[first + i] && \
+                         (pCtx->heat[first + i] >= HOT_APPENDS))
+                    value.flags |= KEEP_HOT;
+                if (depth && (j == depth))
+                    value.flags |= KEEP_LAST;
+                if (value.recLen)
+                    nvmKeepInsert(pCtx, pPlan, gather, lastKey, pKeep, \
+                                  &count, &value);
+                value.newer = value.start;
+                if ((j == depth) || \
+                    nvmFormerValue(pCtx, former, pReg->length, &former))
+                    break;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Function to move the values kept by a compaction, in address order
+ *
+ * The values from a given address on are copied one after the other from
+ * @e *pDest, in ascending order of their current address, each
+ * allocation register being repointed right after its value is copied
+ * (in A/B mode, each one is a switch of its own). The back-pointer before
+ * a value with history is copied along, and once a former value is moved
+ * the back-pointer of the newer one is repointed to it right away, so the
+ * memory always holds the whole history; the back-pointer of the oldest
+ * value kept is cut. Packed from below their lowest address, the values
+ * only move down, so a value never overwrites another one still to be
+ * copied. Gathering copies the values marked to be moved instead, by rank
+ * and then address, onto free space above the last value, where nothing
+ * is overwritten either. The values are indexed a window at a time (see
+ * @ref nvmCompactIndex).
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pPlan What the compaction moves
+ * @param[out] pKeep Room for a window of the index
+ * @param[in] from Lowest address of the values to be moved (sliding)
+ * @param[in] gather Non-zero to move the values marked only, by rank
+ * @param[in,out] pDest Where to copy them, receiving the end of the last
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 nvmCompactPass(nvm_ctx_t *pCtx,
+                            const nvm_compact_plan_t *pPlan,
+                            nvm_keep_t *pKeep,
+                            UInt16 from,
+                            UInt8 gather,
+                            UInt32 *pDest)
+{
+    nvm_keep_t *pMove;
+    alloc_reg_t reg;
+    UInt32 dest = *pDest;
+    Int64 lastKey = gather ? -1 : ((Int64)from << 8) - 1;
+    UInt16 former, moved;
+    UInt8 histLen, kept;
+    int i, count;
+
+    while ((count = nvmCompactIndex(pCtx, pPlan, gather, lastKey, pKeep)) > 0)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            pMove = &pKeep[i];
+            lastKey = KEEP_KEY(pMove, gather);
+            histLen = HIST_LEN(pMove->attrId);
+            moved = dest + histLen;
+            if (histLen)
+            {
+                //Its former value, if kept, is below and was moved already
+                if (histLen != CTX_READ(pCtx, pMove->start - histLen, \
+                                        histLen, (UInt8 *)&former))
+                    return 0xFF;
+                if ((pMove->flags & KEEP_LAST) || \
+                    (former < pCtx->valuesStart + histLen) || \
+                    ((UInt32)former + pMove->recLen + histLen > moved))
+                    former = 0xFFFF;
+                if (histLen != CTX_WRITE(pCtx, dest, histLen, \
+                                         (UInt8 *)&former))
+                    return 0xFF;
+            }
+            if (pMove->flags & KEEP_DELTA)
+            {
+                if (nvmDeltaFold(pCtx, pMove->attrId, moved, &kept))
+                    return 0xFF;
+            }
+            else if (pMove->start != moved)
+            {
+                if (nvmMoveBlock(pCtx, pMove->start, moved, pMove->recLen))
+                    return 0xFF;
+                if (pMove->flags & KEEP_CURRENT)
+                {
+                    nvmReadReg(pCtx, pMove->attrId, &reg);
+                    reg.start = moved;
+                    reg.crc = calcCRC8((UInt8 *)&reg, ALLOC_REG_NO_CRC);
+                    if (pMove->flags & KEEP_RING)
+                        reg.crc ^= ALLOC_CRC_RING;
+                    if (nvmStageReg(pCtx, pMove->attrId, &reg) || \
+                        nvmCommit(pCtx))
+                        return 0xFF;
+                }
+                //The newer value, not moved yet, points to it again
+                if ((pMove->newer != KEEP_NONE) && \
+                    (histLen != CTX_WRITE(pCtx, pMove->newer - histLen, \
+                                          histLen, (UInt8 *)&moved)))
+                    return 0xFF;
+            }
+            dest += histLen + pMove->recLen;
+        }
+    }
+    if (count < 0)
+        return 0xFF;
+
+    *pDest = dest;
+    return 0;
+}
+
+/**
+ * @brief Function to mark the groups to be gathered by a compaction
+ *
+ * A group is gathered when the values of its attributes (former ones
+ * included) are not contiguous, and none of them is below the values
+ * being compacted. The values are gone through in address order, so a
+ * group is contiguous when each of its values comes right after the
+ * previous one, which is of the same group.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in,out] pPlan What the compaction moves, receiving the groups
+ * @param[out] pKeep Room for a window of the index
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static NVM_NOINLINE UInt8 nvmCompactGroups(nvm_ctx_t *pCtx,
+                                           nvm_compact_plan_t *pPlan,
+                                           nvm_keep_t *pKeep)
+{
+    UInt8 seen[sizeof(pPlan->gathered)], below[sizeof(pPlan->gathered)];
+    UInt32 low, prevEnd = 0;
+    Int64 lastKey = -1;
+    UInt8 group, prevGroup = 0;
+    int i, count;
+
+    memset(seen, 0, sizeof(seen));
+    memset(below, 0, sizeof(below));
+    memset(pPlan->gathered, 0, sizeof(pPlan->gathered));
+    while ((count = nvmCompactIndex(pCtx, pPlan, 0, lastKey, pKeep)) > 0)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            group = (pKeep[i].flags & KEEP_RING) ? 0 : \
+                    pCtx->group[pKeep[i].attrId];
+            low = pKeep[i].start - HIST_LEN(pKeep[i].attrId);
+            if (group && REG_BIT(seen, group) && \
+                ((prevGroup != group) || (prevEnd != low)))
+                pPlan->gathered[group >> 3] |= 1 << (group & 7);
+            if (group)
+                seen[group >> 3] |= 1 << (group & 7);
+            if (group && (pKeep[i].start < pPlan->from))
+                below[group >> 3] |= 1 << (group & 7);
+            prevGroup = group;
+            prevEnd = pKeep[i].start + pKeep[i].recLen;
+        }
+        lastKey = KEEP_KEY(&pKeep[count - 1], 0);
+    }
+    for (i = 0; i < (int)sizeof(below); ++i)
+        pPlan->gathered[i] &= ~below[i];
+    return (count < 0) ? 0xFF : 0;
+}
+
+/**
+ * @brief Function to reclaim the space held by garbage values
+ *
+ * Every write appends a fresh copy of the value, so superseded and
+ * deleted values pile up on the values area. This function slides the
+ * live values (value plus trailer) down, in address order (see
+ * @ref nvmCompactPass), and in the end sets @ref NEXT_FREE_ADDR to the
+ * first byte after the last one.
+ * The compaction is generational. Each attribute appended at least
+ * @ref HOT_APPENDS times since the last compaction (the count is halved
+ * by each one, and kept in RAM only) is hot, the others are cold. Once
+ * the values are slid, the hot ones are copied to the space just freed
+ * and the values from the first hot one on are slid again, so the cold
+ * values end up packed below the hot ones: that's the cold region.
+ * From then on a compaction chooses by cost-benefit, garbage reclaimed
+ * per live byte moved, between the values above the cold region (where
+ * the hot attributes make their garbage), whose cold values join the
+ * cold region, and the whole values area. The cold region is compacted
+ * only when its garbage ratio is higher, or when the rest would not free
+ * room for a full length value; values that never change are not copied
+ * again and again along with the counters. After a mount the cold region
+ * is empty, but a garbage-free bottom of the values area never moves.
+ * The procedure is not power-fail safe though: a reset between copying
+ * a value and rewriting its register may lose it.
+ * The values of the attributes of a placement group (see
+ * @ref gpNvm_SetGroup) that are not contiguous are gathered the same way,
+ * group by group, below the hot ones, so @ref gpNvm_GetAttributes reads
+ * a group at once. Grouped attributes are never hot.
+ * The former values of the attributes with history are kept as well, up
+ * to the depth of the schema, with their back-pointers rewritten; they
+ * are still accounted as garbage afterwards. Rings are moved as a whole,
+ * and are never hot nor gathered. Each chain of deltas (see
+ * @ref gpNvm_SetDeltaChain) is folded into a whole value, written where
+ * its bottom one is moved to; a chain below the cold region makes the
+ * compaction a full one.
+ * The values kept are indexed @ref KEEP_WINDOW at a time, streaming the
+ * table again for each window (see @ref nvmCompactIndex), so the stack
+ * taken doesn't grow with the table.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_Compact(nvm_ctx_t *pCtx)
+{
+    nvm_keep_t keep[KEEP_WINDOW];
+    nvm_compact_plan_t plan;
+    UInt32 nextFree, dest, hotStart, low, moveBytes = 0, liveBytes = 0;
+    UInt32 coldLive = 0, coldDead, hotLive = 0, hotDead, hotBytes = 0;
+    Int64 lastKey;
+    UInt16 from;
+    UInt8 histLen, deltaBelow = 0;
+    int i, count;
+
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+    memset(&plan, 0, sizeof(plan));
+    plan.end = APPEND_END;
+
+    //Cost-benefit: garbage of each region over the live bytes it holds
+    nextFree = nvmReadNextFree(pCtx);
+    if ((pCtx->coldEnd < pCtx->valuesStart) || (pCtx->coldEnd > nextFree))
+        pCtx->coldEnd = pCtx->valuesStart;
+    for (lastKey = -1; (count = nvmCompactIndex(pCtx, &plan, 0, lastKey, \
+                                                keep)) > 0; \
+         lastKey = KEEP_KEY(&keep[count - 1], 0))
+    {
+        for (i = 0; i < count; ++i)
+        {
+            if (keep[i].start < pCtx->coldEnd)
+                coldLive += HIST_LEN(keep[i].attrId) + keep[i].recLen;
+            else
+                hotLive += HIST_LEN(keep[i].attrId) + keep[i].recLen;
+            if ((keep[i].flags & KEEP_DELTA) && \
+                (keep[i].start < pCtx->coldEnd))
+                deltaBelow = 1;
+        }
+    }
+    if (count < 0)
+        return 0xFF;
+    coldDead = pCtx->coldEnd - pCtx->valuesStart - coldLive;
+    hotDead = nextFree - pCtx->coldEnd - hotLive;
+    if (deltaBelow || \
+        ((UInt64)coldDead * hotLive > (UInt64)hotDead * coldLive) || \
+        (coldDead > APPEND_END - nextFree + hotDead) || \
+        (APPEND_END - nextFree + hotDead < COMPACT_MIN_GAIN))
+        pCtx->coldEnd = pCtx->valuesStart;
+
+    from = pCtx->coldEnd;
+    plan.from = from;
+    dest = from;
+    if (nvmCompactPass(pCtx, &plan, keep, from, 0, &dest))
+        return 0xFF;
+
+    //Move the hot values above the cold ones, if they aren't yet
+    hotStart = dest;
+    for (lastKey = -1; (count = nvmCompactIndex(pCtx, &plan, 0, lastKey, \
+                                                keep)) > 0; \
+         lastKey = KEEP_KEY(&keep[count - 1], 0))
+    {
+        for (i = 0; i < count; ++i)
+        {
+            histLen = HIST_LEN(keep[i].attrId);
+            if ((keep[i].flags & KEEP_HOT) && (keep[i].start >= from))
+            {
+                hotBytes += histLen + keep[i].recLen;
+                if (keep[i].start < hotStart + histLen)
+                    hotStart = keep[i].start - histLen;
+            }
+        }
+    }
+    if (count < 0)
+        return 0xFF;
+    plan.moveHot = hotBytes && (dest - hotStart >= 2 * hotBytes);
+    //Gather the scattered groups below them
+    if (nvmCompactGroups(pCtx, &plan, keep))
+        return 0xFF;
+    low = dest;
+    for (lastKey = -1; (count = nvmCompactIndex(pCtx, &plan, 0, lastKey, \
+                                                keep)) > 0; \
+         lastKey = KEEP_KEY(&keep[count - 1], 0))
+    {
+        for (i = 0; i < count; ++i)
+        {
+            histLen = HIST_LEN(keep[i].attrId);
+            if (!(keep[i].flags & KEEP_MOVE))
+                continue;
+            moveBytes += histLen + keep[i].recLen;
+            if (keep[i].start < low + histLen)
+                low = keep[i].start - histLen;
+        }
+    }
+    if (count < 0)
+        return 0xFF;
+    if (moveBytes && (APPEND_END - dest >= moveBytes))
+    {
+        //Hand out the space they are copied to, in case of a reset
+        if ((dest + moveBytes > nextFree) && \
+            nvmStageNextFree(pCtx, dest + moveBytes))
+            return 0xFF;
+        plan.end = dest;
+        if (nvmCompactPass(pCtx, &plan, keep, low, 1, &dest))
+            return 0xFF;
+        plan.end = APPEND_END;
+        dest = low;
+        if (nvmCompactPass(pCtx, &plan, keep, low, 0, &dest))
+            return 0xFF;
+    }
+
+    //The cold region ends at the first hot value
+    pCtx->coldEnd = dest;
+    for (lastKey = -1; (count = nvmCompactIndex(pCtx, &plan, 0, lastKey, \
+                                                keep)) > 0; \
+         lastKey = KEEP_KEY(&keep[count - 1], 0))
+    {
+        for (i = 0; i < count; ++i)
+        {
+            histLen = HIST_LEN(keep[i].attrId);
+            if ((keep[i].flags & KEEP_HOT) && (keep[i].start >= from) && \
+                (keep[i].start < (UInt32)pCtx->coldEnd + histLen))
+                pCtx->coldEnd = keep[i].start - histLen;
+            if (keep[i].flags & KEEP_CURRENT)
+                liveBytes += histLen + keep[i].recLen;
+        }
+    }
+    if (count < 0)
+        return 0xFF;
+    for (i = 0; i < MAX_REG_ALLOC; ++i)
+        pCtx->heat[i] >>= 1;
+
+    if (nvmStageNextFree(pCtx, dest) || nvmCommit(pCtx))
+        return 0xFF;
+    pCtx->stats.liveBytes = liveBytes;
+    pCtx->stats.deadBytes = dest - pCtx->valuesStart - liveBytes;
+    pCtx->stats.freeBytes = APPEND_END - dest;
+    pCtx->mounted = 1;
+
+    return nvmDurable(pCtx, 0);
+}
+
+/**
+ * @brief Function to bring the RAM accounting in line with the memory
+ *
+ * This function finds out the table layout first: if any of the A/B
+ * table copies is valid, the newest one is loaded on RAM (see
+ * @ref ab_header_t), otherwise the memory has a single table.
+ * Then it adds up the space taken by the live values, and compares it
+ * with the space already handed out by @ref NEXT_FREE_ADDR. The
+ * difference is garbage left by superseded and deleted values. It runs
+ * on the first API call and must be called again whenever the memory is
+ * changed behind the API back (e.g. after @ref memInit).
  *
- * @param[in] attrId The Id of the attribute to be read
- * @param[out] pLength the length of the value retrieved (in bytes)
- * @param[out] pValue the value retrieved
- * @return Error code: 0xFF for unrecoverable error,
- *                     positive for number of bits recovered by CRC correction
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF for error (in A/B mode, when
+ *         copy A has a header but none of the table copies is valid)
 **/
-gPNvm_Result gpNvm_GetAttribute(gPNvm_AttrId attrId,
-                                UInt8 *pLength,
-                                UInt8 *pValue)
+gPNvm_Result gpNvmCtx_Mount(nvm_ctx_t *pCtx)
 {
-    UInt16 start, crcRead;
-    alloc_reg_t readReg;
+    ab_header_t hdr[2];
+    alloc_reg_t regs[TABLE_CHUNK_REGS];
+    const alloc_reg_t *pReg;
+    UInt8 live[TABLE_CHUNK_REGS / 8], ring[TABLE_CHUNK_REGS / 8];
+    UInt8 delta[TABLE_CHUNK_REGS / 8];
+    UInt16 base, chainBytes;
+    UInt32 nextFree;
+    UInt32 liveBytes = 0;
+    int i, first, count;
 
-    //retrieve the allocation register
-    memRead(ID_ADDRESS(attrId), ALLOC_REG_LEN, (UInt8 *)&readReg);
-    //checks the register CRC
-    if (calcCRC8((UInt8 *)&readReg, ALLOC_REG_LEN))
+    pCtx->mounted = 0;
+    pCtx->tableMode = NVM_TABLE_SINGLE;
+    pCtx->valuesStart = MEM_VALUES_START;
+    pCtx->integrity = NVM_INTEGRITY_CRC16;
+    //A memory that can't be read (e.g. not formatted yet) isn't mounted
+    if ((AB_HEADER_LEN != CTX_READ(pCtx, AB_COPY_ADDR(0), AB_HEADER_LEN, \
+                                   (UInt8 *)&hdr[0])) || \
+        (AB_HEADER_LEN != CTX_READ(pCtx, AB_COPY_ADDR(1), AB_HEADER_LEN, \
+                                   (UInt8 *)&hdr[1])))
+        return 0xFF;
+    //Copy B's header lies on the values of a single table, so its magic
+    //number alone doesn't tell the layout: only a copy whose header and
+    //table CRCs both check does. Copy A's header lies on registers, and a
+    //single table never holds the magic number there.
+    if (nvmMountAb(pCtx, hdr) && (hdr[0].magic == AB_MAGIC))
+        return 0xFF;
+
+    nextFree = nvmReadNextFree(pCtx);
+    //The table is streamed by chunks, each checked in a single pass
+    for (first = 0; first < MAX_REG_ALLOC; first += count)
+    {
+        count = nvmTableLive(pCtx, first, regs, &pReg, live, ring, delta);
+        if (!count)
+            return 0xFF;
+        for (i = 0; i < count; ++i, ++pReg)
+        {
+            if (REG_BIT(live, i))
+                liveBytes += HIST_LEN(first + i) + \
+                             REC_LEN(pCtx, pReg->length);
+            else if (REG_BIT(ring, i))
+                liveBytes += nvmRingLen(pCtx, pReg);
+            else if (REG_BIT(delta, i) && \
+                     nvmDeltaChain(pCtx, pReg, &base, &chainBytes))
+                liveBytes += chainBytes;
+        }
+    }
+
+    //Whatever was handed out and isn't live any more is garbage
+    if (liveBytes > (nextFree - pCtx->valuesStart))
+        liveBytes = nextFree - pCtx->valuesStart;
+    pCtx->stats.liveBytes = liveBytes;
+    pCtx->stats.deadBytes = nextFree - pCtx->valuesStart - liveBytes;
+    pCtx->stats.freeBytes = APPEND_END - nextFree;
+    pCtx->coldEnd = pCtx->valuesStart;
+    pCtx->mounted = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Function to format the memory with a given table layout
+ *
+ * This function formats the memory with @ref memFormat, which leaves a
+ * single table memory. Only the table and the headers are written, plus
+ * the schema slots: the rest of the values area is left as it is, since
+ * no register points there anymore. The header of copy B is erased too,
+ * so an image formerly in A/B mode is not detected as such.
+ * For the A/B layout, the first switch is done over an empty table,
+ * writing copy A as generation 1 and leaving copy B invalid. Its header
+ * records the integrity mode of the values (see nvm_integrity.h).
+ * A sealed memory needs its key set first (@ref gpNvm_SetKey).
+ * The memory is mounted in the end.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] tableMode @ref NVM_TABLE_SINGLE or @ref NVM_TABLE_AB, ORed
+ *                      with an integrity mode (@ref NVM_INTEGRITY_CRC16
+ *                      if none). A single table only supports the CRC-16.
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_Format(nvm_ctx_t *pCtx, UInt8 tableMode)
+{
+    UInt8 allFF[MEM_CHUNK_LEN];
+    UInt8 integrity = tableMode & NVM_INTEGRITY_MASK;
+    UInt16 addr;
+    int i;
+
+    tableMode &= NVM_TABLE_MASK;
+    if (!nvmIntegrityValid(integrity) || \
+        ((tableMode != NVM_TABLE_AB) && (integrity != NVM_INTEGRITY_CRC16)) || \
+        ((integrity == NVM_INTEGRITY_SEALED) && !pCtx->seal.loaded))
+        return 0xFF;
+    if (pCtx->mem.pOps->format(&pCtx->mem, 0))
         return 0xFF;
-    *pLength = memRead(readReg.start, readReg.length, pValue);
 
-    memRead(readReg.start + readReg.length, CRC_LEN, (UInt8 *)&crcRead);
-    // To avoid allocating 256 bytes here and putting the read value
-    // and CRC appended, and perform a CRC checking with the full data
-    // expecting a zero, it will be more efficient to calculate the CRC
-    // over the value and compare with the CRC read. This way we need
-    // to allocate only 2 bytes
-    if (crcRead != calcCRC16(pValue, *pLength))
+    memset(allFF, 0xFF, sizeof(allFF));
+    if (nvmWriteBlock(pCtx, AB_COPY_ADDR(1), AB_HEADER_LEN, allFF))
         return 0xFF;
+    for (addr = 0; addr < NVM_SCHEMA_AREA_LEN; addr += MEM_CHUNK_LEN)
+    {
+        if (nvmWriteBlock(pCtx, NVM_SCHEMA_AREA_START + addr, \
+                          (NVM_SCHEMA_AREA_LEN - addr < MEM_CHUNK_LEN) ? \
+                          (NVM_SCHEMA_AREA_LEN - addr) : MEM_CHUNK_LEN, allFF))
+            return 0xFF;
+    }
 
-    //TODO: Implement the CRC correction on the data
-    // correctedBits = checkCRC(pValue, *pLength);
+    if (tableMode == NVM_TABLE_AB)
+    {
+        memset(pCtx->table, 0xFF, sizeof(pCtx->table));
+        memset(&pCtx->abHeader, 0xFF, sizeof(pCtx->abHeader));
+        pCtx->abHeader.magic = AB_MAGIC;
+        pCtx->abHeader.generation = 0;
+        pCtx->abHeader.nextFree = AB_VALUES_START;
+        if (integrity != NVM_INTEGRITY_CRC16)
+            pCtx->abHeader.integrity = integrity;
+        pCtx->abActive = 1;
+        memset(pCtx->abStale, 0xFF, sizeof(pCtx->abStale));
+        memset(pCtx->abChanged, 0, sizeof(pCtx->abChanged));
+        pCtx->tableMode = NVM_TABLE_AB;
+        pCtx->valuesStart = AB_VALUES_START;
+        if (nvmCommit(pCtx))
+            return 0xFF;
+    }
 
+    if (nvmDurable(pCtx, gpNvmCtx_Mount(pCtx)))
+        return 0xFF;
+    //Every value is gone
+    for (i = 0; i < MAX_REG_ALLOC; ++i)
+        nvmChanged(pCtx, i, 0);
     return 0;
 }
 
 /**
- * @brief Function to store a value in the memory, based on a Attribute
+ * @brief Function to report the usage of the values area
  *
- * This function writes a value into the memory, under an Attribute.
- * It returns the number of bytes actually written.
- * In order to write the data, it first reads the special address memory
- * @ref NEXT_FREE_ADDR which holds the next available address on the memory.
- * Later it updates this value summing the length.
- * Then, it assemble the allocation register using this address as the start
- * and the @p length input parameter as the length. Later it stores the value
- * itself in the determined address.
- * The CRC-8 is calculated over the allocation rergister before storing it.
- * This is meant to check the integrity on the future readings.
- * A CRC-16 is also calculated over the value bytes, and this CRC is appended
- * in the end of the value. This is intended to guarantee the data integrity
- * on the future readings.
- * An improvement could be done here, changing this
- * method to a CRC-correcting, an algorithm that can identify a 1-bit flip
- * and correct it.
+ * This function copies the live, garbage and free byte counters kept in
+ * RAM, so it is cheap enough to be polled every cycle. A caller can
+ * trigger @ref gpNvm_Compact when the free bytes run low and the garbage
+ * is worth reclaiming, instead of waiting for @ref NVM_ERR_NO_SPACE.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[out] pStats Structure receiving the counters
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_GetStats(nvm_ctx_t *pCtx, gpNvm_Stats_t *pStats)
+{
+    if (!pCtx->mounted && gpNvmCtx_Mount(pCtx))
+        return 0xFF;
+    *pStats = pCtx->stats;
+
+    return 0;
+}
+
+/**
+ * @brief Function to set up an instance on a file
  *
+ * The instance starts unmounted, and the file isn't touched until the
+ * first call. The path is kept by reference, so it must outlive the
+ * instance.
  *
- * @param[in] attrId The Id of the attribute to be saved
- * @param[in] length The length of the value to be saved, in bytes.
- *                   0xFF not allowed (reserved).
- * @param[in] pValue Pointer to the value to be saved
- * @return Number of bytes written, 0xFF for error.
+ * @param[out] pCtx The NVM instance
+ * @param[in] path The file modeling the memory
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_InitFile(nvm_ctx_t *pCtx, const char *path)
+{
+    if (!pCtx || !path)
+        return 0xFF;
+    memset(pCtx, 0, sizeof(*pCtx));
+    pCtx->mem.pOps = &memFileOps;
+    pCtx->mem.path = path;
+    pCtx->durability = NVM_DURABILITY_BUFFERED;
+
+    return 0;
+}
+
+/**
+ * @brief Function to set up an instance on a RAM buffer
+ *
+ * Just like @ref gpNvmCtx_InitFile, but the memory is a buffer of
+ * @ref MEM_SIZE bytes owned by the caller. A buffer just allocated must
+ * be formatted (@ref gpNvmCtx_Format) before use.
+ *
+ * @param[out] pCtx The NVM instance
+ * @param[in] pRam The buffer modeling the memory
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_InitRam(nvm_ctx_t *pCtx, UInt8 *pRam)
+{
+    if (!pCtx || !pRam)
+        return 0xFF;
+    memset(pCtx, 0, sizeof(*pCtx));
+    pCtx->mem.pOps = &memRamOps;
+    pCtx->mem.pRam = pRam;
+    pCtx->durability = NVM_DURABILITY_BUFFERED;
+
+    return 0;
+}
+
+#if defined(MEM_HAVE_MMAP)
+/**
+ * @brief Function to set up an instance on a memory-mapped file
+ *
+ * Just like @ref gpNvmCtx_InitFile, but the file is mapped and accessed
+ * as a RAM buffer. The pages written are tracked, so a flush (or a call,
+ * with @ref NVM_DURABILITY_SYNC) syncs only those, instead of the whole
+ * file. POSIX only.
+ *
+ * @param[out] pCtx The NVM instance
+ * @param[in] path The file modeling the memory
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_InitMmap(nvm_ctx_t *pCtx, const char *path)
+{
+    if (!pCtx || !path)
+        return 0xFF;
+    memset(pCtx, 0, sizeof(*pCtx));
+    pCtx->mem.pOps = &memMmapOps;
+    pCtx->mem.path = path;
+    pCtx->durability = NVM_DURABILITY_BUFFERED;
+
+    return 0;
+}
+#endif
+
+#if defined(MEM_HAVE_URING)
+/**
+ * @brief Function to set up an instance on a file accessed through io_uring
+ *
+ * Just like @ref gpNvmCtx_InitFile, but the writes of a call (value,
+ * trailer, table and next free address, or all those of a batch) are
+ * queued on a ring of the instance, linked so they complete in order,
+ * and submitted at once when the call ends, without waiting for them. A
+ * sync (a flush, or a call with @ref NVM_DURABILITY_SYNC) is linked
+ * after them in the same submission. Reads of a range still being
+ * written wait for it; a batch get reads its range ahead, overlapping
+ * with the reads. A crash of the process after a call returned only
+ * loses the writes the kernel had not started yet, a prefix of them.
+ * Where io_uring is not available, or with a depth of 0, the file is
+ * read and written synchronously. Linux only.
+ *
+ * @param[out] pCtx The NVM instance
+ * @param[in] path The file modeling the memory
+ * @param[in] depth Writes queued at most, up to @ref MEM_URING_DEPTH
+ *                  (more are cut); 0 for synchronous I/O
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCtx_InitUring(nvm_ctx_t *pCtx, const char *path, UInt8 depth)
+{
+    if (!pCtx || !path)
+        return 0xFF;
+    memset(pCtx, 0, sizeof(*pCtx));
+    pCtx->mem.pOps = &memUringOps;
+    pCtx->mem.path = path;
+    pCtx->mem.depth = (depth > MEM_URING_DEPTH) ? MEM_URING_DEPTH : depth;
+    pCtx->durability = NVM_DURABILITY_BUFFERED;
+
+    return 0;
+}
+#endif
+
+/**
+ * @brief Function to choose what survives a power loss
+ *
+ * See @ref NVM_DURABILITY_SYNC and the other levels. A memory is
+ * @ref NVM_DURABILITY_BUFFERED when set up. Moving to
+ * @ref NVM_DURABILITY_SYNC syncs the writes done so far, so every call
+ * that returned is covered from then on.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] level The durability level
+ * @return Error code: 0 for success, 0xFF for unknown level or sync error
+**/
+gPNvm_Result gpNvmCtx_SetDurability(nvm_ctx_t *pCtx, UInt8 level)
+{
+    if (level > NVM_DURABILITY_SYNC)
+        return 0xFF;
+    pCtx->durability = level;
+    if (level == NVM_DURABILITY_SYNC)
+        return pCtx->mem.pOps->sync(&pCtx->mem);
+
+    return 0;
+}
+
+/**
+ * @brief Function to sync the memory, as a barrier
+ *
+ * With @ref NVM_DURABILITY_BUFFERED, a batch of calls is made durable as
+ * a whole by a single flush after it, instead of a sync per call. The
+ * calls before the barrier survive a power loss once it returns 0.
+ * With @ref NVM_DURABILITY_NONE nothing is synced.
  *
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF for sync error
 **/
+gPNvm_Result gpNvmCtx_Flush(nvm_ctx_t *pCtx)
+{
+    if (pCtx->durability == NVM_DURABILITY_NONE)
+        return 0;
+    return pCtx->mem.pOps->sync(&pCtx->mem);
+}
+
+/**
+ * @brief Function to set the key of a sealed memory
+ *
+ * The values of a memory formatted with @ref NVM_INTEGRITY_SEALED are
+ * encrypted and authenticated with keys derived from this one (see
+ * nvm_seal.h). The key is kept in RAM only, and must be set again each
+ * time the instance is set up: without it, or with a wrong one, every
+ * value reads as corrupted and none can be written, the fixed slots of
+ * the schema area included. On any other mode the key is not used.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] pSecret The key, @ref NVM_SEAL_KEY_LEN bytes, or NULL to
+ *                    forget it
+ * @return Error code: 0 for success
+**/
+gPNvm_Result gpNvmCtx_SetKey(nvm_ctx_t *pCtx, const UInt8 *pSecret)
+{
+    if (pSecret)
+        nvmSealKey(&pCtx->seal, pSecret);
+    else
+        memset(&pCtx->seal, 0, sizeof(pCtx->seal));
+
+    return 0;
+}
+
+/**
+ * @brief Function to start recording the workload of an instance
+ *
+ * From now on every get, set and delete of the instance is appended to
+ * a trace file (see nvm_trace.h), with its timing, Id, length and
+ * result, and with @ref NVM_TRACE_HASH a CRC-32C of the value. The
+ * values themselves are never recorded. A trace already being recorded
+ * is stopped first. tools/nvm_replay.c runs the trace on any
+ * configuration.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] path The trace file, replaced if it exists
+ * @param[in] flags @ref NVM_TRACE_HASH, or 0
+ * @return Error code: 0 for success, 0xFF if the file can't be written
+**/
+gPNvm_Result gpNvmCtx_StartTrace(nvm_ctx_t *pCtx,
+                                 const char *path,
+                                 UInt8 flags)
+{
+    nvmTraceStop(&pCtx->trace);
+    return nvmTraceStart(&pCtx->trace, path, flags);
+}
+
+/**
+ * @brief Function to stop recording the workload of an instance
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF if part of the trace was lost
+**/
+gPNvm_Result gpNvmCtx_StopTrace(nvm_ctx_t *pCtx)
+{
+    return nvmTraceStop(&pCtx->trace);
+}
+
+/**
+ * @brief Function to release the memory of an instance
+ *
+ * The memory is flushed according to the durability level (see
+ * @ref gpNvmCtx_Flush), then the file is closed, and so is the trace
+ * being recorded, if any. The instance can still be used: it is mounted
+ * again, and the file reopened, on the next call.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @return Error code: 0 for success, 0xFF for sync error or a lost trace
+**/
+gPNvm_Result gpNvmCtx_Close(nvm_ctx_t *pCtx)
+{
+    gPNvm_Result ret = gpNvmCtx_Flush(pCtx);
+
+    pCtx->mem.pOps->close(&pCtx->mem);
+    pCtx->mounted = 0;
+    if (nvmTraceStop(&pCtx->trace))
+        ret = 0xFF;
+
+    return ret;
+}
+
+/**
+ * @brief Function to end a call that changed the memory
+ *
+ * With @ref NVM_DURABILITY_SYNC, the memory is synced once the call
+ * succeeded, so what it wrote survives a power loss when it returns.
+ * Otherwise the writes the backend queued are submitted, so they reach
+ * the OS as with an unbuffered file.
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] ret Result of the call
+ * @return The result of the call, 0xFF if the sync or a write failed
+ */
+gPNvm_Result nvmDurable(nvm_ctx_t *pCtx, gPNvm_Result ret)
+{
+    if (!ret && (pCtx->durability == NVM_DURABILITY_SYNC))
+        return pCtx->mem.pOps->sync(&pCtx->mem) ? 0xFF : 0;
+    if (pCtx->mem.pOps->submit(&pCtx->mem) && !ret)
+        return 0xFF;
+    return ret;
+}
+
+/**
+ * @brief Function to end a call that changed an attribute
+ *
+ * Once the call succeeded, the change counter of the attribute is
+ * incremented and the subscribers to a range holding it are called, in
+ * the order they subscribed. A callback may unsubscribe, or call the API
+ * on the instance (the change is complete by then).
+ *
+ * @param[in,out] pCtx The NVM instance
+ * @param[in] attrId The attribute changed
+ * @param[in] ret Result of the call
+ * @return The result of the call
+ */
+gPNvm_Result nvmChanged(nvm_ctx_t *pCtx, gPNvm_AttrId attrId, gPNvm_Result ret)
+{
+    nvm_subscriber_t *pSub;
+    int i;
+
+    if (ret)
+        return ret;
+    pCtx->change[attrId]++;
+    for (i = 0; i < NVM_SUBSCRIBERS_MAX; ++i)
+    {
+        pSub = &pCtx->subs[i];
+        if (pSub->notify && (attrId >= pSub->first) && \
+            (attrId <= pSub->last))
+            pSub->notify(pSub->pArg, attrId, pCtx->change[attrId]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to get the instance behind the gpNvm_* functions
+ *
+ * @return The default instance, on the file @ref MEM_DEFAULT_PATH
+**/
+nvm_ctx_t *gpNvm_GetDefaultCtx(void)
+{
+    return &nvmDefaultCtx;
+}
+
+/**********************************
+ * Default instance
+ **********************************
+ * Each gpNvm_* function is the gpNvmCtx_* one, on the default instance.
+ */
+gPNvm_Result gpNvm_GetAttribute(gPNvm_AttrId attrId,
+                                UInt8 *pLength,
+                                UInt8 *pValue)
+{
+    return gpNvmCtx_GetAttribute(&nvmDefaultCtx, attrId, pLength, pValue);
+}
+
 gPNvm_Result gpNvm_SetAttribute(gPNvm_AttrId attrId,
                                 UInt8 length,
                                 UInt8 *pValue)
 {
-    UInt16 start, crc16Calc;
-    alloc_reg_t aReg;
+    return gpNvmCtx_SetAttribute(&nvmDefaultCtx, attrId, length, pValue);
+}
 
-    //retrieve the allocation register to check the length
-    memRead(ID_ADDRESS(attrId), ALLOC_REG_LEN, (UInt8 *)&aReg);
-    // If there's already a value stored under this Attribute,
-    // only updates if the length is the same. Attempts to write
-    // the same attribute with different length will return error (0xFF)
-    if ((aReg.length != 0xFF) && (aReg.length != length))
-        return 0xFF;
+gPNvm_Result gpNvm_GetAttributeVersion(gPNvm_AttrId attrId,
+                                       UInt8 version,
+                                       UInt8 *pLength,
+                                       UInt8 *pValue)
+{
+    return gpNvmCtx_GetAttributeVersion(&nvmDefaultCtx, attrId, version, \
+                                        pLength, pValue);
+}
 
-    //retrieve the next available address
-    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&start);
-    aReg.start = start;
-    aReg.length = length;
-    aReg.crc = calcCRC8(((UInt8 *)&aReg), ALLOC_REG_NO_CRC);
+gPNvm_Result gpNvm_DeleteAttribute(gPNvm_AttrId attrId)
+{
+    return gpNvmCtx_DeleteAttribute(&nvmDefaultCtx, attrId);
+}
 
-    //update the next available address
-    start += (length + CRC_LEN);
-    memWrite(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&start);
+gPNvm_Result gpNvm_ReserveAttribute(gPNvm_AttrId attrId, UInt8 slots)
+{
+    return gpNvmCtx_ReserveAttribute(&nvmDefaultCtx, attrId, slots);
+}
 
-    //Store the allocation register
-    memWrite(ID_ADDRESS(attrId), ALLOC_REG_LEN, (UInt8 *)&aReg);
-    //Store the value
-    if (aReg.length != memWrite(aReg.start, aReg.length, pValue))
-      return 0xFF;
-    //Store the CRC-16 of value
-    crc16Calc = calcCRC16(pValue, length);
-    if (CRC_LEN != memWrite(aReg.start + length, CRC_LEN, (UInt8 *)&crc16Calc))
-      return 0xFF;
+gPNvm_Result gpNvm_PatchAttribute(gPNvm_AttrId attrId,
+                                  UInt8 offset,
+                                  UInt8 length,
+                                  UInt8 *pValue)
+{
+    return gpNvmCtx_PatchAttribute(&nvmDefaultCtx, attrId, offset, length, \
+                                   pValue);
+}
 
-    return 0;
+gPNvm_Result gpNvm_Compact(void)
+{
+    return gpNvmCtx_Compact(&nvmDefaultCtx);
+}
+
+gPNvm_Result gpNvm_Mount(void)
+{
+    return gpNvmCtx_Mount(&nvmDefaultCtx);
+}
+
+gPNvm_Result gpNvm_Format(UInt8 tableMode)
+{
+    return gpNvmCtx_Format(&nvmDefaultCtx, tableMode);
+}
+
+gPNvm_Result gpNvm_GetStats(gpNvm_Stats_t *pStats)
+{
+    return gpNvmCtx_GetStats(&nvmDefaultCtx, pStats);
+}
+
+gPNvm_Result gpNvm_SetDurability(UInt8 level)
+{
+    return gpNvmCtx_SetDurability(&nvmDefaultCtx, level);
+}
+
+gPNvm_Result gpNvm_Flush(void)
+{
+    return gpNvmCtx_Flush(&nvmDefaultCtx);
+}
+
+gPNvm_Result gpNvm_SetKey(const UInt8 *pSecret)
+{
+    return gpNvmCtx_SetKey(&nvmDefaultCtx, pSecret);
+}
+
+gPNvm_Result gpNvm_StartTrace(const char *path, UInt8 flags)
+{
+    return gpNvmCtx_StartTrace(&nvmDefaultCtx, path, flags);
+}
+
+gPNvm_Result gpNvm_StopTrace(void)
+{
+    return gpNvmCtx_StopTrace(&nvmDefaultCtx);
+}
+
+gPNvm_Result gpNvm_SetGroup(gPNvm_AttrId attrId, UInt8 group)
+{
+    return gpNvmCtx_SetGroup(&nvmDefaultCtx, attrId, group);
+}
+
+gPNvm_Result gpNvm_GetAttributes(gpNvm_Batch_t *pBatch, UInt8 count)
+{
+    return gpNvmCtx_GetAttributes(&nvmDefaultCtx, pBatch, count);
+}
+
+gPNvm_Result gpNvm_SetAttributes(gpNvm_Batch_t *pBatch, UInt8 count)
+{
+    return gpNvmCtx_SetAttributes(&nvmDefaultCtx, pBatch, count);
+}
+
+gPNvm_Result gpNvm_Subscribe(gPNvm_AttrId first,
+                             gPNvm_AttrId last,
+                             gpNvm_Notify_t notify,
+                             void *pArg)
+{
+    return gpNvmCtx_Subscribe(&nvmDefaultCtx, first, last, notify, pArg);
+}
+
+gPNvm_Result gpNvm_Unsubscribe(gpNvm_Notify_t notify, void *pArg)
+{
+    return gpNvmCtx_Unsubscribe(&nvmDefaultCtx, notify, pArg);
+}
+
+gPNvm_Result gpNvm_GetChange(gPNvm_AttrId attrId, UInt16 *pChange)
+{
+    return gpNvmCtx_GetChange(&nvmDefaultCtx, attrId, pChange);
+}
+
+gPNvm_Result gpNvm_SetDeltaChain(UInt8 maxChain)
+{
+    return gpNvmCtx_SetDeltaChain(&nvmDefaultCtx, maxChain);
 }
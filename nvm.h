@@ -27,11 +27,72 @@ typedef UInt8 gPNvm_Result;
 #define NEXT_FREE_ADDR ALLOC_TABLE_LEN ///< Pointer to the next available address
 #define MAX_VALUE_LENGTH    254 ///< Maximum length of a single attribute value
 #define CRC_LEN             2   ///< Length, in bytes, of CRC used on the values
+#define ALLOC_LEN_FREE      0xFF ///< Register length of a free (unused or deleted) Id
+#define ALLOC_CRC_RING      0xA5 ///< XORed into the CRC-8 of a ring register
+#define NVM_MAX_RING_SLOTS  16   ///< Most slots of a reserved ring
+#define RING_HEADER_LEN     2    ///< Slot count and its complement
+#define ALLOC_CRC_DELTA     0x5A ///< XORed into the CRC-8 of a delta register
+#define NVM_DELTA_MAX_CHAIN 8    ///< Longest chain of delta records
+#define DELTA_HEADER_LEN    6    ///< Length of a delta record header
 
 /// Beginning of value storing area
 #define MEM_VALUES_START (ALLOC_TABLE_LEN + SIZE_MEM_ADDRESS)
 /// Length of memory area to store values (64510 bytes)
 #define MEM_VALUES_LEN   ((1<<16) - MEM_VALUES_START)
+/// End (exclusive) of the values area. It doesn't fit on 16 bits, so a
+/// @ref NEXT_FREE_ADDR pointing here is stored wrapped to 0.
+#define MEM_VALUES_END   (1UL<<16)
+
+#define NVM_ERR_NO_SPACE    0xFE ///< Result: values area full, compaction needed
+#define NVM_ERR_NOT_FOUND   0xFD ///< Result: attribute never written or deleted
+
+/*
+ * Allocation table layouts, see @ref ab_header_t
+ */
+#define NVM_TABLE_SINGLE    0 ///< One allocation table, at address 0
+#define NVM_TABLE_AB        1 ///< Two table copies (A/B) with headers
+#define AB_MAGIC            0x4241564EUL ///< "NVAB", never a valid register
+#define AB_HEADER_LEN       16 ///< Length of each table copy header
+/// Length of each table copy, header included
+#define AB_COPY_LEN         (AB_HEADER_LEN + ALLOC_TABLE_LEN)
+/// Address of the header of table copy 0 (A) or 1 (B)
+#define AB_COPY_ADDR(c)     ((c) * AB_COPY_LEN)
+/// Address of the allocation table of copy 0 (A) or 1 (B)
+#define AB_TABLE_ADDR(c)    (AB_COPY_ADDR(c) + AB_HEADER_LEN)
+/// Beginning of value storing area in A/B mode
+#define AB_VALUES_START     (2 * AB_COPY_LEN)
+
+/*
+ * Integrity modes of the values, see nvm_integrity.h. They are ORed with
+ * the table layout given to @ref gpNvm_Format; anything but the CRC-16
+ * needs the A/B layout, whose header records the mode.
+ */
+#define NVM_TABLE_MASK          0x0F ///< Table layout bits
+#define NVM_INTEGRITY_MASK      0xF0 ///< Integrity mode bits
+#define NVM_INTEGRITY_CRC16     0x00 ///< CRC-16 per value (2 bytes)
+#define NVM_INTEGRITY_CRC32C    0x10 ///< CRC-32C per value (4 bytes)
+#define NVM_INTEGRITY_SECDED    0x20 ///< SECDED per 8-byte block (1 byte)
+#define NVM_INTEGRITY_SEALED    0x30 ///< Encrypted, 8-byte tag (needs key)
+
+/*
+ * Durability levels, see @ref gpNvm_SetDurability. Every level hands the
+ * writes to the OS as they are made (the io_uring backend, at the end of
+ * each call), so all the calls that returned survive a crash of the
+ * process, but for the io_uring writes not started yet (see
+ * @ref gpNvmCtx_InitUring); they differ on a power loss (or a crash of
+ * the OS):
+ * - NONE: nothing is ever synced, the memory may come back at any older
+ *   state the OS happened to write back, with torn writes.
+ * - BUFFERED: everything before the last @ref gpNvm_Flush that returned
+ *   0 survives; the writes after it, as NONE.
+ * - SYNC: every set, delete, patch, compaction or format that returned 0
+ *   survives, at the cost of one sync each. A call cut in the middle
+ *   may lose its own attribute, as on NONE.
+ * On a RAM memory, nothing survives the buffer, whatever the level.
+ */
+#define NVM_DURABILITY_NONE     0 ///< Never synced
+#define NVM_DURABILITY_BUFFERED 1 ///< Synced by gpNvm_Flush (default)
+#define NVM_DURABILITY_SYNC     2 ///< Synced by every call changing it
 
 /**
  * Local functions prototypes
@@ -45,6 +106,95 @@ gPNvm_Result gpNvm_SetAttribute (gPNvm_AttrId attrId,
                                  UInt8        length,
                                  UInt8*       pValue);
 
+gPNvm_Result gpNvm_GetAttributeVersion (gPNvm_AttrId attrId,
+                                        UInt8        version,
+                                        UInt8*       pLength,
+                                        UInt8*       pValue);
+
+gPNvm_Result gpNvm_DeleteAttribute (gPNvm_AttrId attrId);
+
+gPNvm_Result gpNvm_ReserveAttribute (gPNvm_AttrId attrId, UInt8 slots);
+
+gPNvm_Result gpNvm_PatchAttribute (gPNvm_AttrId attrId,
+                                   UInt8        offset,
+                                   UInt8        length,
+                                   UInt8*       pValue);
+
+gPNvm_Result gpNvm_Compact (void);
+
+gPNvm_Result gpNvm_Mount (void);
+
+gPNvm_Result gpNvm_Format (UInt8 tableMode);
+
+gPNvm_Result gpNvm_SetDurability (UInt8 level);
+
+gPNvm_Result gpNvm_SetKey (const UInt8* pSecret);
+
+gPNvm_Result gpNvm_StartTrace (const char* path, UInt8 flags);
+
+gPNvm_Result gpNvm_StopTrace (void);
+
+gPNvm_Result gpNvm_Flush (void);
+
+/**
+ * @brief Usage of the values area
+ *
+ * The three counters add up to the length of the values area, from its
+ * beginning up to the fixed slots of the schema area (see nvm_schema.h),
+ * which are not accounted. They are kept in RAM
+ * and updated on every set, delete and compaction, so reading them costs
+ * nothing but a copy. Each value is accounted with its CRC.
+ */
+typedef struct
+{
+    UInt16 liveBytes; ///< Bytes of the values the allocation table points to
+    UInt16 deadBytes; ///< Bytes of superseded and deleted values (garbage)
+    UInt16 freeBytes; ///< Bytes still available after @ref NEXT_FREE_ADDR
+} gpNvm_Stats_t;
+
+gPNvm_Result gpNvm_GetStats (gpNvm_Stats_t* pStats);
+
+#define NVM_BATCH_MAX       32 ///< Most attributes of a batch get or set
+
+/**
+ * @brief An attribute of a batch get or set, with its outcome
+ *
+ * See @ref gpNvm_GetAttributes and @ref gpNvm_SetAttributes.
+ */
+typedef struct
+{
+    gPNvm_AttrId attrId;    ///< The attribute
+    UInt8 length;           ///< Length of the value, set or retrieved
+    UInt8* pValue;          ///< The value, @ref MAX_VALUE_LENGTH room on get
+    gPNvm_Result result;    ///< Result, as the single attribute function
+} gpNvm_Batch_t;
+
+gPNvm_Result gpNvm_SetGroup (gPNvm_AttrId attrId, UInt8 group);
+
+gPNvm_Result gpNvm_GetAttributes (gpNvm_Batch_t* pBatch, UInt8 count);
+
+gPNvm_Result gpNvm_SetAttributes (gpNvm_Batch_t* pBatch, UInt8 count);
+
+#define NVM_SUBSCRIBERS_MAX 8 ///< Most subscriptions to an instance
+
+/**
+ * @brief Callback of a subscription, see @ref gpNvm_Subscribe
+ *
+ * Called once per committed change of an attribute of the range, with
+ * its change counter (see @ref gpNvm_GetChange).
+ */
+typedef void (*gpNvm_Notify_t)(void* pArg, gPNvm_AttrId attrId,
+                               UInt16 change);
+
+gPNvm_Result gpNvm_Subscribe (gPNvm_AttrId first, gPNvm_AttrId last,
+                              gpNvm_Notify_t notify, void* pArg);
+
+gPNvm_Result gpNvm_Unsubscribe (gpNvm_Notify_t notify, void* pArg);
+
+gPNvm_Result gpNvm_GetChange (gPNvm_AttrId attrId, UInt16* pChange);
+
+gPNvm_Result gpNvm_SetDeltaChain (UInt8 maxChain);
+
 /**
  * @brief Allocation table register structure
  *
@@ -68,6 +218,25 @@ gPNvm_Result gpNvm_SetAttribute (gPNvm_AttrId attrId,
  * the use of a hash table could be needed, avoiding to have a big
  * (and possibly empty) space reserved for the full allocation table.
  * This is a trade-off that must be analised.
+ *
+ * OBS 2: A deleted attribute keeps a valid register (CRC-8 ok) with
+ * @ref ALLOC_LEN_FREE as length. This tombstone tells a deliberate
+ * deletion apart from a corrupted register and keeps the start address
+ * of the dropped value, which is garbage until @ref gpNvm_Compact runs.
+ *
+ * OBS 3: An attribute pinned by @ref gpNvm_ReserveAttribute has
+ * @ref ALLOC_CRC_RING XORed into the CRC-8 of its register, which points
+ * to a ring instead of a value: a header with the slot count and its
+ * complement, followed by the slots. Each slot holds a sequence number,
+ * the value and the trailer of both (see nvm_integrity.h). The valid slot
+ * with the newest sequence number holds the current value.
+ *
+ * OBS 4: An attribute last set as a delta (see @ref gpNvm_SetDeltaChain)
+ * has @ref ALLOC_CRC_DELTA XORed into the CRC-8 of its register, which
+ * keeps the length of the value but points to a delta record: a
+ * @ref delta_header_t, followed by the runs of the changes and their
+ * trailer. The header links to the record it applies to, down to a
+ * whole value.
  */
 
 typedef struct
@@ -77,4 +246,53 @@ typedef struct
     UInt8 crc;    ///< 1 byte CRC for allocation table integrity
 } alloc_reg_t;
 
+/**
+ * @brief Header of a delta record
+ *
+ * The header is not sealed, so a chain is walked (and its length
+ * accounted) by reading the headers alone; its own CRC-16 protects it.
+ * Each run that follows is an offset, a count and that many bytes, the
+ * XOR of the old and the new bytes; the trailer covers the runs.
+ */
+typedef struct
+{
+    UInt16 base;    ///< Address of the record the changes apply to
+    UInt8 depth;    ///< Deltas down to the whole value, this one included
+    UInt8 runsLen;  ///< Length of the runs
+    UInt16 crc;     ///< CRC-16 over the fields above
+} delta_header_t;
+
+/**
+ * @brief Header of an allocation table copy, in A/B mode
+ *
+ * In A/B mode (@ref NVM_TABLE_AB) the memory starts with two copies of
+ * the allocation table, each one preceded by this header, and the values
+ * area starts at @ref AB_VALUES_START. The header holds the next available
+ * address (instead of @ref NEXT_FREE_ADDR), a generation number and a
+ * CRC-16 over the whole table copy, besides its own CRC-16.
+ * Updates are never written to the active copy: the changed registers
+ * go to the inactive one, and then its header is written with the next
+ * generation. That single header write is the switch. A reset before it
+ * leaves the inactive copy invalid (table CRC mismatch) or older, so the
+ * mount keeps using the previous one; a reset after it finds the new one.
+ * Mounting just reads both copies and picks the newest valid one, there
+ * is no need to check or recover register by register.
+ * The magic number is chosen so that it is never a valid register, so
+ * copy A can't be mistaken for a single table. Copy B's header lies on
+ * the values of a single table, where any bytes may be: a memory is
+ * only taken as A/B when a copy's header and table CRCs both check.
+ * The header also records the integrity mode of the values (see
+ * nvm_integrity.h); images made before it was there hold 0xFFFF, that
+ * is the CRC-16.
+ */
+typedef struct
+{
+    UInt32 magic;       ///< @ref AB_MAGIC
+    UInt32 generation;  ///< Incremented on every switch
+    UInt16 nextFree;    ///< Next available address on the values area
+    UInt16 tableCrc;    ///< CRC-16 over the allocation table of this copy
+    UInt16 integrity;   ///< Integrity mode, 0xFFFF for the CRC-16
+    UInt16 crc;         ///< CRC-16 over the fields above
+} ab_header_t;
+
 #endif
@@ -0,0 +1,293 @@
+/**
+ * @file nvm_client.c
+ * @brief This file implements the client of the NVM daemon
+ *
+ * Every call is a batch (see @ref gpNvmCli_Batch): the requests are
+ * encoded on a buffer, sent by as few writes as possible, and then the
+ * responses are read in order. Each call blocks until its responses
+ * arrive, after the daemon synced the store.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <string.h>
+
+#include "nvm_client.h"
+
+#if defined(MEM_HAVE_MMAP)
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CLI_BUFF_LEN    4096 ///< Requests encoded before a write
+
+/**
+ * @brief Function to write a whole buffer on the socket
+ *
+ * @param[in] fd The socket
+ * @param[in] pBuff The data
+ * @param[in] length Length of the data
+ * @return Error code: 0 for success, 0xFF for error
+ */
+static UInt8 cliWriteAll(int fd, const UInt8 *pBuff, int length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = write(fd, pBuff, length);
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        if (n <= 0)
+            return 0xFF;
+        pBuff += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to read a whole buffer from the socket
+ *
+ * @param[in] fd The socket
+ * @param[out] pBuff The data
+ * @param[in] length Length of the data
+ * @return Error code: 0 for success, 0xFF for error or end of stream
+ */
+static UInt8 cliReadAll(int fd, UInt8 *pBuff, int length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = read(fd, pBuff, length);
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        if (n <= 0)
+            return 0xFF;
+        pBuff += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to read the response of a request
+ *
+ * @param[in] fd The socket
+ * @param[in,out] pOp The request, receiving its outcome
+ * @return Error code: 0 for success, 0xFF for error or malformed response
+ */
+static UInt8 cliReadResponse(int fd, nvm_cli_op_t *pOp)
+{
+    UInt8 hdr[NVM_RSP_HEADER_LEN];
+    UInt8 skip[MAX_VALUE_LENGTH];
+
+    if (cliReadAll(fd, hdr, NVM_RSP_HEADER_LEN) || \
+        (hdr[2] > MAX_VALUE_LENGTH))
+        return 0xFF;
+    pOp->result = hdr[0];
+    if ((pOp->op != NVM_OP_GET) && (pOp->op != NVM_OP_NEXT))
+        return hdr[2] ? cliReadAll(fd, skip, hdr[2]) : 0;
+    pOp->attrId = hdr[1];
+    pOp->length = hdr[2];
+    return cliReadAll(fd, pOp->pValue, hdr[2]);
+}
+
+/**
+ * @brief Function to connect to the daemon
+ *
+ * @param[out] pCli The connection
+ * @param[in] path The socket of the daemon, NULL for
+ *                 @ref NVM_CLI_DEFAULT_PATH
+ * @return Error code: 0 for success, 0xFF for error
+**/
+gPNvm_Result gpNvmCli_Connect(nvm_client_t *pCli, const char *path)
+{
+    struct sockaddr_un addr;
+
+    pCli->fd = -1;
+    if (!path)
+        path = NVM_CLI_DEFAULT_PATH;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return 0xFF;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    pCli->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (pCli->fd < 0)
+        return 0xFF;
+    if (connect(pCli->fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        close(pCli->fd);
+        pCli->fd = -1;
+        return 0xFF;
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to send several requests at once
+ *
+ * The requests are sent @ref NVM_CLI_WINDOW at a time, without waiting
+ * for the responses in between, and the daemon serves them together:
+ * a window of sets costs a single sync of the store. The requests are
+ * served in order, but those of other clients may be served in between.
+ * The outcome of each request is left on its entry: the result (as the
+ * gpNvm_* function would return it) and, for a get, the value and its
+ * length. @ref NVM_OP_NEXT also returns the Id found.
+ *
+ * @param[in,out] pCli The connection
+ * @param[in,out] pOps The requests, receiving their outcome
+ * @param[in] count Number of requests
+ * @return Error code: 0 if every request got its response (each one
+ *         with its own result), 0xFF for a connection error
+**/
+gPNvm_Result gpNvmCli_Batch(nvm_client_t *pCli, nvm_cli_op_t *pOps, int count)
+{
+    UInt8 buff[CLI_BUFF_LEN];
+    int first, last, used, i;
+    UInt8 length;
+
+    if (pCli->fd < 0)
+        return 0xFF;
+    for (first = 0; first < count; first = last)
+    {
+        last = (count - first > NVM_CLI_WINDOW) ? first + NVM_CLI_WINDOW : \
+                                                  count;
+        used = 0;
+        for (i = first; i < last; ++i)
+        {
+            length = (pOps[i].op == NVM_OP_SET) ? pOps[i].length : 0;
+            if (used + NVM_REQ_HEADER_LEN + length > CLI_BUFF_LEN)
+            {
+                if (cliWriteAll(pCli->fd, buff, used))
+                    return 0xFF;
+                used = 0;
+            }
+            buff[used++] = pOps[i].op;
+            buff[used++] = pOps[i].attrId;
+            buff[used++] = length;
+            memcpy(buff + used, pOps[i].pValue, length);
+            used += length;
+        }
+        if (cliWriteAll(pCli->fd, buff, used))
+            return 0xFF;
+
+        for (i = first; i < last; ++i)
+        {
+            if (cliReadResponse(pCli->fd, &pOps[i]))
+                return 0xFF;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Function to retrieve a value, as @ref gpNvm_GetAttribute
+ *
+ * @param[in,out] pCli The connection
+ * @param[in] attrId The Id of the attribute to be read
+ * @param[out] pLength the length of the value retrieved (in bytes)
+ * @param[out] pValue the value retrieved
+ * @return Same as @ref gpNvm_GetAttribute, 0xFF for a connection error
+**/
+gPNvm_Result gpNvmCli_GetAttribute(nvm_client_t *pCli,
+                                   gPNvm_AttrId attrId,
+                                   UInt8 *pLength,
+                                   UInt8 *pValue)
+{
+    nvm_cli_op_t op = { NVM_OP_GET, attrId, 0, pValue, 0xFF };
+
+    if (gpNvmCli_Batch(pCli, &op, 1))
+        return 0xFF;
+    *pLength = op.length;
+    return op.result;
+}
+
+/**
+ * @brief Function to store a value, as @ref gpNvm_SetAttribute
+ *
+ * @param[in,out] pCli The connection
+ * @param[in] attrId The Id of the attribute to be saved
+ * @param[in] length The length of the value to be saved, in bytes
+ * @param[in] pValue Pointer to the value to be saved
+ * @return Same as @ref gpNvm_SetAttribute, 0xFF for a connection error
+**/
+gPNvm_Result gpNvmCli_SetAttribute(nvm_client_t *pCli,
+                                   gPNvm_AttrId attrId,
+                                   UInt8 length,
+                                   UInt8 *pValue)
+{
+    nvm_cli_op_t op = { NVM_OP_SET, attrId, length, pValue, 0xFF };
+
+    if (length > MAX_VALUE_LENGTH)
+        return 0xFF;
+    return gpNvmCli_Batch(pCli, &op, 1) ? 0xFF : op.result;
+}
+
+/**
+ * @brief Function to remove an attribute, as @ref gpNvm_DeleteAttribute
+ *
+ * @param[in,out] pCli The connection
+ * @param[in] attrId The Id of the attribute to be deleted
+ * @return Same as @ref gpNvm_DeleteAttribute
+**/
+gPNvm_Result gpNvmCli_DeleteAttribute(nvm_client_t *pCli,
+                                      gPNvm_AttrId attrId)
+{
+    nvm_cli_op_t op = { NVM_OP_DELETE, attrId, 0, NULL, 0xFF };
+
+    return gpNvmCli_Batch(pCli, &op, 1) ? 0xFF : op.result;
+}
+
+/**
+ * @brief Function to iterate over the attributes of the store
+ *
+ * Retrieves the attribute with the lowest Id from @e *pAttrId on that
+ * @ref gpNvm_GetAttribute finds, schema defaults included. A loop
+ * starting from Id 0, and going on from the Id found plus one, visits
+ * every attribute; each step is a request of its own, so the store may
+ * change in between.
+ *
+ * @param[in,out] pCli The connection
+ * @param[in,out] pAttrId The first Id to be tried, receiving the Id found
+ * @param[out] pLength the length of the value retrieved (in bytes)
+ * @param[out] pValue the value retrieved
+ * @return Same as @ref gpNvm_GetAttribute for the Id found,
+ *         @ref NVM_ERR_NOT_FOUND if there is none up to the last Id
+**/
+gPNvm_Result gpNvmCli_NextAttribute(nvm_client_t *pCli,
+                                    gPNvm_AttrId *pAttrId,
+                                    UInt8 *pLength,
+                                    UInt8 *pValue)
+{
+    nvm_cli_op_t op = { NVM_OP_NEXT, *pAttrId, 0, pValue, 0xFF };
+
+    if (gpNvmCli_Batch(pCli, &op, 1))
+        return 0xFF;
+    *pAttrId = op.attrId;
+    *pLength = op.length;
+    return op.result;
+}
+
+/**
+ * @brief Function to close the connection
+ *
+ * @param[in,out] pCli The connection
+ * @return Error code: 0 for success
+**/
+gPNvm_Result gpNvmCli_Close(nvm_client_t *pCli)
+{
+    if (pCli->fd >= 0)
+        close(pCli->fd);
+    pCli->fd = -1;
+    return 0;
+}
+
+#endif
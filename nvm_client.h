@@ -0,0 +1,105 @@
+/**
+ * @file nvm_client.h
+ * @brief Header file for the client of the NVM daemon
+ *
+ * A store on a file can't be shared by several processes through
+ * nvm.c: each one would mount it on its own, and their writes would
+ * overwrite each other. tools/nvm_daemon.c owns the store instead, and
+ * serves the processes over a Unix-domain socket; this library mirrors
+ * the gpNvmCtx_* functions of @ref nvm_ctx.h on a connection to it.
+ * POSIX only (@ref MEM_HAVE_MMAP).
+ *
+ * Protocol: each request is a header (operation, attribute Id, length)
+ * followed, for a set, by the value. Each response is a header (result,
+ * attribute Id, length) followed, for a get, by the value. Responses
+ * come in the order of the requests, so a client may send several of
+ * them before reading any response (@ref gpNvmCli_Batch). The daemon
+ * serves every request received from all its clients, syncs the store
+ * once for all of them (group commit) and only then replies: a set that
+ * returned survives a power loss, as with @ref NVM_DURABILITY_SYNC.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_CLIENT_H__)
+#define __NVM_CLIENT_H__
+
+#include "nvm.h"
+#include "memory.h"
+
+#if defined(MEM_HAVE_MMAP)
+
+#define NVM_CLI_DEFAULT_PATH    "/tmp/nvm.sock" ///< Socket of the daemon
+
+/*
+ * Operations of the protocol
+ */
+#define NVM_OP_GET          0x01 ///< Get an attribute
+#define NVM_OP_SET          0x02 ///< Set an attribute, value follows
+#define NVM_OP_DELETE       0x03 ///< Delete an attribute
+#define NVM_OP_NEXT         0x04 ///< Get the first attribute from the Id
+
+#define NVM_REQ_HEADER_LEN  3 ///< Operation, attribute Id, length
+#define NVM_RSP_HEADER_LEN  3 ///< Result, attribute Id, length
+
+/// Longest request and response: header and a full length value
+#define NVM_MSG_MAX_LEN     (NVM_REQ_HEADER_LEN + MAX_VALUE_LENGTH)
+
+/**
+ * Requests of a batch sent before reading their responses. Their
+ * responses must fit on the socket buffers, so neither side waits for
+ * the other to read.
+ */
+#define NVM_CLI_WINDOW      64
+
+/**
+ * @brief A request of a batch, with its outcome
+ */
+typedef struct
+{
+    UInt8 op;               ///< NVM_OP_*
+    gPNvm_AttrId attrId;    ///< Attribute, found one for @ref NVM_OP_NEXT
+    UInt8 length;           ///< Length of the value, set or retrieved
+    UInt8 *pValue;          ///< Value, @ref MAX_VALUE_LENGTH room on get
+    gPNvm_Result result;    ///< Result, as the gpNvm_* function
+} nvm_cli_op_t;
+
+/**
+ * @brief A connection to the daemon
+ */
+typedef struct
+{
+    int fd;                 ///< The socket, -1 when closed
+} nvm_client_t;
+
+gPNvm_Result gpNvmCli_Connect (nvm_client_t* pCli, const char* path);
+
+gPNvm_Result gpNvmCli_GetAttribute (nvm_client_t* pCli,
+                                    gPNvm_AttrId  attrId,
+                                    UInt8*        pLength,
+                                    UInt8*        pValue);
+
+gPNvm_Result gpNvmCli_SetAttribute (nvm_client_t* pCli,
+                                    gPNvm_AttrId  attrId,
+                                    UInt8         length,
+                                    UInt8*        pValue);
+
+gPNvm_Result gpNvmCli_DeleteAttribute (nvm_client_t* pCli,
+                                       gPNvm_AttrId  attrId);
+
+gPNvm_Result gpNvmCli_NextAttribute (nvm_client_t* pCli,
+                                     gPNvm_AttrId* pAttrId,
+                                     UInt8*        pLength,
+                                     UInt8*        pValue);
+
+gPNvm_Result gpNvmCli_Batch (nvm_client_t* pCli,
+                             nvm_cli_op_t* pOps,
+                             int           count);
+
+gPNvm_Result gpNvmCli_Close (nvm_client_t* pCli);
+
+#endif
+
+#endif
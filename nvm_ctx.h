@@ -0,0 +1,176 @@
+/**
+ * @file nvm_ctx.h
+ * @brief Header file for the multi-instance NVM API
+ *
+ * Every gpNvmCtx_* function works on the NVM instance given by its first
+ * argument: the memory backend, the table layout found on mount and the
+ * RAM accounting are all kept in the @ref nvm_ctx_t handle. The gpNvm_*
+ * functions of @ref nvm.h work on a default instance, on the file
+ * @ref MEM_DEFAULT_PATH.
+ * Instances share nothing, so each one can be used from a different
+ * thread without locking. A single instance must not be used by two
+ * threads at the same time.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_CTX_H__)
+#define __NVM_CTX_H__
+
+#include "nvm.h"
+#include "memory.h"
+#include "nvm_seal.h"
+#include "nvm_trace.h"
+
+/**
+ * @brief A subscription to the changes of a range of attributes
+ */
+typedef struct
+{
+    gpNvm_Notify_t notify;  ///< Callback, NULL if the entry is free
+    void *pArg;             ///< Its argument
+    gPNvm_AttrId first;     ///< First attribute of the range
+    gPNvm_AttrId last;      ///< Last attribute of the range
+} nvm_subscriber_t;
+
+/**
+ * @brief An NVM instance
+ *
+ * The handle is allocated by the caller (statically, if so wished) and
+ * set up by @ref gpNvmCtx_InitFile, @ref gpNvmCtx_InitRam,
+ * @ref gpNvmCtx_InitMmap or @ref gpNvmCtx_InitUring. The memory is
+ * mounted on the first call, as in the default instance. The fields are
+ * managed by nvm.c; offline tools (see tools/) may read them after a
+ * mount, but never change them.
+ */
+typedef struct
+{
+    nvm_mem_t mem;          ///< Memory backend
+    UInt8 durability;       ///< NVM_DURABILITY_* level
+    UInt8 mounted;          ///< The RAM accounting below is up to date
+    gpNvm_Stats_t stats;    ///< Usage of the values area
+    UInt8 tableMode;        ///< Layout found on mount
+    UInt16 valuesStart;     ///< Start of values area
+    UInt8 integrity;        ///< Integrity mode of the values
+    nvm_seal_key_t seal;    ///< Keys of a sealed memory, RAM only
+    nvm_trace_t trace;      ///< Workload trace being recorded, if any
+    UInt16 coldEnd;         ///< End of the cold region, see gpNvmCtx_Compact
+    UInt8 heat[MAX_REG_ALLOC]; ///< Appends per attribute, halved by compaction
+    UInt8 group[MAX_REG_ALLOC]; ///< Placement group per attribute, 0 if none
+    UInt16 change[MAX_REG_ALLOC]; ///< Changes committed per attribute
+    nvm_subscriber_t subs[NVM_SUBSCRIBERS_MAX]; ///< See gpNvmCtx_Subscribe
+    UInt8 deltaChain;       ///< Longest chain of deltas, 0 for none
+
+    /*
+     * A/B mode only. The allocation table is mirrored in RAM, together
+     * with the header of the next switch. The inactive copy lags one
+     * switch behind the active one, so only the registers changed by the
+     * last two switches have to be written to it.
+     */
+    alloc_reg_t table[MAX_REG_ALLOC];   ///< Mirror of the table
+    ab_header_t abHeader;               ///< Header of active copy
+    UInt8 abActive;                     ///< Active copy: 0 (A), 1 (B)
+    UInt8 abChanged[MAX_REG_ALLOC / 8]; ///< Changed since last switch
+    UInt8 abStale[MAX_REG_ALLOC / 8];   ///< Outdated on inactive copy
+} nvm_ctx_t;
+
+gPNvm_Result gpNvmCtx_InitFile (nvm_ctx_t*  pCtx,
+                                const char* path);
+
+gPNvm_Result gpNvmCtx_InitRam (nvm_ctx_t* pCtx,
+                               UInt8*     pRam);
+
+#if defined(MEM_HAVE_MMAP)
+gPNvm_Result gpNvmCtx_InitMmap (nvm_ctx_t*  pCtx,
+                                const char* path);
+#endif
+
+#if defined(MEM_HAVE_URING)
+gPNvm_Result gpNvmCtx_InitUring (nvm_ctx_t*  pCtx,
+                                 const char* path,
+                                 UInt8       depth);
+#endif
+
+gPNvm_Result gpNvmCtx_GetAttribute (nvm_ctx_t*   pCtx,
+                                    gPNvm_AttrId attrId,
+                                    UInt8*       pLength,
+                                    UInt8*       pValue);
+
+gPNvm_Result gpNvmCtx_SetAttribute (nvm_ctx_t*   pCtx,
+                                    gPNvm_AttrId attrId,
+                                    UInt8        length,
+                                    UInt8*       pValue);
+
+gPNvm_Result gpNvmCtx_GetAttributeVersion (nvm_ctx_t*   pCtx,
+                                           gPNvm_AttrId attrId,
+                                           UInt8        version,
+                                           UInt8*       pLength,
+                                           UInt8*       pValue);
+
+gPNvm_Result gpNvmCtx_DeleteAttribute (nvm_ctx_t* pCtx, gPNvm_AttrId attrId);
+
+gPNvm_Result gpNvmCtx_ReserveAttribute (nvm_ctx_t*   pCtx,
+                                        gPNvm_AttrId attrId,
+                                        UInt8        slots);
+
+gPNvm_Result gpNvmCtx_PatchAttribute (nvm_ctx_t*   pCtx,
+                                      gPNvm_AttrId attrId,
+                                      UInt8        offset,
+                                      UInt8        length,
+                                      UInt8*       pValue);
+
+gPNvm_Result gpNvmCtx_Compact (nvm_ctx_t* pCtx);
+
+gPNvm_Result gpNvmCtx_Mount (nvm_ctx_t* pCtx);
+
+gPNvm_Result gpNvmCtx_Format (nvm_ctx_t* pCtx, UInt8 tableMode);
+
+gPNvm_Result gpNvmCtx_GetStats (nvm_ctx_t* pCtx, gpNvm_Stats_t* pStats);
+
+gPNvm_Result gpNvmCtx_SetDurability (nvm_ctx_t* pCtx, UInt8 level);
+
+gPNvm_Result gpNvmCtx_Flush (nvm_ctx_t* pCtx);
+
+gPNvm_Result gpNvmCtx_SetKey (nvm_ctx_t* pCtx, const UInt8* pSecret);
+
+gPNvm_Result gpNvmCtx_SetGroup (nvm_ctx_t*   pCtx,
+                                gPNvm_AttrId attrId,
+                                UInt8        group);
+
+gPNvm_Result gpNvmCtx_GetAttributes (nvm_ctx_t*     pCtx,
+                                     gpNvm_Batch_t* pBatch,
+                                     UInt8          count);
+
+gPNvm_Result gpNvmCtx_SetAttributes (nvm_ctx_t*     pCtx,
+                                     gpNvm_Batch_t* pBatch,
+                                     UInt8          count);
+
+gPNvm_Result gpNvmCtx_Subscribe (nvm_ctx_t*     pCtx,
+                                 gPNvm_AttrId   first,
+                                 gPNvm_AttrId   last,
+                                 gpNvm_Notify_t notify,
+                                 void*          pArg);
+
+gPNvm_Result gpNvmCtx_Unsubscribe (nvm_ctx_t*     pCtx,
+                                   gpNvm_Notify_t notify,
+                                   void*          pArg);
+
+gPNvm_Result gpNvmCtx_GetChange (nvm_ctx_t*   pCtx,
+                                 gPNvm_AttrId attrId,
+                                 UInt16*      pChange);
+
+gPNvm_Result gpNvmCtx_SetDeltaChain (nvm_ctx_t* pCtx, UInt8 maxChain);
+
+gPNvm_Result gpNvmCtx_StartTrace (nvm_ctx_t*  pCtx,
+                                  const char* path,
+                                  UInt8       flags);
+
+gPNvm_Result gpNvmCtx_StopTrace (nvm_ctx_t* pCtx);
+
+gPNvm_Result gpNvmCtx_Close (nvm_ctx_t* pCtx);
+
+nvm_ctx_t* gpNvm_GetDefaultCtx (void);
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @file nvm_integrity.c
+ * @brief This file implements the integrity codes of the values
+ *
+ * The trailer of each value is built by @ref nvmIntegrityEncode and
+ * checked by @ref nvmIntegrityCheck, according to the integrity mode of
+ * the memory (see nvm_integrity.h). The CRCs come from utils.c; the
+ * SECDED code is implemented here. The sealed mode needs the key of the
+ * store, so nvm.c seals and opens those values itself (see nvm_seal.h);
+ * here they only get their trailer length.
+ *
+ * SECDED: the 64 data bits of a block (bit b of byte j is data bit
+ * 8j + b) take the positions 3, 5, 6, 7, 9, ... 71 of a Hamming code,
+ * skipping the powers of two. The low 7 bits of the check byte are the
+ * XOR of the positions of the set data bits, and bit 7 is the parity of
+ * the whole block, check bits included. On reading, a non-zero syndrome
+ * with odd parity is the position of a single flipped bit; with even
+ * parity, two bits flipped. A short last block is padded with zeros.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <string.h>
+
+#include "nvm_integrity.h"
+#include "nvm_seal.h"
+
+#define SECDED_BLOCK_LEN    8 ///< Data bytes covered by a check byte
+
+/*
+ * Pre calculated syndromes of the data bits, a nibble at a time: entry
+ * 16 * n + v is the XOR of the positions of the bits set on value v of
+ * nibble n of the block
+ */
+static const UInt8 secdedSyndrome[256] = {
+        0x00, 0x03, 0x05, 0x06, 0x06, 0x05, 0x03, 0x00, 0x07, 0x04, 0x02, 0x01,\
+        0x01, 0x02, 0x04, 0x07, 0x00, 0x09, 0x0a, 0x03, 0x0b, 0x02, 0x01, 0x08,\
+        0x0c, 0x05, 0x06, 0x0f, 0x07, 0x0e, 0x0d, 0x04, 0x00, 0x0d, 0x0e, 0x03,\
+        0x0f, 0x02, 0x01, 0x0c, 0x11, 0x1c, 0x1f, 0x12, 0x1e, 0x13, 0x10, 0x1d,\
+        0x00, 0x12, 0x13, 0x01, 0x14, 0x06, 0x07, 0x15, 0x15, 0x07, 0x06, 0x14,\
+        0x01, 0x13, 0x12, 0x00, 0x00, 0x16, 0x17, 0x01, 0x18, 0x0e, 0x0f, 0x19,\
+        0x19, 0x0f, 0x0e, 0x18, 0x01, 0x17, 0x16, 0x00, 0x00, 0x1a, 0x1b, 0x01,\
+        0x1c, 0x06, 0x07, 0x1d, 0x1d, 0x07, 0x06, 0x1c, 0x01, 0x1b, 0x1a, 0x00,\
+        0x00, 0x1e, 0x1f, 0x01, 0x21, 0x3f, 0x3e, 0x20, 0x22, 0x3c, 0x3d, 0x23,\
+        0x03, 0x1d, 0x1c, 0x02, 0x00, 0x23, 0x24, 0x07, 0x25, 0x06, 0x01, 0x22,\
+        0x26, 0x05, 0x02, 0x21, 0x03, 0x20, 0x27, 0x04, 0x00, 0x27, 0x28, 0x0f,\
+        0x29, 0x0e, 0x01, 0x26, 0x2a, 0x0d, 0x02, 0x25, 0x03, 0x24, 0x2b, 0x0c,\
+        0x00, 0x2b, 0x2c, 0x07, 0x2d, 0x06, 0x01, 0x2a, 0x2e, 0x05, 0x02, 0x29,\
+        0x03, 0x28, 0x2f, 0x04, 0x00, 0x2f, 0x30, 0x1f, 0x31, 0x1e, 0x01, 0x2e,\
+        0x32, 0x1d, 0x02, 0x2d, 0x03, 0x2c, 0x33, 0x1c, 0x00, 0x33, 0x34, 0x07,\
+        0x35, 0x06, 0x01, 0x32, 0x36, 0x05, 0x02, 0x31, 0x03, 0x30, 0x37, 0x04,\
+        0x00, 0x37, 0x38, 0x0f, 0x39, 0x0e, 0x01, 0x36, 0x3a, 0x0d, 0x02, 0x35,\
+        0x03, 0x34, 0x3b, 0x0c, 0x00, 0x3b, 0x3c, 0x07, 0x3d, 0x06, 0x01, 0x3a,\
+        0x3e, 0x05, 0x02, 0x39, 0x03, 0x38, 0x3f, 0x04, 0x00, 0x3f, 0x41, 0x7e,\
+        0x42, 0x7d, 0x03, 0x3c, 0x43, 0x7c, 0x02, 0x3d, 0x01, 0x3e, 0x40, 0x7f,\
+        0x00, 0x44, 0x45, 0x01, 0x46, 0x02, 0x03, 0x47, 0x47, 0x03, 0x02, 0x46,\
+        0x01, 0x45, 0x44, 0x00 \
+};
+
+/*
+ * Pre calculated data bit at each Hamming position, 0xFF for the check
+ * bits and positions out of the code
+ */
+static const UInt8 secdedDataBit[128] = {
+        0xff, 0xff, 0xff, 0x00, 0xff, 0x01, 0x02, 0x03, 0xff, 0x04, 0x05, 0x06,\
+        0x07, 0x08, 0x09, 0x0a, 0xff, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11,\
+        0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0x1a, 0x1b, 0x1c,\
+        0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,\
+        0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x34,\
+        0x35, 0x36, 0x37, 0x38, 0xff, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,\
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,\
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,\
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,\
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,\
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff \
+};
+
+/**
+ * @brief Function to load a block of data as a 64-bit word
+ *
+ * @param[in] pData The block
+ * @param[in] n Length of the block, up to 8 (the rest taken as zeros)
+ * @param[out] pHigh The 32 upper bits (bytes 4 to 7)
+ * @return The 32 lower bits (bytes 0 to 3)
+ */
+static UInt32 secdedLoad(const UInt8 *pData, int n, UInt32 *pHigh)
+{
+    UInt8 block[SECDED_BLOCK_LEN];
+    UInt32 low;
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, pData, n);
+    low = block[0] | ((UInt32)block[1] << 8) | ((UInt32)block[2] << 16) | \
+          ((UInt32)block[3] << 24);
+    *pHigh = block[4] | ((UInt32)block[5] << 8) | ((UInt32)block[6] << 16) | \
+             ((UInt32)block[7] << 24);
+    return low;
+}
+
+/**
+ * @brief Function to calculate the syndrome and parity of a block
+ *
+ * @param[in] pData The block
+ * @param[in] n Length of the block, up to 8
+ * @return The 7-bit syndrome, with the parity of the data on bit 7
+ */
+static UInt8 secdedBlock(const UInt8 *pData, int n)
+{
+    UInt32 low, high, fold;
+    UInt8 synd = 0;
+    int i;
+
+    low = secdedLoad(pData, n, &high);
+    for (i = 0; i < 8; ++i)
+    {
+        synd ^= secdedSyndrome[(i << 4) | ((low >> (4 * i)) & 0xF)];
+        synd ^= secdedSyndrome[((i + 8) << 4) | ((high >> (4 * i)) & 0xF)];
+    }
+    fold = low ^ high;
+    fold ^= fold >> 16;
+    fold ^= fold >> 8;
+    fold ^= fold >> 4;
+    fold ^= fold >> 2;
+    fold ^= fold >> 1;
+
+    return synd | ((fold & 1) << 7);
+}
+
+/**
+ * @brief Function to calculate the parity of a byte
+ */
+static UInt8 parity8(UInt8 x)
+{
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & 1;
+}
+
+/**
+ * @brief Function to find out the length of the trailer of a value
+ *
+ * @param[in] mode The integrity mode
+ * @param[in] length Length of the value
+ * @return Length of the trailer, in bytes
+ */
+UInt8 nvmIntegrityLen(UInt8 mode, UInt8 length)
+{
+    switch (mode)
+    {
+        case NVM_INTEGRITY_CRC32C:
+            return sizeof(UInt32);
+        case NVM_INTEGRITY_SECDED:
+            return (length + SECDED_BLOCK_LEN - 1) / SECDED_BLOCK_LEN;
+        case NVM_INTEGRITY_SEALED:
+            return NVM_SEAL_TAG_LEN;
+        default:
+            return CRC_LEN;
+    }
+}
+
+/**
+ * @brief Function to check an integrity mode is supported
+ *
+ * @param[in] mode The integrity mode
+ * @return Non-zero if supported
+ */
+UInt8 nvmIntegrityValid(UInt8 mode)
+{
+    return (mode == NVM_INTEGRITY_CRC16) || (mode == NVM_INTEGRITY_CRC32C) || \
+           (mode == NVM_INTEGRITY_SECDED) || (mode == NVM_INTEGRITY_SEALED);
+}
+
+/**
+ * @brief Function to build the trailer of a value
+ *
+ * @param[in] mode The integrity mode
+ * @param[in] pValue The value
+ * @param[in] length Length of the value
+ * @param[out] pTrailer The trailer, @ref nvmIntegrityLen bytes
+ */
+void nvmIntegrityEncode(UInt8 mode,
+                        const UInt8 *pValue,
+                        UInt8 length,
+                        UInt8 *pTrailer)
+{
+    UInt16 crc16Calc;
+    UInt32 crc32Calc;
+    UInt8 check;
+    int i, n;
+
+    switch (mode)
+    {
+        case NVM_INTEGRITY_CRC32C:
+            crc32Calc = calcCRC32C((UInt8 *)pValue, length);
+            memcpy(pTrailer, &crc32Calc, sizeof(crc32Calc));
+            break;
+        case NVM_INTEGRITY_SECDED:
+            for (i = 0; i < length; i += SECDED_BLOCK_LEN)
+            {
+                n = (length - i < SECDED_BLOCK_LEN) ? (length - i) : \
+                                                      SECDED_BLOCK_LEN;
+                check = secdedBlock(pValue + i, n);
+                //The parity must cover the check bits too
+                check ^= parity8(check & 0x7F) << 7;
+                *pTrailer++ = check;
+            }
+            break;
+        case NVM_INTEGRITY_SEALED:
+            break; //Sealed by the caller, with the key
+        default:
+            crc16Calc = calcCRC16((UInt8 *)pValue, length);
+            memcpy(pTrailer, &crc16Calc, CRC_LEN);
+            break;
+    }
+}
+
+/**
+ * @brief Function to check a value against its trailer
+ *
+ * In SECDED mode the single flipped bits found are corrected on the
+ * value; a flipped check bit needs no correction but is counted too.
+ *
+ * @param[in] mode The integrity mode
+ * @param[in,out] pValue The value, corrected in place
+ * @param[in] length Length of the value
+ * @param[in] pTrailer The trailer read with the value
+ * @return 0 if intact, number of bits corrected, 0xFF if corrupted
+ */
+UInt8 nvmIntegrityCheck(UInt8 mode,
+                        UInt8 *pValue,
+                        UInt8 length,
+                        const UInt8 *pTrailer)
+{
+    UInt16 crc16Read;
+    UInt32 crc32Read;
+    UInt8 check, synd, bit;
+    UInt8 corrected = 0;
+    int i, n;
+
+    switch (mode)
+    {
+        case NVM_INTEGRITY_CRC32C:
+            memcpy(&crc32Read, pTrailer, sizeof(crc32Read));
+            return (crc32Read == calcCRC32C(pValue, length)) ? 0 : 0xFF;
+        case NVM_INTEGRITY_SECDED:
+            for (i = 0; i < length; i += SECDED_BLOCK_LEN)
+            {
+                n = (length - i < SECDED_BLOCK_LEN) ? (length - i) : \
+                                                      SECDED_BLOCK_LEN;
+                check = *pTrailer++;
+                synd = secdedBlock(pValue + i, n) ^ check;
+                //Bit 7: parity of data and check bits, odd if one flipped
+                synd ^= parity8(check & 0x7F) << 7;
+                if (!synd)
+                    continue;
+                if (!(synd & 0x80))
+                    return 0xFF; //Two bits flipped
+                synd &= 0x7F;
+                if (synd && (synd & (synd - 1)))
+                {
+                    bit = secdedDataBit[synd];
+                    if ((bit == 0xFF) || ((bit >> 3) >= n))
+                        return 0xFF;
+                    pValue[i + (bit >> 3)] ^= 1 << (bit & 7);
+                }
+                corrected++;
+            }
+            return corrected;
+        case NVM_INTEGRITY_SEALED:
+            return 0xFF; //Opened by the caller, with the key
+        default:
+            memcpy(&crc16Read, pTrailer, CRC_LEN);
+            return (crc16Read == calcCRC16(pValue, length)) ? 0 : 0xFF;
+    }
+}
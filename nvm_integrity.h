@@ -0,0 +1,41 @@
+/**
+ * @file nvm_integrity.h
+ * @brief Header file for the integrity codes of the values
+ *
+ * Each value stored on the values area is followed by a trailer, whose
+ * content depends on the integrity mode of the memory, chosen when it is
+ * formatted (see @ref gpNvm_Format):
+ *
+ * - @ref NVM_INTEGRITY_CRC16: CRC-16, 2 bytes. Detects any error of up
+ *   to 16 bits in a row, lets about 1 in 65536 random errors through.
+ * - @ref NVM_INTEGRITY_CRC32C: CRC-32C, 4 bytes. Detects any error of up
+ *   to 32 bits in a row, lets about 1 in 4 billion random errors through.
+ * - @ref NVM_INTEGRITY_SECDED: Hamming (72,64) SECDED, one check byte per
+ *   8-byte block. Corrects one bit and detects two bits per block, so a
+ *   value may get several bits corrected, but three or more errors on a
+ *   block can be miscorrected.
+ * - @ref NVM_INTEGRITY_SEALED: encrypted value and 8-byte tag, see
+ *   nvm_seal.h. Handled by nvm.c, which holds the key: these functions
+ *   only give its length.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_INTEGRITY_H__)
+#define __NVM_INTEGRITY_H__
+
+#include "nvm.h"
+
+/// Longest trailer: SECDED of a @ref MAX_VALUE_LENGTH value
+#define NVM_MAX_TRAILER_LEN     ((MAX_VALUE_LENGTH + 7) / 8)
+
+UInt8 nvmIntegrityLen (UInt8 mode, UInt8 length);
+UInt8 nvmIntegrityValid (UInt8 mode);
+void nvmIntegrityEncode (UInt8 mode, const UInt8* pValue, UInt8 length,
+                         UInt8* pTrailer);
+UInt8 nvmIntegrityCheck (UInt8 mode, UInt8* pValue, UInt8 length,
+                         const UInt8* pTrailer);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file nvm_schema.c
+ * @brief This file expands the attributes schema into code
+ *
+ * Everything here is generated from @ref NVM_SCHEMA: the build time
+ * checks of the schema, the default values, the descriptors used by the
+ * generic API (@ref nvmSchemaFind) and the typed accessors.
+ * The typed accessors have the size and, for @e SLOT attributes, the
+ * address fixed at compile time. A @e SLOT attribute is read and written
+ * straight on its slot, without touching the allocation table nor
+ * @ref NEXT_FREE_ADDR. When an attribute was never written, the typed
+ * getters return its default value.
+ * Each accessor comes in two flavours: gpNvmCtx_Get<name> works on the
+ * NVM instance given, gpNvm_Get<name> on the default one.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+
+#include "nvm_schema.h"
+
+/**********************************
+ * Build time checks
+ **********************************
+ * A failing check declares an array of negative size. Repeated Ids are
+ * caught by the switch on @ref nvmSchemaFind (duplicate case value).
+ */
+#define NVM_IS_SLOT_SLOT    1
+#define NVM_IS_SLOT_APPEND  0
+
+#define NVM_SCHEMA_CHECK(name, id, type, place, history, ...) \
+    typedef char nvmCheckSize##name[(sizeof(type) <= MAX_VALUE_LENGTH) ? 1 : -1]; \
+    typedef char nvmCheckId##name[((id) >= 0) && ((id) <= 0xFF) ? 1 : -1]; \
+    typedef char nvmCheckHistory##name[((history) <= NVM_MAX_HISTORY) && \
+                                       (!(history) || !NVM_IS_SLOT_##place) \
+                                       ? 1 : -1];
+NVM_SCHEMA(NVM_SCHEMA_CHECK)
+#undef NVM_SCHEMA_CHECK
+
+/// The schema area must leave most of the values area to the appends
+typedef char nvmCheckArea[(NVM_SCHEMA_AREA_LEN <= \
+                          ((MEM_VALUES_END - AB_VALUES_START) / 2)) ? 1 : -1];
+
+/**********************************
+ * Default values and descriptors
+ **********************************
+ */
+#define NVM_SCHEMA_DEFAULT(name, id, type, place, history, ...) \
+    static const type nvmDefault##name = { __VA_ARGS__ };
+NVM_SCHEMA(NVM_SCHEMA_DEFAULT)
+#undef NVM_SCHEMA_DEFAULT
+
+#define NVM_DESC_SLOT(name)     1, NVM_SLOT_ADDR(name)
+#define NVM_DESC_APPEND(name)   0, 0
+
+#define NVM_SCHEMA_DESC(name, id, type, place, history, ...) \
+    static const nvm_schema_attr_t nvmDesc##name = \
+        { sizeof(type), NVM_DESC_##place(name), (history), &nvmDefault##name };
+NVM_SCHEMA(NVM_SCHEMA_DESC)
+#undef NVM_SCHEMA_DESC
+
+/**
+ * @brief Function to find the schema description of an attribute
+ *
+ * @param[in] attrId The Id of the attribute
+ * @return The description, NULL if the attribute isn't on the schema
+ */
+const nvm_schema_attr_t *nvmSchemaFind(gPNvm_AttrId attrId)
+{
+#define NVM_SCHEMA_CASE(name, id, type, place, ...) \
+    case (id): return &nvmDesc##name;
+
+    switch (attrId)
+    {
+        NVM_SCHEMA(NVM_SCHEMA_CASE)
+        default:
+            break;
+    }
+    return NULL;
+
+#undef NVM_SCHEMA_CASE
+}
+
+/**
+ * @brief Function to find how many former values an attribute keeps
+ *
+ * @param[in] attrId The Id of the attribute
+ * @return The history depth of the schema, 0 if none or not on it
+ */
+UInt8 nvmSchemaHistory(gPNvm_AttrId attrId)
+{
+    const nvm_schema_attr_t *pAttr = nvmSchemaFind(attrId);
+
+    return pAttr ? pAttr->history : 0;
+}
+
+/**********************************
+ * Typed accessors
+ **********************************
+ */
+#define NVM_GET_SLOT(name, id, type) \
+    nvmSlotRead(pCtx, (id), NVM_SLOT_ADDR(name), sizeof(type), \
+                (UInt8 *)pValue)
+#define NVM_GET_APPEND(name, id, type) \
+    nvmGetFixed(pCtx, (id), sizeof(type), (UInt8 *)pValue)
+#define NVM_SET_SLOT(name, id, type) \
+    nvmSlotWrite(pCtx, (id), NVM_SLOT_ADDR(name), sizeof(type), \
+                 (const UInt8 *)pValue)
+#define NVM_SET_APPEND(name, id, type) \
+    nvmSetFixed(pCtx, (id), sizeof(type), (const UInt8 *)pValue)
+
+#define NVM_SCHEMA_ACCESSORS(name, id, type, place, ...) \
+gPNvm_Result gpNvmCtx_Get##name(nvm_ctx_t *pCtx, type *pValue) \
+{ \
+    gPNvm_Result ret = NVM_GET_##place(name, id, type); \
+    if (ret == NVM_ERR_NOT_FOUND) \
+    { \
+        *pValue = nvmDefault##name; \
+        ret = 0; \
+    } \
+    return ret; \
+} \
+\
+gPNvm_Result gpNvmCtx_Set##name(nvm_ctx_t *pCtx, const type *pValue) \
+{ \
+    return nvmChanged(pCtx, (id), \
+                      nvmDurable(pCtx, NVM_SET_##place(name, id, type))); \
+} \
+\
+gPNvm_Result gpNvm_Get##name(type *pValue) \
+{ \
+    return gpNvmCtx_Get##name(gpNvm_GetDefaultCtx(), pValue); \
+} \
+\
+gPNvm_Result gpNvm_Set##name(const type *pValue) \
+{ \
+    return gpNvmCtx_Set##name(gpNvm_GetDefaultCtx(), pValue); \
+}
+NVM_SCHEMA(NVM_SCHEMA_ACCESSORS)
+#undef NVM_SCHEMA_ACCESSORS
@@ -0,0 +1,105 @@
+/**
+ * @file nvm_schema.h
+ * @brief Header file for the compile-time attributes schema
+ *
+ * This file expands the schema declared on @ref nvm_schema_def.h into
+ * the typed accessors, gpNvm_Get<name> and gpNvm_Set<name>, and into the
+ * layout of the schema area. Slot addresses and sizes are compile-time
+ * constants, so the typed accessors don't look anything up.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_SCHEMA_H__)
+#define __NVM_SCHEMA_H__
+
+#include <stddef.h>
+
+#include "nvm.h"
+#include "nvm_ctx.h"
+#include "nvm_schema_def.h"
+
+/// Room for the trailer of a slot: its CRC-16, or its tag when sealed
+#define NVM_SLOT_TRAILER_LEN  NVM_SEAL_TAG_LEN
+
+/*
+ * Placement helpers, selected by pasting the place column
+ */
+#define NVM_SLOT_MEMBER_SLOT(name, type) \
+    UInt8 name[sizeof(type) + NVM_SLOT_TRAILER_LEN];
+#define NVM_SLOT_MEMBER_APPEND(name, type)
+
+/**
+ * @brief Layout of the schema area
+ *
+ * One member per @e SLOT attribute, holding the value followed by its
+ * CRC-16, or by its tag on a sealed memory (see nvm_seal.h), so each
+ * slot has room for the longer one. The members are byte arrays, so
+ * there is no padding and the offset of the last member marks the
+ * length of the area.
+ */
+typedef struct
+{
+#define NVM_SCHEMA_MEMBER(name, id, type, place, ...) \
+    NVM_SLOT_MEMBER_##place(name, type)
+    NVM_SCHEMA(NVM_SCHEMA_MEMBER)
+#undef NVM_SCHEMA_MEMBER
+    UInt8 areaEnd[1]; ///< Marks the end of the area, not stored
+} nvm_schema_area_t;
+
+/// Length of the schema area, at the top of the memory
+#define NVM_SCHEMA_AREA_LEN   offsetof(nvm_schema_area_t, areaEnd)
+/// Beginning of the schema area, which is also the end of the values area
+#define NVM_SCHEMA_AREA_START (MEM_VALUES_END - NVM_SCHEMA_AREA_LEN)
+/// Address of the slot of a @e SLOT attribute
+#define NVM_SLOT_ADDR(name) \
+    (NVM_SCHEMA_AREA_START + offsetof(nvm_schema_area_t, name))
+
+/**
+ * @brief Description of a schema attribute, for the generic API
+ */
+typedef struct
+{
+    UInt8 length;         ///< Size of the type
+    UInt8 slot;           ///< Non-zero for @e SLOT attributes
+    UInt16 slotAddr;      ///< Address of the slot, if any
+    UInt8 history;        ///< Former values kept, see NVM_SCHEMA
+    const void *pDefault; ///< Default value
+} nvm_schema_attr_t;
+
+/// Former values kept by all the attributes of the schema, together
+#define NVM_SCHEMA_HISTORY(name, id, type, place, history, ...) + (history)
+enum { NVM_HISTORY_TOTAL = 0 NVM_SCHEMA(NVM_SCHEMA_HISTORY) };
+#undef NVM_SCHEMA_HISTORY
+
+/*
+ * Typed accessors prototypes
+ */
+#define NVM_SCHEMA_PROTO(name, id, type, place, ...) \
+    gPNvm_Result gpNvm_Get##name (type* pValue); \
+    gPNvm_Result gpNvm_Set##name (const type* pValue); \
+    gPNvm_Result gpNvmCtx_Get##name (nvm_ctx_t* pCtx, type* pValue); \
+    gPNvm_Result gpNvmCtx_Set##name (nvm_ctx_t* pCtx, const type* pValue);
+NVM_SCHEMA(NVM_SCHEMA_PROTO)
+#undef NVM_SCHEMA_PROTO
+
+const nvm_schema_attr_t* nvmSchemaFind (gPNvm_AttrId attrId);
+UInt8 nvmSchemaHistory (gPNvm_AttrId attrId);
+
+gPNvm_Result nvmGetFixed (nvm_ctx_t* pCtx, gPNvm_AttrId attrId,
+                          UInt8 length, UInt8* pValue);
+gPNvm_Result nvmSetFixed (nvm_ctx_t* pCtx, gPNvm_AttrId attrId,
+                          UInt8 length, const UInt8* pValue);
+gPNvm_Result nvmSlotRead (nvm_ctx_t* pCtx, gPNvm_AttrId attrId,
+                          UInt16 slotAddr, UInt8 length, UInt8* pValue);
+gPNvm_Result nvmSlotWrite (nvm_ctx_t* pCtx, gPNvm_AttrId attrId,
+                           UInt16 slotAddr, UInt8 length,
+                           const UInt8* pValue);
+gPNvm_Result nvmSlotErase (nvm_ctx_t* pCtx, UInt16 slotAddr, UInt8 length);
+gPNvm_Result nvmDurable (nvm_ctx_t* pCtx, gPNvm_Result ret);
+gPNvm_Result nvmChanged (nvm_ctx_t* pCtx, gPNvm_AttrId attrId,
+                         gPNvm_Result ret);
+
+#endif
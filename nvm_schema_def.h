@@ -0,0 +1,55 @@
+/**
+ * @file nvm_schema_def.h
+ * @brief Declaration of the attributes known at compile time
+ *
+ * This is the only file to be edited to add an attribute to the schema.
+ * Each line of @ref NVM_SCHEMA declares an attribute once: its name (used
+ * on the typed accessors), its Id, its type (which fixes its size), where
+ * it is stored, how many former values are kept and its default value:
+ * - @e SLOT attributes get a fixed slot on the schema area, at the top of
+ *   the memory, and never go through the allocation table;
+ * - @e APPEND attributes are stored like any other attribute, appended to
+ *   the values area, just with the size fixed by the type.
+ * The history column is the number of former values of an @e APPEND
+ * attribute kept for @ref gpNvm_GetAttributeVersion, even through
+ * compaction, up to @ref NVM_MAX_HISTORY. Zero keeps none.
+ * The default value is the initializer of the type, without the braces.
+ * Any mistake (repeated Id, type too big) breaks the build.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_SCHEMA_DEF_H__)
+#define __NVM_SCHEMA_DEF_H__
+
+#include "utils.h"
+
+/**
+ * @brief Calibration data of the device
+ */
+typedef struct
+{
+    UInt16 gain;    ///< Gain, 8.8 fixed point
+    UInt16 offset;  ///< Offset, in ADC counts
+} gpCalibration_t;
+
+/// Most former values kept by an attribute with history
+#define NVM_MAX_HISTORY 7
+
+/**
+ * @brief The attributes schema
+ *
+ * AdcTrim is a calibration written in the field, whose last values are
+ * kept to roll it back.
+ */
+#define NVM_SCHEMA(X) \
+  /* name          id    type             place   history default  */ \
+    X(BootCount,   0xF0, UInt32,          SLOT,   0, 0)               \
+    X(Calibration, 0xF1, gpCalibration_t, SLOT,   0, 0x0100, 0x0000)  \
+    X(SerialNum,   0xF2, UInt32,          APPEND, 0, 0xFFFFFFFFUL)    \
+    X(DeviceMode,  0xF3, UInt8,           APPEND, 0, 1)               \
+    X(AdcTrim,     0xF4, gpCalibration_t, APPEND, 3, 0x0100, 0x0000)
+
+#endif
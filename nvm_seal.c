@@ -0,0 +1,312 @@
+/**
+ * @file nvm_seal.c
+ * @brief This file implements the sealed values (see nvm_seal.h)
+ *
+ * Both primitives are implemented here, with no library behind them:
+ * ChaCha20, in its original form (64-bit block counter and nonce), and
+ * SipHash-2-4. A value is at most 255 bytes long, 4 ChaCha20 blocks: with
+ * SSE2 the 4 blocks are computed at once, one per 32-bit lane, so a long
+ * value costs about as much as a single block. Values up to one block
+ * long are served by the scalar block function.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "nvm_seal.h"
+
+#define CHACHA_BLOCK_LEN    64 ///< Bytes of keystream per block
+#define CHACHA_DOUBLE_ROUNDS 10 ///< ChaCha20: 20 rounds
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define ROTL64(v, n) (((v) << (n)) | ((v) >> (64 - (n))))
+
+/// ChaCha quarter round, on any type with + ^ and a rotation
+#define CHACHA_QR(a, b, c, d, ADD, XOR, ROTL) \
+    a = ADD(a, b); d = XOR(d, a); d = ROTL(d, 16); \
+    c = ADD(c, d); b = XOR(b, c); b = ROTL(b, 12); \
+    a = ADD(a, b); d = XOR(d, a); d = ROTL(d, 8); \
+    c = ADD(c, d); b = XOR(b, c); b = ROTL(b, 7);
+
+#define ADD32(a, b) ((a) + (b))
+#define XOR32(a, b) ((a) ^ (b))
+
+/// Two rounds: the columns, then the diagonals of the state
+#define CHACHA_DOUBLE_ROUND(x, ADD, XOR, ROTL) \
+    CHACHA_QR(x[0], x[4], x[8],  x[12], ADD, XOR, ROTL) \
+    CHACHA_QR(x[1], x[5], x[9],  x[13], ADD, XOR, ROTL) \
+    CHACHA_QR(x[2], x[6], x[10], x[14], ADD, XOR, ROTL) \
+    CHACHA_QR(x[3], x[7], x[11], x[15], ADD, XOR, ROTL) \
+    CHACHA_QR(x[0], x[5], x[10], x[15], ADD, XOR, ROTL) \
+    CHACHA_QR(x[1], x[6], x[11], x[12], ADD, XOR, ROTL) \
+    CHACHA_QR(x[2], x[7], x[8],  x[13], ADD, XOR, ROTL) \
+    CHACHA_QR(x[3], x[4], x[9],  x[14], ADD, XOR, ROTL)
+
+/// SipHash round
+#define SIP_ROUND(v0, v1, v2, v3) \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);
+
+/// "expand 32-byte k"
+static const UInt32 chachaSigma[4] = {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
+};
+
+/**
+ * @brief Function to compute a ChaCha20 block
+ *
+ * @param[in] pIn The input state: constants, key, counter and nonce
+ * @param[out] pOut The keystream block, @ref CHACHA_BLOCK_LEN bytes
+ */
+static void chachaBlock(const UInt32 *pIn, UInt8 *pOut)
+{
+    UInt32 x[16];
+    int i;
+
+    memcpy(x, pIn, sizeof(x));
+    for (i = 0; i < CHACHA_DOUBLE_ROUNDS; ++i)
+    {
+        CHACHA_DOUBLE_ROUND(x, ADD32, XOR32, ROTL32)
+    }
+    for (i = 0; i < 16; ++i)
+        x[i] += pIn[i];
+    memcpy(pOut, x, CHACHA_BLOCK_LEN);
+}
+
+#if defined(__SSE2__)
+#define ROTL128(v, n) \
+    _mm_or_si128(_mm_slli_epi32((v), (n)), _mm_srli_epi32((v), 32 - (n)))
+
+/**
+ * @brief Function to compute 4 consecutive ChaCha20 blocks at once
+ *
+ * Register i holds word i of the state of the 4 blocks, one per lane, so
+ * each round is the scalar one on vectors. The output is transposed back
+ * 4 words at a time. The block counter must not wrap its low word.
+ *
+ * @param[in] pIn The input state of the first block
+ * @param[out] pOut The keystream, 4 * @ref CHACHA_BLOCK_LEN bytes
+ */
+static void chachaBlocks4(const UInt32 *pIn, UInt8 *pOut)
+{
+    __m128i in[16], x[16];
+    __m128i t0, t1, t2, t3;
+    int i;
+
+    for (i = 0; i < 16; ++i)
+        in[i] = _mm_set1_epi32((int)pIn[i]);
+    in[12] = _mm_add_epi32(in[12], _mm_set_epi32(3, 2, 1, 0));
+    memcpy(x, in, sizeof(x));
+    for (i = 0; i < CHACHA_DOUBLE_ROUNDS; ++i)
+    {
+        CHACHA_DOUBLE_ROUND(x, _mm_add_epi32, _mm_xor_si128, ROTL128)
+    }
+
+    for (i = 0; i < 16; i += 4)
+    {
+        x[i] = _mm_add_epi32(x[i], in[i]);
+        x[i + 1] = _mm_add_epi32(x[i + 1], in[i + 1]);
+        x[i + 2] = _mm_add_epi32(x[i + 2], in[i + 2]);
+        x[i + 3] = _mm_add_epi32(x[i + 3], in[i + 3]);
+        t0 = _mm_unpacklo_epi32(x[i], x[i + 1]);
+        t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+        t2 = _mm_unpackhi_epi32(x[i], x[i + 1]);
+        t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+        _mm_storeu_si128((__m128i *)(pOut + 4 * i), \
+                         _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *)(pOut + CHACHA_BLOCK_LEN + 4 * i), \
+                         _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *)(pOut + 2 * CHACHA_BLOCK_LEN + 4 * i), \
+                         _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i *)(pOut + 3 * CHACHA_BLOCK_LEN + 4 * i), \
+                         _mm_unpackhi_epi64(t2, t3));
+    }
+}
+#endif
+
+/**
+ * @brief Function to XOR data with a ChaCha20 keystream
+ *
+ * @param[in] pKey The keys of the store
+ * @param[in] nonce The nonce, the keystream starts at block 0
+ * @param[in,out] pData The data, up to 4 blocks
+ * @param[in] length Length of the data
+ */
+static void chachaXor(const nvm_seal_key_t *pKey,
+                      UInt64 nonce,
+                      UInt8 *pData,
+                      int length)
+{
+    UInt32 state[16];
+    UInt8 stream[4 * CHACHA_BLOCK_LEN];
+    int i;
+
+    memcpy(state, chachaSigma, sizeof(chachaSigma));
+    memcpy(state + 4, pKey->chacha, sizeof(pKey->chacha));
+    state[12] = 0;
+    state[13] = 0;
+    state[14] = (UInt32)nonce;
+    state[15] = (UInt32)(nonce >> 32);
+
+#if defined(__SSE2__)
+    if (length > CHACHA_BLOCK_LEN)
+        chachaBlocks4(state, stream);
+    else
+#endif
+    for (i = 0; i * CHACHA_BLOCK_LEN < length; ++i)
+    {
+        state[12] = i;
+        chachaBlock(state, stream + i * CHACHA_BLOCK_LEN);
+    }
+
+    for (i = 0; i < length; ++i)
+        pData[i] ^= stream[i];
+}
+
+/**
+ * @brief Function to calculate the SipHash-2-4 of a message
+ *
+ * @param[in] pKey The 128-bit key
+ * @param[in] pData The message
+ * @param[in] length Length of the message
+ * @return The 64-bit MAC
+ */
+static UInt64 sipHash(const UInt64 *pKey, const UInt8 *pData, int length)
+{
+    UInt64 v0 = 0x736f6d6570736575ULL ^ pKey[0];
+    UInt64 v1 = 0x646f72616e646f6dULL ^ pKey[1];
+    UInt64 v2 = 0x6c7967656e657261ULL ^ pKey[0];
+    UInt64 v3 = 0x7465646279746573ULL ^ pKey[1];
+    UInt64 m;
+    int i, j;
+
+    for (i = 0; i + 8 <= length; i += 8)
+    {
+        memcpy(&m, pData + i, sizeof(m));
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3)
+        SIP_ROUND(v0, v1, v2, v3)
+        v0 ^= m;
+    }
+    //Last bytes, with the length on the top byte
+    m = (UInt64)(length & 0xFF) << 56;
+    for (j = 0; i + j < length; ++j)
+        m |= (UInt64)pData[i + j] << (8 * j);
+    v3 ^= m;
+    SIP_ROUND(v0, v1, v2, v3)
+    SIP_ROUND(v0, v1, v2, v3)
+    v0 ^= m;
+
+    v2 ^= 0xFF;
+    for (i = 0; i < 4; ++i)
+    {
+        SIP_ROUND(v0, v1, v2, v3)
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief Function to calculate the tag of a plain value
+ *
+ * @param[in] pKey The keys of the store
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pValue The plain value
+ * @param[in] length Length of the value
+ * @return The tag, MAC of the Id followed by the value
+ */
+static UInt64 sealTag(const nvm_seal_key_t *pKey,
+                      UInt8 attrId,
+                      const UInt8 *pValue,
+                      UInt8 length)
+{
+    UInt8 msg[1 + 255];
+
+    msg[0] = attrId;
+    memcpy(msg + 1, pValue, length);
+    return sipHash(pKey->sip, msg, 1 + length);
+}
+
+/**
+ * @brief Function to set the keys of a store
+ *
+ * The key is used as the ChaCha20 key. The SipHash key is the start of
+ * its last keystream block (counter all ones, nonce 0), which no value
+ * ever reaches.
+ *
+ * @param[out] pKey The keys of the store
+ * @param[in] pSecret The key, @ref NVM_SEAL_KEY_LEN bytes
+ */
+void nvmSealKey(nvm_seal_key_t *pKey, const UInt8 *pSecret)
+{
+    UInt32 state[16];
+    UInt8 block[CHACHA_BLOCK_LEN];
+
+    memcpy(pKey->chacha, pSecret, sizeof(pKey->chacha));
+    memcpy(state, chachaSigma, sizeof(chachaSigma));
+    memcpy(state + 4, pKey->chacha, sizeof(pKey->chacha));
+    state[12] = 0xFFFFFFFF;
+    state[13] = 0xFFFFFFFF;
+    state[14] = 0;
+    state[15] = 0;
+    chachaBlock(state, block);
+    memcpy(pKey->sip, block, sizeof(pKey->sip));
+    pKey->loaded = 1;
+
+    memset(state, 0, sizeof(state));
+    memset(block, 0, sizeof(block));
+}
+
+/**
+ * @brief Function to seal a value: tag it, then encrypt it in place
+ *
+ * @param[in] pKey The keys of the store
+ * @param[in] attrId The Id of the attribute
+ * @param[in,out] pValue The plain value, encrypted in place
+ * @param[in] length Length of the value
+ * @param[out] pTag The tag, @ref NVM_SEAL_TAG_LEN bytes
+ */
+void nvmSeal(const nvm_seal_key_t *pKey,
+             UInt8 attrId,
+             UInt8 *pValue,
+             UInt8 length,
+             UInt8 *pTag)
+{
+    UInt64 tag = sealTag(pKey, attrId, pValue, length);
+
+    memcpy(pTag, &tag, NVM_SEAL_TAG_LEN);
+    chachaXor(pKey, tag, pValue, length);
+}
+
+/**
+ * @brief Function to open a sealed value: decrypt it, then check it
+ *
+ * @param[in] pKey The keys of the store
+ * @param[in] attrId The Id of the attribute
+ * @param[in,out] pValue The encrypted value, decrypted in place
+ * @param[in] length Length of the value
+ * @param[in] pTag The tag stored with it
+ * @return 0 if authentic, 0xFF if changed, moved or without a key
+ */
+UInt8 nvmSealOpen(const nvm_seal_key_t *pKey,
+                  UInt8 attrId,
+                  UInt8 *pValue,
+                  UInt8 length,
+                  const UInt8 *pTag)
+{
+    UInt64 tag;
+
+    if (!pKey->loaded)
+        return 0xFF;
+    memcpy(&tag, pTag, NVM_SEAL_TAG_LEN);
+    chachaXor(pKey, tag, pValue, length);
+    return (sealTag(pKey, attrId, pValue, length) == tag) ? 0 : 0xFF;
+}
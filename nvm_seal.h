@@ -0,0 +1,45 @@
+/**
+ * @file nvm_seal.h
+ * @brief Header file for the sealed values: encrypted and authenticated
+ *
+ * In @ref NVM_INTEGRITY_SEALED mode each value is stored encrypted, and
+ * its trailer is an 8-byte tag instead of a CRC. The tag is a SipHash-2-4
+ * MAC of the Id of the attribute and the plain value, so a value changed
+ * on the memory, or moved to another attribute, fails the check just
+ * like a corrupted one. The tag is also the nonce of the ChaCha20
+ * keystream the value is XORed with (a synthetic IV): a value rewritten
+ * elsewhere, or moved by compaction, needs no counter to stay unique.
+ * Equal values of an attribute give equal ciphertexts, and an older copy
+ * of a value put back in place (rollback) is not detected.
+ * Both keys come from the 32-byte key of the store, kept in RAM only.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_SEAL_H__)
+#define __NVM_SEAL_H__
+
+#include "utils.h"
+
+#define NVM_SEAL_KEY_LEN    32 ///< Length of the key of a store
+#define NVM_SEAL_TAG_LEN    8  ///< Length of the tag, trailer of a value
+
+/**
+ * @brief Keys of a store, expanded from its key
+ */
+typedef struct
+{
+    UInt32 chacha[8];   ///< ChaCha20 key
+    UInt64 sip[2];      ///< SipHash-2-4 key
+    UInt8 loaded;       ///< Non-zero once set
+} nvm_seal_key_t;
+
+void nvmSealKey (nvm_seal_key_t* pKey, const UInt8* pSecret);
+void nvmSeal (const nvm_seal_key_t* pKey, UInt8 attrId, UInt8* pValue,
+              UInt8 length, UInt8* pTag);
+UInt8 nvmSealOpen (const nvm_seal_key_t* pKey, UInt8 attrId, UInt8* pValue,
+                   UInt8 length, const UInt8* pTag);
+
+#endif
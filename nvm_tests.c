@@ -12,6 +12,8 @@
 
 
 #include "nvm.h"
+#include "nvm_ctx.h"
+#include "nvm_schema.h"
 #include "memory.h"
 #include "nvm_tests.h"
 #include "..\Unity\src\unity.h"
@@ -19,6 +21,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
  * @brief Macro to calculate the address of an AttrId
@@ -30,6 +33,32 @@
 #define ID_ADDRESS(x) (x<<2) //Since the record length is 4 bytes, let's
                              //take advantage of bit shifting
 
+/// Length of the values area left to the appends, below the schema slots
+#define APPEND_AREA_LEN (NVM_SCHEMA_AREA_START - MEM_VALUES_START)
+
+/// Stack an API call may take, and a compaction (with a window of its index)
+#define TEST_STACK_BUDGET           1024
+#define TEST_STACK_COMPACT_BUDGET   1280
+#define TEST_STACK_PROBE_LEN        32768 ///< Stack painted under a call
+#define TEST_STACK_PATTERN          0xA5
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) && !defined(__SANITIZE_ADDRESS__)
+#define __SANITIZE_ADDRESS__
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define TEST_STACK_SCALE    4 ///< Sanitizers pad every stack frame
+#else
+#define TEST_STACK_SCALE    1
+#endif
+
+#if defined(_MSC_VER)
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE __attribute__((noinline))
+#endif
+
 
 FILE *pTestMemory; ///< The testing file
 gPNvm_Result gpNvm_err = 0; ///< Variable to receive the result of Get and Set
@@ -57,7 +86,10 @@ void setUp(void)
 void tearDown(void)
 {
     if (pTestMemory)
+    {
         fclose(pTestMemory);
+        pTestMemory = NULL;
+    }
 }
 
 /**
@@ -91,28 +123,35 @@ void test_manual_initialize_memory(void)
     // tests independly in a way that we can verify each function,
     // not relying on the success of other features.
 
-    alloc_reg_t allocRegAllFF[MAX_REG_ALLOC];
+    UInt8 allFF[MEM_CHUNK_LEN];
     size_t resFseek, resFwrite;
     UInt16 memNextAddr;
-    UInt8 memValuesFF[MEM_VALUES_LEN];
+    UInt32 left, chunk;
 
     pTestMemory = fopen(".\\mem.bin", "wb");
-    memset((UInt8 *)allocRegAllFF, 0xFF, sizeof(allocRegAllFF));
+    memset(allFF, 0xFF, sizeof(allFF));
     //All 0xFF on the allocation table, meaning that there's no
     //data stored on the memory.
 
-    //Fill up the allocation table with 0xFF.
-    resFwrite = fwrite(allocRegAllFF, 1,
-                       sizeof(allocRegAllFF), pTestMemory);
-    TEST_ASSERT_EQUAL(sizeof(allocRegAllFF), resFwrite);
+    //Fill up the allocation table with 0xFF, a chunk at a time.
+    for (left = ALLOC_TABLE_LEN; left; left -= chunk)
+    {
+        chunk = (left > sizeof(allFF)) ? sizeof(allFF) : left;
+        resFwrite = fwrite(allFF, 1, chunk, pTestMemory);
+        TEST_ASSERT_EQUAL(chunk, resFwrite);
+    }
 
     memNextAddr = MEM_VALUES_START; //This value won't be used on this test.
     // It is here, just to fill the memory correctly. It's value doesn't matter
     fwrite(&memNextAddr, 1, sizeof(UInt16), pTestMemory);
-    memset((UInt8 *)memValuesFF, 0xFF, sizeof(memValuesFF));
-    resFwrite = fwrite(memValuesFF, 1, sizeof(memValuesFF), pTestMemory);
-    TEST_ASSERT_EQUAL(sizeof(memValuesFF), resFwrite);
+    for (left = MEM_VALUES_LEN; left; left -= chunk)
+    {
+        chunk = (left > sizeof(allFF)) ? sizeof(allFF) : left;
+        resFwrite = fwrite(allFF, 1, chunk, pTestMemory);
+        TEST_ASSERT_EQUAL(chunk, resFwrite);
+    }
     fclose(pTestMemory);
+    pTestMemory = NULL;
 } // test_manual_initialize_memory(
 
 /**
@@ -160,6 +199,7 @@ void test_restore_uint8(void)
     //The file is at correct position, just need to write the CRC
     fwrite ((UInt8 *)&dataCRC, 1, CRC_LEN, pTestMemory);
     fclose(pTestMemory);
+    pTestMemory = NULL;
 
     //Now perform the reading
     gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ID, (UInt8 *)pReadLen, \
@@ -198,7 +238,9 @@ void test_backup_uint8(void)
                                    (UInt8 *)pTestInt8);
     TEST_ASSERT_FALSE(gpNvm_err);
 
-    //Then read it, manually
+    //Then read it, manually. Drop whatever stdio buffered before the
+    //write, otherwise the stale 0xFF bytes would be read back.
+    fflush(pTestMemory);
     fseek(pTestMemory, valueAddr, SEEK_SET);
     fread(pValueRead, 1, sizeof(UInt8), pTestMemory);
     TEST_ASSERT_EQUAL_UINT(TEST_VALUE_INT8, valueRead);
@@ -423,6 +465,7 @@ void test_bit_flip_register(void)
     //... and rewrite
     memWrite(ID_ADDRESS(TEST_8BIT_ID), ALLOC_REG_LEN, (UInt8 *)&readReg);
     fclose(pTestMemory);
+    pTestMemory = NULL;
 
     //Now, try to read it
     gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ID, (UInt8 *)pReadLen, \
@@ -455,6 +498,7 @@ void test_bit_flip_read_uint32(void)
     fseek(pTestMemory, NEXT_FREE_ADDR, SEEK_SET);
     fread(pValueAdd, 1, SIZE_MEM_ADDRESS, pTestMemory);
     fclose(pTestMemory);
+    pTestMemory = NULL;
 
     //Write the testing value
     gpNvm_err = gpNvm_SetAttribute(TEST_32BIT_ID, \
@@ -465,8 +509,8 @@ void test_bit_flip_read_uint32(void)
     //Now flip a bit on the value
     randBit = rand() % ((8 * ALLOC_REG_LEN)-1);
     testInt32 ^= (UInt32)(1 << randBit);
-    //and manually write it
-    memWrite(valueAddr, sizeof(UInt32)+CRC_LEN, (UInt8 *)pTestInt32);
+    //and manually write it, keeping the stored CRC
+    memWrite(valueAddr, sizeof(UInt32), (UInt8 *)pTestInt32);
 
     //Then try to read it.
     gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, \
@@ -475,3 +519,1842 @@ void test_bit_flip_read_uint32(void)
     //should receive an error
     TEST_ASSERT_TRUE(gpNvm_err);
 } // test_bit_flip_read_uint32(
+
+/**
+ * @brief Function to test the deletion of an attribute
+ *
+ * This function checks that a deleted attribute can't be read anymore,
+ * can't be deleted twice, and that its Id can be reused with a different
+ * length afterwards.
+ *
+ */
+void test_delete_attribute(void)
+{
+    UInt16 testInt16 = TEST_VALUE_INT16;
+    UInt32 testInt32 = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt8 readLen;
+
+    memInit();
+    gpNvm_Mount();
+
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ID, sizeof(UInt16), \
+                                   (UInt8 *)&testInt16);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_DeleteAttribute(TEST_16BIT_ID);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    //The value is gone, and can't be deleted again
+    gpNvm_err = gpNvm_GetAttribute(TEST_16BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_TRUE(gpNvm_err);
+    gpNvm_err = gpNvm_DeleteAttribute(TEST_16BIT_ID);
+    TEST_ASSERT_TRUE(gpNvm_err);
+
+    //The Id is free again, now with another length
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ID, sizeof(UInt32), \
+                                   (UInt8 *)&testInt32);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_16BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(UInt32), readLen);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, readValue);
+} // test_delete_attribute(
+
+/**
+ * @brief Function to test the compaction of the values area
+ *
+ * This function leaves garbage behind (an overwritten and a deleted
+ * value), compacts the memory and checks that the next free address
+ * only accounts for the live values, which must still be readable.
+ *
+ */
+void test_compact_memory(void)
+{
+    UInt8 testArrayUint8[ARRAY_SIZE], readArray[ARRAY_SIZE];
+    UInt32 testInt32 = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt16 nextFree;
+    UInt8 readLen, i;
+
+    for (i = 0; i < ARRAY_SIZE; ++i)
+        testArrayUint8[i] = i;
+
+    memInit();
+    gpNvm_Mount();
+
+    gpNvm_SetAttribute(TEST_8BIT_ARRAY_ID, sizeof(testArrayUint8), \
+                       testArrayUint8);
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+    testInt32++;
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+    gpNvm_DeleteAttribute(TEST_8BIT_ARRAY_ID);
+    gpNvm_SetAttribute(TEST_8BIT_ARRAY_ID, sizeof(testArrayUint8), \
+                       testArrayUint8);
+
+    gpNvm_err = gpNvm_Compact();
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFree);
+    TEST_ASSERT_EQUAL(MEM_VALUES_START + sizeof(UInt32) + \
+                      sizeof(testArrayUint8) + 2 * CRC_LEN, nextFree);
+
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 1, readValue);
+    gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ARRAY_ID, &readLen, readArray);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(testArrayUint8), readLen);
+    TEST_ASSERT_EQUAL_MEMORY(testArrayUint8, readArray, ARRAY_SIZE);
+} // test_compact_memory(
+
+/**
+ * @brief Function to test changing the length of an attribute
+ *
+ * This function writes the same attribute with a growing and then a
+ * shrinking length, checking the last value is always the one read.
+ * The first copy must have been preserved until the switch, so both
+ * the value and the length read back come from the last write.
+ *
+ */
+void test_resize_attribute(void)
+{
+    UInt8 testArrayUint8[ARRAY_SIZE], readArray[ARRAY_SIZE];
+    UInt16 testInt16 = TEST_VALUE_INT16;
+    UInt8 readLen, i;
+
+    for (i = 0; i < ARRAY_SIZE; ++i)
+        testArrayUint8[i] = ARRAY_SIZE - i;
+
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ARRAY_ID, sizeof(UInt16), \
+                                   (UInt8 *)&testInt16);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    //Grow it
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ARRAY_ID, \
+                                   sizeof(testArrayUint8), testArrayUint8);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_16BIT_ARRAY_ID, &readLen, readArray);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(testArrayUint8), readLen);
+    TEST_ASSERT_EQUAL_MEMORY(testArrayUint8, readArray, ARRAY_SIZE);
+
+    //Then shrink it back
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ARRAY_ID, sizeof(UInt16), \
+                                   (UInt8 *)&testInt16);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_16BIT_ARRAY_ID, &readLen, readArray);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(UInt16), readLen);
+    TEST_ASSERT_EQUAL_UINT16(TEST_VALUE_INT16, *(UInt16 *)readArray);
+
+    //Lengths above the maximum are still refused
+    gpNvm_err = gpNvm_SetAttribute(TEST_16BIT_ARRAY_ID, 0xFF, readArray);
+    TEST_ASSERT_TRUE(gpNvm_err);
+} // test_resize_attribute(
+
+/**
+ * @brief Function to test the live, garbage and free bytes accounting
+ *
+ * This function follows the counters through a write, an overwrite,
+ * a deletion and a compaction, checking they always add up to the
+ * whole values area.
+ *
+ */
+void test_space_stats(void)
+{
+    UInt32 testInt32 = TEST_VALUE_INT32;
+    gpNvm_Stats_t stats;
+    const UInt16 recLen = sizeof(UInt32) + CRC_LEN;
+
+    memInit();
+    gpNvm_Mount();
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.liveBytes);
+    TEST_ASSERT_EQUAL(0, stats.deadBytes);
+    TEST_ASSERT_EQUAL(APPEND_AREA_LEN, stats.freeBytes);
+
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(recLen, stats.liveBytes);
+    TEST_ASSERT_EQUAL(recLen, stats.deadBytes);
+    TEST_ASSERT_EQUAL(APPEND_AREA_LEN - 2 * recLen, stats.freeBytes);
+
+    gpNvm_DeleteAttribute(TEST_32BIT_ID);
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.liveBytes);
+    TEST_ASSERT_EQUAL(2 * recLen, stats.deadBytes);
+
+    //A fresh scan must agree with the incremental counters
+    gpNvm_Mount();
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.liveBytes);
+    TEST_ASSERT_EQUAL(2 * recLen, stats.deadBytes);
+
+    gpNvm_Compact();
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.deadBytes);
+    TEST_ASSERT_EQUAL(APPEND_AREA_LEN, stats.freeBytes);
+} // test_space_stats(
+
+/**
+ * @brief Function to test the memory running out of space
+ *
+ * This function keeps overwriting a maximum length attribute until the
+ * values area is full. The write that doesn't fit must be refused with
+ * @ref NVM_ERR_NO_SPACE without touching the allocation table, and a
+ * compaction must make room again.
+ *
+ */
+void test_no_space(void)
+{
+    UInt8 bigValue[MAX_VALUE_LENGTH], readValue[MAX_VALUE_LENGTH];
+    UInt32 testInt32 = TEST_VALUE_INT32;
+    UInt32 readInt32;
+    UInt8 readLen;
+    gpNvm_Stats_t stats;
+    int writes = 0;
+
+    memset(bigValue, 0x5A, sizeof(bigValue));
+    memInit();
+    gpNvm_Mount();
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+
+    do
+    {
+        gpNvm_err = gpNvm_SetAttribute(TEST_8BIT_ARRAY_ID, \
+                                       sizeof(bigValue), bigValue);
+        writes++;
+    } while (!gpNvm_err);
+    TEST_ASSERT_EQUAL(NVM_ERR_NO_SPACE, gpNvm_err);
+    TEST_ASSERT_EQUAL((APPEND_AREA_LEN - sizeof(UInt32) - CRC_LEN) / \
+                      (MAX_VALUE_LENGTH + CRC_LEN) + 1, writes);
+
+    //Nothing was overwritten
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readInt32);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, readInt32);
+
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_LESS_THAN(MAX_VALUE_LENGTH + CRC_LEN, stats.freeBytes);
+    TEST_ASSERT_EQUAL(APPEND_AREA_LEN, stats.liveBytes + stats.deadBytes + \
+                                      stats.freeBytes);
+
+    gpNvm_Compact();
+    gpNvm_err = gpNvm_SetAttribute(TEST_8BIT_ARRAY_ID, \
+                                   sizeof(bigValue), bigValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ARRAY_ID, &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_MEMORY(bigValue, readValue, MAX_VALUE_LENGTH);
+} // test_no_space(
+
+/**
+ * @brief Function to test the A/B allocation table switching
+ *
+ * This function formats the memory in A/B mode and writes the same
+ * attribute twice, checking each write switches to the other table
+ * copy. Then it corrupts the header of the active copy, as a torn header
+ * write would, and checks the mount falls back to the previous copy,
+ * which still has the first value.
+ *
+ */
+void test_ab_table_switch(void)
+{
+    UInt32 testInt32 = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt8 readLen;
+    ab_header_t hdr[2];
+    gpNvm_Stats_t stats;
+
+    gpNvm_err = gpNvm_Format(NVM_TABLE_AB);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(NVM_SCHEMA_AREA_START - AB_VALUES_START, stats.freeBytes);
+
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+    testInt32++;
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&testInt32);
+
+    //Format wrote generation 1 on A, then each write switched copies
+    memRead(AB_COPY_ADDR(0), AB_HEADER_LEN, (UInt8 *)&hdr[0]);
+    memRead(AB_COPY_ADDR(1), AB_HEADER_LEN, (UInt8 *)&hdr[1]);
+    TEST_ASSERT_EQUAL_UINT32(3, hdr[0].generation);
+    TEST_ASSERT_EQUAL_UINT32(2, hdr[1].generation);
+
+    gpNvm_Mount();
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 1, readValue);
+
+    //Tear the header of the active copy
+    hdr[0].nextFree ^= 0x0100;
+    memWrite(AB_COPY_ADDR(0), AB_HEADER_LEN, (UInt8 *)&hdr[0]);
+    gpNvm_err = gpNvm_Mount();
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, readValue);
+
+    //The next write goes to the torn copy, which becomes valid again
+    gpNvm_err = gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), \
+                                   (UInt8 *)&testInt32);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_Mount();
+    memRead(AB_COPY_ADDR(0), AB_HEADER_LEN, (UInt8 *)&hdr[0]);
+    TEST_ASSERT_EQUAL_UINT32(3, hdr[0].generation);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 1, readValue);
+
+    //Back to a single table memory, for the next tests
+    gpNvm_Format(NVM_TABLE_SINGLE);
+} // test_ab_table_switch(
+
+/**
+ * @brief Function to test a single table holding the A/B magic number
+ *
+ * The header of copy B lies on the values area of a single table, so a
+ * value may hold the magic number there, even with a header CRC that
+ * checks. The memory must still mount as a single table, since the
+ * table of that copy doesn't check.
+ *
+ */
+void test_ab_magic_in_value(void)
+{
+    UInt8 value[64], readValue[64];
+    ab_header_t fake, readHdr;
+    gpNvm_Stats_t stats;
+    UInt32 freeBytes;
+    UInt8 readLen;
+    int i, crc;
+
+    for (i = 0; i < (int)sizeof(value); ++i)
+        value[i] = i;
+    memset(&fake, 0xFF, sizeof(fake));
+    fake.magic = AB_MAGIC;
+    fake.generation = 1;
+    for (crc = 0; crc < 2; ++crc)
+    {
+        //The first value covers the header of copy B
+        if (crc)
+            fake.crc = calcCRC16((UInt8 *)&fake, AB_HEADER_LEN - CRC_LEN);
+        memcpy(value + AB_COPY_ADDR(1) - MEM_VALUES_START, &fake, \
+               AB_HEADER_LEN);
+        gpNvm_Format(NVM_TABLE_SINGLE);
+        gpNvm_err = gpNvm_SetAttribute(0x40, sizeof(value), value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        memRead(AB_COPY_ADDR(1), AB_HEADER_LEN, (UInt8 *)&readHdr);
+        TEST_ASSERT_EQUAL_MEMORY(&fake, &readHdr, AB_HEADER_LEN);
+        gpNvm_GetStats(&stats);
+        freeBytes = stats.freeBytes;
+
+        //Mounted as a single table, the accounting doesn't change
+        gpNvm_err = gpNvm_Mount();
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_GetStats(&stats);
+        TEST_ASSERT_EQUAL(freeBytes, stats.freeBytes);
+        gpNvm_err = gpNvm_GetAttribute(0x40, &readLen, readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+    }
+} // test_ab_magic_in_value(
+
+/**
+ * @brief Function to test the typed accessors of the schema attributes
+ *
+ * This function checks the defaults are returned before the first write,
+ * that @e SLOT attributes are written on their fixed slot without using
+ * the allocation table nor the free space, and that the generic API
+ * agrees with the typed one.
+ *
+ */
+void test_schema_typed_access(void)
+{
+    gpCalibration_t calib, readCalib;
+    UInt32 bootCount, serialNum;
+    UInt16 nextFree, nextFreeAfter;
+    UInt8 readLen;
+
+    memInit();
+    gpNvm_Mount();
+
+    //Nothing written yet: the defaults come back
+    gpNvm_err = gpNvm_GetBootCount(&bootCount);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(0, bootCount);
+    gpNvm_err = gpNvm_GetCalibration(&readCalib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT16(0x0100, readCalib.gain);
+    gpNvm_err = gpNvm_GetSerialNum(&serialNum);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFUL, serialNum);
+
+    //Slots don't go through the allocator
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFree);
+    bootCount = TEST_VALUE_INT32;
+    gpNvm_err = gpNvm_SetBootCount(&bootCount);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    calib.gain = TEST_VALUE_INT16;
+    calib.offset = TEST_VALUE_INT8;
+    gpNvm_err = gpNvm_SetCalibration(&calib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFreeAfter);
+    TEST_ASSERT_EQUAL_UINT16(nextFree, nextFreeAfter);
+
+    gpNvm_err = gpNvm_GetCalibration(&readCalib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_MEMORY(&calib, &readCalib, sizeof(calib));
+
+    //The generic API sees the same slot, and enforces the type size
+    bootCount = 0;
+    gpNvm_err = gpNvm_GetAttribute(0xF0, &readLen, (UInt8 *)&bootCount);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(UInt32), readLen);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, bootCount);
+    gpNvm_err = gpNvm_SetAttribute(0xF0, sizeof(UInt16), (UInt8 *)&bootCount);
+    TEST_ASSERT_TRUE(gpNvm_err);
+
+    //Appended schema attributes work like any other attribute
+    serialNum = TEST_VALUE_INT32;
+    gpNvm_err = gpNvm_SetSerialNum(&serialNum);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    serialNum = 0;
+    gpNvm_err = gpNvm_GetSerialNum(&serialNum);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, serialNum);
+
+    //Deleting a slot brings its default back
+    gpNvm_err = gpNvm_DeleteAttribute(0xF0);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_GetBootCount(&bootCount);
+    TEST_ASSERT_EQUAL_UINT32(0, bootCount);
+} // test_schema_typed_access(
+
+/**
+ * @brief Function to test the fast format and the schema defaults
+ *
+ * This function checks @ref gpNvm_Format leaves the old values on the
+ * values area but unreachable, erases the schema slots and a former A/B
+ * header, and that the generic API returns the defaults of the schema
+ * attributes that were never written.
+ *
+ */
+void test_fast_format_defaults(void)
+{
+    UInt32 value = TEST_VALUE_INT32;
+    UInt16 nextFree;
+    UInt8 readValue[MAX_VALUE_LENGTH];
+    UInt8 readLen;
+
+    gpNvm_Format(NVM_TABLE_AB);
+    gpNvm_err = gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), \
+                                   (UInt8 *)&value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_SetBootCount(&value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    gpNvm_err = gpNvm_Format(NVM_TABLE_SINGLE);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    //Back to a single table memory, with nothing reachable
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFree);
+    TEST_ASSERT_EQUAL_UINT16(MEM_VALUES_START, nextFree);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, readValue);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+
+    //The old value is still there: the values area was not wiped
+    memRead(AB_VALUES_START, sizeof(UInt32), readValue);
+    TEST_ASSERT_EQUAL_MEMORY(&value, readValue, sizeof(UInt32));
+
+    //Defaults for schema attributes, from slots and from the table
+    gpNvm_err = gpNvm_GetAttribute(0xF0, &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(UInt32), readLen);
+    memcpy(&value, readValue, sizeof(UInt32));
+    TEST_ASSERT_EQUAL_UINT32(0, value);
+    gpNvm_err = gpNvm_GetAttribute(0xF3, &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(UInt8), readLen);
+    TEST_ASSERT_EQUAL_UINT8(1, readValue[0]);
+} // test_fast_format_defaults(
+
+/**
+ * @brief Function to test independent NVM instances
+ *
+ * This function runs an instance on a file of its own and another one on
+ * a RAM buffer, next to the default instance, and checks the values and
+ * the accounting of each one don't leak into the others.
+ *
+ */
+void test_ctx_instances(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    nvm_ctx_t fileCtx, ramCtx;
+    gpNvm_Stats_t fileStats, ramStats;
+    UInt32 value = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt8 readLen;
+
+    gpNvm_Format(NVM_TABLE_SINGLE);
+    gpNvmCtx_InitFile(&fileCtx, ".\\mem_ctx.bin");
+    gpNvmCtx_InitRam(&ramCtx, ram);
+    gpNvm_err = gpNvmCtx_Format(&fileCtx, NVM_TABLE_SINGLE);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_Format(&ramCtx, NVM_TABLE_AB);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    //Same Id, a different value on each instance
+    gpNvm_err = gpNvmCtx_SetAttribute(&fileCtx, TEST_32BIT_ID, \
+                                      sizeof(UInt32), (UInt8 *)&value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    value++;
+    gpNvm_err = gpNvmCtx_SetAttribute(&ramCtx, TEST_32BIT_ID, \
+                                      sizeof(UInt32), (UInt8 *)&value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_SetAttribute(&ramCtx, TEST_32BIT_ID, \
+                                      sizeof(UInt32), (UInt8 *)&value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    gpNvm_err = gpNvmCtx_GetAttribute(&fileCtx, TEST_32BIT_ID, &readLen, \
+                                      (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32, readValue);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ramCtx, TEST_32BIT_ID, &readLen, \
+                                      (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 1, readValue);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+
+    //Each instance keeps its own layout and accounting
+    gpNvmCtx_GetStats(&fileCtx, &fileStats);
+    gpNvmCtx_GetStats(&ramCtx, &ramStats);
+    TEST_ASSERT_EQUAL_UINT16(0, fileStats.deadBytes);
+    TEST_ASSERT_EQUAL_UINT16(sizeof(UInt32) + CRC_LEN, ramStats.deadBytes);
+    TEST_ASSERT_EQUAL_UINT16(fileStats.freeBytes - ramStats.deadBytes \
+                             - (AB_VALUES_START - MEM_VALUES_START), \
+                             ramStats.freeBytes);
+
+    //A remount from the memory finds the same state
+    gpNvm_err = gpNvmCtx_Mount(&ramCtx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvmCtx_GetStats(&ramCtx, &fileStats);
+    TEST_ASSERT_EQUAL_MEMORY(&ramStats, &fileStats, sizeof(ramStats));
+
+    gpNvmCtx_Close(&fileCtx);
+    remove(".\\mem_ctx.bin");
+} // test_ctx_instances(
+
+/**
+ * @brief Function to test the single bit correction of the CRCs
+ *
+ * This function flips, one at a time, every bit of a full length value
+ * followed by its CRC-16, and of an allocation register, and checks each
+ * one is found and corrected.
+ *
+ */
+void test_crc_single_bit_correction(void)
+{
+    UInt8 buff[MAX_VALUE_LENGTH + CRC_LEN], orig[MAX_VALUE_LENGTH + CRC_LEN];
+    alloc_reg_t aReg, origReg;
+    UInt16 crc16Calc;
+    int i;
+
+    for (i = 0; i < MAX_VALUE_LENGTH; ++i)
+        buff[i] = rand();
+    crc16Calc = calcCRC16(buff, MAX_VALUE_LENGTH);
+    memcpy(buff + MAX_VALUE_LENGTH, &crc16Calc, CRC_LEN);
+    memcpy(orig, buff, sizeof(buff));
+    TEST_ASSERT_EQUAL_UINT8(0, correctCRC16(buff, sizeof(buff)));
+
+    for (i = 0; i < 8 * (int)sizeof(buff); ++i)
+    {
+        buff[i >> 3] ^= 1 << (i & 7);
+        TEST_ASSERT_EQUAL_UINT8(1, correctCRC16(buff, sizeof(buff)));
+        TEST_ASSERT_EQUAL_MEMORY(orig, buff, sizeof(buff));
+    }
+
+    aReg.start = MEM_VALUES_START;
+    aReg.length = sizeof(UInt32);
+    aReg.crc = calcCRC8((UInt8 *)&aReg, ALLOC_REG_NO_CRC);
+    origReg = aReg;
+    for (i = 0; i < 8 * ALLOC_REG_LEN; ++i)
+    {
+        ((UInt8 *)&aReg)[i >> 3] ^= 1 << (i & 7);
+        TEST_ASSERT_EQUAL_UINT8(1, correctCRC8((UInt8 *)&aReg, ALLOC_REG_LEN));
+        TEST_ASSERT_EQUAL_MEMORY(&origReg, &aReg, ALLOC_REG_LEN);
+    }
+} // test_crc_single_bit_correction(
+
+/**
+ * @brief Function to test patching part of a value in place
+ *
+ * This function changes a few bytes in the middle of a full length value
+ * and a field of a @e SLOT structure, and checks the whole values read
+ * back pass the CRC-16 check, without the free space being used.
+ *
+ */
+void test_patch_attribute(void)
+{
+    UInt8 value[MAX_VALUE_LENGTH], readValue[MAX_VALUE_LENGTH];
+    UInt8 patch[] = { 0x12, 0x34, 0x56 };
+    gpCalibration_t calib, readCalib;
+    UInt16 offset = TEST_VALUE_INT16;
+    gpNvm_Stats_t stats, statsAfter;
+    UInt8 readLen;
+    int i;
+
+    gpNvm_Format(NVM_TABLE_SINGLE);
+    for (i = 0; i < MAX_VALUE_LENGTH; ++i)
+        value[i] = rand();
+    gpNvm_err = gpNvm_SetAttribute(TEST_8BIT_ARRAY_ID, MAX_VALUE_LENGTH, \
+                                   value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_GetStats(&stats);
+
+    gpNvm_err = gpNvm_PatchAttribute(TEST_8BIT_ARRAY_ID, 100, \
+                                     sizeof(patch), patch);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    memcpy(value + 100, patch, sizeof(patch));
+    gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ARRAY_ID, &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(MAX_VALUE_LENGTH, readLen);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue, MAX_VALUE_LENGTH);
+
+    //The first and the last bytes too
+    gpNvm_PatchAttribute(TEST_8BIT_ARRAY_ID, 0, 1, patch);
+    gpNvm_PatchAttribute(TEST_8BIT_ARRAY_ID, MAX_VALUE_LENGTH - 1, 1, patch);
+    value[0] = value[MAX_VALUE_LENGTH - 1] = patch[0];
+    gpNvm_err = gpNvm_GetAttribute(TEST_8BIT_ARRAY_ID, &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue, MAX_VALUE_LENGTH);
+
+    //Nothing was appended
+    gpNvm_GetStats(&statsAfter);
+    TEST_ASSERT_EQUAL_MEMORY(&stats, &statsAfter, sizeof(stats));
+
+    //Ranges out of the value and Ids without value are refused
+    gpNvm_err = gpNvm_PatchAttribute(TEST_8BIT_ARRAY_ID, \
+                                     MAX_VALUE_LENGTH - 1, 2, patch);
+    TEST_ASSERT_TRUE(gpNvm_err);
+    gpNvm_err = gpNvm_PatchAttribute(TEST_32BIT_ID, 0, 1, patch);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+
+    //A field of a slot structure
+    calib.gain = TEST_VALUE_INT8;
+    calib.offset = 0;
+    gpNvm_SetCalibration(&calib);
+    gpNvm_err = gpNvm_PatchAttribute(0xF1, offsetof(gpCalibration_t, offset), \
+                                     sizeof(offset), (UInt8 *)&offset);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetCalibration(&readCalib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT16(TEST_VALUE_INT8, readCalib.gain);
+    TEST_ASSERT_EQUAL_UINT16(TEST_VALUE_INT16, readCalib.offset);
+} // test_patch_attribute(
+
+/**
+ * @brief Function to test the CRC-32C and SECDED integrity modes
+ *
+ * This function formats an A/B memory in each mode, and flips bits of a
+ * stored value on two of its 8-byte blocks: CRC-32C must report the
+ * error, SECDED must correct both bits. A patch spanning two blocks must
+ * keep the trailer valid, and the mode must be found again on a remount.
+ * So must a patch up to the end of a full length value.
+ *
+ */
+void test_integrity_modes(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    static const UInt8 modes[] = { NVM_INTEGRITY_CRC32C, \
+                                   NVM_INTEGRITY_SECDED };
+    UInt8 value[20], readValue[MAX_VALUE_LENGTH];
+    UInt8 longValue[MAX_VALUE_LENGTH];
+    UInt8 patch[] = { 0x12, 0x34, 0x56, 0x78 };
+    nvm_ctx_t ctx;
+    UInt16 start;
+    UInt8 readLen;
+    int i, m;
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    //The single table only has room for the CRC-16
+    gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_SINGLE | NVM_INTEGRITY_CRC32C);
+    TEST_ASSERT_TRUE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB | 0x40);
+    TEST_ASSERT_TRUE(gpNvm_err);
+
+    for (i = 0; i < (int)sizeof(value); ++i)
+        value[i] = rand();
+    for (m = 0; m < (int)sizeof(modes); ++m)
+    {
+        gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB | modes[m]);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_SetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                          sizeof(value), value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        start = ctx.table[TEST_8BIT_ARRAY_ID].start;
+
+        ram[start + 1] ^= 0x10;
+        ram[start + 17] ^= 0x01;
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                          &readLen, readValue);
+        if (modes[m] == NVM_INTEGRITY_SECDED)
+        {
+            TEST_ASSERT_FALSE(gpNvm_err);
+            TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+            //Two bits on the same block are beyond correction
+            ram[start + 2] ^= 0x01;
+            gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                              &readLen, readValue);
+        }
+        TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+
+        //A fresh copy, patched across the first two blocks
+        gpNvmCtx_SetAttribute(&ctx, TEST_8BIT_ARRAY_ID, sizeof(value), value);
+        gpNvm_err = gpNvmCtx_PatchAttribute(&ctx, TEST_8BIT_ARRAY_ID, 6, \
+                                            sizeof(patch), patch);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        memcpy(value + 6, patch, sizeof(patch));
+
+        gpNvm_err = gpNvmCtx_Mount(&ctx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_HEX8(modes[m], ctx.integrity);
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                          &readLen, readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL(sizeof(value), readLen);
+        TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+
+        //A patch up to the end of a full length value
+        memset(longValue, m, sizeof(longValue));
+        gpNvmCtx_SetAttribute(&ctx, TEST_8BIT_ARRAY_ID, sizeof(longValue), \
+                              longValue);
+        gpNvm_err = gpNvmCtx_PatchAttribute(&ctx, TEST_8BIT_ARRAY_ID, 30, \
+                                            sizeof(longValue) - 30, readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        memcpy(longValue + 30, readValue, sizeof(longValue) - 30);
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                          &readLen, readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_MEMORY(longValue, readValue, sizeof(longValue));
+    }
+} // test_integrity_modes(
+
+/**
+ * @brief Function to test the durability levels and the flush barrier
+ *
+ * A power loss can't be simulated here, so this function checks the
+ * levels are accepted and every call still works on each of them, with
+ * the writes seen through another handle on the file right away. A
+ * closed instance must reopen its file on the next call.
+ *
+ */
+void test_durability_levels(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    nvm_ctx_t fileCtx, ramCtx;
+    UInt32 value = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt16 valueAddr;
+    UInt8 level, readLen;
+
+    gpNvmCtx_InitFile(&fileCtx, ".\\mem_ctx.bin");
+    gpNvmCtx_InitRam(&ramCtx, ram);
+    TEST_ASSERT_EQUAL_UINT8(NVM_DURABILITY_BUFFERED, fileCtx.durability);
+    gpNvm_err = gpNvmCtx_SetDurability(&fileCtx, NVM_DURABILITY_SYNC + 1);
+    TEST_ASSERT_TRUE(gpNvm_err);
+
+    for (level = NVM_DURABILITY_NONE; level <= NVM_DURABILITY_SYNC; ++level)
+    {
+        gpNvm_err = gpNvmCtx_SetDurability(&fileCtx, level);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_Format(&fileCtx, NVM_TABLE_SINGLE);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_SetAttribute(&fileCtx, TEST_32BIT_ID, \
+                                          sizeof(UInt32), (UInt8 *)&value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_Flush(&fileCtx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+
+        //The value is already on the file, for any other reader
+        pTestMemory = fopen(".\\mem_ctx.bin", "rb");
+        fseek(pTestMemory, ID_ADDRESS(TEST_32BIT_ID), SEEK_SET);
+        fread(&valueAddr, 1, SIZE_MEM_ADDRESS, pTestMemory);
+        fseek(pTestMemory, valueAddr, SEEK_SET);
+        fread(&readValue, 1, sizeof(UInt32), pTestMemory);
+        fclose(pTestMemory);
+        pTestMemory = NULL;
+        TEST_ASSERT_EQUAL_UINT32(value, readValue);
+
+        //Nothing to sync on RAM, but the calls work the same
+        gpNvmCtx_SetDurability(&ramCtx, level);
+        gpNvm_err = gpNvmCtx_Format(&ramCtx, NVM_TABLE_AB);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_SetAttribute(&ramCtx, TEST_32BIT_ID, \
+                                          sizeof(UInt32), (UInt8 *)&value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_Flush(&ramCtx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        value++;
+    }
+
+    //Closed, then used again
+    gpNvm_err = gpNvmCtx_Close(&fileCtx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_GetAttribute(&fileCtx, TEST_32BIT_ID, &readLen, \
+                                      (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(value - 1, readValue);
+
+    gpNvmCtx_Close(&fileCtx);
+    remove(".\\mem_ctx.bin");
+} // test_durability_levels(
+
+/**
+ * @brief Function to test the single pass check of the allocation table
+ *
+ * A table mixing live, erased, tombstone and corrupted registers must
+ * give the same result as checking each register on its own.
+ *
+ */
+void test_crc8_table_check(void)
+{
+    alloc_reg_t table[MAX_REG_ALLOC];
+    UInt8 valid[MAX_REG_ALLOC / 8], erased[MAX_REG_ALLOC / 8];
+    int i, count;
+
+    for (i = 0; i < MAX_REG_ALLOC; ++i)
+    {
+        table[i].start = rand();
+        table[i].length = (i % 5 == 1) ? ALLOC_LEN_FREE : rand();
+        table[i].crc = calcCRC8((UInt8 *)&table[i], ALLOC_REG_NO_CRC);
+        if (i % 5 == 2)
+            memset(&table[i], 0xFF, ALLOC_REG_LEN);
+        else if (i % 5 == 3)
+            ((UInt8 *)&table[i])[rand() % ALLOC_REG_LEN] ^= 1 << (rand() % 8);
+    }
+
+    //Counts not multiple of 8 leave records over for the scalar path
+    for (count = MAX_REG_ALLOC; count > 0; count -= 37)
+    {
+        checkCRC8Records((UInt8 *)table, count, valid, erased);
+        for (i = 0; i < count; ++i)
+        {
+            TEST_ASSERT_EQUAL(!calcCRC8((UInt8 *)&table[i], ALLOC_REG_LEN), \
+                              !!(valid[i >> 3] & (1 << (i & 7))));
+            TEST_ASSERT_EQUAL(i % 5 == 2, \
+                              !!(erased[i >> 3] & (1 << (i & 7))));
+        }
+    }
+} // test_crc8_table_check(
+
+/**
+ * @brief Function to test the former values kept by an attribute
+ *
+ * Five calibrations are written on AdcTrim, which keeps three former
+ * values, with other values appended in between. The last four values
+ * must be read back by version, before and after a compaction, which
+ * accounts the former values as garbage and keeps no older one. A new
+ * value drops the oldest version, a delete all of them.
+ *
+ */
+void test_attribute_history(void)
+{
+    gpCalibration_t calib, readCalib;
+    gpNvm_Stats_t stats;
+    UInt32 value = TEST_VALUE_INT32;
+    UInt16 recLen = SIZE_MEM_ADDRESS + sizeof(gpCalibration_t) + CRC_LEN;
+    UInt8 readLen;
+    int i, n;
+
+    gpNvm_Format(NVM_TABLE_SINGLE);
+    for (i = 0; i < 5; ++i)
+    {
+        calib.gain = TEST_VALUE_INT16 + i;
+        calib.offset = i;
+        gpNvm_err = gpNvm_SetAdcTrim(&calib);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&value);
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        for (n = 0; n <= 3; ++n)
+        {
+            gpNvm_err = gpNvm_GetAttributeVersion(0xF4, n, &readLen, \
+                                                  (UInt8 *)&readCalib);
+            TEST_ASSERT_FALSE(gpNvm_err);
+            TEST_ASSERT_EQUAL(sizeof(gpCalibration_t), readLen);
+            TEST_ASSERT_EQUAL_UINT16(TEST_VALUE_INT16 + 4 - n, readCalib.gain);
+            TEST_ASSERT_EQUAL_UINT16(4 - n, readCalib.offset);
+        }
+        //Beyond the depth of the schema
+        gpNvm_err = gpNvm_GetAttributeVersion(0xF4, 4, &readLen, \
+                                              (UInt8 *)&readCalib);
+        TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+
+        gpNvm_err = gpNvm_Compact();
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_Mount();
+    }
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(recLen + sizeof(UInt32) + CRC_LEN, stats.liveBytes);
+    TEST_ASSERT_EQUAL(3 * recLen, stats.deadBytes);
+
+    //Attributes without history have no former value
+    gpNvm_err = gpNvm_GetAttributeVersion(TEST_32BIT_ID, 1, &readLen, \
+                                          (UInt8 *)&value);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+
+    calib.gain = TEST_VALUE_INT16 + 5;
+    gpNvm_SetAdcTrim(&calib);
+    gpNvm_Compact();
+    gpNvm_err = gpNvm_GetAttributeVersion(0xF4, 3, &readLen, \
+                                          (UInt8 *)&readCalib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT16(TEST_VALUE_INT16 + 2, readCalib.gain);
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(3 * recLen, stats.deadBytes);
+
+    gpNvm_DeleteAttribute(0xF4);
+    gpNvm_err = gpNvm_GetAttributeVersion(0xF4, 1, &readLen, \
+                                          (UInt8 *)&readCalib);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+} // test_attribute_history(
+
+/**
+ * @brief Function to test an attribute pinned to a ring of slots
+ *
+ * After the reservation, sets must leave the allocation register and
+ * the next free address untouched, writing only the ring. A slot torn
+ * by a reset must be skipped in favour of the previous one, and the
+ * ring must survive a compaction and a new mount.
+ *
+ */
+void test_reserved_ring(void)
+{
+    UInt32 value = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt16 nextFree, nextFreeAfter;
+    UInt16 slotLen = 1 + sizeof(UInt32) + CRC_LEN;
+    alloc_reg_t reg, regAfter;
+    gpNvm_Stats_t stats;
+    UInt8 readLen;
+    int i;
+
+    gpNvm_Format(NVM_TABLE_SINGLE);
+    gpNvm_err = gpNvm_ReserveAttribute(TEST_32BIT_ID, 4);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err); //Not sized yet
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&value);
+    gpNvm_err = gpNvm_ReserveAttribute(TEST_32BIT_ID, 4);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_ReserveAttribute(TEST_32BIT_ID, 4);
+    TEST_ASSERT_TRUE(gpNvm_err);
+
+    memRead(ID_ADDRESS(TEST_32BIT_ID), ALLOC_REG_LEN, (UInt8 *)&reg);
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFree);
+    for (i = 1; i <= 10; ++i)
+    {
+        value = TEST_VALUE_INT32 + i;
+        gpNvm_err = gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), \
+                                       (UInt8 *)&value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                       (UInt8 *)&readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_UINT32(value, readValue);
+    }
+    memRead(ID_ADDRESS(TEST_32BIT_ID), ALLOC_REG_LEN, (UInt8 *)&regAfter);
+    memRead(NEXT_FREE_ADDR, SIZE_MEM_ADDRESS, (UInt8 *)&nextFreeAfter);
+    TEST_ASSERT_EQUAL_MEMORY(&reg, &regAfter, ALLOC_REG_LEN);
+    TEST_ASSERT_EQUAL_UINT16(nextFree, nextFreeAfter);
+    gpNvm_err = gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt16), \
+                                   (UInt8 *)&value);
+    TEST_ASSERT_TRUE(gpNvm_err); //The length is pinned
+
+    //The last set went to slot 1 (3 + 10, wrapped): tear it
+    memWrite(reg.start + RING_HEADER_LEN + slotLen + 2, 1, (UInt8 *)&reg);
+    gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, (UInt8 *)&readValue);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 9, readValue);
+    value = TEST_VALUE_INT32 + 11;
+    gpNvm_SetAttribute(TEST_32BIT_ID, sizeof(UInt32), (UInt8 *)&value);
+
+    //The value appended before the reservation is garbage
+    gpNvm_err = gpNvm_Compact();
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_Mount();
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(RING_HEADER_LEN + 4 * slotLen, stats.liveBytes);
+    TEST_ASSERT_EQUAL(0, stats.deadBytes);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(TEST_VALUE_INT32 + 11, readValue);
+
+    //A delete drops the ring
+    gpNvm_err = gpNvm_DeleteAttribute(TEST_32BIT_ID);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvm_GetAttribute(TEST_32BIT_ID, &readLen, \
+                                   (UInt8 *)&readValue);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+    gpNvm_GetStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.liveBytes);
+} // test_reserved_ring(
+
+/**
+ * @brief Function to test the sealed values
+ *
+ * A sealed memory can't be formatted without a key. A value must read
+ * back, without being found in the clear on the memory; a flipped bit,
+ * a value copied over another attribute or a wrong key must read as
+ * corrupted. Patches, rings and compaction must keep the values sealed.
+ * The schema slots must be sealed as well.
+ *
+ */
+void test_sealed_values(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    UInt8 key[NVM_SEAL_KEY_LEN], otherKey[NVM_SEAL_KEY_LEN];
+    UInt8 value[100], readValue[MAX_VALUE_LENGTH];
+    UInt8 patch[] = { 0x12, 0x34, 0x56, 0x78 };
+    UInt32 counter = TEST_VALUE_INT32;
+    UInt32 readCounter;
+    gpCalibration_t calib = { 0x0123, 0x0045 }, readCalib;
+    nvm_ctx_t ctx;
+    UInt16 start, otherStart, slot = NVM_SLOT_ADDR(BootCount);
+    UInt8 readLen;
+    int i;
+
+    for (i = 0; i < NVM_SEAL_KEY_LEN; ++i)
+    {
+        key[i] = rand();
+        otherKey[i] = key[i] ^ (i == 0);
+    }
+    for (i = 0; i < (int)sizeof(value); ++i)
+        value[i] = rand();
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB | NVM_INTEGRITY_SEALED);
+    TEST_ASSERT_TRUE(gpNvm_err); //No key yet
+    gpNvmCtx_SetKey(&ctx, key);
+    gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB | NVM_INTEGRITY_SEALED);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    gpNvm_err = gpNvmCtx_SetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      sizeof(value), value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    start = ctx.table[TEST_8BIT_ARRAY_ID].start;
+    TEST_ASSERT_TRUE(memcmp(ram + start, value, sizeof(value)));
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(sizeof(value), readLen);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+
+    //A value copied over another attribute fails its tag
+    gpNvmCtx_SetAttribute(&ctx, TEST_STRING_ID, sizeof(value), value);
+    otherStart = ctx.table[TEST_STRING_ID].start;
+    memcpy(ram + otherStart, ram + start, sizeof(value) + NVM_SEAL_TAG_LEN);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_STRING_ID, \
+                                      &readLen, readValue);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    //And so does a flipped bit
+    ram[start + 50] ^= 0x01;
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      &readLen, readValue);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    ram[start + 50] ^= 0x01;
+
+    //Patched, pinned to a ring, compacted and mounted again
+    gpNvm_err = gpNvmCtx_PatchAttribute(&ctx, TEST_8BIT_ARRAY_ID, 60, \
+                                        sizeof(patch), patch);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    memcpy(value + 60, patch, sizeof(patch));
+    gpNvmCtx_SetAttribute(&ctx, TEST_32BIT_ID, sizeof(UInt32), \
+                          (UInt8 *)&counter);
+    gpNvm_err = gpNvmCtx_ReserveAttribute(&ctx, TEST_32BIT_ID, 4);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    for (i = 0; i < 6; ++i)
+    {
+        counter++;
+        gpNvm_err = gpNvmCtx_SetAttribute(&ctx, TEST_32BIT_ID, \
+                                          sizeof(UInt32), (UInt8 *)&counter);
+        TEST_ASSERT_FALSE(gpNvm_err);
+    }
+    gpNvmCtx_DeleteAttribute(&ctx, TEST_STRING_ID);
+    gpNvm_err = gpNvmCtx_Compact(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_Mount(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      &readLen, readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_32BIT_ID, \
+                                      &readLen, (UInt8 *)&readCounter);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(counter, readCounter);
+
+    //A slot is sealed, so tampering with it fails its tag
+    gpNvm_err = gpNvmCtx_SetBootCount(&ctx, &counter);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_TRUE(memcmp(ram + slot, &counter, sizeof(counter)));
+    gpNvm_err = gpNvmCtx_PatchAttribute(&ctx, 0xF0, 0, 1, value);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    memcpy(&counter, value, 1);
+    gpNvm_err = gpNvmCtx_GetBootCount(&ctx, &readCounter);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(counter, readCounter);
+    ram[slot] ^= 0x01;
+    gpNvm_err = gpNvmCtx_GetBootCount(&ctx, &readCounter);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    //Nor can a slot be copied over another one
+    gpNvmCtx_SetCalibration(&ctx, &calib);
+    memcpy(ram + slot, ram + NVM_SLOT_ADDR(Calibration), \
+           sizeof(calib) + NVM_SEAL_TAG_LEN);
+    gpNvm_err = gpNvmCtx_GetBootCount(&ctx, &readCounter);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    gpNvm_err = gpNvmCtx_GetCalibration(&ctx, &readCalib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_MEMORY(&calib, &readCalib, sizeof(calib));
+
+    //A wrong key reads nothing, and no key writes nothing
+    gpNvmCtx_SetKey(&ctx, otherKey);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      &readLen, readValue);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_32BIT_ID, \
+                                      &readLen, (UInt8 *)&readCounter);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    gpNvm_err = gpNvmCtx_GetCalibration(&ctx, &readCalib);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    gpNvmCtx_SetKey(&ctx, NULL);
+    gpNvm_err = gpNvmCtx_SetAttribute(&ctx, TEST_8BIT_ARRAY_ID, \
+                                      sizeof(value), value);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    gpNvm_err = gpNvmCtx_SetBootCount(&ctx, &counter);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+} // test_sealed_values(
+
+/**
+ * @brief Function to test the recording of a workload trace
+ *
+ * A set, a get, a get of a missing attribute and a delete must be read
+ * back from the trace in order, with their Id, length, result and value
+ * hash, and nothing after them. Calls after the trace is stopped must
+ * not be recorded.
+ *
+ */
+void test_workload_trace(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    static const UInt8 ops[] = { NVM_TRACE_OP_SET, NVM_TRACE_OP_GET, \
+                                 NVM_TRACE_OP_GET, NVM_TRACE_OP_DELETE };
+    UInt32 value = TEST_VALUE_INT32;
+    UInt32 readValue;
+    nvm_trace_rec_t rec;
+    nvm_trace_t trace;
+    nvm_ctx_t ctx;
+    UInt8 readLen;
+    int i;
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+    gpNvm_err = gpNvmCtx_StartTrace(&ctx, ".\\trace.bin", NVM_TRACE_HASH);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvmCtx_SetAttribute(&ctx, TEST_32BIT_ID, sizeof(UInt32), \
+                          (UInt8 *)&value);
+    gpNvmCtx_GetAttribute(&ctx, TEST_32BIT_ID, &readLen, (UInt8 *)&readValue);
+    gpNvmCtx_GetAttribute(&ctx, TEST_16BIT_ID, &readLen, (UInt8 *)&readValue);
+    gpNvmCtx_DeleteAttribute(&ctx, TEST_32BIT_ID);
+    gpNvm_err = gpNvmCtx_StopTrace(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvmCtx_SetAttribute(&ctx, TEST_32BIT_ID, sizeof(UInt32), \
+                          (UInt8 *)&value);
+
+    gpNvm_err = nvmTraceOpen(&trace, ".\\trace.bin");
+    TEST_ASSERT_FALSE(gpNvm_err);
+    for (i = 0; i < (int)sizeof(ops); ++i)
+    {
+        gpNvm_err = nvmTraceRead(&trace, &rec);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL(ops[i], rec.op);
+        TEST_ASSERT_EQUAL_HEX8((i == 2) ? TEST_16BIT_ID : TEST_32BIT_ID, \
+                               rec.attrId);
+        TEST_ASSERT_EQUAL_HEX8((i == 2) ? NVM_ERR_NOT_FOUND : 0, rec.result);
+        TEST_ASSERT_EQUAL((i < 2) ? sizeof(UInt32) : 0, rec.length);
+        TEST_ASSERT_EQUAL_HEX32((i < 2) ? calcCRC32C((UInt8 *)&value, \
+                                                     sizeof(UInt32)) : 0, \
+                                rec.hash);
+    }
+    gpNvm_err = nvmTraceRead(&trace, &rec);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+    nvmTraceStop(&trace);
+    remove(".\\trace.bin");
+} // test_workload_trace(
+
+/**
+ * @brief Function to test the generational compaction
+ *
+ * Cold attributes, written once, are interleaved with counters set over
+ * and over. The first compaction must pack the cold values below the
+ * hot ones. Once a cold value is superseded, the next compaction must
+ * leave the other cold values where they are, instead of sliding them
+ * down over its garbage, and every value must still read back.
+ *
+ */
+void test_generational_compaction(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    UInt8 value[100], readValue[MAX_VALUE_LENGTH];
+    UInt16 coldStart[20];
+    UInt32 counter[4] = { 0 }, readCounter;
+    nvm_ctx_t ctx;
+    UInt8 readLen;
+    int i, j;
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+    for (i = 0; i < 20; ++i)
+    {
+        memset(value, i, sizeof(value));
+        gpNvmCtx_SetAttribute(&ctx, 0x40 + i, sizeof(value), value);
+        gpNvmCtx_SetAttribute(&ctx, 0x20 + (i & 3), sizeof(UInt32), \
+                              (UInt8 *)&counter[i & 3]);
+    }
+
+    for (j = 0; j < 2; ++j)
+    {
+        if (j)
+        {
+            memset(value, 0xA5, sizeof(value));
+            gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), value);
+        }
+        for (i = 0; ; ++i)
+        {
+            counter[i & 3]++;
+            if (gpNvmCtx_SetAttribute(&ctx, 0x20 + (i & 3), sizeof(UInt32), \
+                                      (UInt8 *)&counter[i & 3]))
+                break;
+        }
+        gpNvm_err = gpNvmCtx_Compact(&ctx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvm_err = gpNvmCtx_SetAttribute(&ctx, 0x20 + (i & 3), \
+                                          sizeof(UInt32), \
+                                          (UInt8 *)&counter[i & 3]);
+        TEST_ASSERT_FALSE(gpNvm_err);
+
+        for (i = 1; i < 20; ++i)
+        {
+            if (!j)
+                coldStart[i] = ctx.table[0x40 + i].start;
+            TEST_ASSERT_EQUAL(coldStart[i], ctx.table[0x40 + i].start);
+            TEST_ASSERT_TRUE(coldStart[i] < ctx.table[0x20].start);
+        }
+    }
+
+    for (i = 0; i < 20; ++i)
+    {
+        memset(value, i ? i : 0xA5, sizeof(value));
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40 + i, &readLen, \
+                                          readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+    }
+    for (i = 0; i < 4; ++i)
+    {
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x20 + i, &readLen, \
+                                          (UInt8 *)&readCounter);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_UINT32(counter[i], readCounter);
+    }
+} // test_generational_compaction(
+
+/**
+ * @brief Function to test the placement groups and the batch calls
+ *
+ * The members of a group are set interleaved with other attributes.
+ * Compaction must lay them out with none of the others in between, and
+ * a batch get must read them back, along with an attribute never set.
+ * A batch that doesn't fit, or with a wrong length, must leave every
+ * value as it was.
+ *
+ */
+void test_group_placement(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    UInt8 value[200], readValue[8][MAX_VALUE_LENGTH];
+    gpNvm_Batch_t batch[9];
+    nvm_ctx_t ctx;
+    UInt16 low = 0xFFFF, high = 0;
+    int i;
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+    for (i = 0; i < 8; ++i)
+    {
+        memset(value, i + 1, sizeof(value));
+        gpNvmCtx_SetAttribute(&ctx, 0x60 + i, 16, value);
+        gpNvmCtx_SetAttribute(&ctx, 0x70 + i, 40, value);
+        gpNvm_err = gpNvmCtx_SetGroup(&ctx, 0x60 + i, 1);
+        TEST_ASSERT_FALSE(gpNvm_err);
+    }
+    gpNvm_err = gpNvmCtx_Compact(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    for (i = 0; i < 8; ++i)
+    {
+        if (ctx.table[0x60 + i].start < low)
+            low = ctx.table[0x60 + i].start;
+        if (ctx.table[0x60 + i].start > high)
+            high = ctx.table[0x60 + i].start;
+    }
+    for (i = 0; i < 8; ++i)
+        TEST_ASSERT_TRUE((ctx.table[0x70 + i].start < low) || \
+                         (ctx.table[0x70 + i].start > high));
+
+    for (i = 0; i < 9; ++i)
+    {
+        batch[i].attrId = (i < 8) ? 0x67 - i : 0x7F;
+        batch[i].pValue = readValue[i & 7];
+    }
+    gpNvm_err = gpNvmCtx_GetAttributes(&ctx, batch, 9);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    for (i = 0; i < 8; ++i)
+    {
+        memset(value, 8 - i, 16);
+        TEST_ASSERT_FALSE(batch[i].result);
+        TEST_ASSERT_EQUAL(16, batch[i].length);
+        TEST_ASSERT_EQUAL_MEMORY(value, readValue[i], 16);
+    }
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, batch[8].result);
+
+    //A wrong length anywhere in a batch sets none of its values
+    memset(value, 0xEE, sizeof(value));
+    for (i = 0; i < 2; ++i)
+    {
+        batch[i].attrId = i ? 0xF0 : 0x60;
+        batch[i].length = i ? sizeof(UInt16) : 16;
+        batch[i].pValue = value;
+    }
+    gpNvm_err = gpNvmCtx_SetAttributes(&ctx, batch, 2);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, batch[0].result);
+    batch[0].pValue = readValue[0];
+    gpNvm_err = gpNvmCtx_GetAttributes(&ctx, batch, 1);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    memset(value, 1, 16);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue[0], 16);
+
+    //A batch too long for the space left sets none of its values
+    memset(value, 0xA5, sizeof(value));
+    while (!gpNvmCtx_SetAttribute(&ctx, 0x70, 40, value))
+        ;
+    for (i = 0; i < 2; ++i)
+    {
+        batch[i].attrId = 0x60 + i;
+        batch[i].length = sizeof(value);
+        batch[i].pValue = value;
+    }
+    gpNvm_err = gpNvmCtx_SetAttributes(&ctx, batch, 2);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NO_SPACE, gpNvm_err);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NO_SPACE, batch[1].result);
+    for (i = 0; i < 2; ++i)
+    {
+        memset(value, i + 1, 16);
+        batch[i].pValue = readValue[i];
+    }
+    gpNvm_err = gpNvmCtx_GetAttributes(&ctx, batch, 2);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL(16, batch[1].length);
+    TEST_ASSERT_EQUAL_MEMORY(value, readValue[1], 16);
+} // test_group_placement(
+
+static uintptr_t testStackProbe; ///< Address of the stack painted
+
+/**
+ * @brief Function to paint the stack below the caller
+ *
+ * Called right before the call measured, by the same function as
+ * @ref testStackUsed.
+ *
+ */
+static TEST_NOINLINE void testStackPaint(void)
+{
+    volatile UInt8 probe[TEST_STACK_PROBE_LEN];
+    int i;
+
+    for (i = 0; i < TEST_STACK_PROBE_LEN; ++i)
+        probe[i] = TEST_STACK_PATTERN;
+    testStackProbe = (uintptr_t)probe;
+}
+
+/**
+ * @brief Function to measure the stack taken since it was painted
+ *
+ * The stack grows down, so the paint is worn from the top of the probe.
+ *
+ * @return Bytes of stack used below the caller (high-water mark)
+ */
+static TEST_NOINLINE int testStackUsed(void)
+{
+    int i;
+
+    for (i = 0; i < TEST_STACK_PROBE_LEN; ++i)
+    {
+        if (((volatile UInt8 *)testStackProbe)[i] != TEST_STACK_PATTERN)
+            break;
+    }
+    return TEST_STACK_PROBE_LEN - i;
+}
+
+/// Calls an API function on painted stack, checking it stays in budget
+#define TEST_STACK_CALL(budget, call) \
+    do \
+    { \
+        testStackPaint(); \
+        gpNvm_err = (call); \
+        used = testStackUsed(); \
+        TEST_ASSERT_FALSE(gpNvm_err); \
+        TEST_ASSERT_LESS_THAN((budget) * TEST_STACK_SCALE, used); \
+    } while (0)
+
+/**
+ * @brief Function to test the stack high-water mark of the API calls
+ *
+ * Nothing spanning more than a value is held whole on the stack: the
+ * table and the memory are streamed through @ref MEM_CHUNK_LEN bytes.
+ * Every call must stay within @ref TEST_STACK_BUDGET, on a single
+ * table and in A/B mode with the longest trailers, and a compaction
+ * within @ref TEST_STACK_COMPACT_BUDGET, on a memory full of values (its
+ * index only holds a window of them, so this doesn't grow with them).
+ * Deltas are on, so the values are read and compacted from their chains:
+ * the first bytes change on every set, and the last sets go over a chain.
+ *
+ */
+void test_stack_high_water(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    UInt8 value[MAX_VALUE_LENGTH], readLen;
+    gpNvm_Batch_t batch[4];
+    nvm_ctx_t ctx;
+    int i, j, used;
+
+    memset(value, 0x5A, sizeof(value));
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_SetDeltaChain(&ctx, NVM_DELTA_MAX_CHAIN);
+    for (j = 0; j < 2; ++j)
+    {
+        TEST_STACK_CALL(TEST_STACK_BUDGET, gpNvmCtx_Format(&ctx, j ? \
+                        (NVM_TABLE_AB | NVM_INTEGRITY_SECDED) : \
+                        NVM_TABLE_SINGLE));
+        for (i = 0; i < 600; ++i)
+        {
+            memset(value, i, 12);
+            gpNvmCtx_SetAttribute(&ctx, 0x40 + (i % 150), 96, value);
+        }
+
+        TEST_STACK_CALL(TEST_STACK_BUDGET, gpNvmCtx_Mount(&ctx));
+        TEST_STACK_CALL(TEST_STACK_COMPACT_BUDGET, gpNvmCtx_Compact(&ctx));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), \
+                                              value));
+        value[0]++;
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), \
+                                              value));
+        value[100]++;
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), \
+                                              value));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, value));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_PatchAttribute(&ctx, 0x40, 8, 8, value));
+        gpNvmCtx_SetAttribute(&ctx, 0x30, sizeof(value), value);
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_ReserveAttribute(&ctx, 0x30, 4));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_SetAttribute(&ctx, 0x30, sizeof(value), \
+                                              value));
+        for (i = 0; i < 4; ++i)
+        {
+            batch[i].attrId = 0x41 + i;
+            batch[i].length = 96;
+            batch[i].pValue = value;
+        }
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_SetAttributes(&ctx, batch, 4));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_GetAttributes(&ctx, batch, 4));
+        TEST_STACK_CALL(TEST_STACK_BUDGET, \
+                        gpNvmCtx_DeleteAttribute(&ctx, 0x41));
+    }
+} // test_stack_high_water(
+
+/**
+ * @brief Changes heard by @ref testNotify
+ */
+typedef struct
+{
+    int calls;                  ///< Callbacks so far
+    gPNvm_AttrId attrId;        ///< Attribute of the last one
+    UInt16 change;              ///< Its change counter
+} test_changes_t;
+
+static void testNotify(void *pArg, gPNvm_AttrId attrId, UInt16 change)
+{
+    test_changes_t *pChanges = pArg;
+
+    pChanges->calls++;
+    pChanges->attrId = attrId;
+    pChanges->change = change;
+}
+
+/**
+ * @brief Function to test the change subscriptions
+ *
+ * A subscriber to a range hears of each set, patch and delete of its
+ * attributes (the values of a batch one by one), with the counter
+ * reported by @ref gpNvm_GetChange, and of nothing else: failed calls,
+ * attributes out of the range, compaction. After it unsubscribes, the
+ * counters still move, but it is not called anymore. Formatting changes
+ * every attribute, so the counters start at 1.
+ *
+ */
+void test_change_subscription(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    test_changes_t changes = { 0 };
+    UInt32 value = TEST_VALUE_INT32;
+    gpNvm_Batch_t batch[2];
+    nvm_ctx_t ctx;
+    UInt16 change;
+    int i;
+
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+    gpNvm_err = gpNvmCtx_Subscribe(&ctx, 0x40, 0x4F, NULL, &changes);
+    TEST_ASSERT_TRUE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_Subscribe(&ctx, 0x40, 0x4F, testNotify, &changes);
+    TEST_ASSERT_FALSE(gpNvm_err);
+
+    gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), (UInt8 *)&value);
+    gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), (UInt8 *)&value);
+    TEST_ASSERT_EQUAL(2, changes.calls);
+    TEST_ASSERT_EQUAL_HEX8(0x40, changes.attrId);
+    gpNvmCtx_GetChange(&ctx, 0x40, &change);
+    TEST_ASSERT_EQUAL(change, changes.change);
+
+    //Out of the range, failed, or not a change
+    gpNvmCtx_SetAttribute(&ctx, 0x50, sizeof(value), (UInt8 *)&value);
+    gpNvmCtx_SetAttribute(&ctx, 0x41, MAX_VALUE_LENGTH + 1, \
+                          (UInt8 *)&value);
+    gpNvmCtx_DeleteAttribute(&ctx, 0x42);
+    gpNvmCtx_Compact(&ctx);
+    TEST_ASSERT_EQUAL(2, changes.calls);
+    gpNvmCtx_GetChange(&ctx, 0x50, &change);
+    TEST_ASSERT_EQUAL(2, change);           //Format and set
+
+    for (i = 0; i < 2; ++i)
+    {
+        batch[i].attrId = 0x41 + i;
+        batch[i].length = sizeof(value);
+        batch[i].pValue = (UInt8 *)&value;
+    }
+    gpNvmCtx_SetAttributes(&ctx, batch, 2);
+    TEST_ASSERT_EQUAL(4, changes.calls);
+    TEST_ASSERT_EQUAL_HEX8(0x42, changes.attrId);
+    gpNvmCtx_PatchAttribute(&ctx, 0x41, 0, 1, (UInt8 *)&value);
+    gpNvmCtx_DeleteAttribute(&ctx, 0x42);
+    TEST_ASSERT_EQUAL(6, changes.calls);
+    gpNvmCtx_GetChange(&ctx, 0x41, &change);
+    TEST_ASSERT_EQUAL(3, change);
+
+    gpNvm_err = gpNvmCtx_Unsubscribe(&ctx, testNotify, &changes);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), (UInt8 *)&value);
+    TEST_ASSERT_EQUAL(6, changes.calls);
+    gpNvmCtx_GetChange(&ctx, 0x40, &change);
+    TEST_ASSERT_EQUAL(4, change);
+    gpNvm_err = gpNvmCtx_Unsubscribe(&ctx, testNotify, &changes);
+    TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+} // test_change_subscription(
+
+/**
+ * @brief Function to test values kept as chains of deltas
+ *
+ * A change of a few bytes to a long value appends only the runs of its
+ * changes, up to the chain length set; the next change appends the
+ * value whole again. The value reads the same through its chain, the
+ * accounting is found again on mount, a patch goes as a delta of its
+ * own, and a compaction folds the chain into a whole value. On a single
+ * table, in A/B mode with SECDED, and sealed.
+ *
+ */
+void test_delta_chain(void)
+{
+    static UInt8 ram[MEM_SIZE];
+    const UInt8 modes[] = { NVM_TABLE_SINGLE, \
+                            NVM_TABLE_AB | NVM_INTEGRITY_SECDED, \
+                            NVM_TABLE_AB | NVM_INTEGRITY_SEALED };
+    UInt8 key[NVM_SEAL_KEY_LEN];
+    UInt8 value[200], readValue[MAX_VALUE_LENGTH];
+    UInt8 patch[] = { 0x12, 0x34, 0x56, 0x78 };
+    gpNvm_Stats_t stats, mounted;
+    nvm_ctx_t ctx;
+    UInt16 freeBytes, recLen;
+    UInt8 readLen;
+    int i, j, m;
+
+    for (i = 0; i < NVM_SEAL_KEY_LEN; ++i)
+        key[i] = rand();
+    for (i = 0; i < (int)sizeof(value); ++i)
+        value[i] = rand();
+
+    for (m = 0; m < (int)sizeof(modes); ++m)
+    {
+        gpNvmCtx_InitRam(&ctx, ram);
+        gpNvmCtx_SetKey(&ctx, key);
+        gpNvm_err = gpNvmCtx_SetDeltaChain(&ctx, NVM_DELTA_MAX_CHAIN + 1);
+        TEST_ASSERT_EQUAL_HEX8(0xFF, gpNvm_err);
+        gpNvm_err = gpNvmCtx_SetDeltaChain(&ctx, 4);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvmCtx_Format(&ctx, modes[m]);
+        gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), value);
+        gpNvmCtx_GetStats(&ctx, &stats);
+        recLen = stats.liveBytes; //The value and its trailer
+
+        //Four bytes changed at a time, the 5th change goes whole
+        for (i = 0; i < 6; ++i)
+        {
+            gpNvmCtx_GetStats(&ctx, &stats);
+            freeBytes = stats.freeBytes;
+            for (j = 0; j < 4; ++j)
+                value[i * 30 + j] ^= 0x5A;
+            gpNvm_err = gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), \
+                                              value);
+            TEST_ASSERT_FALSE(gpNvm_err);
+            gpNvmCtx_GetStats(&ctx, &stats);
+            if (i == 4)
+                TEST_ASSERT_EQUAL(recLen, freeBytes - stats.freeBytes);
+            else
+                TEST_ASSERT_LESS_THAN(24, freeBytes - stats.freeBytes);
+            gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, \
+                                              readValue);
+            TEST_ASSERT_FALSE(gpNvm_err);
+            TEST_ASSERT_EQUAL(sizeof(value), readLen);
+            TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+        }
+
+        //The chain is accounted the same on mount
+        gpNvmCtx_InitRam(&ctx, ram);
+        gpNvmCtx_SetKey(&ctx, key);
+        gpNvmCtx_SetDeltaChain(&ctx, 4);
+        gpNvmCtx_GetStats(&ctx, &mounted);
+        TEST_ASSERT_EQUAL(stats.liveBytes, mounted.liveBytes);
+        TEST_ASSERT_EQUAL(stats.deadBytes, mounted.deadBytes);
+        TEST_ASSERT_EQUAL(stats.freeBytes, mounted.freeBytes);
+
+        freeBytes = mounted.freeBytes;
+        gpNvm_err = gpNvmCtx_PatchAttribute(&ctx, 0x40, 10, sizeof(patch), \
+                                            patch);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        memcpy(value + 10, patch, sizeof(patch));
+        gpNvmCtx_GetStats(&ctx, &stats);
+        TEST_ASSERT_LESS_THAN(24, freeBytes - stats.freeBytes);
+        if (modes[m] == (NVM_TABLE_AB | NVM_INTEGRITY_SECDED))
+        {
+            //A bit flipped on the runs is corrected, block by block
+            ram[ctx.table[0x40].start + DELTA_HEADER_LEN + 9] ^= 0x04;
+            gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, \
+                                              readValue);
+            TEST_ASSERT_FALSE(gpNvm_err);
+            TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+        }
+
+        //Compaction folds the chain into a whole value
+        gpNvm_err = gpNvmCtx_Compact(&ctx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvmCtx_GetStats(&ctx, &stats);
+        TEST_ASSERT_EQUAL(recLen, stats.liveBytes);
+        TEST_ASSERT_EQUAL(0, stats.deadBytes);
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, readValue);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_MEMORY(value, readValue, sizeof(value));
+
+        //Deleting a chain frees all of it
+        value[0] ^= 0x5A;
+        gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value), value);
+        gpNvm_err = gpNvmCtx_DeleteAttribute(&ctx, 0x40);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvmCtx_GetStats(&ctx, &stats);
+        TEST_ASSERT_EQUAL(0, stats.liveBytes);
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, readValue);
+        TEST_ASSERT_EQUAL_HEX8(NVM_ERR_NOT_FOUND, gpNvm_err);
+        value[0] ^= 0x5A;
+    }
+} // test_delta_chain(
+
+#if defined(MEM_HAVE_MMAP)
+/**
+ * @brief Function to test the dirty page tracking of the mmap backend
+ *
+ * A batch of small attributes touches only the first page (table copy
+ * and values), and a fixed slot only the last ones; a flush syncs them
+ * and clears the tracking. The values must be on the file for any other
+ * reader, and found again after the file is unmapped.
+ *
+ */
+void test_mmap_dirty_pages(void)
+{
+    nvm_ctx_t ctx;
+    gpCalibration_t calib;
+    UInt32 value = TEST_VALUE_INT32;
+    UInt32 readValue;
+    UInt8 readLen;
+    int i;
+
+    remove(".\\mem_map.bin");
+    gpNvmCtx_InitMmap(&ctx, ".\\mem_map.bin");
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_32BIT_ID, &readLen, \
+                                      (UInt8 *)&readValue);
+    TEST_ASSERT_TRUE(gpNvm_err); //Not created until formatted
+    gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    gpNvm_err = gpNvmCtx_Flush(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_HEX32(0, ctx.mem.dirty);
+
+    for (i = 0; i < 8; ++i)
+    {
+        gpNvm_err = gpNvmCtx_SetAttribute(&ctx, TEST_32BIT_ID + i, \
+                                          sizeof(UInt32), (UInt8 *)&value);
+        TEST_ASSERT_FALSE(gpNvm_err);
+    }
+    TEST_ASSERT_EQUAL_HEX32(1, ctx.mem.dirty);
+    gpNvm_err = gpNvmCtx_Flush(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_HEX32(0, ctx.mem.dirty);
+
+    calib.gain = TEST_VALUE_INT8;
+    calib.offset = TEST_VALUE_INT16;
+    gpNvm_err = gpNvmCtx_SetCalibration(&ctx, &calib);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_TRUE(ctx.mem.dirty);
+    TEST_ASSERT_FALSE(ctx.mem.dirty & 1);
+    gpNvm_err = gpNvmCtx_Flush(&ctx);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_HEX32(0, ctx.mem.dirty);
+
+    //Any other reader of the file sees the values
+    pTestMemory = fopen(".\\mem_map.bin", "rb");
+    fseek(pTestMemory, AB_VALUES_START, SEEK_SET);
+    fread(&readValue, 1, sizeof(UInt32), pTestMemory);
+    fclose(pTestMemory);
+    pTestMemory = NULL;
+    TEST_ASSERT_EQUAL_UINT32(value, readValue);
+
+    gpNvmCtx_Close(&ctx);
+    gpNvm_err = gpNvmCtx_GetAttribute(&ctx, TEST_32BIT_ID + 7, &readLen, \
+                                      (UInt8 *)&readValue);
+    TEST_ASSERT_FALSE(gpNvm_err);
+    TEST_ASSERT_EQUAL_UINT32(value, readValue);
+
+    gpNvmCtx_Close(&ctx);
+    remove(".\\mem_map.bin");
+} // test_mmap_dirty_pages(
+#endif
+
+#if defined(MEM_HAVE_URING)
+/**
+ * @brief Function to test the io_uring backend and its fallback
+ *
+ * More writes than the queue holds are done over many calls, each call
+ * submitting its own; a batch get reads its range ahead. A sync goes
+ * with the writes of its call, so another reader of the file sees them.
+ * The values are found again once the ring is closed. The same with a
+ * depth of 0, read and written synchronously.
+ *
+ */
+void test_uring_backend(void)
+{
+    const UInt8 depths[] = { MEM_URING_DEPTH, 0 };
+    nvm_ctx_t ctx, other;
+    gpNvm_Batch_t batch[4];
+    gpNvm_Stats_t stats, otherStats;
+    UInt8 value[4][24], readValue[4][24];
+    UInt8 readLen;
+    int d, i;
+
+    for (d = 0; d < (int)sizeof(depths); ++d)
+    {
+        remove(".\\mem_uring.bin");
+        gpNvmCtx_InitUring(&ctx, ".\\mem_uring.bin", depths[d]);
+        gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40, &readLen, value[0]);
+        TEST_ASSERT_TRUE(gpNvm_err); //Not created until formatted
+        gpNvm_err = gpNvmCtx_Format(&ctx, NVM_TABLE_AB);
+        TEST_ASSERT_FALSE(gpNvm_err);
+
+        for (i = 0; i < 64; ++i)
+        {
+            memset(value[i % 4], i, sizeof(value[0]));
+            gpNvm_err = gpNvmCtx_SetAttribute(&ctx, 0x40 + i % 4, \
+                                              sizeof(value[0]), value[i % 4]);
+            TEST_ASSERT_FALSE(gpNvm_err);
+        }
+        for (i = 0; i < 4; ++i)
+        {
+            batch[i].attrId = 0x40 + i;
+            batch[i].pValue = readValue[i];
+        }
+        gpNvm_err = gpNvmCtx_GetAttributes(&ctx, batch, 4);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        for (i = 0; i < 4; ++i)
+        {
+            TEST_ASSERT_FALSE(batch[i].result);
+            TEST_ASSERT_EQUAL(sizeof(value[0]), batch[i].length);
+            TEST_ASSERT_EQUAL_MEMORY(value[i], readValue[i], sizeof(value[0]));
+        }
+
+        //Synced along with the writes of the call
+        gpNvm_err = gpNvmCtx_SetDurability(&ctx, NVM_DURABILITY_SYNC);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        memset(value[0], 0xA5, sizeof(value[0]));
+        gpNvm_err = gpNvmCtx_SetAttribute(&ctx, 0x40, sizeof(value[0]), \
+                                          value[0]);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        gpNvmCtx_InitFile(&other, ".\\mem_uring.bin");
+        gpNvm_err = gpNvmCtx_GetAttribute(&other, 0x40, &readLen, \
+                                          readValue[0]);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_EQUAL_MEMORY(value[0], readValue[0], sizeof(value[0]));
+        gpNvmCtx_GetStats(&ctx, &stats);
+        gpNvmCtx_GetStats(&other, &otherStats);
+        TEST_ASSERT_EQUAL(stats.liveBytes, otherStats.liveBytes);
+        TEST_ASSERT_EQUAL(stats.freeBytes, otherStats.freeBytes);
+        gpNvmCtx_Close(&other);
+
+        gpNvm_err = gpNvmCtx_Close(&ctx);
+        TEST_ASSERT_FALSE(gpNvm_err);
+        TEST_ASSERT_TRUE(ctx.mem.pUring == NULL);
+        for (i = 0; i < 4; ++i)
+        {
+            gpNvm_err = gpNvmCtx_GetAttribute(&ctx, 0x40 + i, &readLen, \
+                                              readValue[i]);
+            TEST_ASSERT_FALSE(gpNvm_err);
+            TEST_ASSERT_EQUAL_MEMORY(value[i], readValue[i], sizeof(value[0]));
+        }
+        gpNvmCtx_Close(&ctx);
+    }
+    remove(".\\mem_uring.bin");
+} // test_uring_backend(
+#endif
@@ -14,6 +14,7 @@
 #define __NVM_TESTS_H__
 
 #include "nvm.h"
+#include "memory.h"
 
 #define TEST_VALUE_INT8         149
 #define TEST_VALUE_INT16        421
@@ -76,5 +77,35 @@ void test_backup_read_simple_struct(void);
 void test_backup_read_complex_struct(void);
 void test_bit_flip_register(void);
 void test_bit_flip_read_uint32(void);
+void test_delete_attribute(void);
+void test_compact_memory(void);
+void test_resize_attribute(void);
+void test_space_stats(void);
+void test_no_space(void);
+void test_ab_table_switch(void);
+void test_ab_magic_in_value(void);
+void test_schema_typed_access(void);
+void test_fast_format_defaults(void);
+void test_ctx_instances(void);
+void test_crc_single_bit_correction(void);
+void test_patch_attribute(void);
+void test_integrity_modes(void);
+void test_durability_levels(void);
+void test_crc8_table_check(void);
+void test_attribute_history(void);
+void test_reserved_ring(void);
+void test_sealed_values(void);
+void test_workload_trace(void);
+void test_generational_compaction(void);
+void test_group_placement(void);
+void test_stack_high_water(void);
+void test_change_subscription(void);
+void test_delta_chain(void);
+#if defined(MEM_HAVE_MMAP)
+void test_mmap_dirty_pages(void);
+#endif
+#if defined(MEM_HAVE_URING)
+void test_uring_backend(void);
+#endif
 
 #endif
@@ -0,0 +1,203 @@
+/**
+ * @file nvm_trace.c
+ * @brief This file implements the workload traces (see nvm_trace.h)
+ *
+ * Records go through a buffered stream, so recording a call costs a
+ * clock read and a few bytes copied; the file is only written when the
+ * buffer fills up, or the trace is stopped.
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "nvm.h"
+#include "nvm_trace.h"
+
+#define TRACE_REC_MAX_LEN   (5 + 4 + 4) ///< Longest varint, fields, hash
+
+/**
+ * @brief Function to read a monotonic clock
+ *
+ * @return The time in microseconds
+ */
+static UInt64 traceNowUs(void)
+{
+    struct timespec ts;
+
+#if defined(_WIN32)
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (UInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Function to start writing a trace
+ *
+ * @param[out] pTrace The trace
+ * @param[in] path The trace file, replaced if it exists
+ * @param[in] flags @ref NVM_TRACE_HASH to record a hash of the values
+ * @return Error code: 0 for success, 0xFF for error
+ */
+UInt8 nvmTraceStart(nvm_trace_t *pTrace, const char *path, UInt8 flags)
+{
+    UInt8 hdr[NVM_TRACE_HEADER_LEN] = { 0 };
+    FILE *pFile = fopen(path, "wb");
+
+    if (!pFile)
+        return 0xFF;
+    memcpy(hdr, NVM_TRACE_MAGIC, 4);
+    hdr[4] = NVM_TRACE_VERSION;
+    hdr[5] = flags & NVM_TRACE_HASH;
+    if (fwrite(hdr, 1, sizeof(hdr), pFile) != sizeof(hdr))
+    {
+        fclose(pFile);
+        return 0xFF;
+    }
+    pTrace->pFile = pFile;
+    pTrace->flags = hdr[5];
+    pTrace->lastUs = traceNowUs();
+    return 0;
+}
+
+/**
+ * @brief Function to record a call
+ *
+ * A delta too long for 32 bits (over an hour idle) is recorded as the
+ * longest one. Errors writing the trace are only reported when it is
+ * stopped, so they never change the outcome of the call.
+ *
+ * @param[in,out] pTrace The trace
+ * @param[in] op NVM_TRACE_OP_*
+ * @param[in] attrId The attribute
+ * @param[in] length Length set or retrieved, 0 if none
+ * @param[in] pValue The value set or retrieved, if any
+ * @param[in] result Result of the call
+ */
+void nvmTraceRecord(nvm_trace_t *pTrace,
+                    UInt8 op,
+                    UInt8 attrId,
+                    UInt8 length,
+                    const UInt8 *pValue,
+                    UInt8 result)
+{
+    UInt8 rec[TRACE_REC_MAX_LEN];
+    UInt64 now = traceNowUs();
+    UInt64 delta = now - pTrace->lastUs;
+    UInt32 hash;
+    int n = 0;
+
+    pTrace->lastUs = now;
+    if (delta > 0xFFFFFFFFUL)
+        delta = 0xFFFFFFFFUL;
+    do
+    {
+        rec[n] = delta & 0x7F;
+        delta >>= 7;
+        rec[n++] |= delta ? 0x80 : 0;
+    } while (delta);
+    rec[n++] = op;
+    rec[n++] = attrId;
+    rec[n++] = length;
+    rec[n++] = result;
+    if (pTrace->flags & NVM_TRACE_HASH)
+    {
+        hash = length ? calcCRC32C((UInt8 *)pValue, length) : 0;
+        memcpy(rec + n, &hash, sizeof(hash));
+        n += sizeof(hash);
+    }
+    fwrite(rec, 1, n, (FILE *)pTrace->pFile);
+}
+
+/**
+ * @brief Function to stop writing, or reading, a trace
+ *
+ * @param[in,out] pTrace The trace
+ * @return Error code: 0 for success, 0xFF if a record was lost
+ */
+UInt8 nvmTraceStop(nvm_trace_t *pTrace)
+{
+    FILE *pFile = pTrace->pFile;
+    UInt8 ret;
+
+    if (!pFile)
+        return 0;
+    ret = ferror(pFile) ? 0xFF : 0;
+    if (fclose(pFile))
+        ret = 0xFF;
+    pTrace->pFile = NULL;
+    return ret;
+}
+
+/**
+ * @brief Function to open a trace for reading
+ *
+ * @param[out] pTrace The trace
+ * @param[in] path The trace file
+ * @return Error code: 0 for success, 0xFF for error or unknown format
+ */
+UInt8 nvmTraceOpen(nvm_trace_t *pTrace, const char *path)
+{
+    UInt8 hdr[NVM_TRACE_HEADER_LEN];
+    FILE *pFile = fopen(path, "rb");
+
+    if (!pFile)
+        return 0xFF;
+    if ((fread(hdr, 1, sizeof(hdr), pFile) != sizeof(hdr)) || \
+        memcmp(hdr, NVM_TRACE_MAGIC, 4) || (hdr[4] != NVM_TRACE_VERSION))
+    {
+        fclose(pFile);
+        return 0xFF;
+    }
+    pTrace->pFile = pFile;
+    pTrace->flags = hdr[5];
+    pTrace->lastUs = 0;
+    return 0;
+}
+
+/**
+ * @brief Function to read the next record of a trace
+ *
+ * @param[in,out] pTrace The trace
+ * @param[out] pRec The record
+ * @return Error code: 0 for success, @ref NVM_ERR_NOT_FOUND at the end,
+ *         0xFF for a truncated record
+ */
+UInt8 nvmTraceRead(nvm_trace_t *pTrace, nvm_trace_rec_t *pRec)
+{
+    FILE *pFile = pTrace->pFile;
+    UInt8 fields[4];
+    UInt32 delta = 0;
+    int c, shift = 0;
+
+    do
+    {
+        c = fgetc(pFile);
+        if (c == EOF)
+            return shift ? 0xFF : NVM_ERR_NOT_FOUND;
+        if (shift < 32)
+            delta |= (UInt32)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    if (fread(fields, 1, sizeof(fields), pFile) != sizeof(fields))
+        return 0xFF;
+    pRec->deltaUs = delta;
+    pRec->op = fields[0];
+    pRec->attrId = fields[1];
+    pRec->length = fields[2];
+    pRec->result = fields[3];
+    pRec->hash = 0;
+    if ((pTrace->flags & NVM_TRACE_HASH) && \
+        (fread(&pRec->hash, 1, sizeof(pRec->hash), pFile) != \
+         sizeof(pRec->hash)))
+        return 0xFF;
+    pTrace->lastUs += delta;
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file nvm_trace.h
+ * @brief Header file for the workload traces
+ *
+ * While a trace is started on an NVM instance (see
+ * @ref gpNvmCtx_StartTrace), every get, set and delete is appended to a
+ * binary file: time since the previous call, operation, attribute Id,
+ * length, result and, optionally, a CRC-32C of the value. The values
+ * themselves are never written. tools/nvm_replay.c runs a trace against
+ * any configuration of the store.
+ *
+ * File format: an 8-byte header (@ref NVM_TRACE_MAGIC, version, flags,
+ * 2 reserved bytes), then one record per call:
+ * - time since the previous record, in microseconds, as a varint (7 bits
+ *   per byte, least significant first, top bit set on all but the last)
+ * - operation (NVM_TRACE_OP_*), attribute Id, length, result: 1 byte each
+ * - with @ref NVM_TRACE_HASH, the CRC-32C of the value: 4 bytes
+ * A call every millisecond takes 6 bytes (10 with the hash).
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#if !defined(__NVM_TRACE_H__)
+#define __NVM_TRACE_H__
+
+#include "utils.h"
+
+#define NVM_TRACE_MAGIC     "NVMT" ///< First bytes of a trace
+#define NVM_TRACE_VERSION   1      ///< Version of the format
+#define NVM_TRACE_HEADER_LEN 8     ///< Magic, version, flags, reserved
+
+#define NVM_TRACE_HASH      0x01 ///< Records carry a hash of the value
+
+#define NVM_TRACE_OP_GET    0 ///< @ref gpNvm_GetAttribute
+#define NVM_TRACE_OP_SET    1 ///< @ref gpNvm_SetAttribute
+#define NVM_TRACE_OP_DELETE 2 ///< @ref gpNvm_DeleteAttribute
+
+/**
+ * @brief A trace being written or read
+ */
+typedef struct
+{
+    void *pFile;        ///< Open file, NULL if no trace
+    UInt8 flags;        ///< NVM_TRACE_HASH or 0
+    UInt64 lastUs;      ///< Time of the last record (writing)
+} nvm_trace_t;
+
+/**
+ * @brief A call, as recorded
+ */
+typedef struct
+{
+    UInt32 deltaUs;     ///< Time since the previous call
+    UInt8 op;           ///< NVM_TRACE_OP_*
+    UInt8 attrId;       ///< Attribute
+    UInt8 length;       ///< Length set or retrieved, 0 if none
+    UInt8 result;       ///< Result of the call
+    UInt32 hash;        ///< CRC-32C of the value, with NVM_TRACE_HASH
+} nvm_trace_rec_t;
+
+UInt8 nvmTraceStart (nvm_trace_t* pTrace, const char* path, UInt8 flags);
+void nvmTraceRecord (nvm_trace_t* pTrace, UInt8 op, UInt8 attrId,
+                     UInt8 length, const UInt8* pValue, UInt8 result);
+UInt8 nvmTraceStop (nvm_trace_t* pTrace);
+UInt8 nvmTraceOpen (nvm_trace_t* pTrace, const char* path);
+UInt8 nvmTraceRead (nvm_trace_t* pTrace, nvm_trace_rec_t* pRec);
+
+#endif
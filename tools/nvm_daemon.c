@@ -0,0 +1,474 @@
+/**
+ * @file nvm_daemon.c
+ * @brief Daemon sharing a store among processes
+ *
+ * This tool owns a single NVM instance (see nvm_ctx.h) and serves get,
+ * set, delete and iteration requests from any number of processes over
+ * a Unix-domain socket, with the protocol of nvm_client.h. Processes
+ * link nvm_client.c instead of nvm.c.
+ *
+ * A single thread polls all the connections. Each round, every request
+ * received so far is served, from all the clients, then the store is
+ * flushed once, and only then the responses are sent (group commit):
+ * a client pipelining a batch of sets, or many clients setting at the
+ * same time, share a single sync. A client whose responses weren't sent
+ * yet is not read, so a client that doesn't read its responses only
+ * stalls itself. If a flush fails, the clients that changed the store
+ * in that round are disconnected, so their calls fail. A set that
+ * doesn't fit compacts the store, and is tried again.
+ *
+ * Usage: nvm_daemon [-s socket] [-m] [-u] [-n] [-k keyfile] store
+ *   -s  Socket path, @ref NVM_CLI_DEFAULT_PATH by default
+ *   -m  Access the store file through the mmap backend
+ *   -u  Access the store file through the io_uring backend (Linux only):
+ *       the writes of a round go with its flush in a single submission
+ *   -n  Never sync the store (@ref NVM_DURABILITY_NONE)
+ *   -k  Key of a sealed store, a file of @ref NVM_SEAL_KEY_LEN bytes
+ *
+ * The store must exist, formatted. The daemon runs until SIGINT or
+ * SIGTERM, then flushes the store and removes the socket.
+ *
+ * Build (POSIX only, from this directory):
+ *     gcc -O2 -I.. nvm_daemon.c ../nvm.c ../memory.c ../utils.c
+ *         ../nvm_schema.c ../nvm_integrity.c ../nvm_seal.c ../nvm_trace.c
+ *         -o nvm_daemon
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nvm_ctx.h"
+#include "nvm_client.h"
+
+#define DAEMON_MAX_CLIENTS  64   ///< Connections served at once
+#define DAEMON_IN_LEN       4096 ///< Requests received, not served yet
+#define DAEMON_OUT_LEN      8192 ///< Responses not sent yet
+
+/**
+ * @brief A connection of a client
+ */
+typedef struct
+{
+    int fd;                     ///< The socket, -1 if the entry is free
+    UInt8 in[DAEMON_IN_LEN];    ///< Requests received
+    int inLen;                  ///< Bytes received
+    UInt8 out[DAEMON_OUT_LEN];  ///< Responses
+    int outLen;                 ///< Bytes of responses
+    int outPos;                 ///< Bytes already sent
+    int wrote;                  ///< Changed the store in this round
+} daemon_client_t;
+
+static daemon_client_t clients[DAEMON_MAX_CLIENTS];
+static volatile sig_atomic_t stop;
+
+/**
+ * @brief Signal handler: ends the main loop
+ */
+static void daemonStop(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/**
+ * @brief Function to find the length of the first request received
+ *
+ * @param[in] pIn The bytes received
+ * @param[in] length Number of bytes received
+ * @return Length of the request, 0 if not complete yet, -1 if malformed
+ */
+static int daemonRequestLen(const UInt8 *pIn, int length)
+{
+    if (length < NVM_REQ_HEADER_LEN)
+        return 0;
+    if ((pIn[0] < NVM_OP_GET) || (pIn[0] > NVM_OP_NEXT) || \
+        ((pIn[0] != NVM_OP_SET) && pIn[2]) || (pIn[2] > MAX_VALUE_LENGTH))
+        return -1;
+    if (length < NVM_REQ_HEADER_LEN + pIn[2])
+        return 0;
+    return NVM_REQ_HEADER_LEN + pIn[2];
+}
+
+/**
+ * @brief Function to serve a request
+ *
+ * @param[in,out] pCtx The store
+ * @param[in] pReq The request
+ * @param[out] pRsp The response
+ * @param[out] pWrote Set if the store was changed
+ * @return Length of the response
+ */
+static int daemonServe(nvm_ctx_t *pCtx,
+                       const UInt8 *pReq,
+                       UInt8 *pRsp,
+                       int *pWrote)
+{
+    gPNvm_AttrId attrId = pReq[1];
+    UInt8 length = 0;
+    gPNvm_Result ret = NVM_ERR_NOT_FOUND;
+    int id;
+
+    switch (pReq[0])
+    {
+        case NVM_OP_GET:
+            ret = gpNvmCtx_GetAttribute(pCtx, attrId, &length, \
+                                        pRsp + NVM_RSP_HEADER_LEN);
+            break;
+        case NVM_OP_SET:
+            ret = gpNvmCtx_SetAttribute(pCtx, attrId, pReq[2], \
+                                        (UInt8 *)pReq + NVM_REQ_HEADER_LEN);
+            //The daemon owns the store: it compacts it when full
+            if ((ret == NVM_ERR_NO_SPACE) && !gpNvmCtx_Compact(pCtx))
+                ret = gpNvmCtx_SetAttribute(pCtx, attrId, pReq[2], \
+                                            (UInt8 *)pReq + \
+                                            NVM_REQ_HEADER_LEN);
+            *pWrote = 1;
+            break;
+        case NVM_OP_DELETE:
+            ret = gpNvmCtx_DeleteAttribute(pCtx, attrId);
+            *pWrote = 1;
+            break;
+        default:
+            for (id = attrId; id < MAX_REG_ALLOC; ++id)
+            {
+                ret = gpNvmCtx_GetAttribute(pCtx, id, &length, \
+                                            pRsp + NVM_RSP_HEADER_LEN);
+                if (ret != NVM_ERR_NOT_FOUND)
+                    break;
+            }
+            attrId = (id < MAX_REG_ALLOC) ? id : attrId;
+            break;
+    }
+    //Only a value retrieved (bits corrected or not) is sent back
+    if ((ret == NVM_ERR_NOT_FOUND) || (ret == 0xFF))
+        length = 0;
+    pRsp[0] = ret;
+    pRsp[1] = attrId;
+    pRsp[2] = length;
+    return NVM_RSP_HEADER_LEN + length;
+}
+
+/**
+ * @brief Function to serve the requests received from a client
+ *
+ * Requests are served while there is room for their responses; the
+ * rest wait for the responses to be sent.
+ *
+ * @param[in,out] pCtx The store
+ * @param[in,out] pClient The client
+ * @return 0 for success, -1 for a malformed request
+ */
+static int daemonServeClient(nvm_ctx_t *pCtx, daemon_client_t *pClient)
+{
+    int pos = 0;
+    int reqLen;
+
+    while (pClient->outLen + NVM_MSG_MAX_LEN <= DAEMON_OUT_LEN)
+    {
+        reqLen = daemonRequestLen(pClient->in + pos, pClient->inLen - pos);
+        if (reqLen < 0)
+            return -1;
+        if (!reqLen)
+            break;
+        pClient->outLen += daemonServe(pCtx, pClient->in + pos, \
+                                       pClient->out + pClient->outLen, \
+                                       &pClient->wrote);
+        pos += reqLen;
+    }
+    memmove(pClient->in, pClient->in + pos, pClient->inLen - pos);
+    pClient->inLen -= pos;
+    return 0;
+}
+
+/**
+ * @brief Function to close a connection
+ */
+static void daemonDrop(daemon_client_t *pClient)
+{
+    close(pClient->fd);
+    pClient->fd = -1;
+}
+
+/**
+ * @brief Function to open the listening socket
+ *
+ * @param[in] path The socket path, replaced if it exists
+ * @return The socket, -1 for error
+ */
+static int daemonListen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || \
+        listen(fd, DAEMON_MAX_CLIENTS))
+    {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/**
+ * @brief Function to accept the pending connections
+ *
+ * @param[in] listenFd The listening socket
+ */
+static void daemonAccept(int listenFd)
+{
+    int fd, i;
+
+    while ((fd = accept(listenFd, NULL, NULL)) >= 0)
+    {
+        for (i = 0; (i < DAEMON_MAX_CLIENTS) && (clients[i].fd >= 0); ++i)
+            ;
+        if (i == DAEMON_MAX_CLIENTS)
+        {
+            close(fd); //Full: the client sees the connection closed
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        memset(&clients[i], 0, sizeof(clients[i]));
+        clients[i].fd = fd;
+    }
+}
+
+/**
+ * @brief Function to receive the requests of a client
+ *
+ * @param[in,out] pClient The client
+ * @return 0 for success, -1 if the connection was closed
+ */
+static int daemonReceive(daemon_client_t *pClient)
+{
+    ssize_t n;
+
+    n = read(pClient->fd, pClient->in + pClient->inLen, \
+             DAEMON_IN_LEN - pClient->inLen);
+    if (n > 0)
+        pClient->inLen += n;
+    else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Function to send the responses of a client
+ *
+ * @param[in,out] pClient The client
+ * @return 0 for success, -1 if the connection was closed
+ */
+static int daemonSend(daemon_client_t *pClient)
+{
+    ssize_t n;
+
+    while (pClient->outPos < pClient->outLen)
+    {
+        n = send(pClient->fd, pClient->out + pClient->outPos, \
+                 pClient->outLen - pClient->outPos, MSG_NOSIGNAL);
+        if (n > 0)
+            pClient->outPos += n;
+        else if ((n < 0) && (errno == EINTR))
+            continue;
+        else if ((n < 0) && (errno == EAGAIN))
+            return 0;
+        else
+            return -1;
+    }
+    pClient->outLen = 0;
+    pClient->outPos = 0;
+    return 0;
+}
+
+/**
+ * @brief Function to load a key file
+ *
+ * @param[in] path The key file
+ * @param[out] pSecret The key, @ref NVM_SEAL_KEY_LEN bytes
+ * @return 0 for success, -1 for error
+ */
+static int daemonLoadKey(const char *path, UInt8 *pSecret)
+{
+    FILE *pFile = fopen(path, "rb");
+    size_t n;
+
+    if (!pFile)
+        return -1;
+    n = fread(pSecret, 1, NVM_SEAL_KEY_LEN, pFile);
+    fclose(pFile);
+    return (n == NVM_SEAL_KEY_LEN) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    static struct pollfd fds[1 + DAEMON_MAX_CLIENTS];
+    static nvm_ctx_t ctx;
+    const char *sockPath = NVM_CLI_DEFAULT_PATH;
+    const char *keyPath = NULL;
+    UInt8 secret[NVM_SEAL_KEY_LEN];
+    int useMmap = 0, useUring = 0, durability = NVM_DURABILITY_BUFFERED;
+    int listenFd, pending, wrote, nfds, opt, i;
+    daemon_client_t *pClient;
+
+    while ((opt = getopt(argc, argv, "s:munk:")) != -1)
+    {
+        if (opt == 's')
+            sockPath = optarg;
+        else if (opt == 'm')
+            useMmap = 1;
+        else if (opt == 'u')
+            useUring = 1;
+        else if (opt == 'n')
+            durability = NVM_DURABILITY_NONE;
+        else if (opt == 'k')
+            keyPath = optarg;
+        else
+            return 2;
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-s socket] [-m] [-u] [-n] [-k keyfile] " \
+                "store\n", argv[0]);
+        return 2;
+    }
+
+#if defined(MEM_HAVE_MMAP)
+    if (useMmap)
+        gpNvmCtx_InitMmap(&ctx, argv[optind]);
+    else
+#endif
+#if defined(MEM_HAVE_URING)
+    if (useUring)
+        gpNvmCtx_InitUring(&ctx, argv[optind], MEM_URING_DEPTH);
+    else
+#endif
+    gpNvmCtx_InitFile(&ctx, argv[optind]);
+    if (keyPath)
+    {
+        if (daemonLoadKey(keyPath, secret))
+        {
+            fprintf(stderr, "%s: key must be %d bytes\n", keyPath, \
+                    NVM_SEAL_KEY_LEN);
+            return 2;
+        }
+        gpNvmCtx_SetKey(&ctx, secret);
+    }
+    gpNvmCtx_SetDurability(&ctx, durability);
+    if (gpNvmCtx_Mount(&ctx))
+    {
+        fprintf(stderr, "%s: no valid store\n", argv[optind]);
+        return 1;
+    }
+
+    listenFd = daemonListen(sockPath);
+    if (listenFd < 0)
+    {
+        fprintf(stderr, "%s: cannot listen\n", sockPath);
+        return 1;
+    }
+    for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+        clients[i].fd = -1;
+    signal(SIGINT, daemonStop);
+    signal(SIGTERM, daemonStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    pending = 0;
+    while (!stop)
+    {
+        //Clients with responses still to be sent are not read
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+        {
+            fds[1 + i].fd = clients[i].fd;
+            fds[1 + i].events = clients[i].outLen ? POLLOUT : POLLIN;
+            fds[1 + i].revents = 0;
+        }
+        nfds = poll(fds, 1 + DAEMON_MAX_CLIENTS, pending ? 0 : -1);
+        if ((nfds < 0) && (errno != EINTR))
+            break;
+        if ((nfds > 0) && (fds[0].revents & POLLIN))
+            daemonAccept(listenFd);
+
+        //Serve every request received, from all the clients
+        wrote = 0;
+        pending = 0;
+        for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+        {
+            pClient = &clients[i];
+            if ((pClient->fd < 0) || (fds[1 + i].fd != pClient->fd))
+                continue;
+            if ((fds[1 + i].revents & (POLLIN | POLLHUP | POLLERR)) && \
+                !pClient->outLen && daemonReceive(pClient))
+            {
+                daemonDrop(pClient);
+                continue;
+            }
+            if (daemonServeClient(&ctx, pClient))
+            {
+                daemonDrop(pClient);
+                continue;
+            }
+            wrote |= pClient->wrote;
+        }
+
+        //One sync for all of them, then the responses
+        if (wrote && gpNvmCtx_Flush(&ctx))
+        {
+            for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+            {
+                if ((clients[i].fd >= 0) && clients[i].wrote)
+                    daemonDrop(&clients[i]);
+            }
+        }
+        for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+        {
+            pClient = &clients[i];
+            if (pClient->fd < 0)
+                continue;
+            pClient->wrote = 0;
+            if (daemonSend(pClient))
+            {
+                daemonDrop(pClient);
+                continue;
+            }
+            //Requests held back while the responses were pending
+            if (!pClient->outLen && \
+                daemonRequestLen(pClient->in, pClient->inLen))
+                pending = 1;
+        }
+    }
+
+    for (i = 0; i < DAEMON_MAX_CLIENTS; ++i)
+    {
+        if (clients[i].fd >= 0)
+            daemonDrop(&clients[i]);
+    }
+    close(listenFd);
+    unlink(sockPath);
+    gpNvmCtx_Close(&ctx);
+    return 0;
+}
@@ -0,0 +1,580 @@
+/**
+ * @file nvm_fuzz.c
+ * @brief Differential fuzzing of the store against a reference model
+ *
+ * This tool runs a sequence of calls, decoded from an input of random
+ * bytes, on a store on the RAM backend and on a trivial model of it (an
+ * array of values indexed by Id), and aborts on the first result that
+ * differs, so a fuzzer finds the inputs that break the store. The first
+ * byte of the input chooses the configuration: single table, or A/B
+ * with an integrity mode (sealed with a fixed key), by its 3 low bits,
+ * and the chain of deltas by the others. Each call that follows is an
+ * operation byte and its operands:
+ * - set a value (length and seed of its bytes), or change a few bytes of
+ *   the current one, so deltas are made
+ * - get, delete and patch an attribute
+ * - set and get a batch of attributes
+ * - compact, or remount (a new instance on the same RAM, as after a
+ *   reset), each checking every value and the accounting afterwards
+ * Only Ids out of the schema are used, 64 of them, so calls collide.
+ * A set that doesn't fit must leave the value as it was. The live, dead
+ * and free bytes must always add up to the same, and a remount must
+ * find them as they were.
+ *
+ * Usage: nvm_fuzz [file...]
+ *        nvm_fuzz -n count [-s seed]
+ *        nvm_fuzz -c dir
+ *   file  Inputs to run; stdin when none is given (AFL)
+ *   -n    Run so many random inputs, of random length up to 16 KB
+ *   -s    Seed of the random inputs, 1 by default
+ *   -c    Write the seed corpus to a directory: long runs that fill,
+ *         fragment and compact the store, on every configuration
+ *
+ * Build (from this directory), to run inputs or random ones:
+ *     gcc -O1 -g -fsanitize=address,undefined -I.. nvm_fuzz.c ../nvm.c
+ *         ../memory.c ../utils.c ../nvm_schema.c ../nvm_integrity.c
+ *         ../nvm_seal.c ../nvm_trace.c -o nvm_fuzz
+ * with libFuzzer (clang), then nvm_fuzz -max_len=16384 corpus:
+ *     clang -O1 -g -fsanitize=fuzzer,address -DNVM_FUZZ_LIBFUZZER ...
+ * with AFL++ (persistent mode), then afl-fuzz -i corpus -o out nvm_fuzz:
+ *     afl-clang-fast -O1 -g ...
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nvm_ctx.h"
+#include "nvm_schema.h"
+
+#define FUZZ_IDS            64    ///< Attributes used, Ids 0 to 63
+#define FUZZ_MAX_INPUT      16384 ///< Longest input of the random runs
+#define FUZZ_BATCH          4     ///< Most attributes of a batch call
+
+/**
+ * @brief Operations, the operation byte modulo their count
+ */
+enum
+{
+    FUZZ_OP_SET,        ///< Id, length, seed
+    FUZZ_OP_EDIT,       ///< Id, position, count, XOR mask
+    FUZZ_OP_GET,        ///< Id
+    FUZZ_OP_DELETE,     ///< Id
+    FUZZ_OP_PATCH,      ///< Id, offset, length, seed
+    FUZZ_OP_COMPACT,    ///< None
+    FUZZ_OP_REMOUNT,    ///< None
+    FUZZ_OP_SET_BATCH,  ///< Count, then Id, length, seed for each
+    FUZZ_OP_GET_BATCH,  ///< Count, then Id for each
+    FUZZ_OPS
+};
+
+/**
+ * @brief The reference model: what every attribute should read
+ */
+typedef struct
+{
+    UInt8 present[FUZZ_IDS];                ///< Has a value
+    UInt8 length[FUZZ_IDS];                 ///< Its length
+    UInt8 value[FUZZ_IDS][MAX_VALUE_LENGTH]; ///< Its bytes
+} fuzz_model_t;
+
+/**
+ * @brief The input being decoded
+ */
+typedef struct
+{
+    const UInt8 *pData;     ///< The bytes
+    size_t size;            ///< Their count
+    size_t pos;             ///< Next byte
+} fuzz_input_t;
+
+static const UInt8 fuzzKey[NVM_SEAL_KEY_LEN] = { 0x5A, 0x17, 0xC3 };
+static const UInt8 fuzzModes[] = { NVM_TABLE_SINGLE,
+                                   NVM_TABLE_AB | NVM_INTEGRITY_CRC16,
+                                   NVM_TABLE_AB | NVM_INTEGRITY_CRC32C,
+                                   NVM_TABLE_AB | NVM_INTEGRITY_SECDED,
+                                   NVM_TABLE_AB | NVM_INTEGRITY_SEALED };
+
+static UInt8 ram[MEM_SIZE];
+static nvm_ctx_t ctx;
+static fuzz_model_t model;
+static UInt8 deltaChain;    ///< Chain of deltas of the run
+static UInt32 totalBytes;   ///< Live, dead and free bytes, added up
+static UInt32 step;         ///< Calls run, for the report
+
+/**
+ * @brief Function to take the next byte of the input
+ *
+ * @param[in,out] pIn The input
+ * @return The byte, 0 past the end
+ */
+static UInt8 fuzzByte(fuzz_input_t *pIn)
+{
+    return (pIn->pos < pIn->size) ? pIn->pData[pIn->pos++] : 0;
+}
+
+/**
+ * @brief Function to report a difference from the model and stop
+ *
+ * @param[in] what The call that differs
+ * @param[in] attrId The attribute
+ * @param[in] got What the store returned
+ * @param[in] expected What the model expected
+ */
+static void fuzzFail(const char *what, int attrId, int got, int expected)
+{
+    fprintf(stderr, "nvm_fuzz: call %lu, %s of 0x%02X: got 0x%02X, " \
+            "expected 0x%02X\n", (unsigned long)step, what, attrId, got, \
+            expected);
+    abort();
+}
+
+/**
+ * @brief Function to make the bytes of a value from a seed
+ *
+ * Consecutive seeds make values sharing most of their bytes, so a set
+ * often changes only a few of them.
+ *
+ * @param[in] seed The seed
+ * @param[in] length The length of the value
+ * @param[out] pValue The value
+ */
+static void fuzzValue(UInt8 seed, UInt8 length, UInt8 *pValue)
+{
+    int i;
+
+    for (i = 0; i < length; ++i)
+        pValue[i] = (UInt8)(i * 37 + ((i % 16) ? 0 : seed));
+}
+
+/**
+ * @brief Function to set up the instance on the RAM, as after a reset
+ */
+static void fuzzInit(void)
+{
+    gpNvmCtx_InitRam(&ctx, ram);
+    gpNvmCtx_SetKey(&ctx, fuzzKey);
+    gpNvmCtx_SetDeltaChain(&ctx, deltaChain);
+}
+
+/**
+ * @brief Function to check the accounting of the values area
+ *
+ * @param[out] pStats The accounting, if not NULL
+ */
+static void fuzzCheckStats(gpNvm_Stats_t *pStats)
+{
+    gpNvm_Stats_t stats;
+    UInt32 total;
+
+    if (gpNvmCtx_GetStats(&ctx, &stats))
+        fuzzFail("stats", 0, 0xFF, 0);
+    total = (UInt32)stats.liveBytes + stats.deadBytes + stats.freeBytes;
+    if (total != totalBytes)
+        fuzzFail("stats", 0, (int)total, (int)totalBytes);
+    if (pStats)
+        *pStats = stats;
+}
+
+/**
+ * @brief Function to check a value against the model
+ *
+ * @param[in] attrId The attribute
+ * @param[in] ret Result of the get
+ * @param[in] length Length read
+ * @param[in] pValue Value read
+ */
+static void fuzzCheckValue(UInt8 attrId, gPNvm_Result ret, UInt8 length,
+                           const UInt8 *pValue)
+{
+    if (!model.present[attrId])
+    {
+        if (ret != NVM_ERR_NOT_FOUND)
+            fuzzFail("get", attrId, ret, NVM_ERR_NOT_FOUND);
+        return;
+    }
+    if (ret)
+        fuzzFail("get", attrId, ret, 0);
+    if (length != model.length[attrId])
+        fuzzFail("get length", attrId, length, model.length[attrId]);
+    if (memcmp(pValue, model.value[attrId], length))
+        fuzzFail("get value", attrId, pValue[0], model.value[attrId][0]);
+}
+
+/**
+ * @brief Function to check every attribute against the model
+ */
+static void fuzzCheckAll(void)
+{
+    UInt8 value[MAX_VALUE_LENGTH];
+    gPNvm_Result ret;
+    UInt8 length = 0;
+    int i;
+
+    for (i = 0; i < FUZZ_IDS; ++i)
+    {
+        ret = gpNvmCtx_GetAttribute(&ctx, i, &length, value);
+        fuzzCheckValue(i, ret, length, value);
+    }
+}
+
+/**
+ * @brief Function to set a value on the store and on the model
+ *
+ * A set that doesn't fit changes nothing.
+ *
+ * @param[in] attrId The attribute
+ * @param[in] length The length of the value
+ * @param[in] pValue The value
+ */
+static void fuzzSet(UInt8 attrId, UInt8 length, UInt8 *pValue)
+{
+    gPNvm_Result ret = gpNvmCtx_SetAttribute(&ctx, attrId, length, pValue);
+
+    if (length > MAX_VALUE_LENGTH)
+    {
+        if (ret != 0xFF)
+            fuzzFail("set", attrId, ret, 0xFF);
+        return;
+    }
+    if (ret == NVM_ERR_NO_SPACE)
+        return;
+    if (ret)
+        fuzzFail("set", attrId, ret, 0);
+    model.present[attrId] = 1;
+    model.length[attrId] = length;
+    memcpy(model.value[attrId], pValue, length);
+}
+
+/**
+ * @brief Function to run a call decoded from the input
+ *
+ * @param[in,out] pIn The input, at the operation byte
+ */
+static void fuzzCall(fuzz_input_t *pIn)
+{
+    UInt8 value[FUZZ_BATCH][MAX_VALUE_LENGTH + 1];
+    gpNvm_Batch_t batch[FUZZ_BATCH];
+    gpNvm_Stats_t before, after;
+    UInt8 op = fuzzByte(pIn) % FUZZ_OPS;
+    UInt8 attrId = fuzzByte(pIn) % FUZZ_IDS;
+    UInt8 offset, length, count;
+    gPNvm_Result ret;
+    int i;
+
+    switch (op)
+    {
+    case FUZZ_OP_SET:
+        length = fuzzByte(pIn);
+        fuzzValue(fuzzByte(pIn), length, value[0]);
+        fuzzSet(attrId, length, value[0]);
+        break;
+
+    case FUZZ_OP_EDIT:
+        //A few bytes of the current value changed, as deltas are made of
+        offset = fuzzByte(pIn);
+        count = fuzzByte(pIn) % 8 + 1;
+        length = model.present[attrId] ? model.length[attrId] : \
+                                         offset % (MAX_VALUE_LENGTH + 1);
+        memcpy(value[0], model.value[attrId], length);
+        for (i = 0; (i < count) && length; ++i)
+            value[0][(offset + i * 13) % length] ^= fuzzByte(pIn) | 1;
+        fuzzSet(attrId, length, value[0]);
+        break;
+
+    case FUZZ_OP_GET:
+        length = 0;
+        ret = gpNvmCtx_GetAttribute(&ctx, attrId, &length, value[0]);
+        fuzzCheckValue(attrId, ret, length, value[0]);
+        break;
+
+    case FUZZ_OP_DELETE:
+        ret = gpNvmCtx_DeleteAttribute(&ctx, attrId);
+        if (ret != (model.present[attrId] ? 0 : 0xFF))
+            fuzzFail("delete", attrId, ret, model.present[attrId] ? 0 : 0xFF);
+        model.present[attrId] = 0;
+        break;
+
+    case FUZZ_OP_PATCH:
+        offset = fuzzByte(pIn);
+        length = fuzzByte(pIn);
+        fuzzValue(fuzzByte(pIn), length, value[0]);
+        ret = gpNvmCtx_PatchAttribute(&ctx, attrId, offset, length, value[0]);
+        if (!model.present[attrId])
+        {
+            if (ret != NVM_ERR_NOT_FOUND)
+                fuzzFail("patch", attrId, ret, NVM_ERR_NOT_FOUND);
+        }
+        else if (!length || (offset + length > model.length[attrId]))
+        {
+            if (ret != 0xFF)
+                fuzzFail("patch", attrId, ret, 0xFF);
+        }
+        else if (!ret)
+            memcpy(model.value[attrId] + offset, value[0], length);
+        else if (ret != NVM_ERR_NO_SPACE) //A chain of deltas grows
+            fuzzFail("patch", attrId, ret, 0);
+        break;
+
+    case FUZZ_OP_COMPACT:
+        //Garbage may be left on the cold region, but none is made
+        fuzzCheckStats(&before);
+        ret = gpNvmCtx_Compact(&ctx);
+        if (ret)
+            fuzzFail("compact", 0, ret, 0);
+        fuzzCheckStats(&after);
+        if (after.freeBytes < before.freeBytes)
+            fuzzFail("compact free bytes", 0, after.freeBytes, \
+                     before.freeBytes);
+        fuzzCheckAll();
+        break;
+
+    case FUZZ_OP_REMOUNT:
+        fuzzCheckStats(&before);
+        fuzzInit();
+        fuzzCheckStats(&after);
+        if ((before.liveBytes != after.liveBytes) || \
+            (before.freeBytes != after.freeBytes))
+            fuzzFail("remount live bytes", 0, after.liveBytes, \
+                     before.liveBytes);
+        fuzzCheckAll();
+        break;
+
+    case FUZZ_OP_SET_BATCH:
+        count = attrId % FUZZ_BATCH + 1;
+        for (i = 0; i < count; ++i)
+        {
+            batch[i].attrId = fuzzByte(pIn) % FUZZ_IDS;
+            batch[i].length = fuzzByte(pIn) % (MAX_VALUE_LENGTH + 1);
+            batch[i].pValue = value[i];
+            fuzzValue(fuzzByte(pIn), batch[i].length, value[i]);
+        }
+        ret = gpNvmCtx_SetAttributes(&ctx, batch, count);
+        for (i = 0; i < count; ++i)
+        {
+            //None or all of them are set, in order
+            if (batch[i].result != ret)
+                fuzzFail("set batch", batch[i].attrId, batch[i].result, ret);
+            if (ret == NVM_ERR_NO_SPACE)
+                continue;
+            if (ret)
+                fuzzFail("set batch", batch[i].attrId, ret, 0);
+            model.present[batch[i].attrId] = 1;
+            model.length[batch[i].attrId] = batch[i].length;
+            memcpy(model.value[batch[i].attrId], value[i], batch[i].length);
+        }
+        break;
+
+    case FUZZ_OP_GET_BATCH:
+        count = attrId % FUZZ_BATCH + 1;
+        for (i = 0; i < count; ++i)
+        {
+            batch[i].attrId = fuzzByte(pIn) % FUZZ_IDS;
+            batch[i].pValue = value[i];
+        }
+        if (gpNvmCtx_GetAttributes(&ctx, batch, count))
+            fuzzFail("get batch", batch[0].attrId, 0xFF, 0);
+        for (i = 0; i < count; ++i)
+            fuzzCheckValue(batch[i].attrId, batch[i].result, \
+                           batch[i].length, value[i]);
+        break;
+    }
+}
+
+/**
+ * @brief Function to run an input on a freshly formatted store
+ *
+ * @param[in] pData The input
+ * @param[in] size Its length
+ */
+static void fuzzRun(const UInt8 *pData, size_t size)
+{
+    fuzz_input_t in = { pData, size, 0 };
+    UInt8 config = fuzzByte(&in);
+    gpNvm_Stats_t stats;
+
+    memset(&model, 0, sizeof(model));
+    deltaChain = (config >> 3) % (NVM_DELTA_MAX_CHAIN + 1);
+    fuzzInit();
+    if (gpNvmCtx_Format(&ctx, fuzzModes[(config & 7) % sizeof(fuzzModes)]))
+        fuzzFail("format", 0, 0xFF, 0);
+    gpNvmCtx_GetStats(&ctx, &stats);
+    totalBytes = (UInt32)stats.liveBytes + stats.deadBytes + stats.freeBytes;
+
+    for (step = 0; in.pos < in.size; ++step)
+    {
+        fuzzCall(&in);
+        fuzzCheckStats(NULL);
+    }
+    fuzzCheckAll();
+}
+
+#if defined(NVM_FUZZ_LIBFUZZER)
+int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t size)
+{
+    fuzzRun(pData, size);
+    return 0;
+}
+#else
+
+/**
+ * @brief Function to write a long run to the seed corpus
+ *
+ * The store is filled with values on all the Ids, then rewritten over
+ * and over, mostly with large values, whole or a few bytes at a time,
+ * with deletes, patches and batches in between. Compactions are rare,
+ * so the store keeps running out of space and the sets that don't fit
+ * are exercised; remounts come now and then.
+ *
+ * @param[in] path The file
+ * @param[in] config The configuration byte
+ * @return 0 for success, 1 if the file can't be written
+ */
+static int fuzzWriteSeed(const char *path, UInt8 config)
+{
+    FILE *pFile = fopen(path, "wb");
+    UInt8 call[2 + 3 * FUZZ_BATCH];
+    size_t size = 1;
+    int i, n, k, r;
+
+    if (!pFile)
+        return 1;
+    fputc(config, pFile);
+    for (i = 0; size + sizeof(call) <= FUZZ_MAX_INPUT; ++i)
+    {
+        r = (i < FUZZ_IDS) ? 0 : rand() % 200;
+        n = 0;
+        call[n++] = (r < 80)  ? FUZZ_OP_SET :
+                    (r < 130) ? FUZZ_OP_EDIT :
+                    (r < 150) ? FUZZ_OP_GET :
+                    (r < 165) ? FUZZ_OP_DELETE :
+                    (r < 180) ? FUZZ_OP_PATCH :
+                    (r < 188) ? FUZZ_OP_SET_BATCH :
+                    (r < 196) ? FUZZ_OP_GET_BATCH :
+                    (r < 199) ? FUZZ_OP_REMOUNT : FUZZ_OP_COMPACT;
+        call[n++] = (i < FUZZ_IDS) ? i : rand() % FUZZ_IDS;
+        switch (call[0])
+        {
+        case FUZZ_OP_SET:
+            call[n++] = 128 + rand() % (MAX_VALUE_LENGTH - 127);
+            call[n++] = rand();
+            break;
+        case FUZZ_OP_EDIT:
+            call[n++] = rand();
+            call[n++] = rand() % 8;
+            for (k = 0; k <= call[3]; ++k)
+                call[n++] = rand();
+            break;
+        case FUZZ_OP_PATCH:
+            call[n++] = rand() % 64;
+            call[n++] = 1 + rand() % 16;
+            call[n++] = rand();
+            break;
+        case FUZZ_OP_SET_BATCH:
+        case FUZZ_OP_GET_BATCH:
+            for (k = 0; k <= call[1] % FUZZ_BATCH; ++k)
+            {
+                call[n++] = rand() % FUZZ_IDS;
+                if (call[0] == FUZZ_OP_SET_BATCH)
+                {
+                    call[n++] = rand();
+                    call[n++] = rand();
+                }
+            }
+            break;
+        }
+        fwrite(call, 1, n, pFile);
+        size += n;
+    }
+    return fclose(pFile) ? 1 : 0;
+}
+
+/**
+ * @brief Function to run an input file
+ *
+ * @param[in] pFile The file, read to its end
+ * @return 0 for success, 1 if it can't be read
+ */
+static int fuzzRunFile(FILE *pFile)
+{
+    static UInt8 data[1 << 20];
+    size_t size = fread(data, 1, sizeof(data), pFile);
+
+    if (ferror(pFile))
+        return 1;
+    fuzzRun(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static UInt8 data[FUZZ_MAX_INPUT];
+    char path[1024];
+    FILE *pFile;
+    long count, i;
+    size_t size, j;
+    int config;
+
+    if ((argc == 3) && !strcmp(argv[1], "-c"))
+    {
+        srand(1);
+        for (config = 0; config < 0x48; config += (config & 7) < 4 ? 1 : 4)
+        {
+            snprintf(path, sizeof(path), "%s/seed_%02x.bin", argv[2], \
+                     config);
+            if (fuzzWriteSeed(path, config))
+            {
+                fprintf(stderr, "%s: can't be written\n", path);
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if ((argc >= 3) && !strcmp(argv[1], "-n"))
+    {
+        count = atol(argv[2]);
+        srand(((argc == 5) && !strcmp(argv[3], "-s")) ? atoi(argv[4]) : 1);
+        for (i = 0; i < count; ++i)
+        {
+            size = rand() % sizeof(data);
+            for (j = 0; j < size; ++j)
+                data[j] = rand();
+            fuzzRun(data, size);
+        }
+        printf("%ld inputs run, no difference\n", count);
+        return 0;
+    }
+
+    if (argc == 1)
+    {
+#if defined(__AFL_LOOP)
+        //AFL persistent mode: each input is written anew to stdin
+        while (__AFL_LOOP(1000))
+        {
+            clearerr(stdin);
+            fuzzRunFile(stdin);
+        }
+        return 0;
+#else
+        return fuzzRunFile(stdin);
+#endif
+    }
+    for (i = 1; i < argc; ++i)
+    {
+        pFile = fopen(argv[i], "rb");
+        if (!pFile || fuzzRunFile(pFile))
+        {
+            fprintf(stderr, "%s: can't be read\n", argv[i]);
+            return 1;
+        }
+        fclose(pFile);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,384 @@
+/**
+ * @file nvm_replay.c
+ * @brief Replay of a workload trace against a configuration of the store
+ *
+ * This tool runs the calls of a trace (see nvm_trace.h), as fast as
+ * possible, on a freshly formatted store of the configuration given, so
+ * the configurations can be compared on a real workload. The values
+ * aren't in the trace: a set writes a value of the recorded length,
+ * made of its recorded hash (or of its Id) repeated. A set that doesn't
+ * fit compacts the store and is tried again; the compaction is accounted
+ * apart. It reports:
+ * - the calls replayed, and how fast, against the time they took when
+ *   recorded
+ * - the latency of each operation: median, 99th percentile and maximum,
+ *   by powers of two (a value is the upper bound of its bucket)
+ * - the bytes written to the memory and the syncs, and the write
+ *   amplification: bytes written per byte of value set
+ * - the compactions: runs, time and bytes written
+ * - the calls whose result differs from the recorded one (a get of an
+ *   attribute the store had before the trace started, for instance)
+ *
+ * Usage: nvm_replay [-b backend] [-t table] [-i integrity] [-d durability]
+ *                   [-f calls] [-s store] trace
+ *   -b  ram (default), file, mmap (POSIX only) or uring (Linux only)
+ *   -t  ab (default) or single
+ *   -i  crc16 (default), crc32c, secded or sealed (all-zero key)
+ *   -d  none, buffered (default) or sync, see @ref gpNvm_SetDurability
+ *   -f  Flush every so many sets and deletes, 0 (default) only at the end
+ *   -s  Store file of the file backends, replay.bin by default
+ *
+ * Build (from this directory):
+ *     gcc -O2 -I.. nvm_replay.c ../nvm.c ../memory.c ../utils.c
+ *         ../nvm_schema.c ../nvm_integrity.c ../nvm_seal.c ../nvm_trace.c
+ *         -o nvm_replay
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nvm_ctx.h"
+#include "nvm_trace.h"
+
+#define REPLAY_BUCKETS      40 ///< Latency buckets, 1 ns to 2^40 ns
+#define REPLAY_OPS          3  ///< Get, set, delete
+
+static const char *opNames[REPLAY_OPS] = { "get", "set", "delete" };
+
+/**
+ * @brief Named option values
+ */
+typedef struct
+{
+    const char *name;
+    int value;
+} replay_opt_t;
+
+static const replay_opt_t tableOpts[] = {
+    { "ab", NVM_TABLE_AB }, { "single", NVM_TABLE_SINGLE }, { NULL, 0 }
+};
+static const replay_opt_t integrityOpts[] = {
+    { "crc16", NVM_INTEGRITY_CRC16 }, { "crc32c", NVM_INTEGRITY_CRC32C },
+    { "secded", NVM_INTEGRITY_SECDED }, { "sealed", NVM_INTEGRITY_SEALED },
+    { NULL, 0 }
+};
+static const replay_opt_t durabilityOpts[] = {
+    { "none", NVM_DURABILITY_NONE }, { "buffered", NVM_DURABILITY_BUFFERED },
+    { "sync", NVM_DURABILITY_SYNC }, { NULL, 0 }
+};
+
+/**
+ * @brief Counters of the memory accesses
+ */
+static struct
+{
+    UInt64 writes;              ///< Writes
+    UInt64 bytes;               ///< Bytes written
+    UInt64 syncs;               ///< Syncs
+} counts;
+
+static const nvm_mem_ops_t *pBaseOps; ///< Backend being counted
+static UInt64 hist[REPLAY_OPS][REPLAY_BUCKETS];
+static UInt64 maxNs[REPLAY_OPS];
+
+static UInt8 countRead(nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                       UInt8 *buffRead)
+{
+    return pBaseOps->read(pMem, start, length, buffRead);
+}
+
+static UInt8 countWrite(nvm_mem_t *pMem, UInt16 start, UInt8 length,
+                        UInt8 *buffWrite)
+{
+    ++counts.writes;
+    counts.bytes += length;
+    return pBaseOps->write(pMem, start, length, buffWrite);
+}
+
+static UInt8 countFormat(nvm_mem_t *pMem, UInt8 full)
+{
+    return pBaseOps->format(pMem, full);
+}
+
+static UInt8 countSync(nvm_mem_t *pMem)
+{
+    ++counts.syncs;
+    return pBaseOps->sync(pMem);
+}
+
+static void countClose(nvm_mem_t *pMem)
+{
+    pBaseOps->close(pMem);
+}
+
+static void countPrefetch(nvm_mem_t *pMem, UInt16 start, UInt16 length)
+{
+    pBaseOps->prefetch(pMem, start, length);
+}
+
+static UInt8 countSubmit(nvm_mem_t *pMem)
+{
+    return pBaseOps->submit(pMem);
+}
+
+/// Backend counting the accesses to @ref pBaseOps
+static const nvm_mem_ops_t countOps = {
+    countRead, countWrite, countFormat, countSync, countClose, countPrefetch,
+    countSubmit
+};
+
+/**
+ * @brief Function to read a monotonic clock
+ *
+ * @return The time in nanoseconds
+ */
+static UInt64 replayNowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Function to account the latency of a call
+ *
+ * @param[in] op NVM_TRACE_OP_*
+ * @param[in] ns The latency, in nanoseconds
+ */
+static void replayAccount(UInt8 op, UInt64 ns)
+{
+    int bucket = 0;
+
+    while ((bucket < REPLAY_BUCKETS - 1) && (ns >> (bucket + 1)))
+        ++bucket;
+    ++hist[op][bucket];
+    if (ns > maxNs[op])
+        maxNs[op] = ns;
+}
+
+/**
+ * @brief Function to find a percentile of the latency of an operation
+ *
+ * @param[in] op NVM_TRACE_OP_*
+ * @param[in] total Calls of the operation
+ * @param[in] pct The percentile
+ * @return The upper bound of its bucket, in microseconds
+ */
+static double replayPercentile(UInt8 op, UInt64 total, double pct)
+{
+    UInt64 seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < REPLAY_BUCKETS - 1; ++bucket)
+    {
+        seen += hist[op][bucket];
+        if (seen >= total * pct / 100)
+            break;
+    }
+    return (double)(2ULL << bucket) / 1000;
+}
+
+/**
+ * @brief Function to parse a named option value
+ *
+ * @param[in] pOpts The values
+ * @param[in] name The name given
+ * @return The value, -1 if unknown
+ */
+static int replayParse(const replay_opt_t *pOpts, const char *name)
+{
+    for (; pOpts->name; ++pOpts)
+    {
+        if (!strcmp(pOpts->name, name))
+            return pOpts->value;
+    }
+    return -1;
+}
+
+/**
+ * @brief Function to synthesize the value of a set
+ *
+ * @param[in] pRec The recorded set
+ * @param[out] pValue The value, of the recorded length
+ */
+static void replayValue(const nvm_trace_rec_t *pRec, UInt8 *pValue)
+{
+    UInt32 seed = pRec->hash ? pRec->hash : 0x01010101UL * pRec->attrId;
+    int i;
+
+    for (i = 0; i < pRec->length; ++i)
+        pValue[i] = (UInt8)(seed >> (8 * (i & 3)));
+}
+
+int main(int argc, char **argv)
+{
+    static UInt8 ram[MEM_SIZE];
+    static nvm_ctx_t ctx;
+    static const UInt8 zeroKey[NVM_SEAL_KEY_LEN];
+    const char *backend = "ram", *storePath = "replay.bin";
+    int table = NVM_TABLE_AB, integrity = NVM_INTEGRITY_CRC16;
+    int durability = NVM_DURABILITY_BUFFERED, flushEvery = 0;
+    UInt64 calls[REPLAY_OPS] = { 0 };
+    UInt64 traceUs = 0, setBytes = 0, changes = 0, mismatches = 0;
+    UInt64 compactions = 0, compactNs = 0, compactBytes = 0;
+    UInt64 start, elapsed, t0, t1, bytes;
+    UInt8 value[MAX_VALUE_LENGTH];
+    UInt8 length, result;
+    nvm_trace_rec_t rec;
+    nvm_trace_t trace;
+    gpNvm_Stats_t stats;
+    int opt, op;
+
+    while ((opt = getopt(argc, argv, "b:t:i:d:f:s:")) != -1)
+    {
+        if (opt == 'b')
+            backend = optarg;
+        else if (opt == 't')
+            table = replayParse(tableOpts, optarg);
+        else if (opt == 'i')
+            integrity = replayParse(integrityOpts, optarg);
+        else if (opt == 'd')
+            durability = replayParse(durabilityOpts, optarg);
+        else if (opt == 'f')
+            flushEvery = atoi(optarg);
+        else if (opt == 's')
+            storePath = optarg;
+        else
+            return 2;
+    }
+    if ((optind != argc - 1) || (table < 0) || (integrity < 0) || \
+        (durability < 0) || (flushEvery < 0))
+    {
+        fprintf(stderr, "usage: %s [-b ram|file|mmap|uring] [-t ab|single] " \
+                "[-i crc16|crc32c|secded|sealed] [-d none|buffered|sync] " \
+                "[-f calls] [-s store] trace\n", argv[0]);
+        return 2;
+    }
+    if (nvmTraceOpen(&trace, argv[optind]))
+    {
+        fprintf(stderr, "%s: not a trace\n", argv[optind]);
+        return 1;
+    }
+
+    if (!strcmp(backend, "ram"))
+        gpNvmCtx_InitRam(&ctx, ram);
+    else if (!strcmp(backend, "file"))
+        gpNvmCtx_InitFile(&ctx, storePath);
+#if defined(MEM_HAVE_MMAP)
+    else if (!strcmp(backend, "mmap"))
+        gpNvmCtx_InitMmap(&ctx, storePath);
+#endif
+#if defined(MEM_HAVE_URING)
+    else if (!strcmp(backend, "uring"))
+        gpNvmCtx_InitUring(&ctx, storePath, MEM_URING_DEPTH);
+#endif
+    else
+    {
+        fprintf(stderr, "%s: unknown backend\n", backend);
+        return 2;
+    }
+    pBaseOps = ctx.mem.pOps;
+    ctx.mem.pOps = &countOps;
+    if (integrity == NVM_INTEGRITY_SEALED)
+        gpNvmCtx_SetKey(&ctx, zeroKey);
+    gpNvmCtx_SetDurability(&ctx, durability);
+    if (gpNvmCtx_Format(&ctx, table | integrity))
+    {
+        fprintf(stderr, "cannot format the store as configured\n");
+        return 1;
+    }
+    gpNvmCtx_Flush(&ctx);
+    memset(&counts, 0, sizeof(counts));
+
+    start = replayNowNs();
+    while (!(result = nvmTraceRead(&trace, &rec)))
+    {
+        op = rec.op;
+        if (op >= REPLAY_OPS)
+            continue;
+        traceUs += rec.deltaUs;
+        ++calls[op];
+        t0 = replayNowNs();
+        if (op == NVM_TRACE_OP_GET)
+        {
+            result = gpNvmCtx_GetAttribute(&ctx, rec.attrId, &length, value);
+        }
+        else if (op == NVM_TRACE_OP_SET)
+        {
+            replayValue(&rec, value);
+            result = gpNvmCtx_SetAttribute(&ctx, rec.attrId, rec.length, \
+                                           value);
+            if (result == NVM_ERR_NO_SPACE)
+            {
+                t1 = replayNowNs();
+                bytes = counts.bytes;
+                gpNvmCtx_Compact(&ctx);
+                ++compactions;
+                compactBytes += counts.bytes - bytes;
+                t1 = replayNowNs() - t1;
+                compactNs += t1;
+                t0 += t1; //The compaction isn't part of the latency
+                result = gpNvmCtx_SetAttribute(&ctx, rec.attrId, \
+                                               rec.length, value);
+            }
+            if (!result)
+                setBytes += rec.length;
+        }
+        else
+        {
+            result = gpNvmCtx_DeleteAttribute(&ctx, rec.attrId);
+        }
+        if ((op != NVM_TRACE_OP_GET) && flushEvery && \
+            !(++changes % flushEvery))
+            gpNvmCtx_Flush(&ctx);
+        replayAccount(op, replayNowNs() - t0);
+        //A set recorded as not fitting is replayed as any other set
+        if ((result != rec.result) && (rec.result != NVM_ERR_NO_SPACE))
+            ++mismatches;
+    }
+    gpNvmCtx_Flush(&ctx);
+    elapsed = replayNowNs() - start;
+    nvmTraceStop(&trace);
+    if (result != NVM_ERR_NOT_FOUND)
+        fprintf(stderr, "%s: truncated, replayed up to the last record\n", \
+                argv[optind]);
+
+    printf("calls      %llu (get %llu, set %llu, delete %llu)\n", \
+           (unsigned long long)(calls[0] + calls[1] + calls[2]), \
+           (unsigned long long)calls[0], (unsigned long long)calls[1], \
+           (unsigned long long)calls[2]);
+    printf("time       %.3f s replayed, %.3f s recorded, %.0f calls/s\n", \
+           elapsed * 1e-9, traceUs * 1e-6, \
+           (calls[0] + calls[1] + calls[2]) / (elapsed * 1e-9));
+    for (op = 0; op < REPLAY_OPS; ++op)
+    {
+        if (!calls[op])
+            continue;
+        printf("%-10s p50 %8.2f us  p99 %8.2f us  max %8.2f us\n", \
+               opNames[op], replayPercentile(op, calls[op], 50), \
+               replayPercentile(op, calls[op], 99), maxNs[op] * 1e-3);
+    }
+    printf("written    %llu bytes in %llu writes, %llu syncs, " \
+           "amplification %.2f\n", (unsigned long long)counts.bytes, \
+           (unsigned long long)counts.writes, \
+           (unsigned long long)counts.syncs, \
+           setBytes ? (double)counts.bytes / setBytes : 0.0);
+    printf("compaction %llu runs, %.3f ms, %llu bytes\n", \
+           (unsigned long long)compactions, compactNs * 1e-6, \
+           (unsigned long long)compactBytes);
+    gpNvmCtx_GetStats(&ctx, &stats);
+    printf("store      %u live, %u dead, %u free bytes\n", \
+           stats.liveBytes, stats.deadBytes, stats.freeBytes);
+    printf("mismatches %llu results differ from the trace\n", \
+           (unsigned long long)mismatches);
+    gpNvmCtx_Close(&ctx);
+    return 0;
+}
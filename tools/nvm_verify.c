@@ -0,0 +1,531 @@
+/**
+ * @file nvm_verify.c
+ * @brief Offline verification and repair of many memory images
+ *
+ * This tool checks a batch of memory images (dumps of @e mem.bin), each
+ * one mounted on an NVM instance of its own (see nvm_ctx.h) over the
+ * mapped file. For every attribute the allocation register CRC-8 and the
+ * value CRC-16 are verified, and a single flipped bit is corrected when
+ * possible (see @ref correctCRC16). On images formatted with another
+ * integrity mode the values are checked by that mode instead (see
+ * nvm_integrity.h). The schema slots are checked too, and so are the
+ * rings of the reserved attributes, by reading their newest valid slot,
+ * and the values kept as chains of deltas, by reading them through the
+ * chain.
+ * Sealed images (see nvm_seal.h) need their key: their values are opened
+ * on a copy, and can't be corrected. Without the key they are all lost.
+ * A line is printed per image, in the order given:
+ *
+ *     path: single valid 12 corrected 1 lost 0 free 61234 garbage 3.2%
+ *
+ * The images are spread over a pool of worker threads. Each worker owns
+ * a deque of images, taking work from its back, and steals from the
+ * front of the others' when it runs dry, so a few large or damaged
+ * images don't leave the other cores idle. Each image is read once,
+ * sequentially, through the page cache, so the pool is bound by the
+ * disk rather than by one core.
+ *
+ * Usage: nvm_verify [-j threads] [-w] [-k keyfile] image...
+ *   -j  Number of workers, all the cores by default
+ *   -w  Write the corrections back to the images
+ *   -k  Key of the sealed images, a file of @ref NVM_SEAL_KEY_LEN bytes
+ *
+ * Exit code: 0 if all images are healthy, 1 if any attribute was lost or
+ * an image could not be checked, 2 for usage errors.
+ *
+ * Build (POSIX only, from this directory):
+ *     gcc -O2 -I.. nvm_verify.c ../nvm.c ../memory.c ../utils.c
+ *         ../nvm_schema.c ../nvm_integrity.c ../nvm_seal.c ../nvm_trace.c
+ *         -lpthread -o nvm_verify
+ *
+ * @author Marcio J Teixeira Jr.
+ * @date 09/12/18
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "nvm_ctx.h"
+#include "nvm_schema.h"
+#include "nvm_integrity.h"
+
+#define VERIFY_OK           0 ///< Image checked
+#define VERIFY_ERR_OPEN     1 ///< Image could not be opened or mapped
+#define VERIFY_ERR_SIZE     2 ///< Image is not @ref MEM_SIZE bytes long
+#define VERIFY_ERR_MOUNT    3 ///< No valid allocation table
+
+/**
+ * @brief Health report of an image
+ */
+typedef struct
+{
+    UInt8 status;           ///< VERIFY_OK or VERIFY_ERR_*
+    UInt8 tableMode;        ///< Layout found on mount
+    int valid;              ///< Attributes found intact
+    int corrected;          ///< Attributes with a bit corrected
+    int lost;               ///< Attributes beyond repair
+    gpNvm_Stats_t stats;    ///< Usage of the values area, after repair
+} verify_report_t;
+
+/**
+ * @brief Deque of images owned by a worker
+ *
+ * The owner takes from the back, thieves take from the front. Items are
+ * whole images, so a plain lock per deque is far from being contended.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    int *pItems;            ///< Indexes of the images
+    int head;               ///< Front, next to be stolen
+    int tail;               ///< Back (exclusive), next to be taken
+} verify_deque_t;
+
+/**
+ * @brief State shared by the workers
+ */
+typedef struct
+{
+    char **paths;               ///< Images to be checked
+    verify_report_t *pReports;  ///< One report per image
+    verify_deque_t *pDeques;    ///< One deque per worker
+    int workers;                ///< Number of workers
+    int repair;                 ///< Write the corrections back
+    const UInt8 *pSecret;       ///< Key of sealed images, NULL if none
+} verify_pool_t;
+
+typedef struct
+{
+    verify_pool_t *pPool;
+    int self;                   ///< Index of the own deque
+} verify_worker_t;
+
+/**
+ * @brief Function to check if a register holds no value
+ *
+ * Same rule as the NVM: never written (all 0xFF) or a tombstone.
+ */
+static int verifyRegIsFree(const alloc_reg_t *pReg)
+{
+    if ((pReg->start == 0xFFFF) && (pReg->length == 0xFF) && \
+        (pReg->crc == 0xFF))
+        return 1;
+    return !calcCRC8((UInt8 *)pReg, ALLOC_REG_LEN) && \
+           (pReg->length == ALLOC_LEN_FREE);
+}
+
+/**
+ * @brief Function to check if a register points to a ring or a delta
+ *
+ * Same rule as the NVM: CRC-8 valid once @e mark (@ref ALLOC_CRC_RING or
+ * @ref ALLOC_CRC_DELTA) is XORed out. Such a register must not be taken
+ * for a damaged one.
+ */
+static int verifyRegIsMarked(const alloc_reg_t *pReg, UInt8 mark)
+{
+    return ((calcCRC8((UInt8 *)pReg, ALLOC_REG_NO_CRC) ^ mark) == \
+            pReg->crc) && (pReg->length != ALLOC_LEN_FREE);
+}
+
+/**
+ * @brief Function to account the outcome of an attribute
+ *
+ * @param[in] fix Result of the CRC corrections done on the attribute
+ *                (bitwise OR of the results of @ref correctCRC8 and
+ *                @ref correctCRC16)
+ * @param[in,out] pReport Report to be updated
+ */
+static void verifyAccount(UInt8 fix, verify_report_t *pReport)
+{
+    if (fix == 0)
+        pReport->valid++;
+    else if (fix == 1)
+        pReport->corrected++;
+    else
+        pReport->lost++;
+}
+
+/**
+ * @brief Function to check and correct a value on the values area
+ *
+ * @param[in,out] pValue The value, followed by its trailer
+ * @param[in] length Length of the value
+ * @param[in] mode Integrity mode of the image
+ * @return Same as @ref correctCRC16: 0 if intact, 1 if corrected (any
+ *         number of bits, in SECDED mode), 0xFF if lost
+ */
+static UInt8 verifyValue(UInt8 *pValue, UInt8 length, UInt8 mode)
+{
+    UInt8 ret;
+
+    if (mode == NVM_INTEGRITY_CRC16)
+        return correctCRC16(pValue, length + CRC_LEN);
+    ret = nvmIntegrityCheck(mode, pValue, length, pValue + length);
+    return ((ret == 0) || (ret == 0xFF)) ? ret : 1;
+}
+
+/**
+ * @brief Function to check a sealed value
+ *
+ * The value is opened on a copy: the image keeps it encrypted.
+ *
+ * @param[in] pKey The keys of the image
+ * @param[in] attrId The Id of the attribute
+ * @param[in] pValue The value, followed by its tag
+ * @param[in] length Length of the value
+ * @return 0 if authentic, 0xFF if lost
+ */
+static UInt8 verifySealed(const nvm_seal_key_t *pKey,
+                          UInt8 attrId,
+                          const UInt8 *pValue,
+                          UInt8 length)
+{
+    UInt8 copy[MAX_VALUE_LENGTH];
+
+    memcpy(copy, pValue, length);
+    return nvmSealOpen(pKey, attrId, copy, length, pValue + length);
+}
+
+/**
+ * @brief Function to check if a schema slot was ever written
+ *
+ * @param[in] pSlot The slot, on the mapped image
+ * @param[in] length Length of the value and its trailer
+ * @return Non-zero if the slot is erased (value and trailer all 0xFF)
+ */
+static int verifySlotIsErased(const UInt8 *pSlot, UInt16 length)
+{
+    int i;
+
+    for (i = 0; i < length; ++i)
+    {
+        if (pSlot[i] != 0xFF)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Function to check a mapped image
+ *
+ * The image is mounted by the NVM itself, which finds out the layout and
+ * the valid table copy. With a single table each register is checked
+ * (and corrected) in place; in A/B mode the table copy was already
+ * checked as a whole by its CRC-16, and the registers are taken from the
+ * RAM mirror. Then each value is checked against its trailer, followed by
+ * the schema slots ever written. The image is mounted again in the end,
+ * so the usage reflects the repaired registers.
+ *
+ * @param[in,out] pImage The mapped image, @ref MEM_SIZE bytes
+ * @param[in] pSecret Key of a sealed image, NULL if none
+ * @param[out] pReport The health report
+ */
+static void verifyImage(UInt8 *pImage,
+                        const UInt8 *pSecret,
+                        verify_report_t *pReport)
+{
+    nvm_ctx_t ctx;
+    alloc_reg_t *pTable;
+    alloc_reg_t *pReg;
+    const nvm_schema_attr_t *pAttr;
+    UInt8 valid[MAX_REG_ALLOC / 8], erased[MAX_REG_ALLOC / 8];
+    UInt8 value[MAX_VALUE_LENGTH];
+    UInt8 fix, length, sealed;
+    int i;
+
+    gpNvmCtx_InitRam(&ctx, pImage);
+    if (pSecret)
+        gpNvmCtx_SetKey(&ctx, pSecret);
+    if (gpNvmCtx_Mount(&ctx))
+    {
+        pReport->status = VERIFY_ERR_MOUNT;
+        return;
+    }
+    pReport->tableMode = ctx.tableMode;
+    pTable = (ctx.tableMode == NVM_TABLE_AB) ? ctx.table : \
+                                               (alloc_reg_t *)pImage;
+
+    //A single pass finds the registers to be corrected
+    checkCRC8Records((UInt8 *)pTable, MAX_REG_ALLOC, valid, erased);
+    for (i = 0; i < MAX_REG_ALLOC; ++i)
+    {
+        pReg = &pTable[i];
+        if ((erased[i >> 3] & (1 << (i & 7))) || \
+            ((valid[i >> 3] & (1 << (i & 7))) && \
+             (pReg->length == ALLOC_LEN_FREE)))
+            continue;
+        fix = 0;
+        if (!(valid[i >> 3] & (1 << (i & 7))) && \
+            (verifyRegIsMarked(pReg, ALLOC_CRC_RING) || \
+             verifyRegIsMarked(pReg, ALLOC_CRC_DELTA)))
+        {
+            //Torn slots are skipped by the NVM, the newest valid counts;
+            //a chain of deltas is checked record by record as it is read
+            verifyAccount(gpNvmCtx_GetAttribute(&ctx, i, &length, value) ? \
+                          0xFF : 0, pReport);
+            continue;
+        }
+        if (!(valid[i >> 3] & (1 << (i & 7))))
+            fix = correctCRC8((UInt8 *)pReg, ALLOC_REG_LEN);
+        if ((fix != 0xFF) && verifyRegIsFree(pReg))
+            continue; //A damaged tombstone
+        if ((fix != 0xFF) && \
+            ((pReg->start < ctx.valuesStart) || \
+             ((UInt32)pReg->start + pReg->length + \
+              nvmIntegrityLen(ctx.integrity, pReg->length) > \
+              NVM_SCHEMA_AREA_START)))
+            fix = 0xFF;
+        if ((fix != 0xFF) && (ctx.integrity == NVM_INTEGRITY_SEALED))
+            fix |= verifySealed(&ctx.seal, i, pImage + pReg->start, \
+                                pReg->length);
+        else if (fix != 0xFF)
+            fix |= verifyValue(pImage + pReg->start, pReg->length, \
+                               ctx.integrity);
+        verifyAccount(fix, pReport);
+    }
+
+    //Slots have a CRC-16, or a tag on a sealed image
+    sealed = (ctx.integrity == NVM_INTEGRITY_SEALED);
+    for (i = 0; i < MAX_REG_ALLOC; ++i)
+    {
+        pAttr = nvmSchemaFind(i);
+        if (!pAttr || !pAttr->slot || \
+            verifySlotIsErased(pImage + pAttr->slotAddr, pAttr->length + \
+                               (sealed ? NVM_SEAL_TAG_LEN : CRC_LEN)))
+            continue;
+        if (sealed)
+            verifyAccount(verifySealed(&ctx.seal, i, \
+                                       pImage + pAttr->slotAddr, \
+                                       pAttr->length), pReport);
+        else
+            verifyAccount(correctCRC16(pImage + pAttr->slotAddr, \
+                                       pAttr->length + CRC_LEN), pReport);
+    }
+
+    gpNvmCtx_Mount(&ctx);
+    gpNvmCtx_GetStats(&ctx, &pReport->stats);
+    pReport->status = VERIFY_OK;
+}
+
+/**
+ * @brief Function to map and check an image
+ *
+ * Without repair the image is mapped privately, so the corrections
+ * never reach the file. The kernel is told the image is read once, in
+ * order, so it reads ahead.
+ *
+ * @param[in] path The image file
+ * @param[in] repair Write the corrections back
+ * @param[in] pSecret Key of a sealed image, NULL if none
+ * @param[out] pReport The health report
+ */
+static void verifyFile(const char *path,
+                       int repair,
+                       const UInt8 *pSecret,
+                       verify_report_t *pReport)
+{
+    struct stat st;
+    UInt8 *pImage;
+    int fd;
+
+    memset(pReport, 0, sizeof(*pReport));
+    pReport->status = VERIFY_ERR_OPEN;
+    fd = open(path, repair ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) || (st.st_size != (off_t)MEM_SIZE))
+    {
+        pReport->status = VERIFY_ERR_SIZE;
+        close(fd);
+        return;
+    }
+    pImage = mmap(NULL, MEM_SIZE, PROT_READ | PROT_WRITE, \
+                  repair ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pImage == MAP_FAILED)
+        return;
+    madvise(pImage, MEM_SIZE, MADV_SEQUENTIAL);
+    madvise(pImage, MEM_SIZE, MADV_WILLNEED);
+
+    verifyImage(pImage, pSecret, pReport);
+
+    munmap(pImage, MEM_SIZE);
+}
+
+/**
+ * @brief Function to take the next image, own or stolen
+ *
+ * @param[in] pPool The pool
+ * @param[in] self Index of the own deque
+ * @return Index of the image, -1 when there is no work left anywhere
+ */
+static int verifyTake(verify_pool_t *pPool, int self)
+{
+    verify_deque_t *pDeque;
+    int item = -1;
+    int i;
+
+    for (i = 0; (i < pPool->workers) && (item < 0); ++i)
+    {
+        pDeque = &pPool->pDeques[(self + i) % pPool->workers];
+        pthread_mutex_lock(&pDeque->lock);
+        if (pDeque->head < pDeque->tail)
+            item = i ? pDeque->pItems[pDeque->head++] : \
+                       pDeque->pItems[--pDeque->tail];
+        pthread_mutex_unlock(&pDeque->lock);
+    }
+    return item;
+}
+
+/**
+ * @brief Worker thread: checks images until there is none left
+ *
+ * No image is ever added, so a full round over the deques finding
+ * nothing means the work is done.
+ */
+static void *verifyWorker(void *arg)
+{
+    verify_worker_t *pWorker = arg;
+    verify_pool_t *pPool = pWorker->pPool;
+    int item;
+
+    while ((item = verifyTake(pPool, pWorker->self)) >= 0)
+        verifyFile(pPool->paths[item], pPool->repair, pPool->pSecret, \
+                   &pPool->pReports[item]);
+    return NULL;
+}
+
+/**
+ * @brief Function to print the report of an image
+ *
+ * @return Non-zero if the image is not healthy
+ */
+static int verifyPrint(const char *path, const verify_report_t *pReport)
+{
+    static const char *errors[] = { "", "cannot open or map", \
+                                    "not a 64 KB image", "no valid table" };
+    UInt32 used;
+
+    if (pReport->status != VERIFY_OK)
+    {
+        printf("%s: ERROR %s\n", path, errors[pReport->status]);
+        return 1;
+    }
+    used = pReport->stats.liveBytes + pReport->stats.deadBytes;
+    printf("%s: %s valid %d corrected %d lost %d free %u garbage %.1f%%\n", \
+           path, (pReport->tableMode == NVM_TABLE_AB) ? "ab" : "single", \
+           pReport->valid, pReport->corrected, pReport->lost, \
+           pReport->stats.freeBytes, \
+           used ? (100.0 * pReport->stats.deadBytes / used) : 0.0);
+    return pReport->lost != 0;
+}
+
+int main(int argc, char **argv)
+{
+    verify_pool_t pool;
+    verify_worker_t *pWorkers;
+    pthread_t *pThreads;
+    struct timespec t0, t1;
+    UInt8 secret[NVM_SEAL_KEY_LEN];
+    FILE *pKeyFile;
+    double secs;
+    int images, per, first, unhealthy = 0, corrected = 0;
+    int opt, i;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "j:wk:")) != -1)
+    {
+        if (opt == 'j')
+            pool.workers = atoi(optarg);
+        else if (opt == 'w')
+            pool.repair = 1;
+        else if (opt == 'k')
+        {
+            pKeyFile = fopen(optarg, "rb");
+            if (!pKeyFile || \
+                (fread(secret, 1, sizeof(secret), pKeyFile) != sizeof(secret)))
+            {
+                fprintf(stderr, "%s: key must be %d bytes\n", optarg, \
+                        NVM_SEAL_KEY_LEN);
+                return 2;
+            }
+            fclose(pKeyFile);
+            pool.pSecret = secret;
+        }
+        else
+            return 2;
+    }
+    images = argc - optind;
+    if (images <= 0)
+    {
+        fprintf(stderr, "usage: %s [-j threads] [-w] [-k keyfile] image...\n", \
+                argv[0]);
+        return 2;
+    }
+    if (pool.workers < 1)
+        pool.workers = 1;
+    if (pool.workers > images)
+        pool.workers = images;
+
+    pool.paths = argv + optind;
+    pool.pReports = calloc(images, sizeof(verify_report_t));
+    pool.pDeques = calloc(pool.workers, sizeof(verify_deque_t));
+    pWorkers = calloc(pool.workers, sizeof(verify_worker_t));
+    pThreads = calloc(pool.workers, sizeof(pthread_t));
+    if (!pool.pReports || !pool.pDeques || !pWorkers || !pThreads)
+        return 1;
+
+    //Contiguous runs of images to each worker, to begin with
+    per = (images + pool.workers - 1) / pool.workers;
+    for (i = 0; i < pool.workers; ++i)
+    {
+        first = i * per;
+        pthread_mutex_init(&pool.pDeques[i].lock, NULL);
+        pool.pDeques[i].pItems = malloc(per * sizeof(int));
+        for (; (first < images) && (first < (i + 1) * per); ++first)
+            pool.pDeques[i].pItems[pool.pDeques[i].tail++] = first;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < pool.workers; ++i)
+    {
+        pWorkers[i].pPool = &pool;
+        pWorkers[i].self = i;
+        pthread_create(&pThreads[i], NULL, verifyWorker, &pWorkers[i]);
+    }
+    for (i = 0; i < pool.workers; ++i)
+        pthread_join(pThreads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (i = 0; i < images; ++i)
+    {
+        unhealthy += verifyPrint(pool.paths[i], &pool.pReports[i]);
+        corrected += pool.pReports[i].corrected != 0;
+    }
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d images: %d healthy, %d with corrections, %d with losses\n", \
+           images, images - unhealthy, corrected, unhealthy);
+    fprintf(stderr, "%d workers, %.3f s, %.1f MB/s\n", pool.workers, secs, \
+            secs > 0 ? (images * (double)MEM_SIZE / 1e6 / secs) : 0.0);
+
+    for (i = 0; i < pool.workers; ++i)
+    {
+        pthread_mutex_destroy(&pool.pDeques[i].lock);
+        free(pool.pDeques[i].pItems);
+    }
+    free(pThreads);
+    free(pWorkers);
+    free(pool.pDeques);
+    free(pool.pReports);
+
+    return unhealthy ? 1 : 0;
+}
@@ -13,6 +13,16 @@
  *
  */
 
+#include <string.h>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 #include "nvm.h"
 
 /*
@@ -53,6 +63,78 @@ static UInt16 crc16Table[256] = {
         0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040 \
 };
 
+/*
+ * Pre calculated x^(2^k) modulo the CRC-16 polynomial, bit reflected
+ * (x^0 is 0x8000). The powers repeat after 15, since x^(2^15) = x.
+ */
+static const UInt16 crc16X2n[15] = {
+        0x4000, 0x2000, 0x0800, 0x0080, 0xa001, 0xe801, 0xc881, 0x6080,\
+        0x8801, 0xe081, 0x6800, 0x2880, 0xa881, 0x4880, 0x8081 \
+};
+
+/*
+ * Pre calculated table for CRC-32C polynomial (0x82F63B78 = 0x1EDC6F41
+ * reflected), used when the SSE4.2 crc32 instruction is not available
+ */
+#if !defined(__SSE4_2__)
+static const UInt32 crc32cTable[256] = {
+        0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,\
+        0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,\
+        0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,\
+        0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,\
+        0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,\
+        0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,\
+        0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,\
+        0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,\
+        0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,\
+        0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,\
+        0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,\
+        0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,\
+        0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,\
+        0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,\
+        0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,\
+        0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,\
+        0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,\
+        0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,\
+        0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,\
+        0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,\
+        0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,\
+        0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,\
+        0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,\
+        0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,\
+        0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,\
+        0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,\
+        0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,\
+        0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,\
+        0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,\
+        0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,\
+        0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,\
+        0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,\
+        0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,\
+        0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,\
+        0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,\
+        0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,\
+        0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,\
+        0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,\
+        0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,\
+        0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,\
+        0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,\
+        0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,\
+        0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351 \
+};
+#endif
+
+/*
+ * Pre calculated x^(2^k) modulo the CRC-32C polynomial, bit reflected
+ * (x^0 is 0x80000000). Enough for up to 8191 zero bytes.
+ */
+static const UInt32 crc32cX2n[16] = {
+        0x40000000, 0x20000000, 0x08000000, 0x00800000, 0x00008000,\
+        0x82f63b78, 0x6ea2d55c, 0x18b8ea18, 0x510ac59a, 0xb82be955,\
+        0xb8fdb1e7, 0x88e56f72, 0x74c360a4, 0xe4172b16, 0x0d65762a,\
+        0x35d73a62 \
+};
+
 /*
  * Pre calculated table for CRC-8 polynomial 0x07 (CCITT)
  *
@@ -92,6 +174,31 @@ static UInt8 crc8Table[256] = {
     0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3\
 };
 
+#if defined(__AVX2__) || defined(__SSSE3__)
+/*
+ * Pre calculated CRC-8 of a 4-byte record holding a single nibble: row
+ * 2p is the low nibble of byte p, row 2p + 1 its high nibble
+ */
+static const UInt8 crc8Nibble[8][16] = {
+        {0x00, 0x16, 0x2c, 0x3a, 0x58, 0x4e, 0x74, 0x62,\
+         0xb0, 0xa6, 0x9c, 0x8a, 0xe8, 0xfe, 0xc4, 0xd2},\
+        {0x00, 0x67, 0xce, 0xa9, 0x9b, 0xfc, 0x55, 0x32,\
+         0x31, 0x56, 0xff, 0x98, 0xaa, 0xcd, 0x64, 0x03},\
+        {0x00, 0x6b, 0xd6, 0xbd, 0xab, 0xc0, 0x7d, 0x16,\
+         0x51, 0x3a, 0x87, 0xec, 0xfa, 0x91, 0x2c, 0x47},\
+        {0x00, 0xa2, 0x43, 0xe1, 0x86, 0x24, 0xc5, 0x67,\
+         0x0b, 0xa9, 0x48, 0xea, 0x8d, 0x2f, 0xce, 0x6c},\
+        {0x00, 0x15, 0x2a, 0x3f, 0x54, 0x41, 0x7e, 0x6b,\
+         0xa8, 0xbd, 0x82, 0x97, 0xfc, 0xe9, 0xd6, 0xc3},\
+        {0x00, 0x57, 0xae, 0xf9, 0x5b, 0x0c, 0xf5, 0xa2,\
+         0xb6, 0xe1, 0x18, 0x4f, 0xed, 0xba, 0x43, 0x14},\
+        {0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,\
+         0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d},\
+        {0x00, 0x70, 0xe0, 0x90, 0xc7, 0xb7, 0x27, 0x57,\
+         0x89, 0xf9, 0x69, 0x19, 0x4e, 0x3e, 0xae, 0xde} \
+};
+#endif
+
 
 /**
  * @brief Function to calculate the CRC-16 based on the pre calculated table
@@ -141,3 +248,390 @@ UInt8 calcCRC8(UInt8 *buffer, int len)
     }
     return crc;
 }
+
+#if defined(__AVX2__)
+/**
+ * @brief Function to check 8 records ending with a CRC-8, with AVX2
+ *
+ * Each lane looks its nibbles up on the tables of its byte of the
+ * record, then the 4 lanes of each record are XORed together.
+ *
+ * @param[in] buffer The records
+ * @param[out] pErased Bit i set when record i is all 0xFF
+ * @return Bit i set when the CRC-8 of record i is valid
+ */
+static UInt8 checkCRC8Block(const UInt8 *buffer, UInt8 *pErased)
+{
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i recs = _mm256_loadu_si256((const __m256i *)buffer);
+    __m256i lo = _mm256_and_si256(recs, lowMask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(recs, 4), lowMask);
+    __m256i syn = _mm256_setzero_si256();
+    __m256i tabLo, tabHi, crc;
+    int p;
+
+    for (p = 0; p < 4; ++p)
+    {
+        tabLo = _mm256_broadcastsi128_si256( \
+                    _mm_loadu_si128((const __m128i *)crc8Nibble[2 * p]));
+        tabHi = _mm256_broadcastsi128_si256( \
+                    _mm_loadu_si128((const __m128i *)crc8Nibble[2 * p + 1]));
+        crc = _mm256_xor_si256(_mm256_shuffle_epi8(tabLo, lo), \
+                               _mm256_shuffle_epi8(tabHi, hi));
+        syn = _mm256_xor_si256(syn, _mm256_and_si256(crc, \
+                  _mm256_set1_epi32((int)(0xFFU << (8 * p)))));
+    }
+    syn = _mm256_xor_si256(syn, _mm256_srli_epi32(syn, 16));
+    syn = _mm256_xor_si256(syn, _mm256_srli_epi32(syn, 8));
+    syn = _mm256_and_si256(syn, _mm256_set1_epi32(0xFF));
+
+    *pErased = _mm256_movemask_ps(_mm256_castsi256_ps( \
+                   _mm256_cmpeq_epi32(recs, _mm256_set1_epi8(-1))));
+    return _mm256_movemask_ps(_mm256_castsi256_ps( \
+               _mm256_cmpeq_epi32(syn, _mm256_setzero_si256())));
+}
+#elif defined(__SSSE3__)
+/**
+ * @brief Function to check 4 records ending with a CRC-8, with SSSE3
+ *
+ * Each lane looks its nibbles up on the tables of its byte of the
+ * record, then the 4 lanes of each record are XORed together.
+ *
+ * @param[in] buffer The records
+ * @param[out] pErased Bit i set when record i is all 0xFF
+ * @return Bit i set when the CRC-8 of record i is valid
+ */
+static UInt8 checkCRC8Quad(const UInt8 *buffer, UInt8 *pErased)
+{
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    __m128i recs = _mm_loadu_si128((const __m128i *)buffer);
+    __m128i lo = _mm_and_si128(recs, lowMask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(recs, 4), lowMask);
+    __m128i syn = _mm_setzero_si128();
+    __m128i crc;
+    int p;
+
+    for (p = 0; p < 4; ++p)
+    {
+        crc = _mm_xor_si128( \
+                  _mm_shuffle_epi8(_mm_loadu_si128( \
+                      (const __m128i *)crc8Nibble[2 * p]), lo), \
+                  _mm_shuffle_epi8(_mm_loadu_si128( \
+                      (const __m128i *)crc8Nibble[2 * p + 1]), hi));
+        syn = _mm_xor_si128(syn, _mm_and_si128(crc, \
+                  _mm_set1_epi32((int)(0xFFU << (8 * p)))));
+    }
+    syn = _mm_xor_si128(syn, _mm_srli_epi32(syn, 16));
+    syn = _mm_xor_si128(syn, _mm_srli_epi32(syn, 8));
+    syn = _mm_and_si128(syn, _mm_set1_epi32(0xFF));
+
+    *pErased = _mm_movemask_ps(_mm_castsi128_ps( \
+                   _mm_cmpeq_epi32(recs, _mm_set1_epi8(-1))));
+    return _mm_movemask_ps(_mm_castsi128_ps( \
+               _mm_cmpeq_epi32(syn, _mm_setzero_si128())));
+}
+
+/**
+ * @brief Function to check 8 records ending with a CRC-8, with SSSE3
+ *
+ * @param[in] buffer The records
+ * @param[out] pErased Bit i set when record i is all 0xFF
+ * @return Bit i set when the CRC-8 of record i is valid
+ */
+static UInt8 checkCRC8Block(const UInt8 *buffer, UInt8 *pErased)
+{
+    UInt8 erasedHi, valid;
+
+    valid = checkCRC8Quad(buffer, pErased);
+    valid |= checkCRC8Quad(buffer + 16, &erasedHi) << 4;
+    *pErased |= erasedHi << 4;
+    return valid;
+}
+#endif
+
+/**
+ * @brief Function to check a table of 4-byte records ending with a CRC-8
+ *
+ * This is @ref calcCRC8 over each record (such as an allocation
+ * register) for a whole table in a single pass, together with the check
+ * for erased records (all 0xFF). Since the CRC-8 is linear and a record
+ * has 4 bytes, its CRC is the XOR of one entry per nibble of the
+ * @ref crc8Nibble tables, looked up by shuffles over 8 records at a time
+ * when built with SSSE3 or AVX2 (e.g. -mssse3, -mavx2). Otherwise, and
+ * for the last records, each record is checked on its own.
+ *
+ * @param[in] buffer The records
+ * @param[in] count Number of records
+ * @param[out] pValid Bitmap, bit i set when the CRC-8 of record i is valid
+ * @param[out] pErased Bitmap, bit i set when record i is all 0xFF
+ *                     (NULL if not needed)
+ */
+void checkCRC8Records(const UInt8 *buffer,
+                      int count,
+                      UInt8 *pValid,
+                      UInt8 *pErased)
+{
+    const UInt8 allFF[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    int i = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    UInt8 erased;
+#endif
+
+    memset(pValid, 0, (count + 7) / 8);
+    if (pErased)
+        memset(pErased, 0, (count + 7) / 8);
+#if defined(__AVX2__) || defined(__SSSE3__)
+    for (; i + 8 <= count; i += 8)
+    {
+        pValid[i >> 3] = checkCRC8Block(buffer + 4 * i, &erased);
+        if (pErased)
+            pErased[i >> 3] = erased;
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        if (!calcCRC8((UInt8 *)buffer + 4 * i, 4))
+            pValid[i >> 3] |= 1 << (i & 7);
+        if (pErased && !memcmp(buffer + 4 * i, allFF, 4))
+            pErased[i >> 3] |= 1 << (i & 7);
+    }
+}
+
+/**
+ * @brief Function to correct a single flipped bit, using the CRC-16
+ *
+ * The buffer holds the data followed by its CRC-16 (as stored on the
+ * memory), so its CRC-16 is zero when intact. Since the CRC has no
+ * initial value nor final XOR, it is linear: the CRC-16 of a damaged
+ * buffer (the syndrome) is the CRC-16 of the error pattern alone. The
+ * syndrome of a single bit at the last byte is an entry of the table,
+ * and moving it one byte earlier is the same as feeding a zero byte, so
+ * the candidates are walked from the end in 8 x len steps. Up to 4095
+ * bytes every single bit gives a different syndrome. Two or more flipped
+ * bits may be taken for a single one, so the result is still a guess.
+ *
+ * @param[in,out] buffer The data and its CRC-16, corrected in place
+ * @param[in] len Length of the buffer, CRC included
+ * @return 0 if intact, 1 if a bit was corrected, 0xFF if not correctable
+ */
+UInt8 correctCRC16(UInt8 *buffer, int len)
+{
+    UInt16 syndrome = calcCRC16(buffer, len);
+    UInt16 err[8];
+    int i, b;
+
+    if (!syndrome)
+        return 0;
+    for (b = 0; b < 8; ++b)
+        err[b] = crc16Table[1 << b];
+    for (i = len - 1; i >= 0; --i)
+    {
+        for (b = 0; b < 8; ++b)
+        {
+            if (err[b] == syndrome)
+            {
+                buffer[i] ^= 1 << b;
+                return 1;
+            }
+            //One more zero byte after the flipped bit
+            err[b] = (err[b] >> 8) ^ crc16Table[err[b] & 0xff];
+        }
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to correct a single flipped bit, using the CRC-8
+ *
+ * Same as @ref correctCRC16, for a buffer ending with its CRC-8, such as
+ * an allocation register. Up to 15 bytes every single bit gives a
+ * different syndrome.
+ *
+ * @param[in,out] buffer The data and its CRC-8, corrected in place
+ * @param[in] len Length of the buffer, CRC included
+ * @return 0 if intact, 1 if a bit was corrected, 0xFF if not correctable
+ */
+UInt8 correctCRC8(UInt8 *buffer, int len)
+{
+    UInt8 syndrome = calcCRC8(buffer, len);
+    UInt8 err[8];
+    int i, b;
+
+    if (!syndrome)
+        return 0;
+    for (b = 0; b < 8; ++b)
+        err[b] = crc8Table[1 << b];
+    for (i = len - 1; i >= 0; --i)
+    {
+        for (b = 0; b < 8; ++b)
+        {
+            if (err[b] == syndrome)
+            {
+                buffer[i] ^= 1 << b;
+                return 1;
+            }
+            err[b] = crc8Table[err[b]];
+        }
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief Function to multiply two polynomials modulo the CRC-16 one
+ *
+ * Both operands are bit reflected, as the CRC-16 register. The first one
+ * must not be zero.
+ *
+ * @param[in] a First operand, not zero
+ * @param[in] b Second operand
+ * @return a * b modulo the CRC-16 polynomial
+ */
+static UInt16 mulModCRC16(UInt16 a, UInt16 b)
+{
+    UInt16 m = 0x8000;
+    UInt16 p = 0;
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if (!(a & (m - 1)))
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ 0xA001) : (b >> 1);
+    }
+    return p;
+}
+
+/**
+ * @brief Function to extend a CRC-16 with zero bytes
+ *
+ * Returns the CRC-16 of the buffer it was calculated over, followed by
+ * @e zeros bytes of value zero, without going through them: appending n
+ * zero bits multiplies the CRC by x^n, and x^(8 * zeros) is built from
+ * the pre calculated powers in a few steps. Together with the linearity
+ * of the CRC (no initial value nor final XOR), this updates the CRC of a
+ * value when only some of its bytes change: the new CRC is the old one
+ * XOR the CRC of the changes, extended by the bytes after them.
+ *
+ * @param[in] crc The CRC-16 of a buffer
+ * @param[in] zeros Number of zero bytes appended to it
+ * @return The CRC-16 of the extended buffer
+ */
+UInt16 shiftCRC16(UInt16 crc, int zeros)
+{
+    UInt16 op = 0x8000; //x^0
+    int k = 3;          //x^8 per byte
+
+    for (; zeros; zeros >>= 1, k++)
+    {
+        if (zeros & 1)
+            op = mulModCRC16(crc16X2n[k % 15], op);
+    }
+    return mulModCRC16(op, crc);
+}
+
+/**
+ * @brief Function to feed bytes to a CRC-32C register
+ *
+ * This is the bare CRC-32C update: no initial value nor final XOR are
+ * applied, so it is linear just like @ref calcCRC16. When built with
+ * SSE4.2 (e.g. -msse4.2) the crc32 instruction handles 8 bytes at a
+ * time; otherwise a table handles one byte at a time.
+ *
+ * @param[in] crc The CRC-32C register
+ * @param[in] buffer The bytes to be fed
+ * @param[in] len Length of the buffer
+ * @return The updated register
+ */
+UInt32 updateCRC32C(UInt32 crc, UInt8 *buffer, int len)
+{
+#if defined(__SSE4_2__)
+    unsigned long long crc64 = crc;
+    unsigned long long word;
+
+    for (; len >= 8; len -= 8, buffer += 8)
+    {
+        memcpy(&word, buffer, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (UInt32)crc64;
+    for (; len; --len)
+        crc = _mm_crc32_u8(crc, *buffer++);
+#else
+    for (; len; --len)
+        crc = (crc >> 8) ^ crc32cTable[(crc ^ *buffer++) & 0xff];
+#endif
+    return crc;
+}
+
+/**
+ * @brief Function to calculate the CRC-32C of a buffer
+ *
+ * The standard CRC-32C (Castagnoli), as used by iSCSI and ext4: the
+ * register starts with all ones and the result is inverted.
+ *
+ * @param[in] buffer containing the bytes where the calculation should
+ *            be performed at
+ * @param[in] len Length of the buffer
+ * @return The calculated CRC-32C
+ */
+UInt32 calcCRC32C(UInt8 *buffer, int len)
+{
+    return ~updateCRC32C(0xFFFFFFFFUL, buffer, len);
+}
+
+/**
+ * @brief Function to multiply two polynomials modulo the CRC-32C one
+ *
+ * Same as @ref mulModCRC16, for the CRC-32C.
+ *
+ * @param[in] a First operand, not zero
+ * @param[in] b Second operand
+ * @return a * b modulo the CRC-32C polynomial
+ */
+static UInt32 mulModCRC32C(UInt32 a, UInt32 b)
+{
+    UInt32 m = 0x80000000UL;
+    UInt32 p = 0;
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if (!(a & (m - 1)))
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ 0x82F63B78UL) : (b >> 1);
+    }
+    return p;
+}
+
+/**
+ * @brief Function to extend a bare CRC-32C with zero bytes
+ *
+ * Same as @ref shiftCRC16, for a register given by @ref updateCRC32C
+ * from zero. Since the initial value and the final XOR of
+ * @ref calcCRC32C only depend on the length, two values of the same
+ * length still differ by the bare CRC of their difference.
+ *
+ * @param[in] crc The bare CRC-32C of a buffer
+ * @param[in] zeros Number of zero bytes appended to it, up to 8191
+ * @return The bare CRC-32C of the extended buffer
+ */
+UInt32 shiftCRC32C(UInt32 crc, int zeros)
+{
+    UInt32 op = 0x80000000UL; //x^0
+    int k = 3;                //x^8 per byte
+
+    for (; zeros; zeros >>= 1, k++)
+    {
+        if (zeros & 1)
+            op = mulModCRC32C(crc32cX2n[k & 15], op);
+    }
+    return mulModCRC32C(op, crc);
+}
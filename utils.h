@@ -11,6 +11,9 @@
  */
 
 
+#if !defined(__UTILS_H__)
+#define __UTILS_H__
+
 /**********************************
  * Generic use types
  **********************************
@@ -20,6 +23,8 @@ typedef signed char Int8;
 typedef unsigned short int UInt16;
 typedef signed int Int32;
 typedef unsigned int UInt32;
+typedef signed long long Int64;
+typedef unsigned long long UInt64;
 
 /**********************************
  * Prototype of exported functions
@@ -27,3 +32,13 @@ typedef unsigned int UInt32;
  */
 UInt16 calcCRC16(UInt8 *buffer, int len);
 UInt8 calcCRC8(UInt8 *buffer, int len);
+UInt8 correctCRC16(UInt8 *buffer, int len);
+UInt8 correctCRC8(UInt8 *buffer, int len);
+void checkCRC8Records(const UInt8 *buffer, int count, UInt8 *pValid,
+                      UInt8 *pErased);
+UInt16 shiftCRC16(UInt16 crc, int zeros);
+UInt32 updateCRC32C(UInt32 crc, UInt8 *buffer, int len);
+UInt32 calcCRC32C(UInt8 *buffer, int len);
+UInt32 shiftCRC32C(UInt32 crc, int zeros);
+
+#endif